@@ -107,6 +107,50 @@ bool maxavro_read_integer_from_file(MAXAVRO_FILE* file, uint64_t* dest)
     return true;
 }
 
+/**
+ * @brief Read an Avro integer from the memory mapping of the file
+ *
+ * The mapping is extended if the value continues past the end of it.
+ *
+ * @param file The file to read from
+ * @param pos  File offset of the value, moved past the value if it was read
+ * @param dest Destination where the read value is written
+ * @return True if value was read successfully, false if the file ends before
+ * the value does or an error occurred
+ */
+bool maxavro_read_integer_from_map(MAXAVRO_FILE* file, uint64_t* pos, uint64_t* dest)
+{
+    uint64_t rval = 0;
+    uint64_t offset = *pos;
+    uint8_t nread = 0;
+    uint8_t byte;
+    do
+    {
+        if (nread >= MAX_INTEGER_SIZE)
+        {
+            file->last_error = MAXAVRO_ERR_VALUE_OVERFLOW;
+            return false;
+        }
+
+        if (!maxavro_map_file(file, offset + 1))
+        {
+            return false;
+        }
+
+        byte = file->map[offset++];
+        rval |= (uint64_t)(byte & 0x7f) << (nread++ * 7);
+    }
+    while (more_bytes(byte));
+
+    *pos = offset;
+
+    if (dest)
+    {
+        *dest = avro_decode(rval);
+    }
+    return true;
+}
+
 /**
  * @brief Calculate the length of an Avro integer
  *
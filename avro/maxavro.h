@@ -51,17 +51,22 @@ typedef struct
     enum maxavro_value_type type;
 } MAXAVRO_SCHEMA_FIELD;
 
+/** Compiled JSON serialization layout of a schema */
+typedef struct maxavro_json_layout MAXAVRO_JSON_LAYOUT;
+
 typedef struct
 {
     MAXAVRO_SCHEMA_FIELD* fields;
     size_t                num_fields;
+    MAXAVRO_JSON_LAYOUT*  json_layout;  /*< Compiled on first use */
 } MAXAVRO_SCHEMA;
 
 enum maxavro_codec
 {
     MAXAVRO_CODEC_NULL,
     MAXAVRO_CODEC_DEFLATE,
-    MAXAVRO_CODEC_SNAPPY,   /**< Not yet implemented */
+    MAXAVRO_CODEC_SNAPPY,   /**< Requires the snappy library */
+    MAXAVRO_CODEC_ZSTD,     /**< Requires the Zstandard library */
 };
 
 enum maxavro_error
@@ -88,10 +93,14 @@ typedef struct
     uint8_t*           buffer;      /**< The uncompressed data */
     uint8_t*           buffer_end;  /**< The byte after the end of the buffer*/
     uint8_t*           buffer_ptr;  /**< Pointer to @c buffer which is moved as records are read */
-    /** The position @c ftell returns before the first record is read  */
+    bool               buffer_mapped;/**< Whether @c buffer points into @c map */
+    uint8_t*           map;         /**< Read-only mapping of the file */
+    uint64_t           map_size;    /**< Size of the mapping */
+    /** The file offset of the first data block */
     long header_end_pos;
     long data_start_pos;
     long block_start_pos;
+    long next_block_pos;            /*< The file offset where the next data block starts */
     bool metadata_read;             /*< If datablock metadata has been read. This is kept
                                      * in memory if EOF is reached but an attempt to read
                                      * is made later when new data is available. We need
@@ -127,6 +136,14 @@ typedef struct
     MAXAVRO_FILE* avrofile;     /*< The current open file */
 } MAXAVRO_DATABLOCK;
 
+/** A reusable output buffer for JSON text */
+typedef struct
+{
+    char*  data;
+    size_t length;  /*< Length of the text */
+    size_t size;    /*< Size of the allocated memory */
+} MAXAVRO_TEXT;
+
 typedef struct avro_map_value
 {
     char*                  key;
@@ -143,6 +160,11 @@ void          maxavro_file_close(MAXAVRO_FILE* file);
 /** Reading records */
 json_t* maxavro_record_read_json(MAXAVRO_FILE* file);
 GWBUF*  maxavro_record_read_binary(MAXAVRO_FILE* file);
+bool    maxavro_record_read_json_text(MAXAVRO_FILE* file, MAXAVRO_TEXT* text, uint64_t* integers);
+
+/** JSON text buffers */
+bool maxavro_text_append(MAXAVRO_TEXT* text, const char* data, size_t len);
+void maxavro_text_free(MAXAVRO_TEXT* text);
 
 /** Navigation of the file */
 bool maxavro_record_seek(MAXAVRO_FILE* file, uint64_t offset);
@@ -152,6 +174,10 @@ bool maxavro_next_block(MAXAVRO_FILE* file);
 /** Get binary format header */
 GWBUF* maxavro_file_binary_header(MAXAVRO_FILE* file);
 
+/** Compression codecs */
+const char* maxavro_codec_to_string(enum maxavro_codec codec);
+bool        maxavro_codec_supported(enum maxavro_codec codec);
+
 /** File error functions */
 enum maxavro_error maxavro_get_error(MAXAVRO_FILE* file);
 const char*        maxavro_get_error_string(MAXAVRO_FILE* file);
@@ -14,10 +14,20 @@
 #include "maxavro_internal.h"
 #include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <maxbase/assert.h>
 #include <maxscale/log.h>
 #include <zlib.h>
 
+#ifdef HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 static bool maxavro_read_sync(FILE* file, uint8_t* sync)
 {
     bool rval = true;
@@ -45,153 +55,344 @@ static bool maxavro_read_sync(FILE* file, uint8_t* sync)
     return rval;
 }
 
+/**
+ * @brief Make sure the file is mapped up to an offset
+ *
+ * The files are appended to while they are being read which means the mapping
+ * is recreated when data past the end of the current mapping is needed. The
+ * caller must not hold pointers into the old mapping.
+ *
+ * @param file File to map
+ * @param end  Offset up to which the file needs to be mapped
+ * @return True if the file is mapped up to @c end, false if the file is not
+ * that large or an error occurred
+ */
+bool maxavro_map_file(MAXAVRO_FILE* file, uint64_t end)
+{
+    if (end <= file->map_size)
+    {
+        return true;
+    }
+
+    struct stat st;
+
+    if (fstat(fileno(file->file), &st) == -1)
+    {
+        MXS_ERROR("Failed to stat file '%s': %d, %s", file->filename, errno, mxs_strerror(errno));
+        file->last_error = MAXAVRO_ERR_IO;
+        return false;
+    }
+
+    if ((uint64_t)st.st_size < end)
+    {
+        // The data has not been written yet
+        return false;
+    }
+
+    uint8_t* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(file->file), 0);
+
+    if (map == MAP_FAILED)
+    {
+        MXS_ERROR("Failed to map file '%s': %d, %s", file->filename, errno, mxs_strerror(errno));
+        file->last_error = MAXAVRO_ERR_IO;
+        return false;
+    }
+
+    if (file->map)
+    {
+        munmap(file->map, file->map_size);
+    }
+
+    file->map = map;
+    file->map_size = st.st_size;
+    return true;
+}
+
+/**
+ * @brief Release the current data block
+ *
+ * @param file File whose block is released
+ */
+static void release_block(MAXAVRO_FILE* file)
+{
+    if (!file->buffer_mapped)
+    {
+        MXS_FREE(file->buffer);
+    }
+
+    file->buffer = NULL;
+    file->buffer_ptr = NULL;
+    file->buffer_end = NULL;
+    file->buffer_mapped = false;
+    file->records_in_block = 0;
+    file->records_read_from_block = 0;
+}
+
 bool maxavro_verify_block(MAXAVRO_FILE* file)
 {
-    char sync[SYNC_MARKER_SIZE];
-    int rc = fread(sync, 1, SYNC_MARKER_SIZE, file->file);
-    if (rc != SYNC_MARKER_SIZE)
+    mxb_assert(file->next_block_pos >= SYNC_MARKER_SIZE
+               && (uint64_t)file->next_block_pos <= file->map_size);
+
+    if (memcmp(file->sync, file->map + file->next_block_pos - SYNC_MARKER_SIZE, SYNC_MARKER_SIZE))
+    {
+        MXS_ERROR("Sync marker mismatch at file offset %ld in '%s'.",
+                  file->next_block_pos - SYNC_MARKER_SIZE,
+                  file->filename);
+        return false;
+    }
+
+    /** Increment block count */
+    file->blocks_read++;
+    file->bytes_read += file->buffer_size;
+    return true;
+}
+
+#ifdef HAVE_SNAPPY
+/**
+ * @brief Uncompress a snappy data block
+ *
+ * Each block is compressed separately and is followed by the big-endian
+ * CRC32 checksum of the uncompressed data.
+ *
+ * @param file File the block was read from
+ * @param data Compressed data
+ * @param size Size of the compressed data, including the checksum
+ * @return The uncompressed data or NULL on error
+ */
+static uint8_t* snappy_uncompress_block(MAXAVRO_FILE* file, const uint8_t* data, long size)
+{
+    uint8_t* buffer = NULL;
+    size_t len = 0;
+
+    if (size < 4 || snappy_uncompressed_length((char*)data, size - 4, &len) != SNAPPY_OK)
+    {
+        MXS_ERROR("Corrupted snappy data block in '%s'.", file->filename);
+    }
+    else if ((buffer = MXS_MALLOC(len ? len : 1)))
     {
-        if (ferror(file->file))
+        const uint8_t* crc = data + size - 4;
+        uint32_t expected = (crc[0] << 24) | (crc[1] << 16) | (crc[2] << 8) | crc[3];
+
+        if (snappy_uncompress((char*)data, size - 4, (char*)buffer, &len) != SNAPPY_OK)
         {
-            MXS_ERROR("Failed to read file: %d %s", errno, mxs_strerror(errno));
+            MXS_ERROR("Failed to uncompress snappy data block in '%s'.", file->filename);
+            MXS_FREE(buffer);
+            buffer = NULL;
         }
-        else if (rc > 0 || !feof(file->file))
+        else if (crc32(0, buffer, len) != expected)
         {
-            MXS_ERROR("Short read when reading sync marker. Read %d bytes instead of %d",
-                      rc,
-                      SYNC_MARKER_SIZE);
+            MXS_ERROR("Checksum mismatch in snappy data block in '%s'.", file->filename);
+            MXS_FREE(buffer);
+            buffer = NULL;
         }
-        return false;
+        else
+        {
+            file->buffer_size = len;
+        }
+    }
+
+    return buffer;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * @brief Uncompress a Zstandard data block
+ *
+ * The frame content size is not always stored in the frame so the output
+ * buffer is grown until the whole block fits into it.
+ *
+ * @param file File the block was read from
+ * @param data Compressed data
+ * @param size Size of the compressed data
+ * @return The uncompressed data or NULL on error
+ */
+static uint8_t* zstd_uncompress_block(MAXAVRO_FILE* file, const uint8_t* data, long size)
+{
+    ZSTD_DStream* stream = ZSTD_createDStream();
+    unsigned long long content_size = ZSTD_getFrameContentSize(data, size);
+    size_t buffer_size = size * 4;
+
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size != ZSTD_CONTENTSIZE_ERROR)
+    {
+        buffer_size = content_size;
     }
 
-    if (memcmp(file->sync, sync, SYNC_MARKER_SIZE))
+    uint8_t* buffer = MXS_MALLOC(buffer_size ? buffer_size : 1);
+    ZSTD_inBuffer in = {data, (size_t)size, 0};
+    ZSTD_outBuffer out = {buffer, buffer_size, 0};
+    size_t rc = 1;
+    bool ok = stream && buffer && !ZSTD_isError(ZSTD_initDStream(stream));
+
+    while (ok && (rc != 0 || in.pos < in.size))
     {
-        long pos = ftell(file->file);
-        long expected = file->data_start_pos + file->buffer_size + SYNC_MARKER_SIZE;
-        if (pos != expected)
+        if (out.pos == out.size)
         {
-            MXS_ERROR("Sync marker mismatch due to wrong file offset. file is at %ld "
-                      "when it should be at %ld.",
-                      pos,
-                      expected);
+            size_t increment = out.size ? out.size : 1024;
+            uint8_t* temp = MXS_REALLOC(buffer, out.size + increment);
+
+            if (!temp)
+            {
+                ok = false;
+                break;
+            }
+
+            buffer = temp;
+            out.dst = buffer;
+            out.size += increment;
         }
-        else
+
+        size_t in_pos = in.pos;
+        size_t out_pos = out.pos;
+        rc = ZSTD_decompressStream(stream, &out, &in);
+
+        if (ZSTD_isError(rc))
         {
-            MXS_ERROR("Sync marker mismatch.");
+            MXS_ERROR("Failed to uncompress Zstandard data block in '%s': %s",
+                      file->filename,
+                      ZSTD_getErrorName(rc));
+            ok = false;
+        }
+        else if (in.pos == in_pos && out.pos == out_pos)
+        {
+            MXS_ERROR("Truncated Zstandard data block in '%s'.", file->filename);
+            ok = false;
         }
-        return false;
     }
 
-    /** Increment block count */
-    file->blocks_read++;
-    file->bytes_read += file->buffer_size;
-    return true;
+    if (ok)
+    {
+        file->buffer_size = out.pos;
+    }
+    else
+    {
+        MXS_FREE(buffer);
+        buffer = NULL;
+    }
+
+    ZSTD_freeDStream(stream);
+    return buffer;
 }
+#endif
 
-static uint8_t* read_block_data(MAXAVRO_FILE* file, long deflate_size)
+/**
+ * @brief Uncompress a data block
+ *
+ * Uncompressed blocks are not copied, the buffer points to the mapped file.
+ *
+ * @param file         File the block is read from
+ * @param data         The block data in the mapped file
+ * @param deflate_size Size of the block in the file
+ * @return The uncompressed data or NULL on error
+ */
+static uint8_t* read_block_data(MAXAVRO_FILE* file, const uint8_t* data, long deflate_size)
 {
-    uint8_t* temp_buffer = MXS_MALLOC(deflate_size);
     uint8_t* buffer = NULL;
+    unsigned long inflate_size = 0;
 
-    if (temp_buffer && fread(temp_buffer, 1, deflate_size, file->file) == deflate_size)
+    switch (file->codec)
     {
-        unsigned long inflate_size = 0;
+    case MAXAVRO_CODEC_NULL:
+        file->buffer_size = deflate_size;
+        file->buffer_mapped = true;
+        buffer = (uint8_t*)data;
+        break;
 
-        switch (file->codec)
-        {
-        case MAXAVRO_CODEC_NULL:
-            file->buffer_size = deflate_size;
-            buffer = temp_buffer;
-            temp_buffer = NULL;
-            break;
+    case MAXAVRO_CODEC_DEFLATE:
+        inflate_size = deflate_size * 2;
 
-        case MAXAVRO_CODEC_DEFLATE:
-            inflate_size = deflate_size * 2;
-
-            if ((buffer = MXS_MALLOC(inflate_size)))
+        if ((buffer = MXS_MALLOC(inflate_size)))
+        {
+            z_stream stream;
+            stream.avail_in = deflate_size;
+            stream.next_in = (Bytef*)data;
+            stream.avail_out = inflate_size;
+            stream.next_out = buffer;
+            stream.zalloc = 0;
+            stream.zfree = 0;
+            inflateInit2(&stream, -15);
+
+            int rc;
+
+            while ((rc = inflate(&stream, Z_FINISH)) == Z_BUF_ERROR)
             {
-                z_stream stream;
-                stream.avail_in = deflate_size;
-                stream.next_in = temp_buffer;
-                stream.avail_out = inflate_size;
-                stream.next_out = buffer;
-                stream.zalloc = 0;
-                stream.zfree = 0;
-                inflateInit2(&stream, -15);
-
-                int rc;
-
-                while ((rc = inflate(&stream, Z_FINISH)) == Z_BUF_ERROR)
-                {
-                    int increment = inflate_size;
-                    uint8_t* temp = MXS_REALLOC(buffer, inflate_size + increment);
-
-                    if (temp)
-                    {
-                        buffer = temp;
-                        stream.avail_out += increment;
-                        stream.next_out = buffer + stream.total_out;
-                        inflate_size += increment;
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
+                int increment = inflate_size;
+                uint8_t* temp = MXS_REALLOC(buffer, inflate_size + increment);
 
-                if (rc == Z_STREAM_END)
+                if (temp)
                 {
-                    file->buffer_size = stream.total_out;
+                    buffer = temp;
+                    stream.avail_out += increment;
+                    stream.next_out = buffer + stream.total_out;
+                    inflate_size += increment;
                 }
                 else
                 {
-                    MXS_ERROR("Failed to inflate value: %s", zError(rc));
-                    MXS_FREE(buffer);
-                    buffer = NULL;
+                    break;
                 }
-
-                inflateEnd(&stream);
             }
-            break;
 
-        case MAXAVRO_CODEC_SNAPPY:
-            // TODO: implement snappy compression
-            break;
+            if (rc == Z_STREAM_END)
+            {
+                file->buffer_size = stream.total_out;
+            }
+            else
+            {
+                MXS_ERROR("Failed to inflate value: %s", zError(rc));
+                MXS_FREE(buffer);
+                buffer = NULL;
+            }
 
-        default:
-            break;
+            inflateEnd(&stream);
         }
+        break;
+
+#ifdef HAVE_SNAPPY
+    case MAXAVRO_CODEC_SNAPPY:
+        buffer = snappy_uncompress_block(file, data, deflate_size);
+        break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case MAXAVRO_CODEC_ZSTD:
+        buffer = zstd_uncompress_block(file, data, deflate_size);
+        break;
+#endif
 
-        MXS_FREE(temp_buffer);
+    default:
+        break;
     }
 
     return buffer;
 }
 
+/**
+ * @brief Read the data block that starts at the current read position
+ *
+ * If the block is not yet completely written, the read position is not moved
+ * and the block can be read again once more data has been written.
+ *
+ * @param file File to read from
+ * @return True if the block was read
+ */
 bool maxavro_read_datablock_start(MAXAVRO_FILE* file)
 {
-    /** The actual start of the binary block */
-    file->block_start_pos = ftell(file->file);
-    file->metadata_read = false;
+    uint64_t pos = file->next_block_pos;
     uint64_t records, bytes;
-    bool rval = maxavro_read_integer_from_file(file, &records)
-        && maxavro_read_integer_from_file(file, &bytes);
+    file->metadata_read = false;
+    release_block(file);
+
+    bool rval = maxavro_read_integer_from_map(file, &pos, &records)
+        && maxavro_read_integer_from_map(file, &pos, &bytes);
 
     if (rval)
     {
         rval = false;
-        long pos = ftell(file->file);
+        uint64_t end = pos + bytes + SYNC_MARKER_SIZE;
 
-        if (pos == -1)
+        if (end > pos && maxavro_map_file(file, end))
         {
-            MXS_ERROR("Failed to read datablock start: %d, %s",
-                      errno,
-                      mxs_strerror(errno));
-        }
-        else
-        {
-            MXS_FREE(file->buffer);
-            file->buffer = read_block_data(file, bytes);
+            file->buffer = read_block_data(file, file->map + pos, bytes);
 
             if (file->buffer)
             {
@@ -199,7 +400,9 @@ bool maxavro_read_datablock_start(MAXAVRO_FILE* file)
                 file->buffer_ptr = file->buffer;
                 file->records_in_block = records;
                 file->records_read_from_block = 0;
+                file->block_start_pos = file->next_block_pos;
                 file->data_start_pos = pos;
+                file->next_block_pos = end;
                 mxb_assert(file->data_start_pos > file->block_start_pos);
                 file->metadata_read = true;
                 rval = maxavro_verify_block(file);
@@ -210,10 +413,7 @@ bool maxavro_read_datablock_start(MAXAVRO_FILE* file)
     {
         MXS_ERROR("Failed to read data block start.");
     }
-    else if (feof(file->file))
-    {
-        clearerr(file->file);
-    }
+
     return rval;
 }
 
@@ -224,6 +424,7 @@ bool maxavro_read_datablock_start(MAXAVRO_FILE* file)
 static char* read_schema(MAXAVRO_FILE* file)
 {
     char* rval = NULL;
+    bool codec_ok = true;
     MAXAVRO_MAP* head = maxavro_read_map_from_file(file);
     MAXAVRO_MAP* map = head;
 
@@ -247,9 +448,14 @@ static char* read_schema(MAXAVRO_FILE* file)
             {
                 file->codec = MAXAVRO_CODEC_SNAPPY;
             }
+            else if (strcmp(map->value, "zstandard") == 0)
+            {
+                file->codec = MAXAVRO_CODEC_ZSTD;
+            }
             else
             {
                 MXS_ERROR("Unknown Avro codec: %s", map->value);
+                codec_ok = false;
             }
         }
         map = map->next;
@@ -259,11 +465,83 @@ static char* read_schema(MAXAVRO_FILE* file)
     {
         MXS_ERROR("No schema found from Avro header.");
     }
+    else if (codec_ok && !maxavro_codec_supported(file->codec))
+    {
+        MXS_ERROR("Avro file '%s' uses the '%s' codec which is not supported by this build.",
+                  file->filename,
+                  maxavro_codec_to_string(file->codec));
+        codec_ok = false;
+    }
+
+    if (!codec_ok)
+    {
+        MXS_FREE(rval);
+        rval = NULL;
+    }
 
     maxavro_map_free(head);
     return rval;
 }
 
+/**
+ * @brief Get the name of a codec
+ *
+ * @param codec Codec to convert
+ * @return The name of the codec as stored in the file header
+ */
+const char* maxavro_codec_to_string(enum maxavro_codec codec)
+{
+    switch (codec)
+    {
+    case MAXAVRO_CODEC_NULL:
+        return "null";
+
+    case MAXAVRO_CODEC_DEFLATE:
+        return "deflate";
+
+    case MAXAVRO_CODEC_SNAPPY:
+        return "snappy";
+
+    case MAXAVRO_CODEC_ZSTD:
+        return "zstandard";
+
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * @brief Check if a codec can be read
+ *
+ * The null and deflate codecs are always supported, snappy and Zstandard
+ * depend on whether the libraries were available at build time.
+ *
+ * @param codec Codec to check
+ * @return True if files using the codec can be read
+ */
+bool maxavro_codec_supported(enum maxavro_codec codec)
+{
+    switch (codec)
+    {
+    case MAXAVRO_CODEC_NULL:
+    case MAXAVRO_CODEC_DEFLATE:
+        return true;
+
+#ifdef HAVE_SNAPPY
+    case MAXAVRO_CODEC_SNAPPY:
+        return true;
+#endif
+
+#ifdef HAVE_ZSTD
+    case MAXAVRO_CODEC_ZSTD:
+        return true;
+#endif
+
+    default:
+        return false;
+    }
+}
+
 /**
  * @brief Open an avro file
  *
@@ -317,11 +595,17 @@ MAXAVRO_FILE* maxavro_file_open(const char* filename)
 
             if (avrofile->schema
                 && maxavro_read_sync(file, avrofile->sync)
-                && maxavro_read_datablock_start(avrofile))
+                && (avrofile->header_end_pos = ftell(file)) != -1)
             {
-                avrofile->header_end_pos = avrofile->block_start_pos;
+                // The data blocks are read from a memory mapping of the file
+                avrofile->next_block_pos = avrofile->header_end_pos;
             }
             else
+            {
+                avrofile->header_end_pos = 0;
+            }
+
+            if (avrofile->header_end_pos == 0 || !maxavro_read_datablock_start(avrofile))
             {
                 maxavro_schema_free(avrofile->schema);
                 error = true;
@@ -341,6 +625,17 @@ MAXAVRO_FILE* maxavro_file_open(const char* filename)
     if (error)
     {
         fclose(file);
+
+        if (avrofile)
+        {
+            release_block(avrofile);
+
+            if (avrofile->map)
+            {
+                munmap(avrofile->map, avrofile->map_size);
+            }
+        }
+
         MXS_FREE(avrofile);
         MXS_FREE(my_filename);
         avrofile = NULL;
@@ -393,8 +688,14 @@ void maxavro_file_close(MAXAVRO_FILE* file)
 {
     if (file)
     {
+        release_block(file);
+
+        if (file->map)
+        {
+            munmap(file->map, file->map_size);
+        }
+
         fclose(file->file);
-        MXS_FREE(file->buffer);
         MXS_FREE(file->filename);
         maxavro_schema_free(file->schema);
         MXS_FREE(file);
@@ -415,40 +716,12 @@ GWBUF* maxavro_file_binary_header(MAXAVRO_FILE* file)
     long pos = file->header_end_pos;
     GWBUF* rval = NULL;
 
-    if (fseek(file->file, 0, SEEK_SET) == 0)
-    {
-        if ((rval = gwbuf_alloc(pos)))
-        {
-            if (fread(GWBUF_DATA(rval), 1, pos, file->file) != pos)
-            {
-                if (ferror(file->file))
-                {
-                    MXS_ERROR("Failed to read binary header: %d, %s",
-                              errno,
-                              mxs_strerror(errno));
-                }
-                else if (feof(file->file))
-                {
-                    MXS_ERROR("Short read when reading binary header.");
-                }
-                else
-                {
-                    MXS_ERROR("Unspecified error when reading binary header.");
-                }
-                gwbuf_free(rval);
-                rval = NULL;
-            }
-        }
-        else
-        {
-            MXS_ERROR("Memory allocation failed when allocating %ld bytes.", pos);
-        }
-    }
-    else
+    // The header is always mapped as the first data block is read when the file is opened
+    mxb_assert((uint64_t)pos <= file->map_size);
+
+    if (!(rval = gwbuf_alloc_and_load(pos, file->map)))
     {
-        MXS_ERROR("Failed to read binary header: %d, %s",
-                  errno,
-                  mxs_strerror(errno));
+        MXS_ERROR("Memory allocation failed when allocating %ld bytes.", pos);
     }
 
     return rval;
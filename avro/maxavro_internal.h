@@ -30,6 +30,10 @@ bool  maxavro_read_double(MAXAVRO_FILE* file, double* dest);
 /** Only used when opening the file */
 bool maxavro_read_integer_from_file(MAXAVRO_FILE* file, uint64_t* val);
 
+/** Reading from the memory mapping of the file */
+bool maxavro_map_file(MAXAVRO_FILE* file, uint64_t end);
+bool maxavro_read_integer_from_map(MAXAVRO_FILE* file, uint64_t* pos, uint64_t* val);
+
 /** Reading complex types */
 MAXAVRO_MAP* maxavro_read_map_from_file(MAXAVRO_FILE* file);
 void         maxavro_map_free(MAXAVRO_MAP* value);
@@ -41,6 +45,7 @@ void         maxavro_map_free(MAXAVRO_MAP* value);
 /** Schema creation */
 MAXAVRO_SCHEMA* maxavro_schema_alloc(const char* json);
 void            maxavro_schema_free(MAXAVRO_SCHEMA* schema);
+void            maxavro_json_layout_free(MAXAVRO_JSON_LAYOUT* layout);
 
 /** Data block generation */
 MAXAVRO_DATABLOCK* maxavro_datablock_allocate(MAXAVRO_FILE* file, size_t buffersize);
@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file maxavro_json.c - Direct conversion of Avro records into JSON text
+ *
+ * The schema of a file is compiled into a field layout the first time a record
+ * is serialized. The layout holds the pre-rendered object keys, the resolved
+ * union branches and the quoted enum symbols which means that the records can
+ * be decoded straight into the output buffer without building a JSON tree.
+ *
+ * The output is identical to what json_dumps() with JSON_PRESERVE_ORDER
+ * produces for the value returned by maxavro_record_read_json().
+ */
+
+#include <maxscale/cdefs.h>
+#include "maxavro_internal.h"
+#include <string.h>
+#include <math.h>
+#include <maxbase/assert.h>
+#include <maxscale/log.h>
+
+/** A compiled value type */
+typedef struct
+{
+    enum maxavro_value_type type;
+    char**                  symbols;        /*< Quoted enum symbols */
+    size_t*                 symbol_lens;    /*< Lengths of the quoted symbols */
+    size_t                  num_symbols;
+} MAXAVRO_JSON_TYPE;
+
+/** A compiled record field */
+typedef struct
+{
+    char*              key;         /*< The quoted key with the separators */
+    size_t             key_len;
+    MAXAVRO_JSON_TYPE  value;       /*< Type of a non-union field */
+    MAXAVRO_JSON_TYPE* branches;    /*< Branches of a union field */
+    size_t             num_branches;
+} MAXAVRO_JSON_FIELD;
+
+struct maxavro_json_layout
+{
+    MAXAVRO_JSON_FIELD* fields;
+    size_t              num_fields;
+};
+
+static const char hexdigits[] = "0123456789ABCDEF";
+
+static bool text_reserve(MAXAVRO_TEXT* text, size_t len)
+{
+    if (text->length + len > text->size)
+    {
+        size_t size = text->size ? text->size : 1024;
+
+        while (size < text->length + len)
+        {
+            size *= 2;
+        }
+
+        char* data = MXS_REALLOC(text->data, size);
+
+        if (data == NULL)
+        {
+            return false;
+        }
+
+        text->data = data;
+        text->size = size;
+    }
+
+    return true;
+}
+
+bool maxavro_text_append(MAXAVRO_TEXT* text, const char* data, size_t len)
+{
+    if (!text_reserve(text, len))
+    {
+        return false;
+    }
+
+    memcpy(text->data + text->length, data, len);
+    text->length += len;
+    return true;
+}
+
+void maxavro_text_free(MAXAVRO_TEXT* text)
+{
+    MXS_FREE(text->data);
+    text->data = NULL;
+    text->length = 0;
+    text->size = 0;
+}
+
+/**
+ * Length of a valid UTF-8 sequence
+ *
+ * @param ptr Start of the sequence
+ * @param end End of the string
+ * @return Length of the sequence or 0 if it is not valid UTF-8
+ */
+static size_t utf8_sequence_len(const uint8_t* ptr, const uint8_t* end)
+{
+    uint8_t c = *ptr;
+    size_t len;
+    uint32_t cp;
+
+    if (c < 0x80)
+    {
+        return 1;
+    }
+    else if (c >= 0xc2 && c <= 0xdf)
+    {
+        len = 2;
+        cp = c & 0x1f;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        len = 3;
+        cp = c & 0x0f;
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        len = 4;
+        cp = c & 0x07;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (end - ptr < (long)len)
+    {
+        return 0;
+    }
+
+    for (size_t i = 1; i < len; i++)
+    {
+        if ((ptr[i] & 0xc0) != 0x80)
+        {
+            return 0;
+        }
+        cp = (cp << 6) | (ptr[i] & 0x3f);
+    }
+
+    // Reject overlong encodings, surrogates and values above U+10FFFF
+    if ((len == 3 && cp < 0x800) || (len == 4 && (cp < 0x10000 || cp > 0x10ffff))
+        || (cp >= 0xd800 && cp <= 0xdfff))
+    {
+        return 0;
+    }
+
+    return len;
+}
+
+/**
+ * Append a quoted and escaped JSON string
+ *
+ * Bytes that are not valid UTF-8 are escaped as if they were Latin-1 characters.
+ */
+static bool text_append_string(MAXAVRO_TEXT* text, const char* str, size_t len)
+{
+    // Worst case is six bytes per input byte plus the quotes
+    if (!text_reserve(text, len * 6 + 2))
+    {
+        return false;
+    }
+
+    const uint8_t* ptr = (const uint8_t*)str;
+    const uint8_t* end = ptr + len;
+    char* out = text->data + text->length;
+    *out++ = '"';
+
+    while (ptr < end)
+    {
+        uint8_t c = *ptr;
+        size_t seqlen = utf8_sequence_len(ptr, end);
+
+        if (seqlen > 1)
+        {
+            memcpy(out, ptr, seqlen);
+            out += seqlen;
+            ptr += seqlen;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '"':
+        case '\\':
+            *out++ = '\\';
+            *out++ = c;
+            break;
+
+        case '\b':
+            *out++ = '\\';
+            *out++ = 'b';
+            break;
+
+        case '\f':
+            *out++ = '\\';
+            *out++ = 'f';
+            break;
+
+        case '\n':
+            *out++ = '\\';
+            *out++ = 'n';
+            break;
+
+        case '\r':
+            *out++ = '\\';
+            *out++ = 'r';
+            break;
+
+        case '\t':
+            *out++ = '\\';
+            *out++ = 't';
+            break;
+
+        default:
+            if (c < 0x20 || seqlen == 0)
+            {
+                *out++ = '\\';
+                *out++ = 'u';
+                *out++ = '0';
+                *out++ = '0';
+                *out++ = hexdigits[c >> 4];
+                *out++ = hexdigits[c & 0xf];
+            }
+            else
+            {
+                *out++ = c;
+            }
+            break;
+        }
+
+        ptr++;
+    }
+
+    *out++ = '"';
+    text->length = out - text->data;
+    return true;
+}
+
+static bool text_append_integer(MAXAVRO_TEXT* text, int64_t value)
+{
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* ptr = end;
+    uint64_t u = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+    do
+    {
+        *--ptr = '0' + u % 10;
+        u /= 10;
+    }
+    while (u);
+
+    if (value < 0)
+    {
+        *--ptr = '-';
+    }
+
+    return maxavro_text_append(text, ptr, end - ptr);
+}
+
+/**
+ * Append a real value in the same format jansson uses
+ */
+static bool text_append_real(MAXAVRO_TEXT* text, double value)
+{
+    if (isnan(value) || isinf(value))
+    {
+        // Not representable in JSON
+        return false;
+    }
+
+    char buf[100];
+    int len = snprintf(buf, sizeof(buf), "%.17g", value);
+
+    if (strpbrk(buf, ".eE") == NULL)
+    {
+        // Make sure the value is read back as a real
+        memcpy(buf + len, ".0", 3);
+        len += 2;
+    }
+
+    char* exp = strchr(buf, 'e');
+
+    if (exp)
+    {
+        // Remove the leading '+' and any leading zeros from the exponent
+        char* start = exp + 1;
+        char* ptr = start;
+
+        if (*start == '-')
+        {
+            start++;
+            ptr++;
+        }
+
+        while (*ptr == '+' || (*ptr == '0' && ptr[1]))
+        {
+            ptr++;
+        }
+
+        if (ptr != start)
+        {
+            memmove(start, ptr, buf + len - ptr + 1);
+            len -= ptr - start;
+        }
+    }
+
+    return maxavro_text_append(text, buf, len);
+}
+
+static void json_type_free(MAXAVRO_JSON_TYPE* type)
+{
+    for (size_t i = 0; i < type->num_symbols; i++)
+    {
+        MXS_FREE(type->symbols[i]);
+    }
+
+    MXS_FREE(type->symbols);
+    MXS_FREE(type->symbol_lens);
+}
+
+static bool json_type_compile(MAXAVRO_JSON_TYPE* type, enum maxavro_value_type value_type, json_t* symbols)
+{
+    type->type = value_type;
+
+    if (value_type == MAXAVRO_TYPE_ENUM && json_is_array(symbols))
+    {
+        size_t n = json_array_size(symbols);
+        type->symbols = MXS_CALLOC(n, sizeof(char*));
+        type->symbol_lens = MXS_CALLOC(n, sizeof(size_t));
+
+        if (!type->symbols || !type->symbol_lens)
+        {
+            return false;
+        }
+
+        type->num_symbols = n;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const char* sym = json_string_value(json_array_get(symbols, i));
+            MAXAVRO_TEXT quoted = {NULL, 0, 0};
+
+            if (!sym || !text_append_string(&quoted, sym, strlen(sym)))
+            {
+                maxavro_text_free(&quoted);
+                return false;
+            }
+
+            type->symbols[i] = quoted.data;
+            type->symbol_lens[i] = quoted.length;
+        }
+    }
+
+    return true;
+}
+
+static bool json_field_compile(MAXAVRO_JSON_FIELD* field, MAXAVRO_SCHEMA_FIELD* schema_field, bool first)
+{
+    MAXAVRO_TEXT key = {NULL, 0, 0};
+
+    if ((!first && !maxavro_text_append(&key, ", ", 2))
+        || !text_append_string(&key, schema_field->name, strlen(schema_field->name))
+        || !maxavro_text_append(&key, ": ", 2))
+    {
+        maxavro_text_free(&key);
+        return false;
+    }
+
+    field->key = key.data;
+    field->key_len = key.length;
+
+    if (schema_field->type == MAXAVRO_TYPE_UNION)
+    {
+        json_t* arr = schema_field->extra;
+        size_t n = json_array_size(arr);
+        field->value.type = MAXAVRO_TYPE_UNION;
+        field->branches = MXS_CALLOC(n, sizeof(MAXAVRO_JSON_TYPE));
+
+        if (!field->branches)
+        {
+            return false;
+        }
+
+        field->num_branches = n;
+
+        for (size_t i = 0; i < n; i++)
+        {
+            json_t* branch = json_array_get(arr, i);
+            const char* name = json_string_value(json_object_get(branch, "type"));
+            enum maxavro_value_type type = name ? string_to_type(name) : MAXAVRO_TYPE_UNKNOWN;
+
+            if (!json_type_compile(&field->branches[i], type, json_object_get(branch, "symbols")))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    return json_type_compile(&field->value, schema_field->type, schema_field->extra);
+}
+
+static void json_layout_free(MAXAVRO_JSON_LAYOUT* layout)
+{
+    if (layout)
+    {
+        for (size_t i = 0; i < layout->num_fields; i++)
+        {
+            MAXAVRO_JSON_FIELD* field = &layout->fields[i];
+            MXS_FREE(field->key);
+            json_type_free(&field->value);
+
+            for (size_t j = 0; j < field->num_branches; j++)
+            {
+                json_type_free(&field->branches[j]);
+            }
+
+            MXS_FREE(field->branches);
+        }
+
+        MXS_FREE(layout->fields);
+        MXS_FREE(layout);
+    }
+}
+
+void maxavro_json_layout_free(MAXAVRO_JSON_LAYOUT* layout)
+{
+    json_layout_free(layout);
+}
+
+static MAXAVRO_JSON_LAYOUT* json_layout_compile(MAXAVRO_SCHEMA* schema)
+{
+    MAXAVRO_JSON_LAYOUT* layout = MXS_CALLOC(1, sizeof(MAXAVRO_JSON_LAYOUT));
+
+    if (layout)
+    {
+        layout->fields = MXS_CALLOC(schema->num_fields, sizeof(MAXAVRO_JSON_FIELD));
+
+        if (layout->fields || schema->num_fields == 0)
+        {
+            layout->num_fields = schema->num_fields;
+
+            for (size_t i = 0; i < schema->num_fields; i++)
+            {
+                if (!json_field_compile(&layout->fields[i], &schema->fields[i], i == 0))
+                {
+                    json_layout_free(layout);
+                    layout = NULL;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            json_layout_free(layout);
+            layout = NULL;
+        }
+    }
+
+    if (!layout)
+    {
+        MXS_ERROR("Failed to compile the JSON layout of the Avro schema.");
+    }
+
+    return layout;
+}
+
+/**
+ * Decode one value and append it as JSON
+ *
+ * @param file    File to read from
+ * @param text    Output buffer
+ * @param type    Compiled type of the value
+ * @param integer Where integer values are stored, can be NULL
+ * @return True if the value was read and appended
+ */
+static bool append_value(MAXAVRO_FILE* file, MAXAVRO_TEXT* text, MAXAVRO_JSON_TYPE* type, uint64_t* integer)
+{
+    bool rval = false;
+
+    switch (type->type)
+    {
+    case MAXAVRO_TYPE_BOOL:
+        if (file->buffer_ptr < file->buffer_end)
+        {
+            bool value = *file->buffer_ptr++;
+            rval = value ? maxavro_text_append(text, "true", 4) : maxavro_text_append(text, "false", 5);
+        }
+        break;
+
+    case MAXAVRO_TYPE_INT:
+    case MAXAVRO_TYPE_LONG:
+        {
+            uint64_t val = 0;
+
+            if (maxavro_read_integer(file, &val))
+            {
+                if (integer)
+                {
+                    *integer = val;
+                }
+                rval = text_append_integer(text, (int64_t)val);
+            }
+        }
+        break;
+
+    case MAXAVRO_TYPE_ENUM:
+        {
+            uint64_t val = 0;
+
+            if (maxavro_read_integer(file, &val) && val < type->num_symbols)
+            {
+                rval = maxavro_text_append(text, type->symbols[val], type->symbol_lens[val]);
+            }
+        }
+        break;
+
+    case MAXAVRO_TYPE_FLOAT:
+        {
+            float f = 0;
+            rval = maxavro_read_float(file, &f) && text_append_real(text, f);
+        }
+        break;
+
+    case MAXAVRO_TYPE_DOUBLE:
+        {
+            double d = 0;
+            rval = maxavro_read_double(file, &d) && text_append_real(text, d);
+        }
+        break;
+
+    case MAXAVRO_TYPE_BYTES:
+    case MAXAVRO_TYPE_STRING:
+        {
+            uint64_t len = 0;
+
+            if (maxavro_read_integer(file, &len)
+                && len <= (uint64_t)(file->buffer_end - file->buffer_ptr))
+            {
+                // The value is escaped straight from the data block
+                rval = text_append_string(text, (const char*)file->buffer_ptr, len);
+                file->buffer_ptr += len;
+            }
+        }
+        break;
+
+    case MAXAVRO_TYPE_NULL:
+        rval = maxavro_text_append(text, "null", 4);
+        break;
+
+    default:
+        MXS_ERROR("Unimplemented type: %d", type->type);
+        break;
+    }
+
+    return rval;
+}
+
+/**
+ * @brief Read a record and append it to a buffer as JSON text
+ *
+ * This is the allocation free equivalent of serializing the value returned by
+ * maxavro_record_read_json() with json_dumps(). Nothing is appended if an
+ * error occurs.
+ *
+ * @param file     File to read from
+ * @param text     Buffer where the record is appended
+ * @param integers If not NULL, the values of integer fields are stored at the
+ *                 field's index in this array which must hold one value per
+ *                 schema field
+ * @return True if a record was read
+ */
+bool maxavro_record_read_json_text(MAXAVRO_FILE* file, MAXAVRO_TEXT* text, uint64_t* integers)
+{
+    if (!file->metadata_read && !maxavro_read_datablock_start(file))
+    {
+        return false;
+    }
+
+    if (file->records_read_from_block >= file->records_in_block)
+    {
+        return false;
+    }
+
+    if (!file->schema->json_layout && !(file->schema->json_layout = json_layout_compile(file->schema)))
+    {
+        return false;
+    }
+
+    MAXAVRO_JSON_LAYOUT* layout = file->schema->json_layout;
+    size_t start = text->length;
+
+    if (!maxavro_text_append(text, "{", 1))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < layout->num_fields; i++)
+    {
+        MAXAVRO_JSON_FIELD* field = &layout->fields[i];
+        MAXAVRO_JSON_TYPE* type = &field->value;
+        uint64_t* integer = integers ? &integers[i] : NULL;
+        bool ok = maxavro_text_append(text, field->key, field->key_len);
+
+        if (ok && type->type == MAXAVRO_TYPE_UNION)
+        {
+            uint64_t branch = 0;
+            ok = maxavro_read_integer(file, &branch) && branch < field->num_branches;
+            type = ok ? &field->branches[branch] : NULL;
+        }
+
+        if (!ok || !append_value(file, text, type, integer))
+        {
+            MXS_ERROR("Failed to read field value '%s', type '%s' in the "
+                      "data block at file offset %ld, record number %lu.",
+                      file->schema->fields[i].name,
+                      type_to_string(file->schema->fields[i].type),
+                      file->block_start_pos,
+                      file->records_read);
+            text->length = start;
+            return false;
+        }
+    }
+
+    if (!maxavro_text_append(text, "}", 1))
+    {
+        text->length = start;
+        return false;
+    }
+
+    file->records_read_from_block++;
+    file->records_read++;
+    return true;
+}
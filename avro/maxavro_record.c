@@ -129,10 +129,17 @@ static json_t* read_and_pack_value(MAXAVRO_FILE *file, MAXAVRO_SCHEMA_FIELD *fie
     return value;
 }
 
-static void skip_value(MAXAVRO_FILE* file, enum maxavro_value_type type)
+static void skip_value(MAXAVRO_FILE* file, MAXAVRO_SCHEMA_FIELD* field, enum maxavro_value_type type)
 {
     switch (type)
     {
+    case MAXAVRO_TYPE_BOOL:
+        if (file->buffer_ptr < file->buffer_end)
+        {
+            file->buffer_ptr++;
+        }
+        break;
+
     case MAXAVRO_TYPE_INT:
     case MAXAVRO_TYPE_LONG:
     case MAXAVRO_TYPE_ENUM:
@@ -143,6 +150,12 @@ static void skip_value(MAXAVRO_FILE* file, enum maxavro_value_type type)
         break;
 
     case MAXAVRO_TYPE_FLOAT:
+        {
+            float f = 0;
+            maxavro_read_float(file, &f);
+        }
+        break;
+
     case MAXAVRO_TYPE_DOUBLE:
         {
             double d = 0;
@@ -157,6 +170,22 @@ static void skip_value(MAXAVRO_FILE* file, enum maxavro_value_type type)
         }
         break;
 
+    case MAXAVRO_TYPE_UNION:
+        {
+            json_t* arr = field->extra;
+            uint64_t val = 0;
+
+            if (maxavro_read_integer(file, &val) && val < json_array_size(arr))
+            {
+                json_t* union_type = json_object_get(json_array_get(arr, val), "type");
+                skip_value(file, field, string_to_type(json_string_value(union_type)));
+            }
+        }
+        break;
+
+    case MAXAVRO_TYPE_NULL:
+        break;
+
     default:
         MXS_ERROR("Unimplemented type: %d - %s", type, type_to_string(type));
         break;
@@ -194,12 +223,11 @@ json_t* maxavro_record_read_json(MAXAVRO_FILE* file)
                 }
                 else
                 {
-                    long pos = ftell(file->file);
-                    MXS_ERROR("Failed to read field value '%s', type '%s' at "
-                              "file offset %ld, record number %lu.",
+                    MXS_ERROR("Failed to read field value '%s', type '%s' in the "
+                              "data block at file offset %ld, record number %lu.",
                               file->schema->fields[i].name,
                               type_to_string(file->schema->fields[i].type),
-                              pos,
+                              file->block_start_pos,
                               file->records_read);
                     json_decref(object);
                     return NULL;
@@ -218,7 +246,7 @@ static void skip_record(MAXAVRO_FILE* file)
 {
     for (size_t i = 0; i < file->schema->num_fields; i++)
     {
-        skip_value(file, file->schema->fields[i].type);
+        skip_value(file, &file->schema->fields[i], file->schema->fields[i].type);
     }
     file->records_read_from_block++;
     file->records_read++;
@@ -271,7 +299,6 @@ bool maxavro_record_seek(MAXAVRO_FILE* file, uint64_t offset)
         {
             /** Skip full blocks that don't have the position we want */
             offset -= file->records_in_block;
-            fseek(file->file, file->buffer_size, SEEK_CUR);
             maxavro_next_block(file);
         }
 
@@ -299,8 +326,21 @@ bool maxavro_record_seek(MAXAVRO_FILE* file, uint64_t offset)
  */
 bool maxavro_record_set_pos(MAXAVRO_FILE* file, long pos)
 {
-    fseek(file->file, pos - SYNC_MARKER_SIZE, SEEK_SET);
-    return maxavro_verify_block(file) && maxavro_read_datablock_start(file);
+    bool rval = false;
+
+    if (pos >= file->header_end_pos
+        && maxavro_map_file(file, pos)
+        && memcmp(file->map + pos - SYNC_MARKER_SIZE, file->sync, SYNC_MARKER_SIZE) == 0)
+    {
+        file->next_block_pos = pos;
+        rval = maxavro_read_datablock_start(file);
+    }
+    else
+    {
+        MXS_ERROR("File offset %ld in '%s' is not the start of a data block.", pos, file->filename);
+    }
+
+    return rval;
 }
 
 /**
@@ -324,32 +364,14 @@ GWBUF* maxavro_record_read_binary(MAXAVRO_FILE* file)
             return NULL;
         }
 
-        long data_size = (file->data_start_pos - file->block_start_pos) + file->buffer_size;
+        // The whole block, including the sync marker, is copied as-is from the mapped file
+        long data_size = file->next_block_pos - file->block_start_pos;
         mxb_assert(data_size > 0);
-        rval = gwbuf_alloc(data_size + SYNC_MARKER_SIZE);
+        rval = gwbuf_alloc_and_load(data_size, file->map + file->block_start_pos);
 
         if (rval)
         {
-            fseek(file->file, file->block_start_pos, SEEK_SET);
-
-            if (fread(GWBUF_DATA(rval), 1, data_size, file->file) == data_size)
-            {
-                memcpy(((uint8_t*) GWBUF_DATA(rval)) + data_size, file->sync, sizeof(file->sync));
-                maxavro_next_block(file);
-            }
-            else
-            {
-                if (ferror(file->file))
-                {
-                    MXS_ERROR("Failed to read %ld bytes: %d, %s",
-                              data_size,
-                              errno,
-                              mxs_strerror(errno));
-                    file->last_error = MAXAVRO_ERR_IO;
-                }
-                gwbuf_free(rval);
-                rval = NULL;
-            }
+            maxavro_next_block(file);
         }
         else
         {
@@ -128,6 +128,7 @@ MAXAVRO_SCHEMA* maxavro_schema_alloc(const char* json)
     if (rval)
     {
         bool error = false;
+        rval->json_layout = NULL;
         json_error_t err;
         json_t* schema = json_loads(json, 0, &err);
 
@@ -217,6 +218,7 @@ void maxavro_schema_free(MAXAVRO_SCHEMA* schema)
         {
             maxavro_schema_field_free(&schema->fields[i]);
         }
+        maxavro_json_layout_free(schema->json_layout);
         MXS_FREE(schema->fields);
         MXS_FREE(schema);
     }
@@ -50,6 +50,7 @@ int check_file(const char* filename)
             printf("%hhx", file->sync[i]);
         }
         printf("\n");
+        printf("File codec: %s\n", maxavro_codec_to_string(file->codec));
     }
 
     /** After the header come the data blocks. Each data block has the number of records
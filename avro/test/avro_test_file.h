@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+#pragma once
+
+/**
+ * Helpers for writing Avro files in the tests
+ *
+ * The files are written without the Avro C library so that the tests know
+ * which rows are in which data block.
+ */
+
+#include <maxavro.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The sync marker of the test files */
+static const char sync_marker[SYNC_MARKER_SIZE + 1] = "0123456789abcdef";
+
+/**
+ * Encode a long
+ *
+ * @param ptr   Where the value is stored, at least 10 bytes
+ * @param value Value to encode
+ *
+ * @return Number of bytes stored
+ */
+static inline size_t put_long(uint8_t* ptr, int64_t value)
+{
+    uint64_t n = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    size_t len = 0;
+
+    while (n & ~0x7fULL)
+    {
+        ptr[len++] = (n & 0x7f) | 0x80;
+        n >>= 7;
+    }
+
+    ptr[len++] = n;
+    return len;
+}
+
+/**
+ * Encode bytes or a string
+ *
+ * @param ptr  Where the value is stored
+ * @param data Data to encode
+ * @param size Size of the data
+ *
+ * @return Number of bytes stored
+ */
+static inline size_t put_bytes(uint8_t* ptr, const char* data, size_t size)
+{
+    size_t len = put_long(ptr, size);
+    memcpy(ptr + len, data, size);
+    return len + size;
+}
+
+/**
+ * Write the file header
+ *
+ * @param file   File to write to
+ * @param schema Schema of the records
+ * @param codec  Name of the codec the data blocks are compressed with
+ *
+ * @return True if the header was written
+ */
+static inline bool write_header(FILE* file, const char* schema, const char* codec)
+{
+    uint8_t hdr[64];
+    size_t len = 0;
+
+    fwrite(avro_magic, 1, AVRO_MAGIC_SIZE, file);
+
+    // File metadata: a map with the schema and the codec
+    len = put_long(hdr, 2);
+    len += put_bytes(hdr + len, "avro.schema", strlen("avro.schema"));
+    len += put_long(hdr + len, strlen(schema));
+    fwrite(hdr, 1, len, file);
+    fwrite(schema, 1, strlen(schema), file);
+    len = put_bytes(hdr, "avro.codec", strlen("avro.codec"));
+    len += put_bytes(hdr + len, codec, strlen(codec));
+    len += put_long(hdr + len, 0);
+    fwrite(hdr, 1, len, file);
+    fwrite(sync_marker, 1, SYNC_MARKER_SIZE, file);
+
+    return !ferror(file);
+}
+
+/**
+ * Write a data block
+ *
+ * @param file    File to write to
+ * @param records Number of records in the block
+ * @param data    The encoded, and possibly compressed, records
+ * @param size    Size of the data
+ *
+ * @return True if the block was written
+ */
+static inline bool write_block(FILE* file, int64_t records, const uint8_t* data, size_t size)
+{
+    uint8_t hdr[20];
+    size_t len = put_long(hdr, records);
+    len += put_long(hdr + len, size);
+
+    fwrite(hdr, 1, len, file);
+    fwrite(data, 1, size, file);
+    fwrite(sync_marker, 1, SYNC_MARKER_SIZE, file);
+
+    return !ferror(file);
+}
+
+/**
+ * Encode a data block
+ *
+ * @param dest    Where the block is stored
+ * @param records Number of records in the block
+ * @param data    The encoded, and possibly compressed, records
+ * @param size    Size of the data
+ *
+ * @return Size of the block, including the sync marker
+ */
+static inline size_t put_block(uint8_t* dest, int64_t records, const uint8_t* data, size_t size)
+{
+    size_t len = put_long(dest, records);
+    len += put_long(dest + len, size);
+    memcpy(dest + len, data, size);
+    len += size;
+    memcpy(dest + len, sync_marker, SYNC_MARKER_SIZE);
+    return len + SYNC_MARKER_SIZE;
+}
+
+/**
+ * Create a file with only the header in it
+ *
+ * @param path   Path to the file
+ * @param schema Schema of the records
+ * @param codec  Name of the codec the data blocks are compressed with
+ *
+ * @return True if the file was created
+ */
+static inline bool create_file(const char* path, const char* schema, const char* codec)
+{
+    FILE* file = fopen(path, "wb");
+    bool rval = false;
+
+    if (file)
+    {
+        rval = write_header(file, schema, codec);
+        rval = fclose(file) == 0 && rval;
+    }
+
+    return rval;
+}
+
+/**
+ * Append data to a file
+ *
+ * @param path Path to the file
+ * @param data Data to append
+ * @param size Size of the data
+ *
+ * @return File offset the data was written at or -1 on error
+ */
+static inline long append_data(const char* path, const uint8_t* data, size_t size)
+{
+    FILE* file = fopen(path, "ab");
+    long offset = -1;
+
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        offset = ftell(file);
+
+        if (fwrite(data, 1, size, file) != size)
+        {
+            offset = -1;
+        }
+
+        fclose(file);
+    }
+
+    return offset;
+}
+
+/**
+ * The schema of the change records that put_gtid_row() encodes
+ */
+static const char gtid_schema[]
+    = "{\"namespace\": \"MaxScaleChangeDataSchema.avro\", \"type\": \"record\", "
+      "\"name\": \"ChangeRecord\", \"fields\": ["
+      "{\"name\": \"domain\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"server_id\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"sequence\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_number\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"timestamp\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_type\", \"type\": {\"type\": \"enum\", \"name\": \"EVENT_TYPES\", "
+      "\"symbols\": [\"insert\", \"update_before\", \"update_after\", \"delete\"]}}, "
+      "{\"name\": \"id\", \"type\": [{\"type\": \"null\"}, {\"type\": \"long\"}]}, "
+      "{\"name\": \"name\", \"type\": [{\"type\": \"null\"}, {\"type\": \"string\"}]}"
+      "]}";
+
+/** Index of the sequence field in gtid_schema */
+#define GTID_SEQ_FIELD 2
+
+/** Maximum size of a row encoded by put_gtid_row() */
+#define GTID_ROW_SIZE 128
+
+/**
+ * Encode a change record of gtid_schema
+ *
+ * Every row is a transaction of its own: row number N has the GTID 0-1-N, the
+ * id N and the name "row number N".
+ *
+ * @param ptr Where the row is stored, at least GTID_ROW_SIZE bytes
+ * @param row Row number
+ *
+ * @return Number of bytes stored
+ */
+static inline size_t put_gtid_row(uint8_t* ptr, int64_t row)
+{
+    char name[64];
+    size_t len = 0;
+
+    snprintf(name, sizeof(name), "row number %ld", (long)row);
+
+    len += put_long(ptr + len, 0);
+    len += put_long(ptr + len, 1);
+    len += put_long(ptr + len, row);
+    len += put_long(ptr + len, 1);
+    len += put_long(ptr + len, 1500000000 + row);
+    len += put_long(ptr + len, 0);
+    len += put_long(ptr + len, 1);
+    len += put_long(ptr + len, row);
+    len += put_long(ptr + len, 1);
+    len += put_bytes(ptr + len, name, strlen(name));
+    return len;
+}
+
+/**
+ * Append a block of consecutive rows of gtid_schema to a file with the null codec
+ *
+ * @param path      Path to the file
+ * @param first_row Row number of the first row
+ * @param rows      Number of rows in the block
+ *
+ * @return File offset of the block or -1 on error
+ */
+static inline long append_gtid_block(const char* path, int64_t first_row, int rows)
+{
+    uint8_t* data = (uint8_t*)malloc(rows * GTID_ROW_SIZE);
+    uint8_t* block = (uint8_t*)malloc(rows * GTID_ROW_SIZE + 64);
+    size_t size = 0;
+    long offset = -1;
+
+    if (data && block)
+    {
+        for (int64_t row = first_row; row < first_row + rows; row++)
+        {
+            size += put_gtid_row(data + size, row);
+        }
+
+        offset = append_data(path, block, put_block(block, rows, data, size));
+    }
+
+    free(data);
+    free(block);
+    return offset;
+}
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test and benchmark for the maxavro compression codecs
+ *
+ * Writes the same rows with each supported codec, checks that the rows read
+ * back are identical and reports the file size, the compression throughput
+ * and the read throughput of each codec.
+ *
+ * Usage: test_codecs [ROWS]
+ */
+
+#include "avro_test_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <zlib.h>
+
+#ifdef HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static const char* testfile = "test_codecs.avro";
+
+static const char* schema
+    = "{\"namespace\": \"MaxScaleChangeDataSchema.avro\", \"type\": \"record\", "
+      "\"name\": \"ChangeRecord\", \"fields\": ["
+      "{\"name\": \"domain\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"server_id\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"sequence\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_number\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"timestamp\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_type\", \"type\": {\"type\": \"enum\", \"name\": \"EVENT_TYPES\", "
+      "\"symbols\": [\"insert\", \"update_before\", \"update_after\", \"delete\"]}}, "
+      "{\"name\": \"id\", \"type\": [{\"type\": \"null\"}, {\"type\": \"long\"}]}, "
+      "{\"name\": \"name\", \"type\": [{\"type\": \"null\"}, {\"type\": \"string\"}]}, "
+      "{\"name\": \"price\", \"type\": [{\"type\": \"null\"}, {\"type\": \"double\"}]}"
+      "]}";
+
+static const char* names[] =
+{
+    "Widget", "Gadget", "Sprocket", "Flange", "Bracket", "Gasket", "Coupling", "Bearing"
+};
+
+#define NUM_NAMES      (sizeof(names) / sizeof(names[0]))
+#define ROWS_PER_BLOCK 1000
+
+typedef size_t (* compress_func)(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t len);
+
+static size_t put_row(uint8_t* ptr, int64_t row)
+{
+    char name[64];
+    size_t len = 0;
+    double price = (row % 1000) * 1.25;
+
+    snprintf(name, sizeof(name), "%s number %ld", names[row % NUM_NAMES], row % 100);
+
+    len += put_long(ptr + len, 0);
+    len += put_long(ptr + len, 3000);
+    len += put_long(ptr + len, row / 3);
+    len += put_long(ptr + len, row % 3 + 1);
+    len += put_long(ptr + len, 1500000000 + row / 100);
+    len += put_long(ptr + len, row % 4);
+    len += put_long(ptr + len, 1);
+    len += put_long(ptr + len, row);
+    len += put_long(ptr + len, 1);
+    len += put_bytes(ptr + len, name, strlen(name));
+
+    if (row % 7)
+    {
+        len += put_long(ptr + len, 1);
+        memcpy(ptr + len, &price, sizeof(price));
+        len += sizeof(price);
+    }
+    else
+    {
+        len += put_long(ptr + len, 0);
+    }
+
+    return len;
+}
+
+static size_t compress_null(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t len)
+{
+    memcpy(dest, src, len);
+    return len;
+}
+
+static size_t compress_deflate(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t len)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Raw deflate without the zlib header, as required by the Avro specification
+    deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = (uint8_t*)src;
+    stream.avail_in = len;
+    stream.next_out = dest;
+    stream.avail_out = dest_size;
+    int rc = deflate(&stream, Z_FINISH);
+    size_t rval = rc == Z_STREAM_END ? stream.total_out : 0;
+    deflateEnd(&stream);
+    return rval;
+}
+
+#ifdef HAVE_SNAPPY
+static size_t compress_snappy(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t len)
+{
+    size_t out = dest_size - 4;
+
+    if (snappy_compress((const char*)src, len, (char*)dest, &out) != SNAPPY_OK)
+    {
+        return 0;
+    }
+
+    // The compressed data is followed by the big-endian CRC32 of the uncompressed data
+    uint32_t crc = crc32(0, src, len);
+    dest[out++] = crc >> 24;
+    dest[out++] = crc >> 16;
+    dest[out++] = crc >> 8;
+    dest[out++] = crc;
+    return out;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static size_t compress_zstd(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t len)
+{
+    size_t rc = ZSTD_compress(dest, dest_size, src, len, 3);
+    return ZSTD_isError(rc) ? 0 : rc;
+}
+#endif
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Write the test file
+ *
+ * @return Time spent compressing the data blocks or a negative value on error
+ */
+static double write_file(int64_t rows, const char* codec, compress_func func)
+{
+    FILE* file = fopen(testfile, "wb");
+
+    if (!file)
+    {
+        return -1;
+    }
+
+    size_t block_size = ROWS_PER_BLOCK * 256;
+    uint8_t* block = malloc(block_size);
+    uint8_t* compressed = malloc(block_size * 2);
+    double elapsed = write_header(file, schema, codec) ? 0 : -1;
+
+    for (int64_t row = 0; row < rows && elapsed >= 0;)
+    {
+        size_t size = 0;
+        int64_t n = 0;
+
+        for (; n < ROWS_PER_BLOCK && row < rows; n++, row++)
+        {
+            size += put_row(block + size, row);
+        }
+
+        double start = now();
+        size_t compressed_size = func(compressed, block_size * 2, block, size);
+        elapsed += now() - start;
+
+        if (compressed_size == 0)
+        {
+            printf("Failed to compress block with codec '%s'\n", codec);
+            elapsed = -1;
+            break;
+        }
+
+        if (!write_block(file, n, compressed, compressed_size))
+        {
+            elapsed = -1;
+        }
+    }
+
+    free(block);
+    free(compressed);
+    return fclose(file) == 0 ? elapsed : -1;
+}
+
+/**
+ * Read all rows from the test file
+ *
+ * @param rows     Number of rows read
+ * @param checksum CRC32 of the rows in JSON format
+ * @return Time spent reading the file or a negative value on error
+ */
+static double read_file(int64_t* rows, uint32_t* checksum)
+{
+    MAXAVRO_FILE* file = maxavro_file_open(testfile);
+
+    if (!file)
+    {
+        return -1;
+    }
+
+    MAXAVRO_TEXT text = {NULL, 0, 0};
+    uLong crc = crc32(0, NULL, 0);
+    double start = now();
+    *rows = 0;
+
+    do
+    {
+        text.length = 0;
+
+        while (maxavro_record_read_json_text(file, &text, NULL))
+        {
+            ++*rows;
+        }
+
+        crc = crc32(crc, (uint8_t*)text.data, text.length);
+    }
+    while (maxavro_next_block(file));
+
+    double elapsed = now() - start;
+    bool ok = maxavro_get_error(file) == MAXAVRO_ERR_NONE;
+    *checksum = crc;
+    maxavro_text_free(&text);
+    maxavro_file_close(file);
+    return ok ? elapsed : -1;
+}
+
+/** Size of the uncompressed file */
+static long null_size = 0;
+
+static int test_codec(int64_t rows, enum maxavro_codec codec, compress_func func, uint32_t* expected)
+{
+    const char* name = maxavro_codec_to_string(codec);
+    double compress_time = write_file(rows, name, func);
+
+    if (compress_time < 0)
+    {
+        printf("%s: failed to write file\n", name);
+        return 1;
+    }
+
+    FILE* file = fopen(testfile, "rb");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+
+    int64_t rows_read = 0;
+    uint32_t checksum = 0;
+    double read_time = read_file(&rows_read, &checksum);
+
+    if (read_time < 0 || rows_read != rows)
+    {
+        printf("%s: failed to read file, got %ld rows out of %ld\n", name, rows_read, rows);
+        return 1;
+    }
+
+    if (codec == MAXAVRO_CODEC_NULL)
+    {
+        *expected = checksum;
+        null_size = size;
+    }
+    else if (checksum != *expected)
+    {
+        printf("%s: rows differ from the uncompressed file\n", name);
+        return 1;
+    }
+
+    printf("%-10s %10ld bytes %8.1f%% %10.0f rows/s compressed %10.0f rows/s read\n",
+           name,
+           size,
+           100.0 * size / null_size,
+           compress_time > 0 ? rows / compress_time : 0,
+           rows / read_time);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int64_t rows = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+    uint32_t expected = 0;
+    int errors = 0;
+
+    errors += test_codec(rows, MAXAVRO_CODEC_NULL, compress_null, &expected);
+    errors += test_codec(rows, MAXAVRO_CODEC_DEFLATE, compress_deflate, &expected);
+
+#ifdef HAVE_SNAPPY
+    errors += test_codec(rows, MAXAVRO_CODEC_SNAPPY, compress_snappy, &expected);
+#endif
+
+#ifdef HAVE_ZSTD
+    errors += test_codec(rows, MAXAVRO_CODEC_ZSTD, compress_zstd, &expected);
+#endif
+
+    remove(testfile);
+    return errors;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for reading Avro files through the file mapping
+ *
+ * Checks that the rows are read in order across data block boundaries, that
+ * maxavro_record_set_pos() and maxavro_record_seek() find the right rows, that
+ * blocks appended to an open file are found and that a partially written block
+ * is read again once it has been completely written.
+ */
+
+#include "avro_test_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <zlib.h>
+#include <maxscale/log.h>
+
+static const char* testfile = "test_file_map.avro";
+
+#define NUM_BLOCKS     10
+#define ROWS_PER_BLOCK 100
+#define MAX_BLOCK_SIZE (ROWS_PER_BLOCK * GTID_ROW_SIZE)
+
+static int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+/**
+ * Encode a data block
+ *
+ * @param dest      Where the block is stored, at least MAX_BLOCK_SIZE bytes
+ * @param first_row Row number of the first row in the block
+ * @param codec     The codec of the file
+ *
+ * @return Size of the block, including the sync marker
+ */
+static size_t make_block(uint8_t* dest, int64_t first_row, enum maxavro_codec codec)
+{
+    uint8_t data[MAX_BLOCK_SIZE];
+    uint8_t compressed[MAX_BLOCK_SIZE];
+    size_t size = 0;
+
+    for (int64_t row = first_row; row < first_row + ROWS_PER_BLOCK; row++)
+    {
+        size += put_gtid_row(data + size, row);
+    }
+
+    if (codec == MAXAVRO_CODEC_DEFLATE)
+    {
+        // Raw deflate without the zlib header, as required by the Avro specification
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        stream.next_in = data;
+        stream.avail_in = size;
+        stream.next_out = compressed;
+        stream.avail_out = sizeof(compressed);
+        deflate(&stream, Z_FINISH);
+        size = stream.total_out;
+        deflateEnd(&stream);
+    }
+    else
+    {
+        memcpy(compressed, data, size);
+    }
+
+    return put_block(dest, ROWS_PER_BLOCK, compressed, size);
+}
+
+/** Read the next row, returns its row number or -1 if there are no rows left in the block */
+static int64_t next_row(MAXAVRO_FILE* file, MAXAVRO_TEXT* text)
+{
+    uint64_t values[8];
+    text->length = 0;
+    return maxavro_record_read_json_text(file, text, values) ? (int64_t)values[GTID_SEQ_FIELD] : -1;
+}
+
+static void test_codec(enum maxavro_codec codec)
+{
+    uint8_t block[MAX_BLOCK_SIZE];
+    long offsets[NUM_BLOCKS];
+    MAXAVRO_TEXT text = {NULL, 0, 0};
+
+    create_file(testfile, gtid_schema, maxavro_codec_to_string(codec));
+
+    for (int i = 0; i < NUM_BLOCKS; i++)
+    {
+        offsets[i] = append_data(testfile, block, make_block(block, i * ROWS_PER_BLOCK, codec));
+    }
+
+    MAXAVRO_FILE* file = maxavro_file_open(testfile);
+
+    if (!file)
+    {
+        printf("%s: failed to open file\n", maxavro_codec_to_string(codec));
+        errors++;
+        return;
+    }
+
+    // All rows are read in order across the block boundaries
+    int64_t expected = 0;
+    int blocks = 0;
+
+    do
+    {
+        EXPECT(blocks < NUM_BLOCKS && file->block_start_pos == offsets[blocks]);
+        EXPECT(file->records_in_block == ROWS_PER_BLOCK);
+        blocks++;
+
+        for (int64_t row; (row = next_row(file, &text)) != -1; expected++)
+        {
+            EXPECT(row == expected);
+        }
+    }
+    while (maxavro_next_block(file));
+
+    EXPECT(blocks == NUM_BLOCKS);
+    EXPECT(expected == NUM_BLOCKS * ROWS_PER_BLOCK);
+    EXPECT(maxavro_get_error(file) == MAXAVRO_ERR_NONE);
+
+    // Jumping to the start of a block, in any order
+    for (int i = NUM_BLOCKS - 1; i >= 0; i -= 3)
+    {
+        EXPECT(maxavro_record_set_pos(file, offsets[i]));
+        EXPECT(file->block_start_pos == offsets[i]);
+        EXPECT(next_row(file, &text) == i * ROWS_PER_BLOCK);
+    }
+
+    // Offsets that are not at the start of a block are rejected
+    EXPECT(!maxavro_record_set_pos(file, offsets[3] + 1));
+    EXPECT(!maxavro_record_set_pos(file, file->header_end_pos - 1));
+    EXPECT(!maxavro_record_set_pos(file, offsets[NUM_BLOCKS - 1] + MAX_BLOCK_SIZE * 2));
+
+    // Skipping rows across the block boundaries
+    EXPECT(maxavro_record_set_pos(file, offsets[0]));
+    EXPECT(next_row(file, &text) == 0);
+    EXPECT(maxavro_record_seek(file, ROWS_PER_BLOCK * 2 + 49));
+    EXPECT(next_row(file, &text) == ROWS_PER_BLOCK * 2 + 50);
+
+    // A block that is being written is read once it is complete
+    EXPECT(maxavro_record_set_pos(file, offsets[NUM_BLOCKS - 1]));
+    EXPECT(!maxavro_next_block(file));
+
+    size_t size = make_block(block, NUM_BLOCKS * ROWS_PER_BLOCK, codec);
+    long offset = append_data(testfile, block, size / 2);
+    EXPECT(!maxavro_next_block(file));
+    EXPECT(maxavro_get_error(file) == MAXAVRO_ERR_NONE);
+
+    append_data(testfile, block + size / 2, size - size / 2);
+    EXPECT(maxavro_next_block(file));
+    EXPECT(file->block_start_pos == offset);
+    EXPECT(next_row(file, &text) == NUM_BLOCKS * ROWS_PER_BLOCK);
+
+    maxavro_file_close(file);
+    maxavro_text_free(&text);
+    remove(testfile);
+}
+
+int main()
+{
+    mxs_log_init(NULL, NULL, MXS_LOG_TARGET_STDOUT);
+
+    test_codec(MAXAVRO_CODEC_NULL);
+    test_codec(MAXAVRO_CODEC_DEFLATE);
+
+    mxs_log_finish();
+    return errors;
+}
@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test and benchmark for maxavro_record_read_json_text
+ *
+ * Generates an Avro file, checks that the direct serialization produces the
+ * same output as json_dumps() of maxavro_record_read_json() and then measures
+ * the rows per second of both methods.
+ *
+ * Usage: test_json_text [ROWS]
+ */
+
+#include "avro_test_file.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char* testfile = "test_json_text.avro";
+
+static const char* schema
+    = "{\"namespace\": \"MaxScaleChangeDataSchema.avro\", \"type\": \"record\", "
+      "\"name\": \"ChangeRecord\", \"fields\": ["
+      "{\"name\": \"domain\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"server_id\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"sequence\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_number\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"timestamp\", \"type\": {\"type\": \"int\"}}, "
+      "{\"name\": \"event_type\", \"type\": {\"type\": \"enum\", \"name\": \"EVENT_TYPES\", "
+      "\"symbols\": [\"insert\", \"update_before\", \"update_after\", \"delete\"]}}, "
+      "{\"name\": \"id\", \"type\": {\"type\": \"long\"}}, "
+      "{\"name\": \"name \\\"quoted\\\"\", \"type\": {\"type\": \"string\"}}, "
+      "{\"name\": \"data\", \"type\": {\"type\": \"bytes\"}}, "
+      "{\"name\": \"price\", \"type\": {\"type\": \"double\"}}, "
+      "{\"name\": \"ratio\", \"type\": {\"type\": \"float\"}}, "
+      "{\"name\": \"flag\", \"type\": {\"type\": \"bool\"}}, "
+      "{\"name\": \"opt\", \"type\": [{\"type\": \"null\"}, {\"type\": \"long\"}]}"
+      "]}";
+
+static const char* strings[] =
+{
+    "",
+    "plain text",
+    "quote \" backslash \\ slash /",
+    "control \b\f\n\r\t\x01\x1f",
+    "utf-8 \xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80",
+};
+
+/** Not valid UTF-8, jansson refuses to create a string out of this */
+static const char invalid_utf8[] = "invalid \xff\xc3 utf-8 \xed\xa0\x80";
+static const char invalid_utf8_json[] = "\"invalid \\u00FF\\u00C3 utf-8 \\u00ED\\u00A0\\u0080\"";
+static bool use_invalid_utf8 = false;
+
+#define NUM_STRINGS (sizeof(strings) / sizeof(strings[0]))
+
+static const double doubles[] = {0.0, -1.5, 3.141592653589793, 1e20, 1.25e-7, 123456789.0, -0.1};
+
+#define NUM_DOUBLES (sizeof(doubles) / sizeof(doubles[0]))
+
+static size_t put_row(uint8_t* ptr, int64_t row)
+{
+    size_t len = 0;
+    const char* str = use_invalid_utf8 ? invalid_utf8 : strings[row % NUM_STRINGS];
+    double d = doubles[row % NUM_DOUBLES] * (row % 3 ? 1 : row);
+    float f = (float)d / 7;
+
+    len += put_long(ptr + len, 0);
+    len += put_long(ptr + len, 3000);
+    len += put_long(ptr + len, row / 10);
+    len += put_long(ptr + len, row % 10);
+    len += put_long(ptr + len, 1500000000 + row);
+    len += put_long(ptr + len, row % 4);
+    len += put_long(ptr + len, row % 2 ? row * 1000003 : -row);
+    len += put_bytes(ptr + len, str, strlen(str));
+    len += put_bytes(ptr + len, "\x01\x02\x7f binary", row % 11);
+    memcpy(ptr + len, &d, sizeof(d));
+    len += sizeof(d);
+    memcpy(ptr + len, &f, sizeof(f));
+    len += sizeof(f);
+    ptr[len++] = row % 2;
+
+    if (row % 5)
+    {
+        len += put_long(ptr + len, 1);
+        len += put_long(ptr + len, row << 20);
+    }
+    else
+    {
+        len += put_long(ptr + len, 0);
+    }
+
+    return len;
+}
+
+static bool write_file(int64_t rows)
+{
+    const int64_t rows_per_block = 1000;
+    FILE* file = fopen(testfile, "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    uint8_t* block = malloc(rows_per_block * 512);
+    bool ok = write_header(file, schema, "null");
+
+    for (int64_t row = 0; row < rows && ok;)
+    {
+        size_t size = 0;
+        int64_t n = 0;
+
+        for (; n < rows_per_block && row < rows; n++, row++)
+        {
+            size += put_row(block + size, row);
+        }
+
+        ok = write_block(file, n, block, size);
+    }
+
+    free(block);
+    return fclose(file) == 0 && ok;
+}
+
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int check_output(int64_t rows)
+{
+    MAXAVRO_FILE* tree_file = maxavro_file_open(testfile);
+    MAXAVRO_FILE* text_file = maxavro_file_open(testfile);
+
+    if (!tree_file || !text_file)
+    {
+        printf("Failed to open file\n");
+        return 1;
+    }
+
+    MAXAVRO_TEXT text = {NULL, 0, 0};
+    uint64_t integers[13];
+    int64_t n = 0;
+    int errors = 0;
+
+    do
+    {
+        json_t* row;
+
+        while ((row = maxavro_record_read_json(tree_file)))
+        {
+            char* expected = json_dumps(row, JSON_PRESERVE_ORDER);
+            text.length = 0;
+
+            if (!maxavro_record_read_json_text(text_file, &text, integers))
+            {
+                printf("Row %ld: failed to read JSON text\n", n);
+                errors++;
+            }
+            else if (text.length != strlen(expected) || memcmp(text.data, expected, text.length) != 0)
+            {
+                printf("Row %ld: output mismatch\nExpected: %s\nGot:      %.*s\n",
+                       n, expected, (int)text.length, text.data);
+                errors++;
+            }
+            else if (integers[2] != (uint64_t)(n / 10) || integers[6] != (uint64_t)(n % 2 ? n * 1000003 : -n))
+            {
+                printf("Row %ld: wrong integer values\n", n);
+                errors++;
+            }
+
+            free(expected);
+            json_decref(row);
+            n++;
+        }
+    }
+    while (errors < 10 && maxavro_next_block(tree_file) && maxavro_next_block(text_file));
+
+    if (n != rows)
+    {
+        printf("Expected %ld rows, read %ld\n", rows, n);
+        errors++;
+    }
+
+    maxavro_text_free(&text);
+    maxavro_file_close(tree_file);
+    maxavro_file_close(text_file);
+    return errors;
+}
+
+static int check_invalid_utf8()
+{
+    int errors = 0;
+    use_invalid_utf8 = true;
+
+    if (!write_file(1))
+    {
+        printf("Failed to write test file\n");
+        return 1;
+    }
+
+    use_invalid_utf8 = false;
+    MAXAVRO_FILE* file = maxavro_file_open(testfile);
+    MAXAVRO_TEXT text = {NULL, 0, 0};
+
+    if (!file || !maxavro_record_read_json_text(file, &text, NULL))
+    {
+        printf("Failed to read row with invalid UTF-8\n");
+        errors++;
+    }
+    else if (!maxavro_text_append(&text, "", 1) || !strstr(text.data, invalid_utf8_json))
+    {
+        printf("Invalid UTF-8 was not escaped: %.*s\n", (int)text.length, text.data);
+        errors++;
+    }
+
+    maxavro_text_free(&text);
+    maxavro_file_close(file);
+    return errors;
+}
+
+static double bench_tree(int64_t rows)
+{
+    MAXAVRO_FILE* file = maxavro_file_open(testfile);
+    double start = now();
+
+    do
+    {
+        json_t* row;
+
+        while ((row = maxavro_record_read_json(file)))
+        {
+            // What the CDC protocol did for each row
+            char* json = json_dumps(row, JSON_PRESERVE_ORDER);
+            size_t len = strlen(json);
+            GWBUF* buf = gwbuf_alloc(len + 1);
+            memcpy(GWBUF_DATA(buf), json, len);
+            GWBUF_DATA(buf)[len] = '\n';
+            gwbuf_free(buf);
+            free(json);
+            json_decref(row);
+        }
+    }
+    while (maxavro_next_block(file));
+
+    double elapsed = now() - start;
+    maxavro_file_close(file);
+    return rows / elapsed;
+}
+
+static double bench_text(int64_t rows)
+{
+    MAXAVRO_FILE* file = maxavro_file_open(testfile);
+    MAXAVRO_TEXT text = {NULL, 0, 0};
+    uint64_t integers[13];
+    double start = now();
+
+    do
+    {
+        while (maxavro_record_read_json_text(file, &text, integers))
+        {
+            maxavro_text_append(&text, "\n", 1);
+        }
+
+        // One buffer per data block
+        GWBUF* buf = gwbuf_alloc_and_load(text.length, text.data);
+        gwbuf_free(buf);
+        text.length = 0;
+    }
+    while (maxavro_next_block(file));
+
+    double elapsed = now() - start;
+    maxavro_text_free(&text);
+    maxavro_file_close(file);
+    return rows / elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    int64_t rows = argc > 1 ? strtol(argv[1], NULL, 10) : 100000;
+
+    if (!write_file(rows))
+    {
+        printf("Failed to write test file\n");
+        return 1;
+    }
+
+    int errors = check_output(rows) + check_invalid_utf8();
+
+    if (errors == 0 && write_file(rows))
+    {
+        double tree = bench_tree(rows);
+        double text = bench_text(rows);
+        printf("json_t + json_dumps: %.0f rows/s\n", tree);
+        printf("direct JSON text:    %.0f rows/s (%.1fx)\n", text, text / tree);
+    }
+
+    remove(testfile);
+    return errors ? 1 : 0;
+}
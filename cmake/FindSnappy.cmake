@@ -0,0 +1,16 @@
+# This CMake file locates the Snappy compression library
+#
+# The following variables are set:
+# SNAPPY_FOUND - If the Snappy library was found
+# SNAPPY_LIBRARIES - Path to the library
+# SNAPPY_INCLUDE_DIR - Path to Snappy headers
+
+find_path(SNAPPY_INCLUDE_DIR snappy-c.h)
+find_library(SNAPPY_LIBRARIES NAMES snappy)
+
+if (SNAPPY_INCLUDE_DIR AND SNAPPY_LIBRARIES)
+  message(STATUS "Found Snappy: ${SNAPPY_LIBRARIES}")
+  set(SNAPPY_FOUND TRUE)
+else()
+  message(STATUS "Could not find Snappy")
+endif()
@@ -0,0 +1,16 @@
+# This CMake file locates the Zstandard compression library
+#
+# The following variables are set:
+# ZSTD_FOUND - If the Zstandard library was found
+# ZSTD_LIBRARIES - Path to the library
+# ZSTD_INCLUDE_DIR - Path to Zstandard headers
+
+find_path(ZSTD_INCLUDE_DIR zstd.h)
+find_library(ZSTD_LIBRARIES NAMES zstd)
+
+if (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES)
+  message(STATUS "Found Zstandard: ${ZSTD_LIBRARIES}")
+  set(ZSTD_FOUND TRUE)
+else()
+  message(STATUS "Could not find Zstandard")
+endif()
@@ -129,6 +129,7 @@ extern const char CN_HAS_WHERE_CLAUSE[];
 extern const char CN_ID[];
 extern const char CN_INET[];
 extern const char CN_LISTENER[];
+extern const char CN_LISTENER_MODE[];
 extern const char CN_LISTENERS[];
 extern const char CN_LOCALHOST_MATCH_WILDCARD_HOST[];
 extern const char CN_LOG_AUTH_WARNINGS[];
@@ -155,6 +156,7 @@ extern const char CN_PASSIVE[];
 extern const char CN_PASSWORD[];
 extern const char CN_POLL_SLEEP[];
 extern const char CN_PORT[];
+extern const char CN_PROFILER_FREQUENCY[];
 extern const char CN_EXTRA_PORT[];
 extern const char CN_PROTOCOL[];
 extern const char CN_QUERY_CLASSIFIER[];
@@ -162,6 +164,8 @@ extern const char CN_QUERY_CLASSIFIER_ARGS[];
 extern const char CN_QUERY_CLASSIFIER_CACHE_SIZE[];
 extern const char CN_QUERY_RETRIES[];
 extern const char CN_QUERY_RETRY_TIMEOUT[];
+extern const char CN_REBALANCE_PERIOD[];
+extern const char CN_REBALANCE_THRESHOLD[];
 extern const char CN_RELATIONSHIPS[];
 extern const char CN_LINKS[];
 extern const char CN_REQUIRED[];
@@ -170,6 +174,7 @@ extern const char CN_RETRY_ON_FAILURE[];
 extern const char CN_ROUTER[];
 extern const char CN_ROUTER_DIAGNOSTICS[];
 extern const char CN_ROUTER_OPTIONS[];
+extern const char CN_RPS_INTERFACE[];
 extern const char CN_SELF[];
 extern const char CN_SERVERS[];
 extern const char CN_SERVER[];
@@ -190,6 +195,7 @@ extern const char CN_SSL_VERSION[];
 extern const char CN_STRIP_DB_ESC[];
 extern const char CN_SUBSTITUTE_VARIABLES[];
 extern const char CN_THREADS[];
+extern const char CN_THREAD_AFFINITY[];
 extern const char CN_THREAD_STACK_SIZE[];
 extern const char CN_TICKS[];
 extern const char CN_TYPE[];
@@ -221,6 +227,16 @@ extern const char CN_MAXLOG[];
 extern const char CN_LOG_AUGMENTATION[];
 extern const char CN_LOG_TO_SHM[];
 
+/**
+ * How the listening sockets are distributed between the routing workers
+ */
+typedef enum mxs_listener_mode
+{
+    MXS_LISTENER_MODE_SHARED,           /**< One socket in an epoll instance shared by all workers */
+    MXS_LISTENER_MODE_REUSEPORT,        /**< One SO_REUSEPORT socket per worker */
+    MXS_LISTENER_MODE_REUSEPORT_CPU,    /**< As above, connections steered by the receiving CPU */
+} mxs_listener_mode_t;
+
 /**
  * The config parameter
  */
@@ -294,6 +310,16 @@ typedef struct
     char             peer_user[MAX_ADMIN_HOST_LEN];     /**< Username for maxscale-to-maxscale traffic */
     char             peer_password[MAX_ADMIN_HOST_LEN]; /**< Password for maxscale-to-maxscale traffic */
     mxb_log_target_t log_target;                        /**< Log type */
+    mxs_listener_mode_t listener_mode;                  /**< How listening sockets are distributed */
+    int              rebalance_threshold;               /**< Load difference in percent that triggers
+                                                         * moving of idle sessions, 0 for never */
+    int              rebalance_period;                  /**< How often the load is checked, in seconds */
+    char*            thread_affinity;                   /**< CPUs the routing workers are pinned to, NULL
+                                                         * if they are not pinned */
+    char*            rps_interface;                     /**< Network interface whose receive queues are
+                                                         * steered to the CPUs of the routing workers */
+    int              profiler_frequency;                /**< Samples per second taken by the profiler of
+                                                         * each routing worker, 0 if not profiling */
 } MXS_CONFIG;
 
 /**
@@ -36,6 +36,7 @@ struct service;
 struct servlistener;
 
 struct dcb;
+struct dcb_listener_shard;
 
 #define DCBFD_CLOSED -1
 
@@ -200,6 +201,8 @@ typedef struct dcb
     GWBUF*   readq;                                     /**< Read queue for storing incomplete reads */
     GWBUF*   fakeq;                                     /**< Fake event queue for generated events */
     uint32_t fake_event;                                /**< Fake event to be delivered to handler */
+    uint32_t read_size;                                 /**< Size of the next read, adapted to the data
+                                                         * received */
 
     DCBSTATS    stats;                      /**< DCB related statistics */
     struct dcb* nextpersistent;             /**< Next DCB in the persistent pool for SERVER */
@@ -212,12 +215,15 @@ typedef struct dcb
     void*           authenticator_data;     /**< The authenticator data for this DCB */
     DCB_CALLBACK*   callbacks;              /**< The list of callbacks for the DCB */
     int64_t         last_read;              /*< Last time the DCB received data */
+    int64_t         last_write;             /*< Last time the DCB sent data */
+    void*           idle_timer;             /*< Idle timeout of a client DCB, owned by its worker */
     struct server*  server;                 /**< The associated backend server */
     SSL*            ssl;                    /*< SSL struct for connection */
     bool            ssl_read_want_read;     /*< Flag */
     bool            ssl_read_want_write;    /*< Flag */
     bool            ssl_write_want_read;    /*< Flag */
     bool            ssl_write_want_write;   /*< Flag */
+    uint32_t        ssl_write_pending;      /*< Length of an SSL_write() that must be retried */
     bool            was_persistent;         /**< Whether this DCB was in the persistent pool */
     bool            high_water_reached;     /** High water mark reached, to determine whether need release
                                              * throttle */
@@ -229,6 +235,9 @@ typedef struct dcb
     uint32_t n_close;           /** How many times dcb_close has been called. */
     char*    path;              /** If a Unix socket, the path it was bound to. */
 
+    struct dcb_listener_shard* listener_shards; /** Per-worker SO_REUSEPORT sockets of a listener. */
+    int                        n_listener_shards;
+
     uint64_t m_uid; /**< Unique identifier for this DCB */
 } DCB;
 
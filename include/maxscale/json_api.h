@@ -35,6 +35,7 @@ MXS_BEGIN_DECLS
 #define MXS_JSON_API_TASKS       "/maxscale/tasks/"
 #define MXS_JSON_API_MODULES     "/maxscale/modules/"
 #define MXS_JSON_API_QC_STATS    "/maxscale/qc_stats/"
+#define MXS_JSON_API_PROFILE     "/maxscale/profile/"
 #define MXS_JSON_API_QC          "/maxscale/query_classifier/"
 #define MXS_JSON_API_QC_CLASSIFY "/maxscale/query_classifier/classify"
 #define MXS_JSON_API_USERS       "/users/"
@@ -346,6 +346,9 @@ typedef struct
                                              * packet type */
     bool large_query;                       /*< Whether to ignore the command byte of the next
                                              * packet*/
+    bool    compress;                       /*< Whether the compressed protocol is used */
+    uint8_t compress_seq;                   /*< Sequence number of the next compressed packet */
+    GWBUF*  compressed_readq;               /*< Incomplete compressed packets */
 } MySQLProtocol;
 
 typedef struct
@@ -517,6 +520,30 @@ bool send_auth_switch_request_packet(DCB* dcb);
 /** Write an OK packet to a DCB */
 int mxs_mysql_send_ok(DCB* dcb, int sequence, uint8_t affected_rows, const char* message);
 
+/** The length of the header of a compressed protocol packet */
+#define MYSQL_COMPRESSED_HEADER_LEN 7
+
+/**
+ * @brief Wrap data in compressed protocol packets
+ *
+ * @param proto  The protocol of the connection, for the packet sequence
+ * @param buffer Data to send, freed by the call
+ * @return The compressed packets or NULL on memory allocation failure
+ */
+GWBUF* mxs_mysql_compress(MySQLProtocol* proto, GWBUF* buffer);
+
+/**
+ * @brief Extract the data from compressed protocol packets
+ *
+ * Incomplete packets are stored in the protocol until the rest of them is read.
+ *
+ * @param proto  The protocol of the connection
+ * @param input  Data read from the connection, may be NULL
+ * @param output The data of the complete packets is appended here
+ * @return False if a packet could not be decompressed
+ */
+bool mxs_mysql_decompress(MySQLProtocol* proto, GWBUF* input, GWBUF** output);
+
 /**
  * @brief Check if the buffer contains an OK packet
  *
@@ -259,6 +259,10 @@ typedef enum router_capability
                                              *  users when the service is started */
     RCAP_TYPE_NO_AUTH        = 0x00040000,  /**< No `user` or `password` parameter required */
     RCAP_TYPE_RUNTIME_CONFIG = 0x00080000,  /**< Router supports runtime cofiguration */
+    RCAP_TYPE_COMPRESSION    = 0x00100000,  /**< Clients may use the compressed protocol */
+    RCAP_TYPE_MAIN_WORKER    = 0x00200000,  /**< Client sessions are handled by the main worker */
+    RCAP_TYPE_MOVABLE_SESSIONS = 0x00400000,/**< Router sessions keep no worker bound state and
+                                             *  idle ones can be moved to another worker */
 } mxs_router_capability_t;
 
 typedef enum
@@ -21,6 +21,7 @@
 #include <atomic>
 
 #include <maxbase/atomic.hh>
+#include <maxbase/profiler.hh>
 #include <maxbase/semaphore.hh>
 #include <maxbase/worker.hh>
 #include <maxbase/stopwatch.hh>
@@ -108,6 +109,34 @@ public:
         return m_id;
     }
 
+    /**
+     * Returns the CPU the worker is pinned to.
+     *
+     * @return The CPU, or -1 if the worker is not pinned to a CPU.
+     */
+    int cpu() const
+    {
+        return m_cpu;
+    }
+
+    /**
+     * Returns the NUMA node of the CPU the worker is pinned to.
+     *
+     * @return The node, or -1 if the worker is not pinned or the node is not known.
+     */
+    int numa_node() const
+    {
+        return m_numa_node;
+    }
+
+    /**
+     * Returns the placement of the calling worker as a JSON object.
+     *
+     * @return The configured CPU and NUMA node, the CPU the worker currently
+     *         runs on and the CPUs the worker is allowed to run on.
+     */
+    json_t* placement_to_json() const;
+
     /**
      * Register zombie for later deletion.
      *
@@ -428,6 +457,47 @@ public:
      */
     static std::unique_ptr<json_t> get_qc_stats_as_json(const char* zHost, int id);
 
+    /**
+     * Start, stop or change the sampling frequency of the profilers of all workers.
+     *
+     * @param frequency  Samples per second, 0 to stop profiling.
+     */
+    static void set_profiler_frequency(int frequency);
+
+    /**
+     * Move idle sessions of this worker to another worker at the end of the
+     * current poll cycle. The sessions are not moved while the events of the
+     * cycle are being handled, as some of the events may be for their descriptors.
+     *
+     * @note Must be called in this worker.
+     *
+     * @param to       The id of the worker to move the sessions to.
+     * @param percent  At most this percentage of the sessions is moved.
+     */
+    void move_idle_sessions(int to, int percent);
+
+    /**
+     * Provides the stacks sampled by the profilers of all workers as a Json object
+     * for use in the REST-API. The stacks are in the folded format of flame graph tools.
+     *
+     * @param zHost  The name of the MaxScale host.
+     */
+    static std::unique_ptr<json_t> get_profile_as_json(const char* zHost);
+
+    /**
+     * Discard the stacks sampled by the profilers of all workers.
+     */
+    static void reset_profile();
+
+    /**
+     * @return The profiler of the worker, empty if the worker has never been profiled.
+     *         May only be accessed in the thread of the worker.
+     */
+    const std::unique_ptr<mxb::Profiler>& profiler() const
+    {
+        return m_sProfiler;
+    }
+
     /**
      * To be called from the initial (parent) thread if the systemd watchdog is on.
      */
@@ -485,6 +555,49 @@ public:
         RoutingWorker* m_pWorker;
     };
 
+    class Unpinned;
+    friend Unpinned;
+
+    /**
+     * @class Unpinned
+     *
+     * RAII-class using which a worker that is pinned to a CPU can run on all
+     * CPUs while it does something that may create threads, such as creating
+     * monitors and services at runtime. The threads would otherwise inherit
+     * the CPU of the worker.
+     *
+     * The constructor unpins the calling worker and the destructor pins it
+     * again. Must be used in the thread of the worker.
+     */
+    class Unpinned
+    {
+        Unpinned(const Unpinned&);
+        Unpinned& operator=(const Unpinned&);
+
+    public:
+        Unpinned(RoutingWorker* pWorker)
+            : m_pWorker(pWorker)
+        {
+            mxb_assert(pWorker == RoutingWorker::get_current());
+
+            if (m_pWorker->m_cpu != -1)
+            {
+                mxb::Worker::reset_affinity();
+            }
+        }
+
+        ~Unpinned()
+        {
+            if (m_pWorker->m_cpu != -1)
+            {
+                m_pWorker->pin();
+            }
+        }
+
+    private:
+        RoutingWorker* m_pWorker;
+    };
+
 private:
     class WatchdogNotifier;
     friend WatchdogNotifier;
@@ -496,9 +609,15 @@ private:
                                      *  it's up to the protocol to decide whether a new
                                      *  session is added to the map. */
     Zombies      m_zombies;         /*< DCBs to be deleted. */
+    int          m_cpu;             /*< The CPU the worker is pinned to, or -1. */
+    int          m_numa_node;       /*< The NUMA node of m_cpu, or -1. */
     LocalData    m_local_data;      /*< Data local to this worker */
     DataDeleters m_data_deleters;   /*< Delete functions for the local data */
 
+    std::unique_ptr<mxb::Profiler> m_sProfiler;    /*< The profiler, if the worker has been profiled. */
+    int          m_move_to;         /*< Worker idle sessions are moved to at the end of the cycle, or -1. */
+    int          m_move_percent;    /*< Share of the sessions to move. */
+
     RoutingWorker();
     virtual ~RoutingWorker();
 
@@ -509,6 +628,9 @@ private:
     void epoll_tick();  // override
 
     void delete_zombies();
+    void apply_placement();
+    bool pin();
+    void update_profiler(int frequency);
     void check_systemd_watchdog();
     void start_watchdog_workaround();
     void stop_watchdog_workaround();
@@ -654,4 +654,14 @@ uint64_t get_byteN(const uint8_t* ptr, int bytes);
  * @return The next byte after the stored value
  */
 uint8_t* set_byteN(uint8_t* ptr, uint64_t value, int bytes);
+
+/**
+ * Parse a list of CPUs given in the format used by the kernel, e.g. "0-3,8,10-11".
+ *
+ * @param zList  The list to parse.
+ * @param pCpus  On success, the CPUs in the order they appear in the list.
+ *
+ * @return True, if the list was valid.
+ */
+bool parse_cpu_list(const char* zList, std::vector<int>* pCpus);
 }
@@ -43,7 +43,8 @@ const maxscale_params = [
     'query_retries',
     'query_retry_timeout',
     'retain_last_statements',
-    'dump_last_statements'
+    'dump_last_statements',
+    'profiler_frequency'
 ]
 
 function setFilters(host, argv){
@@ -26,6 +26,15 @@ exports.builder = function(yargs) {
                 return doRequest(host, target, null, {method: 'PUT'})
             })
         })
+        .command('profile', 'Clear the profile of the worker threads', function(yargs) {
+            return yargs.epilog('This command discards the stacks sampled so far. If profiling ' +
+                                'is enabled, sampling continues.')
+                .usage('Usage: clear profile')
+        }, function(argv) {
+            maxctrl(argv, function(host) {
+                return doRequest(host, 'maxscale/profile', null, {method: 'DELETE'})
+            })
+        })
         .usage('Usage: clear <command>')
         .help()
         .command('*', 'the default command', {}, function(argv) {
@@ -266,6 +266,19 @@ exports.builder = function(yargs) {
                 ])
             })
         })
+        .command('profile', 'Show the profile of the worker threads', function(yargs) {
+            return yargs.epilog('The sampled stacks of all worker threads are printed in the ' +
+                                'folded format that flame graph tools, e.g. flamegraph.pl, ' +
+                                'take as input. Profiling is enabled with the ' +
+                                '`profiler_frequency` parameter, see `help alter maxscale`.')
+                .usage('Usage: show profile')
+        }, function(argv) {
+            maxctrl(argv, function(host) {
+                return doRequest(host, 'maxscale/profile', (res) => {
+                    return res.data.attributes.folded
+                })
+            })
+        })
         .command('commands <module>', 'Show module commands of a module', function(yargs) {
             return yargs.epilog('This command shows the parameters the command expects with ' +
                                 'the parameter descriptions.')
@@ -21,6 +21,7 @@ var tests = [
     'show logging',
     'show threads',
     'show thread 0',
+    'show profile',
     'show server server1',
     'show service RW-Split-Router',
     'show monitor MariaDB-Monitor',
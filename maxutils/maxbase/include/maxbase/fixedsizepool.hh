@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#pragma once
+
+#include <maxbase/ccdefs.hh>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace maxbase
+{
+
+/**
+ * @class FixedSizePool
+ *
+ * A pool of equally sized blocks of memory. The blocks are allocated in chunks
+ * and a released block is kept on a free list from where it is handed out again,
+ * so once the pool has grown to its working size no more heap allocations are
+ * made. Memory is returned to the heap only when the pool is destroyed.
+ *
+ * The pool is not thread safe; it is intended to be owned by one worker.
+ */
+template<size_t SIZE, size_t N_BLOCKS_PER_CHUNK = 64>
+class FixedSizePool
+{
+public:
+    FixedSizePool(const FixedSizePool&) = delete;
+    FixedSizePool& operator=(const FixedSizePool&) = delete;
+
+    enum
+    {
+        BLOCK_SIZE = SIZE
+    };
+
+    FixedSizePool()
+        : m_pFree(nullptr)
+    {
+    }
+
+    /**
+     * Allocate a block.
+     *
+     * @return A block of at least @c SIZE bytes, suitably aligned for any type.
+     */
+    void* allocate()
+    {
+        if (!m_pFree)
+        {
+            grow();
+        }
+
+        Block* pBlock = m_pFree;
+        m_pFree = pBlock->pNext;
+
+        return pBlock;
+    }
+
+    /**
+     * Return a block to the pool.
+     *
+     * @param pBlock  A block obtained from @c allocate of this pool.
+     */
+    void deallocate(void* pBlock)
+    {
+        Block* p = static_cast<Block*>(pBlock);
+        p->pNext = m_pFree;
+        m_pFree = p;
+    }
+
+private:
+    union Block
+    {
+        Block*                                                          pNext;
+        typename std::aligned_storage<SIZE, alignof(max_align_t)>::type storage;
+    };
+
+    void grow()
+    {
+        std::unique_ptr<Block[]> sChunk(new Block[N_BLOCKS_PER_CHUNK]);
+
+        for (size_t i = 0; i < N_BLOCKS_PER_CHUNK; ++i)
+        {
+            sChunk[i].pNext = m_pFree;
+            m_pFree = &sChunk[i];
+        }
+
+        m_chunks.push_back(std::move(sChunk));
+    }
+
+    Block*                                m_pFree;
+    std::vector<std::unique_ptr<Block[]>> m_chunks;
+};
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#pragma once
+
+#include <maxbase/ccdefs.hh>
+#include <stdint.h>
+#include <array>
+
+namespace maxbase
+{
+
+/**
+ * @class Histogram
+ *
+ * A histogram of durations with logarithmic buckets. Bucket 0 counts durations
+ * shorter than one microsecond and bucket N, N > 0, durations of at least
+ * 2^(N-1) but less than 2^N microseconds. The last bucket also counts all
+ * durations longer than that.
+ *
+ * Adding a duration is a couple of instructions, so a histogram can be updated
+ * for every event a worker handles. The histogram is not thread safe.
+ */
+class Histogram
+{
+public:
+    enum
+    {
+        N_BUCKETS = 25      // The last bucket starts at 2^23us, that is, about 8 seconds.
+    };
+
+    /**
+     * Add a duration.
+     *
+     * @param ns  The duration in nanoseconds.
+     */
+    void add(int64_t ns)
+    {
+        uint64_t us = ns > 0 ? ns / 1000 : 0;
+        int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+
+        ++m_buckets[bucket < N_BUCKETS ? bucket : N_BUCKETS - 1];
+        ++m_count;
+        m_total += ns;
+
+        if (ns > m_max)
+        {
+            m_max = ns;
+        }
+    }
+
+    /**
+     * @return The number of durations added.
+     */
+    uint64_t count() const
+    {
+        return m_count;
+    }
+
+    /**
+     * @return The sum of the durations, in nanoseconds.
+     */
+    int64_t total() const
+    {
+        return m_total;
+    }
+
+    /**
+     * @return The longest duration, in nanoseconds.
+     */
+    int64_t max() const
+    {
+        return m_max;
+    }
+
+    /**
+     * @return The number of durations in a bucket.
+     */
+    uint64_t bucket(int i) const
+    {
+        return m_buckets[i];
+    }
+
+    /**
+     * @return The exclusive upper limit of a bucket in microseconds, or -1 for the last one.
+     */
+    static int64_t bucket_limit(int i)
+    {
+        return i < N_BUCKETS - 1 ? int64_t(1) << i : -1;
+    }
+
+    /**
+     * Estimate a percentile.
+     *
+     * @param fraction  The percentile as a fraction, e.g. 0.99.
+     *
+     * @return The upper limit, in microseconds, of the bucket the percentile falls
+     *         into. For the last bucket, the longest duration is returned.
+     */
+    int64_t percentile(double fraction) const
+    {
+        uint64_t target = fraction * m_count;
+        uint64_t n = 0;
+
+        for (int i = 0; i < N_BUCKETS - 1; ++i)
+        {
+            n += m_buckets[i];
+
+            if (n > target)
+            {
+                return bucket_limit(i);
+            }
+        }
+
+        return m_max / 1000;
+    }
+
+private:
+    std::array<uint64_t, N_BUCKETS> m_buckets {};
+    uint64_t                        m_count = 0;
+    int64_t                         m_total = 0;
+    int64_t                         m_max = 0;
+};
+}
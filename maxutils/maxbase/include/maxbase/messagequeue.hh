@@ -13,6 +13,7 @@
 #pragma once
 
 #include <maxbase/ccdefs.hh>
+#include <atomic>
 #include <maxbase/poll.hh>
 
 namespace maxbase
@@ -104,8 +105,23 @@ public:
 
 
 /**
- * The class @c MessageQueue provides a cross thread message queue implemented
- * on top of a pipe.
+ * The class @c MessageQueue provides a cross thread message queue. Any thread
+ * may post messages to it, but the messages are handled by the worker the queue
+ * has been added to.
+ *
+ * The messages are stored in a bounded lock-free ring. The worker is woken up
+ * using an eventfd, but only if it has emptied the queue and is not going to
+ * look at it again without being woken up. When woken up, the worker handles
+ * the messages in batches, so that a busy queue does not starve the other
+ * descriptors of the worker.
+ *
+ * Posting never blocks. While the ring has room, posting does not allocate
+ * memory. If the ring is full, the message is allocated from the heap and
+ * pushed to a lock-free overflow list that has no bound, so a worker posting
+ * to its own queue, or two workers posting to each other, can neither deadlock
+ * nor fail. Until the worker has taken the overflow list, later messages go
+ * to the list as well, so that the messages of one thread are handled in the
+ * order they were posted.
  */
 class MessageQueue : private mxb::PollData
 {
@@ -116,6 +132,12 @@ public:
     typedef MessageQueueHandler Handler;
     typedef MessageQueueMessage Message;
 
+    enum
+    {
+        CAPACITY   = 16384, /*< How many messages the ring can hold, a power of 2. */
+        BATCH_SIZE = 256    /*< How many messages are handled per wakeup. */
+    };
+
     /**
      * Creates a @c MessageQueue with the provided handler.
      *
@@ -133,7 +155,7 @@ public:
     /**
      * Destructor
      *
-     * Removes itself If still added to a worker and closes the pipe.
+     * Removes itself If still added to a worker and closes the eventfd.
      */
     ~MessageQueue();
 
@@ -150,6 +172,11 @@ public:
      *
      * @attention Note that the message queue must have been added to a worker
      *            before a message can be posted.
+     *
+     * @attention The function does not block and only fails if memory cannot
+     *            be allocated. It is signal safe while the ring has room; if the
+     *            ring is full, the message is allocated from the heap, which is
+     *            not signal safe.
      */
     bool post(const Message& message) const;
 
@@ -181,7 +208,29 @@ private:
     static void finish();
 
 private:
-    MessageQueue(Handler* pHandler, int read_fd, int write_fd);
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;      /*< Position the slot is ready for, see try_enqueue(). */
+        Message               message;
+    };
+
+    struct Node
+    {
+        Message message;
+        Node*   pNext;
+    };
+
+    MessageQueue(Handler* pHandler, int event_fd, Slot* pSlots);
+
+    bool try_enqueue(const Message& message) const;
+    bool try_dequeue(Message* pMessage);
+    bool empty() const;
+    bool push_overflow(const Message& message) const;
+    bool take_overflow();
+    void ring_doorbell() const;
+    int  handle_messages(int max);
+
+    static void delete_nodes(Node* pNode);
 
     uint32_t handle_poll_events(Worker* pWorker, uint32_t events);
 
@@ -189,8 +238,15 @@ private:
 
 private:
     Handler& m_handler;
-    int      m_read_fd;
-    int      m_write_fd;
+    int      m_event_fd;        /*< The doorbell. */
     Worker*  m_pWorker;
+    Slot*    m_pSlots;          /*< The ring of CAPACITY slots. */
+    Node*    m_pPending;        /*< Overflow taken by the worker, oldest first, used by the worker only. */
+    uint64_t m_head;            /*< Next position to handle, used by the worker only. */
+
+    // Written by the posting threads, kept apart from the fields of the worker.
+    alignas(64) mutable std::atomic<uint64_t> m_tail;       /*< Next position to post to. */
+    alignas(64) mutable std::atomic<Node*>    m_overflow;   /*< Posted when the ring was full, newest first. */
+    alignas(64) mutable std::atomic<bool>     m_sleeping;   /*< Must the doorbell be rung. */
 };
 }
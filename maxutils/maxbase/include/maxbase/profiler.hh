@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#pragma once
+
+#include <maxbase/ccdefs.hh>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace maxbase
+{
+
+/**
+ * @class Profiler
+ *
+ * A sampling profiler for one thread. A timer measuring the CPU time of the
+ * thread delivers SIGPROF at the requested frequency and the signal handler
+ * records the stack of the thread into a ring buffer. The stack is unwound by
+ * following the frame pointers, which is async-signal-safe, so it is complete
+ * only for code that is built with frame pointers. The thread itself drains
+ * the ring into an aggregate of distinct stacks, so no locks are needed and an
+ * idle thread is not sampled at all.
+ *
+ * All functions, except @c n_samples and @c n_dropped, must be called in the
+ * thread being profiled.
+ */
+class Profiler
+{
+public:
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    enum
+    {
+        MAX_DEPTH     = 64,     // The maximum number of frames recorded.
+        N_SAMPLES     = 256,    // The capacity of the ring buffer.
+        MAX_STACKS    = 10000,  // The maximum number of distinct stacks kept.
+        MAX_FREQUENCY = 1000    // The maximum sampling frequency.
+    };
+
+    /** A stack, innermost frame first. An empty stack stands for all stacks over the limit. */
+    typedef std::vector<void*>          Stack;
+    typedef std::map<Stack, uint64_t>   Stacks;
+
+    Profiler();
+    ~Profiler();
+
+    /**
+     * Start sampling the calling thread. If the profiler is already running,
+     * the frequency is changed.
+     *
+     * @param frequency  Samples per second of CPU time, at most @c MAX_FREQUENCY.
+     *
+     * @return True, if the profiler could be started.
+     */
+    bool start(int frequency);
+
+    /**
+     * Stop sampling. The collected stacks are retained.
+     */
+    void stop();
+
+    /**
+     * @return The sampling frequency, or 0 if the profiler is not running.
+     */
+    int frequency() const
+    {
+        return m_frequency;
+    }
+
+    /**
+     * Move the samples in the ring buffer to the aggregated stacks. Should be
+     * called regularly, so that the ring does not fill up.
+     */
+    void collect();
+
+    /**
+     * @return The aggregated stacks.
+     */
+    const Stacks& stacks() const
+    {
+        return m_stacks;
+    }
+
+    /**
+     * Discard the aggregated stacks.
+     */
+    void reset();
+
+    /**
+     * @return The number of samples taken.
+     */
+    uint64_t n_samples() const
+    {
+        return m_head.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return The number of samples dropped because the ring buffer was full.
+     */
+    uint64_t n_dropped() const
+    {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Add stacks to others.
+     *
+     * @param pInto  The stacks to add to.
+     * @param from   The stacks to add.
+     */
+    static void merge(Stacks* pInto, const Stacks& from);
+
+    /**
+     * Format stacks in the folded format used by flame graph tools: one line per
+     * stack, outermost function first, the functions separated by semicolons and
+     * followed by the number of samples.
+     *
+     * @param stacks  The stacks.
+     *
+     * @return The stacks in folded format.
+     */
+    static std::string to_folded(const Stacks& stacks);
+
+private:
+    struct Sample
+    {
+        int   depth;
+        void* frames[MAX_DEPTH];    // The interrupted instruction and the return addresses.
+    };
+
+    static void signal_handler(int signo, siginfo_t* pInfo, void* pContext);
+
+    void sample(void* pContext);
+
+    int                   m_frequency;
+    bool                  m_timer_created;
+    timer_t               m_timer;
+    uintptr_t             m_stack_lo;           // The stack of the thread, for the unwinder.
+    uintptr_t             m_stack_hi;
+    std::atomic<uint64_t> m_head;               // Written by the signal handler.
+    std::atomic<uint64_t> m_tail;               // Written by collect().
+    std::atomic<uint64_t> m_dropped;
+    Sample                m_samples[N_SAMPLES];
+    Stacks                m_stacks;
+};
+}
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#pragma once
+
+#include <maxbase/ccdefs.hh>
+#include <stdint.h>
+#include <maxbase/assert.h>
+
+namespace maxbase
+{
+
+/**
+ * @class TimerWheel
+ *
+ * A hierarchical timing wheel. Time is divided into ticks of a fixed length and
+ * the wheel consists of levels of 64 slots, where a slot on level N covers 64^N
+ * ticks. An entry is placed on the lowest level whose range reaches its expiry
+ * time, and when the wheel turns, the entries of a slot on a higher level are
+ * redistributed to the lower levels. Scheduling and cancelling an entry are O(1)
+ * operations and all entries expiring within the same tick are handled as one
+ * batch.
+ *
+ * The entries are intrusive, that is, the object to be scheduled derives from
+ * @c TimerWheel::Entry, so the wheel itself never allocates memory.
+ *
+ * The wheel does not have a clock of its own; the time units are whatever the
+ * user passes to @c schedule and @c advance, the only requirement being that the
+ * time never decreases. The wheel is not thread safe.
+ */
+class TimerWheel
+{
+public:
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    class Entry
+    {
+    public:
+        Entry(const Entry&) = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        Entry()
+            : m_pNext(nullptr)
+            , m_ppPrev(nullptr)
+            , m_tick(0)
+            , m_level(0)
+            , m_slot(0)
+        {
+        }
+
+        ~Entry()
+        {
+            mxb_assert(!scheduled());
+        }
+
+        /**
+         * @return True, if the entry is currently in a wheel.
+         */
+        bool scheduled() const
+        {
+            return m_ppPrev != nullptr;
+        }
+
+    private:
+        friend class TimerWheel;
+
+        Entry*  m_pNext;    // The next entry in the same slot.
+        Entry** m_ppPrev;   // The pointer pointing to this entry.
+        int64_t m_tick;     // The tick at which the entry expires.
+        uint8_t m_level;    // The level of the slot the entry is in.
+        uint8_t m_slot;     // The slot the entry is in.
+    };
+
+    enum
+    {
+        LEVEL_BITS = 6,
+        N_SLOTS    = 1 << LEVEL_BITS,
+        N_LEVELS   = 6
+    };
+
+    /**
+     * Constructor
+     *
+     * @param tick  The length of a tick; the granularity with which entries
+     *              are expired.
+     * @param now   The current time.
+     */
+    explicit TimerWheel(int64_t tick, int64_t now = 0);
+
+    /**
+     * @return The length of a tick.
+     */
+    int64_t tick() const
+    {
+        return m_tick;
+    }
+
+    /**
+     * @return The number of scheduled entries.
+     */
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * @return True, if no entries are scheduled.
+     */
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    /**
+     * Schedule an entry. If the entry already is scheduled, it is rescheduled.
+     *
+     * @param pEntry  The entry to schedule.
+     * @param at      The time at which the entry should expire. It expires at
+     *                the first tick boundary at or after that time, or at the
+     *                next tick, if the time already has passed.
+     */
+    void schedule(Entry* pEntry, int64_t at);
+
+    /**
+     * Cancel an entry. Cancelling an entry that is not scheduled is allowed.
+     *
+     * @param pEntry  The entry to cancel.
+     */
+    void cancel(Entry* pEntry)
+    {
+        if (pEntry->scheduled())
+        {
+            unlink(pEntry);
+        }
+    }
+
+    /**
+     * The time at which @c advance next needs to be called. This is either the
+     * expiry time of an entry or the time at which entries on a higher level
+     * are redistributed.
+     *
+     * @return The time, or -1 if no entries are scheduled.
+     */
+    int64_t next_expiry() const
+    {
+        int64_t tick = next_tick();
+
+        return tick == INT64_MAX ? -1 : tick * m_tick;
+    }
+
+    /**
+     * Turn the wheel up to the current time and expire all entries whose time
+     * has come. An entry is removed from the wheel before @c expire is called,
+     * so the function may schedule it again, schedule and cancel other entries
+     * or free the entry.
+     *
+     * @param now     The current time.
+     * @param expire  Function, invoked as `expire(Entry*)`.
+     */
+    template<class Expire>
+    void advance(int64_t now, Expire expire)
+    {
+        int64_t target = now / m_tick;
+
+        while (m_current < target)
+        {
+            int64_t next = next_tick();
+
+            if (next > target)
+            {
+                m_current = target;
+                break;
+            }
+
+            m_current = next;
+            cascade();
+
+            Entry*& pHead = m_slots[0][m_current & (N_SLOTS - 1)];
+
+            while (pHead)
+            {
+                Entry* pEntry = pHead;
+                unlink(pEntry);
+                expire(pEntry);
+            }
+        }
+    }
+
+private:
+    void    link(Entry* pEntry);
+    void    unlink(Entry* pEntry);
+    void    cascade();
+    int64_t next_tick() const;
+
+    int64_t  m_tick;                        // The length of a tick.
+    int64_t  m_current;                     // The last tick that has been handled.
+    size_t   m_size;                        // The number of scheduled entries.
+    uint64_t m_occupied[N_LEVELS];          // Bitmap per level of the non-empty slots.
+    Entry*   m_slots[N_LEVELS][N_SLOTS];    // The slots.
+};
+}
@@ -17,16 +17,18 @@
 #include <array>
 #include <cstring>
 #include <functional>
-#include <map>
 #include <memory>
 #include <thread>
-#include <unordered_map>
+#include <vector>
 
 #include <maxbase/assert.h>
 #include <maxbase/atomic.h>
 #include <maxbase/average.hh>
+#include <maxbase/fixedsizepool.hh>
+#include <maxbase/histogram.hh>
 #include <maxbase/messagequeue.hh>
 #include <maxbase/semaphore.hh>
+#include <maxbase/timerwheel.hh>
 #include <maxbase/worker.h>
 #include <maxbase/workertask.hh>
 
@@ -41,6 +43,19 @@ struct WORKER_STATISTICS
         N_QUEUE_TIMES = 30
     };
 
+    /**
+     * The stages of the event loop the time of a worker is divided into.
+     */
+    enum stage_t
+    {
+        STAGE_WAIT,             /*< Waiting in epoll_wait() */
+        STAGE_EVENTS,           /*< Handling descriptor events */
+        STAGE_DELAYED_CALLS,    /*< Invoking delayed calls and other timers */
+        STAGE_MESSAGES,         /*< Handling messages posted to the worker */
+        STAGE_TICK,             /*< The per loop processing of the worker */
+        N_STAGES
+    };
+
     int64_t n_read = 0;         /*< Number of read events   */
     int64_t n_write = 0;        /*< Number of write events  */
     int64_t n_error = 0;        /*< Number of error events  */
@@ -55,6 +70,9 @@ struct WORKER_STATISTICS
     std::array<int64_t, MAXNFDS>            n_fds {};   /*< Number of wakeups with particular n_fds value */
     std::array<uint32_t, N_QUEUE_TIMES + 1> qtimes {};
     std::array<uint32_t, N_QUEUE_TIMES + 1> exectimes {};
+    std::array<int64_t, N_STAGES>           stage_time {};  /*< Time spent in each stage, in nanoseconds */
+    Histogram                               event_time;     /*< Time it takes to handle an event */
+    Histogram                               event_latency;  /*< Time an event waits before it is handled */
 };
 
 /**
@@ -430,7 +448,7 @@ public:
      * @attention A call to this function will only initiate the shutdowm,
      *            the worker will not have shut down when the function returns.
      *
-     * @attention This function is signal safe.
+     * @attention This function is signal safe, see @c post_message().
      */
     void shutdown();
 
@@ -540,7 +558,8 @@ public:
      * @attention The return value tells *only* whether the message could be sent,
      *            *not* that it has reached the worker.
      *
-     * @attention This function is signal safe.
+     * @attention This function is signal safe, unless the message queue of
+     *            the worker is full, see @c MessageQueue::post().
      */
     bool post_message(uint32_t msg_id, intptr_t arg1, intptr_t arg2);
 
@@ -551,6 +570,15 @@ public:
      */
     static Worker* get_current();
 
+    /**
+     * Let the calling thread run on all the CPUs the process was allowed to run
+     * on when the workers were initialized. A thread inherits the CPU affinity
+     * of the thread that creates it, so the threads of the workers call this
+     * before @c pre_run, in case they were started by a thread that is pinned
+     * to a CPU.
+     */
+    static void reset_affinity();
+
     /**
      * Push a function for delayed execution.
      *
@@ -572,7 +600,7 @@ public:
      */
     uint32_t delayed_call(int32_t delay, bool (* pFunction)(Worker::Call::action_t action))
     {
-        return add_delayed_call(new DelayedCallFunctionVoid(delay, next_delayed_call_id(), pFunction));
+        return create_delayed_call<DelayedCallFunctionVoid>(delay, pFunction);
     }
 
     /**
@@ -600,7 +628,7 @@ public:
                           bool (* pFunction)(Worker::Call::action_t action, D data),
                           D data)
     {
-        return add_delayed_call(new DelayedCallFunction<D>(delay, next_delayed_call_id(), pFunction, data));
+        return create_delayed_call<DelayedCallFunction<D>>(delay, pFunction, data);
     }
 
     /**
@@ -627,7 +655,7 @@ public:
                           bool (T::* pMethod)(Worker::Call::action_t action),
                           T* pT)
     {
-        return add_delayed_call(new DelayedCallMethodVoid<T>(delay, next_delayed_call_id(), pMethod, pT));
+        return create_delayed_call<DelayedCallMethodVoid<T>>(delay, pMethod, pT);
     }
 
     /**
@@ -656,11 +684,7 @@ public:
                           T* pT,
                           D data)
     {
-        return add_delayed_call(new DelayedCallMethod<T, D>(delay,
-                                                            next_delayed_call_id(),
-                                                            pMethod,
-                                                            pT,
-                                                            data));
+        return create_delayed_call<DelayedCallMethod<T, D>>(delay, pMethod, pT, data);
     }
 
     /**
@@ -730,19 +754,29 @@ private:
     static bool init();
     static void finish();
 
+    friend class MessageQueue;
+    friend class WorkerTimer;
+
 private:
     class DelayedCall;
     friend class DelayedCall;
 
-    uint32_t next_delayed_call_id()
-    {
-        // Called in single-thread context. Wrapping does not matter
-        // as it is unlikely there would be 4 billion pending delayed
-        // calls.
-        return ++m_next_delayed_call_id;
-    }
+    /**
+     * The delayed calls are allocated from a pool of blocks of this size.
+     * A call with a larger data argument does not compile.
+     */
+    static const size_t DELAYED_CALL_SIZE = 128;
 
-    class DelayedCall
+    /**
+     * A delayed call id consists of the index of the slot where the call is
+     * stored, and of a generation number that is incremented whenever the slot
+     * is reused, so that a stale id does not match a later call.
+     */
+    static const int      DELAYED_CALL_INDEX_BITS = 22;
+    static const uint32_t DELAYED_CALL_INDEX_MASK = (1 << DELAYED_CALL_INDEX_BITS) - 1;
+    static const uint32_t DELAYED_CALL_MAX_GENERATION = (1 << (32 - DELAYED_CALL_INDEX_BITS)) - 1;
+
+    class DelayedCall : public TimerWheel::Entry
     {
         DelayedCall(const DelayedCall&) = delete;
         DelayedCall& operator=(const DelayedCall&) = delete;
@@ -762,6 +796,11 @@ private:
             return m_id;
         }
 
+        void set_id(uint32_t id)
+        {
+            m_id = id;
+        }
+
         int64_t at() const
         {
             return m_at;
@@ -779,8 +818,8 @@ private:
         }
 
     protected:
-        DelayedCall(int32_t delay, int32_t id)
-            : m_id(id)
+        DelayedCall(int32_t delay)
+            : m_id(0)
             , m_delay(delay)
             , m_at(get_at(delay))
         {
@@ -815,10 +854,9 @@ private:
 
     public:
         DelayedCallFunction(int32_t delay,
-                            int32_t id,
                             bool (*pFunction)(Worker::Call::action_t action, D data),
                             D data)
-            : DelayedCall(delay, id)
+            : DelayedCall(delay)
             , m_pFunction(pFunction)
             , m_data(data)
         {
@@ -843,9 +881,8 @@ private:
 
     public:
         DelayedCallFunctionVoid(int32_t delay,
-                                int32_t id,
                                 bool (*pFunction)(Worker::Call::action_t action))
-            : DelayedCall(delay, id)
+            : DelayedCall(delay)
             , m_pFunction(pFunction)
         {
         }
@@ -868,11 +905,10 @@ private:
 
     public:
         DelayedCallMethod(int32_t delay,
-                          int32_t id,
                           bool (T::* pMethod)(Worker::Call::action_t action, D data),
                           T* pT,
                           D data)
-            : DelayedCall(delay, id)
+            : DelayedCall(delay)
             , m_pMethod(pMethod)
             , m_pT(pT)
             , m_data(data)
@@ -899,10 +935,9 @@ private:
 
     public:
         DelayedCallMethodVoid(int32_t delay,
-                              int32_t id,
                               bool (T::* pMethod)(Worker::Call::action_t),
                               T* pT)
-            : DelayedCall(delay, id)
+            : DelayedCall(delay)
             , m_pMethod(pMethod)
             , m_pT(pT)
         {
@@ -919,7 +954,15 @@ private:
         T* m_pT;
     };
 
+    template<class C, class ... Args>
+    uint32_t create_delayed_call(Args ... args)
+    {
+        static_assert(sizeof(C) <= DELAYED_CALL_SIZE, "A delayed call must fit in a pool block.");
+        return add_delayed_call(new(m_call_pool.allocate())C(args ...));
+    }
+
     uint32_t add_delayed_call(DelayedCall* pDelayed_call);
+    void     destroy_delayed_call(DelayedCall* pDelayed_call);
     void     adjust_timer();
 
     void handle_message(MessageQueue& queue, const MessageQueue::Message& msg);     // override
@@ -930,20 +973,12 @@ private:
 
     void tick();
 private:
-    class LaterAt : public std::binary_function<const DelayedCall*, const DelayedCall*, bool>
-    {
-    public:
-        bool operator()(const DelayedCall* pLhs, const DelayedCall* pRhs)
-        {
-            return pLhs->at() > pRhs->at();
-        }
-    };
-
     void run(mxb::Semaphore* pSem);
 
-    typedef DelegatingTimer<Worker>                    PrivateTimer;
-    typedef std::multimap<int64_t, DelayedCall*>       DelayedCallsByTime;
-    typedef std::unordered_map<uint32_t, DelayedCall*> DelayedCallsById;
+    typedef DelegatingTimer<Worker>            PrivateTimer;
+    typedef FixedSizePool<DELAYED_CALL_SIZE>   DelayedCallPool;
+    typedef std::vector<uint32_t>              DelayedCallIds;
+    typedef std::vector<DelayedCall*>          DelayedCalls;
 
     uint32_t           m_max_events;            /*< Maximum numer of events in each epoll_wait call. */
     STATISTICS         m_statistics;            /*< Worker statistics. */
@@ -956,9 +991,14 @@ private:
     uint64_t           m_nTotal_descriptors;    /*< Total number of descriptors. */
     Load               m_load;                  /*< The worker load. */
     PrivateTimer*      m_pTimer;                /*< The worker's own timer. */
-    DelayedCallsByTime m_sorted_calls;          /*< Current delayed calls sorted by time. */
-    DelayedCallsById   m_calls;                 /*< Current delayed calls indexed by id. */
-
-    int32_t m_next_delayed_call_id;     /*< The next delayed call id. */
+    int64_t            m_timer_at;              /*< When the timer expires, -1 if it is not running. */
+    TimerWheel         m_wheel;                 /*< Current delayed calls by time. */
+    DelayedCallPool    m_call_pool;             /*< Where the delayed calls are allocated from. */
+    DelayedCallIds     m_call_ids;              /*< The id last used in each slot. */
+    DelayedCalls       m_calls;                 /*< Current delayed calls indexed by slot. */
+    DelayedCallIds     m_free_call_slots;       /*< The unused slots. */
+    DelayedCalls       m_repeating_calls;       /*< Calls to be rescheduled after a tick. */
+
+    STATISTICS::stage_t m_event_stage;  /*< The stage the event being handled is accounted to. */
 };
 }
@@ -13,10 +13,9 @@
 
 #include <maxbase/messagequeue.hh>
 #include <errno.h>
-#include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
-#include <fstream>
+#include <sys/eventfd.h>
 #include <maxbase/assert.h>
 #include <maxbase/log.h>
 #include <maxbase/string.h>
@@ -28,50 +27,48 @@ namespace
 static struct
 {
     bool initialized;
-    int  pipe_max_size;
 } this_unit =
 {
     false
 };
-
-int get_pipe_max_size()
-{
-    int size = 65536;   // Default value from pipe(7)
-    std::ifstream file("/proc/sys/fs/pipe-max-size");
-
-    if (file.good())
-    {
-        file >> size;
-    }
-
-    return size;
-}
 }
 
 namespace maxbase
 {
 
-MessageQueue::MessageQueue(Handler* pHandler, int read_fd, int write_fd)
+MessageQueue::MessageQueue(Handler* pHandler, int event_fd, Slot* pSlots)
     : mxb::PollData(&MessageQueue::poll_handler)
     , m_handler(*pHandler)
-    , m_read_fd(read_fd)
-    , m_write_fd(write_fd)
+    , m_event_fd(event_fd)
     , m_pWorker(NULL)
+    , m_pSlots(pSlots)
+    , m_pPending(NULL)
+    , m_head(0)
+    , m_tail(0)
+    , m_overflow(NULL)
+    , m_sleeping(true)
 {
     mxb_assert(pHandler);
-    mxb_assert(read_fd);
-    mxb_assert(write_fd);
+    mxb_assert(event_fd);
+    mxb_assert(pSlots);
+
+    for (uint64_t i = 0; i < CAPACITY; ++i)
+    {
+        m_pSlots[i].seq.store(i, std::memory_order_relaxed);
+    }
 }
 
 MessageQueue::~MessageQueue()
 {
     if (m_pWorker)
     {
-        m_pWorker->remove_fd(m_read_fd);
+        m_pWorker->remove_fd(m_event_fd);
     }
 
-    close(m_read_fd);
-    close(m_write_fd);
+    close(m_event_fd);
+    delete[] m_pSlots;
+    delete_nodes(m_pPending);
+    delete_nodes(m_overflow.load(std::memory_order_acquire));
 }
 
 // static
@@ -80,7 +77,6 @@ bool MessageQueue::init()
     mxb_assert(!this_unit.initialized);
 
     this_unit.initialized = true;
-    this_unit.pipe_max_size = get_pipe_max_size();
 
     return this_unit.initialized;
 }
@@ -96,79 +92,169 @@ void MessageQueue::finish()
 MessageQueue* MessageQueue::create(Handler* pHandler)
 {
     mxb_assert(this_unit.initialized);
-
-    /* From "man 7 pipe"
-     * ----
-     *
-     * O_NONBLOCK enabled, n <= PIPE_BUF
-     *   If  there  is room to write n bytes to the pipe, then write(2)
-     *   succeeds immediately, writing all n bytes; otherwise write(2)
-     *   fails, with errno set to EAGAIN.
-     *
-     * ... (On Linux, PIPE_BUF is 4096 bytes.)
-     *
-     * ----
-     *
-     * As O_NONBLOCK is set and the messages are less than 4096 bytes,
-     * O_DIRECT should not be needed and we should be safe without it.
-     *
-     * However, to be in the safe side, we first try whether it is supported,
-     * and if not, we create the pipe without O_DIRECT.
-     */
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "The capacity must be a power of 2.");
 
     MessageQueue* pThis = NULL;
 
-    int fds[2];
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 
-    int rv = pipe2(fds, O_NONBLOCK | O_CLOEXEC | O_DIRECT);
-
-    if ((rv != 0) && (errno == EINVAL))
+    if (fd != -1)
     {
-        // Ok, apparently the kernel does not support O_DIRECT. Let's try without.
-        rv = pipe2(fds, O_NONBLOCK | O_CLOEXEC);
-
-        if (rv == 0)
-        {
-            // Succeeded, so apparently it was the missing support for O_DIRECT.
-            MXB_WARNING("Platform does not support O_DIRECT in conjunction with pipes, "
-                        "using without.");
-        }
-    }
+        Slot* pSlots = new(std::nothrow) Slot[CAPACITY];
 
-    if (rv == 0)
-    {
-        int read_fd = fds[0];
-        int write_fd = fds[1];
-#ifdef F_SETPIPE_SZ
-        /**
-         * Increase the pipe buffer size on systems that support it. Modifying
-         * the buffer size of one fd will also increase it for the other.
-         */
-        if (fcntl(fds[0], F_SETPIPE_SZ, this_unit.pipe_max_size) == -1)
+        if (pSlots)
         {
-            MXB_WARNING("Failed to increase pipe buffer size to '%d': %d, %s",
-                        this_unit.pipe_max_size,
-                        errno,
-                        mxb_strerror(errno));
+            pThis = new(std::nothrow) MessageQueue(pHandler, fd, pSlots);
         }
-#endif
-        pThis = new(std::nothrow) MessageQueue(pHandler, read_fd, write_fd);
 
         if (!pThis)
         {
             MXB_OOM();
-            close(read_fd);
-            close(write_fd);
+            delete[] pSlots;
+            close(fd);
         }
     }
     else
     {
-        MXB_ERROR("Could not create pipe for worker: %s", mxb_strerror(errno));
+        MXB_ERROR("Could not create eventfd for worker: %s", mxb_strerror(errno));
     }
 
     return pThis;
 }
 
+/**
+ * The ring is a bounded multi-producer queue where each slot carries a sequence
+ * number. A slot at position pos is free when its sequence number is pos and
+ * contains a message when it is pos + 1. After the message has been handled,
+ * the sequence number is set to pos + CAPACITY, that is, to the position the
+ * slot will have on the next round.
+ */
+bool MessageQueue::try_enqueue(const Message& message) const
+{
+    uint64_t pos = m_tail.load(std::memory_order_relaxed);
+
+    while (true)
+    {
+        Slot& slot = m_pSlots[pos & (CAPACITY - 1)];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        int64_t diff = (int64_t)seq - (int64_t)pos;
+
+        if (diff == 0)
+        {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.message = message;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // The slot still contains the message from the previous round: full.
+            return false;
+        }
+        else
+        {
+            // Another thread got the slot.
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool MessageQueue::try_dequeue(Message* pMessage)
+{
+    Slot& slot = m_pSlots[m_head & (CAPACITY - 1)];
+
+    if (slot.seq.load(std::memory_order_acquire) != m_head + 1)
+    {
+        // Empty, or the message is still being written.
+        return false;
+    }
+
+    *pMessage = slot.message;
+    slot.seq.store(m_head + CAPACITY, std::memory_order_release);
+    ++m_head;
+
+    return true;
+}
+
+bool MessageQueue::empty() const
+{
+    return m_pPending == NULL
+           && m_pSlots[m_head & (CAPACITY - 1)].seq.load(std::memory_order_acquire) != m_head + 1
+           && m_overflow.load(std::memory_order_acquire) == NULL;
+}
+
+/**
+ * Pushes a message to the overflow list. The list is a lock-free stack, newest
+ * message first.
+ *
+ * @return False if the memory for the message could not be allocated.
+ */
+bool MessageQueue::push_overflow(const Message& message) const
+{
+    Node* pNode = new(std::nothrow) Node;
+
+    if (!pNode)
+    {
+        return false;
+    }
+
+    pNode->message = message;
+    pNode->pNext = m_overflow.load(std::memory_order_relaxed);
+
+    while (!m_overflow.compare_exchange_weak(pNode->pNext, pNode,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed))
+    {
+    }
+
+    return true;
+}
+
+/**
+ * Takes the messages of the overflow list to the pending list of the worker,
+ * oldest message first.
+ *
+ * @return True if there were messages.
+ */
+bool MessageQueue::take_overflow()
+{
+    mxb_assert(m_pPending == NULL);
+    Node* pNode = m_overflow.exchange(NULL, std::memory_order_acquire);
+
+    while (pNode)
+    {
+        Node* pNext = pNode->pNext;
+        pNode->pNext = m_pPending;
+        m_pPending = pNode;
+        pNode = pNext;
+    }
+
+    return m_pPending != NULL;
+}
+
+// static
+void MessageQueue::delete_nodes(Node* pNode)
+{
+    while (pNode)
+    {
+        Node* pNext = pNode->pNext;
+        delete pNode;
+        pNode = pNext;
+    }
+}
+
+void MessageQueue::ring_doorbell() const
+{
+    // NOTE: No logging here, this function must be signal safe.
+    uint64_t one = 1;
+    MXB_AT_DEBUG(ssize_t n = ) write(m_event_fd, &one, sizeof(one));
+    // Can only fail if the counter would overflow, in which case the
+    // worker has not yet been woken up by the earlier writes.
+    mxb_assert(n == sizeof(one) || errno == EAGAIN);
+}
+
 bool MessageQueue::post(const Message& message) const
 {
     // NOTE: No logging here, this function must be signal safe.
@@ -177,56 +263,29 @@ bool MessageQueue::post(const Message& message) const
     mxb_assert(m_pWorker);
     if (m_pWorker)
     {
-        /**
-         * This is a stopgap measure to solve MXS-1983 that causes Resource temporarily
-         * unavailable errors. The errors are caused by the pipe buffer being too small to
-         * hold all worker messages. By retrying a limited number of times before giving
-         * up, the success rate for posted messages under heavy load increases
-         * significantly.
-         */
-        int fast = 0;
-        int slow = 0;
-        const int fast_size = 100;
-        const int slow_limit = 3;
-        ssize_t n;
-
-        while (true)
+        // Once a message is in the overflow list, the following ones must also
+        // go there; the worker only takes the list when the ring is empty, so
+        // the messages of one thread are handled in the order they were posted.
+        if (m_overflow.load(std::memory_order_acquire) == NULL && try_enqueue(message))
         {
-            n = write(m_write_fd, &message, sizeof(message));
-            rv = (n == sizeof(message));
-
-            if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
-            {
-                if (++fast > fast_size)
-                {
-                    fast = 0;
-
-                    if (++slow >= slow_limit)
-                    {
-                        break;
-                    }
-                    else
-                    {
-                        sched_yield();
-                    }
-                }
-            }
-            else
-            {
-                break;
-            }
+            rv = true;
         }
-
-        if (n == -1)
+        else
         {
-            MXB_ERROR("Failed to write message: %d, %s", errno, mxb_strerror(errno));
+            // The ring is full. The worker may be waiting for this thread, so
+            // the message is stored instead of waiting for room.
+            rv = push_overflow(message);
+        }
 
-            static bool warn_pipe_buffer_size = true;
+        if (rv)
+        {
+            // The store to the slot must be visible before m_sleeping is read;
+            // handle_poll_events() does the opposite.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
 
-            if ((errno == EAGAIN || errno == EWOULDBLOCK) && warn_pipe_buffer_size)
+            if (m_sleeping.exchange(false))
             {
-                MXB_ERROR("Consider increasing pipe buffer size (sysctl fs.pipe-max-size)");
-                warn_pipe_buffer_size = false;
+                ring_doorbell();
             }
         }
     }
@@ -242,11 +301,11 @@ bool MessageQueue::add_to_worker(Worker* pWorker)
 {
     if (m_pWorker)
     {
-        m_pWorker->remove_fd(m_read_fd);
+        m_pWorker->remove_fd(m_event_fd);
         m_pWorker = NULL;
     }
 
-    if (pWorker->add_fd(m_read_fd, EPOLLIN, this))
+    if (pWorker->add_fd(m_event_fd, EPOLLIN, this))
     {
         m_pWorker = pWorker;
     }
@@ -260,13 +319,48 @@ Worker* MessageQueue::remove_from_worker()
 
     if (m_pWorker)
     {
-        m_pWorker->remove_fd(m_read_fd);
+        m_pWorker->remove_fd(m_event_fd);
         m_pWorker = NULL;
     }
 
     return pWorker;
 }
 
+int MessageQueue::handle_messages(int max)
+{
+    int n = 0;
+    Message message;
+
+    while (n < max)
+    {
+        // A handler may post messages to this queue, hence each message is
+        // copied before handling.
+        if (m_pPending)
+        {
+            Node* pNode = m_pPending;
+            m_pPending = pNode->pNext;
+            message = pNode->message;
+            delete pNode;
+        }
+        else if (!try_dequeue(&message))
+        {
+            // The ring is empty, so the messages in the overflow list are the
+            // oldest ones. Those posted after they are taken go to the ring.
+            if (!take_overflow())
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        m_handler.handle_message(*this, message);
+        ++n;
+    }
+
+    return n;
+}
+
 uint32_t MessageQueue::handle_poll_events(Worker* pWorker, uint32_t events)
 {
     uint32_t rc = MXB_POLL_NOP;
@@ -278,39 +372,32 @@ uint32_t MessageQueue::handle_poll_events(Worker* pWorker, uint32_t events)
 
     if (events & EPOLLIN)
     {
-        Message message;
+        uint64_t count;
 
-        ssize_t n;
+        if (read(m_event_fd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+        {
+            MXB_ERROR("Worker could not read from eventfd: %s", mxb_strerror(errno));
+        }
 
-        do
+        if (handle_messages(BATCH_SIZE) == BATCH_SIZE)
         {
-            n = read(m_read_fd, &message, sizeof(message));
+            // There may be more. The doorbell is rung so that the worker comes
+            // back after having handled the other events; m_sleeping remains
+            // false so the posters do not need to ring it.
+            ring_doorbell();
+        }
+        else
+        {
+            m_sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
 
-            if (n == sizeof(message))
-            {
-                m_handler.handle_message(*this, message);
-            }
-            else if (n == -1)
+            // A message may have been posted before m_sleeping was set, in which
+            // case its poster did not ring the doorbell.
+            if (!empty() && m_sleeping.exchange(false))
             {
-                if (errno != EWOULDBLOCK)
-                {
-                    MXB_ERROR("Worker could not read from pipe: %s", mxb_strerror(errno));
-                }
-            }
-            else if (n != 0)
-            {
-                // This really should not happen as the pipe is in message mode. We
-                // should either get a message, nothing at all or an error. In non-debug
-                // mode we continue reading in order to empty the pipe as otherwise the
-                // thread may hang.
-                MXB_ERROR("MessageQueue could only read %ld bytes from pipe, although "
-                          "expected %lu bytes.",
-                          n,
-                          sizeof(message));
-                mxb_assert(!true);
+                ring_doorbell();
             }
         }
-        while ((n != 0) && (n != -1));
 
         rc = MXB_POLL_READ;
     }
@@ -322,7 +409,10 @@ uint32_t MessageQueue::handle_poll_events(Worker* pWorker, uint32_t events)
 uint32_t MessageQueue::poll_handler(MXB_POLL_DATA* pData, MXB_WORKER* pWorker, uint32_t events)
 {
     MessageQueue* pThis = static_cast<MessageQueue*>(pData);
+    Worker* pOwner = static_cast<Worker*>(pWorker);
+
+    pOwner->m_event_stage = Worker::STATISTICS::STAGE_MESSAGES;
 
-    return pThis->handle_poll_events(static_cast<Worker*>(pWorker), events);
+    return pThis->handle_poll_events(pOwner, events);
 }
 }
@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include <maxbase/profiler.hh>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include <maxbase/assert.h>
+#include <maxbase/log.h>
+#include <maxbase/string.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace
+{
+
+using maxbase::Profiler;
+
+/**
+ * The profiler of the current thread. Set before the timer of the thread is
+ * started, so the memory for it has been allocated when the signal handler
+ * first accesses it.
+ */
+thread_local Profiler* this_thread_profiler = nullptr;
+
+std::once_flag install_once;
+
+/**
+ * Unwind the stack of the interrupted code by following the frame pointers.
+ *
+ * This is called in a signal handler, so it must be async-signal-safe. That
+ * rules out backtrace(), which can take the loader lock in dl_iterate_phdr()
+ * and deadlock if the thread was interrupted while holding it. The walk only
+ * reads memory within the stack of the thread, so a frame pointer that is
+ * garbage can't fault. The stacks are complete only for code built with frame
+ * pointers, as MaxScale is; a function without one hides its caller.
+ *
+ * @param pContext  The context of the interrupted code.
+ * @param lo        The lowest address of the stack of the thread.
+ * @param hi        The highest address of the stack of the thread.
+ * @param pFrames   The interrupted instruction followed by the return addresses.
+ * @param max       The capacity of @c pFrames.
+ *
+ * @return The number of frames.
+ */
+int unwind(void* pContext, uintptr_t lo, uintptr_t hi, void** pFrames, int max)
+{
+    ucontext_t* pUc = static_cast<ucontext_t*>(pContext);
+    uintptr_t pc;
+    uintptr_t fp;
+    uintptr_t sp;
+#if defined (__x86_64__)
+    pc = pUc->uc_mcontext.gregs[REG_RIP];
+    fp = pUc->uc_mcontext.gregs[REG_RBP];
+    sp = pUc->uc_mcontext.gregs[REG_RSP];
+#elif defined (__i386__)
+    pc = pUc->uc_mcontext.gregs[REG_EIP];
+    fp = pUc->uc_mcontext.gregs[REG_EBP];
+    sp = pUc->uc_mcontext.gregs[REG_ESP];
+#elif defined (__aarch64__)
+    pc = pUc->uc_mcontext.pc;
+    fp = pUc->uc_mcontext.regs[29];
+    sp = pUc->uc_mcontext.sp;
+#else
+    return 0;
+#endif
+
+    int depth = 0;
+    pFrames[depth++] = reinterpret_cast<void*>(pc);
+
+    // A frame is the saved frame pointer followed by the return address. The
+    // stack grows down, so the frames of the callers are at higher addresses.
+    uintptr_t low = std::max(sp, lo);
+
+    while (depth < max
+           && fp >= low && hi - fp >= 2 * sizeof(uintptr_t)
+           && fp % sizeof(uintptr_t) == 0)
+    {
+        const uintptr_t* pFrame = reinterpret_cast<const uintptr_t*>(fp);
+        uintptr_t next = pFrame[0];
+        uintptr_t ret = pFrame[1];
+
+        if (ret == 0)
+        {
+            break;
+        }
+
+        pFrames[depth++] = reinterpret_cast<void*>(ret);
+
+        if (next <= fp)
+        {
+            break;
+        }
+
+        fp = next;
+    }
+
+    return depth;
+}
+
+/**
+ * Get a printable name for an address.
+ *
+ * @param addr    The address.
+ * @param caller  True if the address is a return address, in which case the
+ *                address of the call instruction is looked up.
+ */
+std::string symbol_name(void* addr, bool caller)
+{
+    const char* pLookup = static_cast<const char*>(addr) - (caller ? 1 : 0);
+    std::string name;
+    Dl_info info;
+
+    if (dladdr(pLookup, &info) && info.dli_sname)
+    {
+        int status;
+        char* zDemangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+
+        name = zDemangled ? zDemangled : info.dli_sname;
+        free(zDemangled);
+    }
+    else if (info.dli_fname)
+    {
+        // No symbol, e.g. a static function in a binary without dynamic symbols.
+        const char* zModule = strrchr(info.dli_fname, '/');
+        std::stringstream ss;
+        ss << (zModule ? zModule + 1 : info.dli_fname) << "+0x" << std::hex
+           << (pLookup - static_cast<const char*>(info.dli_fbase));
+        name = ss.str();
+    }
+    else
+    {
+        std::stringstream ss;
+        ss << addr;
+        name = ss.str();
+    }
+
+    // Semicolons separate the functions in the folded format.
+    std::replace(name.begin(), name.end(), ';', ':');
+
+    return name;
+}
+}
+
+namespace maxbase
+{
+
+Profiler::Profiler()
+    : m_frequency(0)
+    , m_timer_created(false)
+    , m_timer()
+    , m_stack_lo(0)
+    , m_stack_hi(0)
+    , m_head(0)
+    , m_tail(0)
+    , m_dropped(0)
+{
+}
+
+Profiler::~Profiler()
+{
+    if (m_timer_created)
+    {
+        timer_delete(m_timer);
+    }
+
+    if (this_thread_profiler == this)
+    {
+        this_thread_profiler = nullptr;
+    }
+}
+
+bool Profiler::start(int frequency)
+{
+    mxb_assert(frequency > 0 && frequency <= MAX_FREQUENCY);
+    mxb_assert(!this_thread_profiler || this_thread_profiler == this);
+
+#ifdef HAVE_GLIBC
+    bool ok = true;
+
+    std::call_once(install_once, [&ok]() {
+                       struct sigaction sa;
+                       memset(&sa, 0, sizeof(sa));
+                       sa.sa_sigaction = &Profiler::signal_handler;
+                       sa.sa_flags = SA_SIGINFO | SA_RESTART;
+                       sigemptyset(&sa.sa_mask);
+
+                       if (sigaction(SIGPROF, &sa, nullptr) != 0)
+                       {
+                           MXB_ERROR("Could not install the profiler signal handler: %s",
+                                     mxb_strerror(errno));
+                           ok = false;
+                       }
+                   });
+
+    if (!ok)
+    {
+        return false;
+    }
+
+    if (!m_stack_hi)
+    {
+        // The unwinder must know the bounds of the stack, but can't ask for them
+        // in the signal handler.
+        pthread_attr_t attr;
+        void* pStack;
+        size_t size;
+
+        if (pthread_getattr_np(pthread_self(), &attr) != 0)
+        {
+            MXB_ERROR("Could not get the stack of the profiled thread.");
+            return false;
+        }
+
+        int rc = pthread_attr_getstack(&attr, &pStack, &size);
+        pthread_attr_destroy(&attr);
+
+        if (rc != 0)
+        {
+            MXB_ERROR("Could not get the stack of the profiled thread.");
+            return false;
+        }
+
+        m_stack_lo = reinterpret_cast<uintptr_t>(pStack);
+        m_stack_hi = m_stack_lo + size;
+    }
+
+    this_thread_profiler = this;
+
+    if (!m_timer_created)
+    {
+        struct sigevent sev;
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_signo = SIGPROF;
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+
+        if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &m_timer) != 0)
+        {
+            MXB_ERROR("Could not create the profiler timer: %s", mxb_strerror(errno));
+            return false;
+        }
+
+        m_timer_created = true;
+    }
+
+    long interval = 1000000000 / frequency;
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = interval / 1000000000;
+    spec.it_interval.tv_nsec = interval % 1000000000;
+    spec.it_value = spec.it_interval;
+
+    if (timer_settime(m_timer, 0, &spec, nullptr) != 0)
+    {
+        MXB_ERROR("Could not start the profiler timer: %s", mxb_strerror(errno));
+        return false;
+    }
+
+    m_frequency = frequency;
+    return true;
+#else
+    MXB_ERROR("Profiling is only supported on GLIBC systems.");
+    return false;
+#endif
+}
+
+void Profiler::stop()
+{
+    if (m_frequency)
+    {
+        struct itimerspec spec;
+        memset(&spec, 0, sizeof(spec));
+        timer_settime(m_timer, 0, &spec, nullptr);
+        m_frequency = 0;
+    }
+
+    collect();
+}
+
+// static
+void Profiler::signal_handler(int signo, siginfo_t* pInfo, void* pContext)
+{
+    int saved_errno = errno;
+    Profiler* pThis = this_thread_profiler;
+
+    if (pThis)
+    {
+        pThis->sample(pContext);
+    }
+
+    errno = saved_errno;
+}
+
+void Profiler::sample(void* pContext)
+{
+    // Only called in the profiled thread, so there is only one writer.
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+
+    if (head - m_tail.load(std::memory_order_acquire) == N_SAMPLES)
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Sample& sample = m_samples[head % N_SAMPLES];
+    sample.depth = unwind(pContext, m_stack_lo, m_stack_hi, sample.frames, MAX_DEPTH);
+
+    m_head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::collect()
+{
+    // The signal handler may interrupt this function, but it only ever writes
+    // to the slots outside the range being read.
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+
+    for (; tail != head; ++tail)
+    {
+        const Sample& sample = m_samples[tail % N_SAMPLES];
+        Stack stack(sample.frames, sample.frames + sample.depth);
+
+        auto it = m_stacks.find(stack);
+
+        if (it != m_stacks.end())
+        {
+            ++it->second;
+        }
+        else if (m_stacks.size() < MAX_STACKS)
+        {
+            m_stacks.insert(std::make_pair(std::move(stack), 1));
+        }
+        else
+        {
+            ++m_stacks[Stack()];
+        }
+
+        m_tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+void Profiler::reset()
+{
+    collect();
+    m_stacks.clear();
+}
+
+// static
+void Profiler::merge(Stacks* pInto, const Stacks& from)
+{
+    for (const auto& kv : from)
+    {
+        (*pInto)[kv.first] += kv.second;
+    }
+}
+
+// static
+std::string Profiler::to_folded(const Stacks& stacks)
+{
+    std::unordered_map<void*, std::string> names;
+    // Stacks that differ only in the addresses within the functions are combined.
+    std::map<std::string, uint64_t> folded;
+
+    for (const auto& kv : stacks)
+    {
+        const Stack& stack = kv.first;
+        std::string line;
+
+        if (stack.empty())
+        {
+            line = "[truncated]";
+        }
+
+        for (size_t i = stack.size(); i-- > 0;)
+        {
+            // Only the innermost frame is not a return address.
+            void* addr = stack[i];
+            void* key = static_cast<char*>(addr) - (i != 0 ? 1 : 0);
+            auto it = names.find(key);
+
+            if (it == names.end())
+            {
+                it = names.insert(std::make_pair(key, symbol_name(addr, i != 0))).first;
+            }
+
+            line += it->second;
+
+            if (i != 0)
+            {
+                line += ';';
+            }
+        }
+
+        folded[line] += kv.second;
+    }
+
+    std::string rval;
+
+    for (const auto& kv : folded)
+    {
+        rval += kv.first;
+        rval += ' ';
+        rval += std::to_string(kv.second);
+        rval += '\n';
+    }
+
+    return rval;
+}
+}
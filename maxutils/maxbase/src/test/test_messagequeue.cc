@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#if !defined (SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined (NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <maxbase/ccdefs.hh>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <maxbase/assert.h>
+#include <maxbase/maxbase.hh>
+#include <maxbase/messagequeue.hh>
+#include <maxbase/semaphore.hh>
+#include <maxbase/worker.hh>
+
+using namespace maxbase;
+using namespace std;
+
+namespace
+{
+
+const int MAX_PRODUCERS = 8;
+const int N_MESSAGES = 1000000;
+
+/**
+ * The state of a receiving worker. Only accessed by the worker itself,
+ * except before it is started and after the done semaphore has been posted.
+ */
+struct Receiver
+{
+    int64_t   expected[MAX_PRODUCERS];  // The next sequence number of each producer.
+    int64_t   n_received;
+    int64_t   n_total;
+    int       n_errors;
+    Semaphore done;
+};
+
+Receiver receivers[2];
+
+intptr_t encode(int producer, int64_t seq)
+{
+    return (intptr_t)(((int64_t)producer << 48) | seq);
+}
+
+void receive(MXB_WORKER* pWorker, void* pData, Receiver& r)
+{
+    intptr_t value = (intptr_t)pData;
+    int producer = value >> 48;
+    int64_t seq = value & ((1LL << 48) - 1);
+
+    if (seq != r.expected[producer])
+    {
+        // The messages of one producer must arrive in order and none may be lost.
+        ++r.n_errors;
+    }
+
+    r.expected[producer] = seq + 1;
+
+    if (++r.n_received == r.n_total)
+    {
+        r.done.post();
+    }
+}
+
+void receive0(MXB_WORKER* pWorker, void* pData)
+{
+    receive(pWorker, pData, receivers[0]);
+}
+
+void receive1(MXB_WORKER* pWorker, void* pData)
+{
+    receive(pWorker, pData, receivers[1]);
+}
+
+void reset(Receiver& r, int64_t n_total)
+{
+    for (int i = 0; i < MAX_PRODUCERS; ++i)
+    {
+        r.expected[i] = 0;
+    }
+
+    r.n_received = 0;
+    r.n_total = n_total;
+    r.n_errors = 0;
+}
+
+/**
+ * Measures the throughput of threads posting to one worker.
+ */
+int test_throughput(int n_producers)
+{
+    Worker worker;
+    worker.start();
+
+    Receiver& r = receivers[0];
+    reset(r, (int64_t)n_producers * N_MESSAGES);
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> producers;
+
+    for (int i = 0; i < n_producers; ++i)
+    {
+        producers.emplace_back([&worker, i]() {
+                                   for (int64_t seq = 0; seq < N_MESSAGES; ++seq)
+                                   {
+                                       MXB_AT_DEBUG(bool posted = )
+                                       worker.post_message(MXB_WORKER_MSG_CALL,
+                                                           (intptr_t)receive0,
+                                                           encode(i, seq));
+                                       mxb_assert(posted);
+                                   }
+                               });
+    }
+
+    for (auto& t : producers)
+    {
+        t.join();
+    }
+
+    r.done.wait();
+
+    auto secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    worker.shutdown();
+    worker.join();
+
+    cout << setw(2) << n_producers << " producers: "
+         << setw(12) << fixed << setprecision(0) << r.n_received / secs << " messages/s, "
+         << r.n_errors << " errors" << endl;
+
+    return r.n_errors;
+}
+
+/**
+ * Two workers post more messages to each other than the rings can hold, which
+ * must neither deadlock nor fail.
+ */
+int test_mutual_posting()
+{
+    const int64_t n_messages = 4 * MessageQueue::CAPACITY;
+
+    Worker workers[2];
+    void (* receive_functions[2])(MXB_WORKER*, void*) = {receive0, receive1};
+
+    for (int i = 0; i < 2; ++i)
+    {
+        reset(receivers[i], n_messages);
+        workers[i].start();
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        Worker* pOther = &workers[1 - i];
+        auto receive_function = receive_functions[1 - i];
+
+        workers[i].execute([pOther, receive_function, i, n_messages]() {
+                               for (int64_t seq = 0; seq < n_messages; ++seq)
+                               {
+                                   MXB_AT_DEBUG(bool posted = )
+                                   pOther->post_message(MXB_WORKER_MSG_CALL,
+                                                        (intptr_t)receive_function,
+                                                        encode(i, seq));
+                                   mxb_assert(posted);
+                               }
+                           },
+                           Worker::EXECUTE_QUEUED);
+    }
+
+    int rv = 0;
+
+    for (int i = 0; i < 2; ++i)
+    {
+        receivers[i].done.wait();
+        rv += receivers[i].n_errors;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        workers[i].shutdown();
+        workers[i].join();
+    }
+
+    cout << "Mutual posting: " << rv << " errors" << endl;
+
+    return rv;
+}
+
+/**
+ * A worker posts more messages to its own queue than the ring can hold. All
+ * must be posted without blocking and arrive in order.
+ */
+int test_own_queue_full()
+{
+    const int64_t n_messages = 4 * MessageQueue::CAPACITY;
+
+    Worker worker;
+    Receiver& r = receivers[0];
+    reset(r, n_messages);
+    worker.start();
+
+    int64_t n_posted = 0;
+    Semaphore posted;
+
+    worker.execute([&worker, &n_posted, &posted, n_messages]() {
+                       while (n_posted < n_messages
+                              && worker.post_message(MXB_WORKER_MSG_CALL,
+                                                     (intptr_t)receive0,
+                                                     encode(0, n_posted)))
+                       {
+                           ++n_posted;
+                       }
+
+                       posted.post();
+                   },
+                   Worker::EXECUTE_QUEUED);
+
+    posted.wait();
+
+    int rv = 0;
+
+    if (n_posted == n_messages)
+    {
+        r.done.wait();
+        rv = r.n_errors;
+    }
+    else
+    {
+        rv = 1;
+    }
+
+    worker.shutdown();
+    worker.join();
+
+    cout << "Own queue full: " << n_posted << " messages posted, " << rv << " errors" << endl;
+
+    return rv;
+}
+}
+
+int main()
+{
+    mxb::MaxBase mxb(MXB_LOG_TARGET_STDOUT);
+
+    int rv = 0;
+
+    for (int n_producers = 1; n_producers <= MAX_PRODUCERS; n_producers *= 2)
+    {
+        rv += test_throughput(n_producers);
+    }
+
+    rv += test_mutual_posting();
+    rv += test_own_queue_full();
+
+    return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#if !defined (SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined (NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <maxbase/ccdefs.hh>
+#include <time.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <maxbase/log.hh>
+#include <maxbase/profiler.hh>
+
+using namespace maxbase;
+using namespace std;
+
+namespace
+{
+
+volatile uint64_t sink;
+
+/**
+ * Burn CPU for a while, collecting the samples now and then like a worker does.
+ */
+void __attribute__ ((noinline)) spin(Profiler& profiler, int ms)
+{
+    timespec start;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+    while (true)
+    {
+        for (int i = 0; i < 100000; ++i)
+        {
+            sink = sink * 31 + i;
+        }
+
+        profiler.collect();
+
+        timespec now;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+        if ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000 >= ms)
+        {
+            break;
+        }
+    }
+}
+
+uint64_t total(const Profiler::Stacks& stacks)
+{
+    uint64_t n = 0;
+
+    for (const auto& kv : stacks)
+    {
+        n += kv.second;
+    }
+
+    return n;
+}
+
+int test_profiler()
+{
+    int errors = 0;
+    Profiler profiler;
+
+    if (!profiler.start(1000))
+    {
+        cout << "Could not start the profiler." << endl;
+        return 1;
+    }
+
+    spin(profiler, 200);
+    profiler.stop();
+
+    uint64_t n = total(profiler.stacks());
+
+    // About 200 samples are expected; leave plenty of room for a loaded machine.
+    if (n < 20 || n != profiler.n_samples() - profiler.n_dropped())
+    {
+        cout << "Unexpected number of samples: " << n << endl;
+        ++errors;
+    }
+
+    // Each line of the folded output ends with the number of samples of the stack.
+    istringstream folded(Profiler::to_folded(profiler.stacks()));
+    string line;
+    uint64_t n_folded = 0;
+
+    while (getline(folded, line))
+    {
+        n_folded += stoull(line.substr(line.rfind(' ') + 1));
+    }
+
+    if (n_folded != n)
+    {
+        cout << "The folded stacks contain " << n_folded << " samples, not " << n << endl;
+        ++errors;
+    }
+
+    // The stacks must reach past the interrupted function, at least to the
+    // caller of spin().
+    size_t depth = 0;
+
+    for (const auto& kv : profiler.stacks())
+    {
+        depth = std::max(depth, kv.first.size());
+    }
+
+    if (depth < 3)
+    {
+        cout << "The stacks were not unwound, the deepest has " << depth << " frames." << endl;
+        ++errors;
+    }
+
+    // No samples after stopping.
+    uint64_t before = profiler.n_samples();
+    spin(profiler, 50);
+
+    if (profiler.n_samples() != before)
+    {
+        cout << "Samples were taken after the profiler was stopped." << endl;
+        ++errors;
+    }
+
+    Profiler::Stacks merged;
+    Profiler::merge(&merged, profiler.stacks());
+    Profiler::merge(&merged, profiler.stacks());
+
+    if (total(merged) != 2 * n)
+    {
+        cout << "Merging the stacks did not add up the samples." << endl;
+        ++errors;
+    }
+
+    profiler.reset();
+
+    if (!profiler.stacks().empty())
+    {
+        cout << "The stacks were not discarded." << endl;
+        ++errors;
+    }
+
+    cout << "Profiler: " << n << " samples, " << errors << " errors" << endl;
+
+    return errors;
+}
+}
+
+int main()
+{
+    mxb::Log log(MXB_LOG_TARGET_STDOUT);
+    int rv = 0;
+
+    // Profiling is per thread; run it in another one to make sure that works.
+    std::thread thr([&rv]() {
+                        rv = test_profiler();
+                    });
+    thr.join();
+
+    return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#if !defined (SS_DEBUG)
+#define SS_DEBUG
+#endif
+#if defined (NDEBUG)
+#undef NDEBUG
+#endif
+
+#include <maxbase/ccdefs.hh>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include <maxbase/fixedsizepool.hh>
+#include <maxbase/timerwheel.hh>
+
+using namespace maxbase;
+using namespace std;
+
+namespace
+{
+
+struct Timer : public TimerWheel::Entry
+{
+    int64_t at;         // When the timer should expire.
+    int64_t due;        // The tick at which the timer should expire.
+    int64_t expired;    // When the timer expired, -1 if it has not.
+};
+
+/**
+ * Schedules and cancels timers at random and checks that every timer expires
+ * exactly at the first tick at or after its time.
+ */
+int test_expiry(int64_t tick, int64_t max_delay)
+{
+    const int N_TIMERS = 10000;
+    const int N_ROUNDS = 20000;
+
+    mt19937 random(tick * max_delay);
+    uniform_int_distribution<int64_t> delays(0, max_delay);
+    uniform_int_distribution<int> timers(0, N_TIMERS - 1);
+    uniform_int_distribution<int> steps(0, 3 * tick);
+
+    int64_t now = 1000000;
+    TimerWheel wheel(tick, now);
+    vector<Timer> all(N_TIMERS);
+    int errors = 0;
+
+    auto expire = [&](TimerWheel::Entry* pEntry) {
+            Timer* pTimer = static_cast<Timer*>(pEntry);
+
+            if (now / tick < pTimer->due || pTimer->expired != -1)
+            {
+                ++errors;
+            }
+
+            pTimer->expired = now;
+        };
+
+    for (int round = 0; round < N_ROUNDS; ++round)
+    {
+        for (int i = 0; i < 5; ++i)
+        {
+            Timer& timer = all[timers(random)];
+
+            if (timer.scheduled() && round % 3 == 0)
+            {
+                wheel.cancel(&timer);
+            }
+            else
+            {
+                timer.at = now + delays(random);
+                // A timer whose time has passed expires at the next tick.
+                timer.due = max((timer.at + tick - 1) / tick, now / tick + 1);
+                timer.expired = -1;
+                wheel.schedule(&timer, timer.at);
+            }
+        }
+
+        int64_t next = wheel.next_expiry();
+
+        if (next != -1 && next < now)
+        {
+            ++errors;
+        }
+
+        now += steps(random);
+        wheel.advance(now, expire);
+
+        for (const Timer& timer : all)
+        {
+            // A timer whose tick has passed must have expired.
+            if (timer.scheduled() && timer.due <= now / tick)
+            {
+                ++errors;
+            }
+        }
+    }
+
+    for (Timer& timer : all)
+    {
+        wheel.cancel(&timer);
+    }
+
+    if (!wheel.empty())
+    {
+        ++errors;
+    }
+
+    cout << "Tick " << tick << ", delays up to " << max_delay << ": " << errors << " errors" << endl;
+
+    return errors;
+}
+
+/**
+ * A timer far beyond the range of the wheel must expire in time when the
+ * wheel is turned only at the times it reports.
+ */
+int test_far_future()
+{
+    TimerWheel wheel(1, 0);
+    Timer timer;
+    timer.at = (int64_t(1) << 40) + 12345;
+    timer.expired = -1;
+
+    wheel.schedule(&timer, timer.at);
+
+    int64_t now = 0;
+
+    while (!wheel.empty())
+    {
+        now = wheel.next_expiry();
+        wheel.advance(now, [&](TimerWheel::Entry*) {
+                          timer.expired = now;
+                      });
+    }
+
+    int errors = timer.expired == timer.at ? 0 : 1;
+
+    cout << "Far future: " << errors << " errors" << endl;
+
+    return errors;
+}
+
+/**
+ * Compares scheduling and cancelling with the multimap the worker used to have.
+ */
+void benchmark()
+{
+    const int N_TIMERS = 50000;
+    const int N_OPERATIONS = 2000000;
+
+    mt19937 random(4711);
+    uniform_int_distribution<int64_t> delays(1, 60000);
+    uniform_int_distribution<int> timers(0, N_TIMERS - 1);
+    vector<int64_t> at(N_OPERATIONS);
+
+    for (auto& a : at)
+    {
+        a = delays(random);
+    }
+
+    vector<int> which(N_OPERATIONS);
+
+    for (auto& w : which)
+    {
+        w = timers(random);
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    {
+        TimerWheel wheel(1, 0);
+        vector<Timer> all(N_TIMERS);
+
+        for (int i = 0; i < N_OPERATIONS; ++i)
+        {
+            wheel.schedule(&all[which[i]], at[i]);
+        }
+
+        for (auto& timer : all)
+        {
+            wheel.cancel(&timer);
+        }
+    }
+
+    auto wheel_secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    start = chrono::steady_clock::now();
+
+    {
+        typedef multimap<int64_t, Timer*> Map;
+        Map map;
+        vector<Timer> all(N_TIMERS);
+        vector<Map::iterator> its(N_TIMERS, map.end());
+
+        for (int i = 0; i < N_OPERATIONS; ++i)
+        {
+            int w = which[i];
+
+            if (its[w] != map.end())
+            {
+                map.erase(its[w]);
+            }
+
+            its[w] = map.insert(make_pair(at[i], &all[w]));
+        }
+    }
+
+    auto map_secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Rescheduling " << N_TIMERS << " timers: wheel "
+         << fixed << setprecision(0) << N_OPERATIONS / wheel_secs << " ops/s, multimap "
+         << N_OPERATIONS / map_secs << " ops/s" << endl;
+}
+
+int test_pool()
+{
+    FixedSizePool<sizeof(Timer), 16> pool;
+    vector<void*> blocks;
+
+    for (int i = 0; i < 100; ++i)
+    {
+        blocks.push_back(pool.allocate());
+    }
+
+    for (void* pBlock : blocks)
+    {
+        pool.deallocate(pBlock);
+    }
+
+    // Released blocks are handed out again, most recently released first.
+    int errors = pool.allocate() == blocks.back() ? 0 : 1;
+
+    cout << "Pool: " << errors << " errors" << endl;
+
+    return errors;
+}
+}
+
+int main()
+{
+    int rv = 0;
+
+    rv += test_expiry(1, 100);
+    rv += test_expiry(1, 100000);
+    rv += test_expiry(10, 1000);
+    rv += test_expiry(7, 10000000);
+    rv += test_far_future();
+    rv += test_pool();
+
+    benchmark();
+
+    return rv == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
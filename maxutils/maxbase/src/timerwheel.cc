@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include <maxbase/timerwheel.hh>
+
+namespace
+{
+
+const int64_t SLOT_MASK = maxbase::TimerWheel::N_SLOTS - 1;
+
+/**
+ * The number of ticks a slot on a particular level covers.
+ */
+inline int64_t ticks_per_slot(int level)
+{
+    return int64_t(1) << (level * maxbase::TimerWheel::LEVEL_BITS);
+}
+
+/**
+ * Rotate a bitmap so that bit @c n becomes the lowest one.
+ */
+inline uint64_t rotate_right(uint64_t bits, int n)
+{
+    return n == 0 ? bits : (bits >> n) | (bits << (64 - n));
+}
+}
+
+namespace maxbase
+{
+
+TimerWheel::TimerWheel(int64_t tick, int64_t now)
+    : m_tick(tick)
+    , m_current(now / tick)
+    , m_size(0)
+{
+    mxb_assert(tick > 0);
+
+    for (int level = 0; level < N_LEVELS; ++level)
+    {
+        m_occupied[level] = 0;
+
+        for (int slot = 0; slot < N_SLOTS; ++slot)
+        {
+            m_slots[level][slot] = nullptr;
+        }
+    }
+}
+
+void TimerWheel::schedule(Entry* pEntry, int64_t at)
+{
+    if (pEntry->scheduled())
+    {
+        unlink(pEntry);
+    }
+
+    // Rounded up, an entry never expires early. The current tick has already
+    // been handled, so an entry whose time has passed expires at the next one.
+    int64_t tick = (at + m_tick - 1) / m_tick;
+
+    pEntry->m_tick = tick > m_current ? tick : m_current + 1;
+    link(pEntry);
+}
+
+void TimerWheel::link(Entry* pEntry)
+{
+    int64_t tick = pEntry->m_tick;
+    mxb_assert(tick >= m_current);
+
+    // The delta is 0 only when an entry is moved down from a higher level at the
+    // very tick it expires; it is then placed in the slot about to be handled.
+    int64_t delta = tick - m_current;
+    int level = 0;
+
+    while (level < N_LEVELS - 1 && delta >= ticks_per_slot(level + 1))
+    {
+        ++level;
+    }
+
+    if (delta >= ticks_per_slot(level + 1))
+    {
+        // Beyond the range of the wheel. The entry is placed in the slot that is
+        // redistributed last and it keeps moving around until its time comes.
+        tick = m_current + ticks_per_slot(level + 1) - 1;
+    }
+
+    int slot = (tick >> (level * LEVEL_BITS)) & SLOT_MASK;
+    Entry*& pHead = m_slots[level][slot];
+
+    pEntry->m_level = level;
+    pEntry->m_slot = slot;
+    pEntry->m_pNext = pHead;
+    pEntry->m_ppPrev = &pHead;
+
+    if (pHead)
+    {
+        pHead->m_ppPrev = &pEntry->m_pNext;
+    }
+
+    pHead = pEntry;
+    m_occupied[level] |= uint64_t(1) << slot;
+    ++m_size;
+}
+
+void TimerWheel::unlink(Entry* pEntry)
+{
+    mxb_assert(pEntry->scheduled());
+
+    *pEntry->m_ppPrev = pEntry->m_pNext;
+
+    if (pEntry->m_pNext)
+    {
+        pEntry->m_pNext->m_ppPrev = pEntry->m_ppPrev;
+    }
+
+    if (!m_slots[pEntry->m_level][pEntry->m_slot])
+    {
+        m_occupied[pEntry->m_level] &= ~(uint64_t(1) << pEntry->m_slot);
+    }
+
+    pEntry->m_pNext = nullptr;
+    pEntry->m_ppPrev = nullptr;
+    --m_size;
+}
+
+void TimerWheel::cascade()
+{
+    // When the lower bits of the current tick wrap around, the corresponding slot
+    // on the level above is redistributed. All its entries expire within the range
+    // of the levels below, so they never end up in the slot they came from.
+    for (int level = 1; level < N_LEVELS; ++level)
+    {
+        if ((m_current & (ticks_per_slot(level) - 1)) != 0)
+        {
+            break;
+        }
+
+        Entry*& pHead = m_slots[level][(m_current >> (level * LEVEL_BITS)) & SLOT_MASK];
+
+        while (pHead)
+        {
+            Entry* pEntry = pHead;
+            unlink(pEntry);
+            link(pEntry);
+        }
+    }
+}
+
+int64_t TimerWheel::next_tick() const
+{
+    int64_t next = INT64_MAX;
+
+    for (int level = 0; level < N_LEVELS; ++level)
+    {
+        if (m_occupied[level])
+        {
+            // The slots are scanned starting from the one after the current one. On
+            // level 0 that is the next tick, on higher levels the next redistribution.
+            int shift = level * LEVEL_BITS;
+            int64_t base = m_current >> shift;
+            int start = (base + 1) & SLOT_MASK;
+            int offset = __builtin_ctzll(rotate_right(m_occupied[level], start));
+            int64_t tick = (base + 1 + offset) << shift;
+
+            if (tick < next)
+            {
+                next = tick;
+            }
+        }
+    }
+
+    return next;
+}
+}
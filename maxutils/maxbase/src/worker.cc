@@ -15,6 +15,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -46,10 +48,13 @@ const int MXB_WORKER_MSG_DISPOSABLE_TASK = -2;
  */
 struct this_unit
 {
-    bool initialized;   // Whether the initialization has been performed.
+    bool      initialized;  // Whether the initialization has been performed.
+    bool      have_cpus;    // Whether the CPU affinity of the process is known.
+    cpu_set_t cpus;         // The CPU affinity of the process.
 } this_unit =
 {
     false,      // initialized
+    false,      // have_cpus
 };
 
 thread_local struct this_thread
@@ -250,6 +255,7 @@ uint32_t WorkerTimer::handle(Worker* pWorker, uint32_t events)
     {
     }
 
+    pWorker->m_event_stage = Worker::STATISTICS::STAGE_DELAYED_CALLS;
     tick();
 
     return MXB_POLL_READ;
@@ -292,7 +298,9 @@ Worker::Worker(int max_events)
     , m_nCurrent_descriptors(0)
     , m_nTotal_descriptors(0)
     , m_pTimer(new PrivateTimer(this, this, &Worker::tick))
-    , m_next_delayed_call_id{1}
+    , m_timer_at(-1)
+    , m_wheel(1, WorkerLoad::get_time_ms())
+    , m_event_stage(STATISTICS::STAGE_EVENTS)
 {
     mxb_assert(max_events > 0);
 
@@ -325,10 +333,14 @@ Worker::~Worker()
     close(m_epoll_fd);
 
     // When going down, we need to cancel all pending calls.
-    for (auto i = m_calls.begin(); i != m_calls.end(); ++i)
+    for (DelayedCall* pCall : m_calls)
     {
-        i->second->call(Call::CANCEL);
-        delete i->second;
+        if (pCall)
+        {
+            m_wheel.cancel(pCall);
+            pCall->call(Call::CANCEL);
+            destroy_delayed_call(pCall);
+        }
     }
 }
 
@@ -337,6 +349,8 @@ bool Worker::init()
 {
     mxb_assert(!this_unit.initialized);
 
+    // Called in the main thread before any thread has been pinned to a CPU.
+    this_unit.have_cpus = sched_getaffinity(0, sizeof(this_unit.cpus), &this_unit.cpus) == 0;
     this_unit.initialized = true;
 
     return this_unit.initialized;
@@ -664,9 +678,24 @@ void Worker::handle_message(MessageQueue& queue, const MessageQueue::Message& ms
 // static
 void Worker::thread_main(Worker* pThis, mxb::Semaphore* pSem)
 {
+    reset_affinity();
     pThis->run(pSem);
 }
 
+// static
+void Worker::reset_affinity()
+{
+    if (this_unit.have_cpus)
+    {
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(this_unit.cpus), &this_unit.cpus);
+
+        if (rc != 0)
+        {
+            MXB_WARNING("Could not reset the CPU affinity of a thread: %s", mxb_strerror(rc));
+        }
+    }
+}
+
 bool Worker::pre_run()
 {
     return true;
@@ -736,14 +765,24 @@ void Worker::resolve_poll_error(int fd, int errornum, int op)
 namespace
 {
 
-long time_in_100ms_ticks()
-{
-    using TenthSecondDuration = std::chrono::duration<long, std::ratio<1, 10>>;
+const int64_t NS_PER_100MS = 100000000;
 
-    auto dur = std::chrono::steady_clock::now().time_since_epoch();
-    auto tenth = std::chrono::duration_cast<TenthSecondDuration>(dur);
+/**
+ * The time used for timing the event loop, in nanoseconds.
+ */
+int64_t time_in_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    return tenth.count();
+/**
+ * The number of 100ms periods a duration covers, for the queue and execution
+ * time statistics.
+ */
+int64_t to_100ms_ticks(int64_t ns)
+{
+    return ns / NS_PER_100MS;
 }
 }
 
@@ -777,10 +816,15 @@ void Worker::poll_waitevents()
             timeout = 0;
         }
 
+        int64_t wait_start = time_in_ns();
+
         m_load.about_to_wait(now);
         nfds = epoll_wait(m_epoll_fd, events, m_max_events, timeout);
         m_load.about_to_work();
 
+        int64_t cycle_start = time_in_ns();
+        m_statistics.stage_time[STATISTICS::STAGE_WAIT] += cycle_start - wait_start;
+
         if (nfds == -1 && errno != EINTR)
         {
             int eno = errno;
@@ -818,13 +862,13 @@ void Worker::poll_waitevents()
             m_statistics.n_fds[(nfds < STATISTICS::MAXNFDS ? (nfds - 1) : STATISTICS::MAXNFDS - 1)]++;
         }
 
-        uint64_t cycle_start = time_in_100ms_ticks();
+        int64_t started = cycle_start;
 
         for (int i = 0; i < nfds; i++)
         {
             /** Calculate event queue statistics */
-            int64_t started = time_in_100ms_ticks();
-            int64_t qtime = started - cycle_start;
+            int64_t latency = started - cycle_start;
+            int64_t qtime = to_100ms_ticks(latency);
 
             if (qtime > STATISTICS::N_QUEUE_TIMES)
             {
@@ -836,9 +880,13 @@ void Worker::poll_waitevents()
             }
 
             m_statistics.maxqtime = std::max(m_statistics.maxqtime, qtime);
+            m_statistics.event_latency.add(latency);
 
             MXB_POLL_DATA* data = (MXB_POLL_DATA*)events[i].data.ptr;
 
+            // The timer and the message queue handlers change the stage.
+            m_event_stage = STATISTICS::STAGE_EVENTS;
+
             uint32_t actions = data->handler(data, this, events[i].events);
 
             if (actions & MXB_POLL_ACCEPT)
@@ -867,7 +915,9 @@ void Worker::poll_waitevents()
             }
 
             /** Calculate event execution statistics */
-            qtime = time_in_100ms_ticks() - started;
+            int64_t ended = time_in_ns();
+            int64_t exec_time = ended - started;
+            qtime = to_100ms_ticks(exec_time);
 
             if (qtime > STATISTICS::N_QUEUE_TIMES)
             {
@@ -879,10 +929,16 @@ void Worker::poll_waitevents()
             }
 
             m_statistics.maxexectime = std::max(m_statistics.maxexectime, qtime);
+            m_statistics.stage_time[m_event_stage] += exec_time;
+            m_statistics.event_time.add(exec_time);
+
+            started = ended;
         }
 
         epoll_tick();
 
+        m_statistics.stage_time[STATISTICS::STAGE_TICK] += time_in_ns() - started;
+
         m_state = IDLE;
     }   /*< while(1) */
 }
@@ -891,97 +947,104 @@ void Worker::tick()
 {
     int64_t now = WorkerLoad::get_time_ms();
 
-    vector<DelayedCall*> repeating_calls;
-
-    auto i = m_sorted_calls.begin();
-
-    // i->first is the time when the first call should be invoked.
-    while (!m_sorted_calls.empty() && (i->first <= now))
+    // The timer has expired, so it is re-armed whatever the state of the wheel.
+    m_timer_at = -1;
+
+    m_wheel.advance(now, [this](TimerWheel::Entry* pEntry) {
+                        DelayedCall* pCall = static_cast<DelayedCall*>(pEntry);
+                        uint32_t index = pCall->id() & DELAYED_CALL_INDEX_MASK;
+
+                        // While being invoked, the call cannot be cancelled.
+                        m_calls[index] = nullptr;
+
+                        if (pCall->call(Worker::Call::EXECUTE))
+                        {
+                            m_repeating_calls.push_back(pCall);
+                        }
+                        else
+                        {
+                            m_free_call_slots.push_back(index);
+                            destroy_delayed_call(pCall);
+                        }
+                    });
+
+    // Repeating calls are rescheduled only now, so that a call that has fallen
+    // behind is invoked once per tick and not repeatedly to catch up.
+    for (DelayedCall* pCall : m_repeating_calls)
     {
-        DelayedCall* pCall = i->second;
-
-        auto j = m_calls.find(pCall->id());
-        mxb_assert(j != m_calls.end());
-
-        m_sorted_calls.erase(i);
-        m_calls.erase(j);
-
-        if (pCall->call(Worker::Call::EXECUTE))
-        {
-            repeating_calls.push_back(pCall);
-        }
-        else
-        {
-            delete pCall;
-        }
-
-        // NOTE: Must be reassigned, ++i will not work in case a delayed
-        // NOTE: call cancels another delayed call.
-        i = m_sorted_calls.begin();
+        m_calls[pCall->id() & DELAYED_CALL_INDEX_MASK] = pCall;
+        m_wheel.schedule(pCall, pCall->at());
     }
 
-    for (auto i = repeating_calls.begin(); i != repeating_calls.end(); ++i)
-    {
-        DelayedCall* pCall = *i;
-
-        m_sorted_calls.insert(std::make_pair(pCall->at(), pCall));
-        m_calls.insert(std::make_pair(pCall->id(), pCall));
-    }
+    m_repeating_calls.clear();
 
     adjust_timer();
 }
 
 uint32_t Worker::add_delayed_call(DelayedCall* pCall)
 {
-    bool adjust = true;
+    uint32_t index;
 
-    if (!m_sorted_calls.empty())
+    if (!m_free_call_slots.empty())
+    {
+        index = m_free_call_slots.back();
+        m_free_call_slots.pop_back();
+    }
+    else
     {
-        DelayedCall* pFirst = m_sorted_calls.begin()->second;
+        index = m_calls.size();
+        mxb_assert(index <= DELAYED_CALL_INDEX_MASK);
 
-        if (pCall->at() > pFirst->at())
-        {
-            // If the added delayed call needs to be called later
-            // than the first delayed call, then we do not need to
-            // adjust the timer.
-            adjust = false;
-        }
+        m_calls.push_back(nullptr);
+        m_call_ids.push_back(0);
     }
 
-    // Insert the delayed call into the map ordered by invocation time.
-    m_sorted_calls.insert(std::make_pair(pCall->at(), pCall));
+    uint32_t generation = (m_call_ids[index] >> DELAYED_CALL_INDEX_BITS) % DELAYED_CALL_MAX_GENERATION + 1;
+    uint32_t id = (generation << DELAYED_CALL_INDEX_BITS) | index;
+
+    m_call_ids[index] = id;
+    m_calls[index] = pCall;
+    pCall->set_id(id);
 
-    // Insert the delayed call into the map indexed by id.
-    mxb_assert(m_calls.find(pCall->id()) == m_calls.end());
-    m_calls.insert(std::make_pair(pCall->id(), pCall));
+    m_wheel.schedule(pCall, pCall->at());
 
-    if (adjust)
+    if (m_timer_at == -1 || pCall->at() < m_timer_at)
     {
         adjust_timer();
     }
 
-    return pCall->id();
+    return id;
+}
+
+void Worker::destroy_delayed_call(DelayedCall* pCall)
+{
+    pCall->~DelayedCall();
+    m_call_pool.deallocate(pCall);
 }
 
 void Worker::adjust_timer()
 {
-    if (!m_sorted_calls.empty())
+    int64_t at = m_wheel.next_expiry();
+
+    if (at != m_timer_at)
     {
-        DelayedCall* pCall = m_sorted_calls.begin()->second;
+        if (at != -1)
+        {
+            int64_t delay = at - (int64_t)WorkerLoad::get_time_ms();
 
-        uint64_t now = WorkerLoad::get_time_ms();
-        int64_t delay = pCall->at() - now;
+            if (delay <= 0)
+            {
+                delay = 1;
+            }
 
-        if (delay <= 0)
+            m_pTimer->start(delay);
+        }
+        else
         {
-            delay = 1;
+            m_pTimer->cancel();
         }
 
-        m_pTimer->start(delay);
-    }
-    else
-    {
-        m_pTimer->cancel();
+        m_timer_at = at;
     }
 }
 
@@ -989,34 +1052,20 @@ bool Worker::cancel_delayed_call(uint32_t id)
 {
     bool found = false;
 
-    auto i = m_calls.find(id);
+    uint32_t index = id & DELAYED_CALL_INDEX_MASK;
 
-    if (i != m_calls.end())
+    if (index < m_calls.size() && m_calls[index] && m_call_ids[index] == id)
     {
-        DelayedCall* pCall = i->second;
-        m_calls.erase(i);
+        DelayedCall* pCall = m_calls[index];
 
-        // All delayed calls with exactly the same trigger time.
-        // Not particularly likely there will be many of those.
-        auto range = m_sorted_calls.equal_range(pCall->at());
+        m_calls[index] = nullptr;
+        m_free_call_slots.push_back(index);
 
-        mxb_assert(range.first != range.second);
-
-        for (auto k = range.first; k != range.second; ++k)
-        {
-            if (k->second == pCall)
-            {
-                m_sorted_calls.erase(k);
-
-                pCall->call(Worker::Call::CANCEL);
-                delete pCall;
-
-                found = true;
-                break;
-            }
-        }
+        m_wheel.cancel(pCall);
+        pCall->call(Worker::Call::CANCEL);
+        destroy_delayed_call(pCall);
 
-        mxb_assert(found);
+        found = true;
     }
     else
     {
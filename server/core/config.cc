@@ -42,6 +42,7 @@
 
 #include <maxbase/atomic.hh>
 #include <maxbase/format.hh>
+#include <maxbase/profiler.hh>
 #include <maxscale/adminusers.h>
 #include <maxscale/alloc.h>
 #include <maxscale/clock.h>
@@ -110,6 +111,7 @@ const char CN_HAS_WHERE_CLAUSE[] = "has_where_clause";
 const char CN_ID[] = "id";
 const char CN_INET[] = "inet";
 const char CN_LISTENER[] = "listener";
+const char CN_LISTENER_MODE[] = "listener_mode";
 const char CN_LISTENERS[] = "listeners";
 const char CN_LOCALHOST_MATCH_WILDCARD_HOST[] = "localhost_match_wildcard_host";
 const char CN_LOG_AUTH_WARNINGS[] = "log_auth_warnings";
@@ -136,6 +138,7 @@ const char CN_PASSIVE[] = "passive";
 const char CN_PASSWORD[] = "password";
 const char CN_POLL_SLEEP[] = "poll_sleep";
 const char CN_PORT[] = "port";
+const char CN_PROFILER_FREQUENCY[] = "profiler_frequency";
 const char CN_EXTRA_PORT[] = "extra_port";
 const char CN_PROTOCOL[] = "protocol";
 const char CN_QUERY_CLASSIFIER[] = "query_classifier";
@@ -143,6 +146,8 @@ const char CN_QUERY_CLASSIFIER_ARGS[] = "query_classifier_args";
 const char CN_QUERY_CLASSIFIER_CACHE_SIZE[] = "query_classifier_cache_size";
 const char CN_QUERY_RETRIES[] = "query_retries";
 const char CN_QUERY_RETRY_TIMEOUT[] = "query_retry_timeout";
+const char CN_REBALANCE_PERIOD[] = "rebalance_period";
+const char CN_REBALANCE_THRESHOLD[] = "rebalance_threshold";
 const char CN_RELATIONSHIPS[] = "relationships";
 const char CN_LINKS[] = "links";
 const char CN_LOCAL_ADDRESS[] = "local_address";
@@ -152,6 +157,7 @@ const char CN_RETRY_ON_FAILURE[] = "retry_on_failure";
 const char CN_ROUTER[] = "router";
 const char CN_ROUTER_DIAGNOSTICS[] = "router_diagnostics";
 const char CN_ROUTER_OPTIONS[] = "router_options";
+const char CN_RPS_INTERFACE[] = "rps_interface";
 const char CN_SELF[] = "self";
 const char CN_SERVERS[] = "servers";
 const char CN_SERVER[] = "server";
@@ -173,6 +179,7 @@ const char CN_SSL_VERSION[] = "ssl_version";
 const char CN_STRIP_DB_ESC[] = "strip_db_esc";
 const char CN_SUBSTITUTE_VARIABLES[] = "substitute_variables";
 const char CN_THREADS[] = "threads";
+const char CN_THREAD_AFFINITY[] = "thread_affinity";
 const char CN_THREAD_STACK_SIZE[] = "thread_stack_size";
 const char CN_TICKS[] = "ticks";
 const char CN_TYPE[] = "type";
@@ -1240,6 +1247,11 @@ bool config_load_global(const char* filename)
                    mxb::to_binary_size(gateway.qc_cache_properties.max_size).c_str());
     }
 
+    if (rval == 0 && gateway.rps_interface && !gateway.thread_affinity)
+    {
+        MXS_WARNING("'%s' has no effect unless '%s' is set.", CN_RPS_INTERFACE, CN_THREAD_AFFINITY);
+    }
+
     return rval == 0;
 }
 
@@ -2233,6 +2245,32 @@ static int handle_global_item(const char* name, const char* value)
             gateway.n_threads = MXS_MAX_ROUTING_THREADS;
         }
     }
+    else if (strcmp(name, CN_THREAD_AFFINITY) == 0)
+    {
+        std::vector<int> cpus;
+
+        if (strcmp(value, "none") == 0)
+        {
+            MXS_FREE(gateway.thread_affinity);
+            gateway.thread_affinity = NULL;
+        }
+        else if (strcmp(value, CN_AUTO) == 0 || mxs::parse_cpu_list(value, &cpus))
+        {
+            MXS_FREE(gateway.thread_affinity);
+            gateway.thread_affinity = MXS_STRDUP_A(value);
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for '%s', expected 'none', 'auto' or a list of CPUs: %s",
+                      CN_THREAD_AFFINITY, value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, CN_RPS_INTERFACE) == 0)
+    {
+        MXS_FREE(gateway.rps_interface);
+        gateway.rps_interface = *value ? MXS_STRDUP_A(value) : NULL;
+    }
     else if (strcmp(name, CN_THREAD_STACK_SIZE) == 0)
     {
         // DEPRECATED in 2.3, remove in 2.4
@@ -2496,6 +2534,27 @@ static int handle_global_item(const char* name, const char* value)
     {
         gateway.local_address = MXS_STRDUP_A(value);
     }
+    else if (strcmp(name, CN_LISTENER_MODE) == 0)
+    {
+        if (strcmp(value, "shared") == 0)
+        {
+            gateway.listener_mode = MXS_LISTENER_MODE_SHARED;
+        }
+        else if (strcmp(value, "reuseport") == 0)
+        {
+            gateway.listener_mode = MXS_LISTENER_MODE_REUSEPORT;
+        }
+        else if (strcmp(value, "reuseport_cpu") == 0)
+        {
+            gateway.listener_mode = MXS_LISTENER_MODE_REUSEPORT_CPU;
+        }
+        else
+        {
+            MXS_ERROR("%s can have the values 'shared', 'reuseport' or 'reuseport_cpu'.",
+                      CN_LISTENER_MODE);
+            return 0;
+        }
+    }
     else if (strcmp(name, CN_USERS_REFRESH_TIME) == 0)
     {
         char* endptr;
@@ -2572,6 +2631,50 @@ static int handle_global_item(const char* name, const char* value)
         }
         MXS_NOTICE("Writeq low water mark set to: %lu", gateway.writeq_low_water);
     }
+    else if (strcmp(name, CN_REBALANCE_THRESHOLD) == 0)
+    {
+        char* endptr;
+        int intval = strtol(value, &endptr, 0);
+        if (*endptr == '\0' && intval >= 0 && intval <= 100)
+        {
+            gateway.rebalance_threshold = intval;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for '%s', expected a percentage between 0 and 100: %s",
+                      CN_REBALANCE_THRESHOLD, value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, CN_REBALANCE_PERIOD) == 0)
+    {
+        char* endptr;
+        int intval = strtol(value, &endptr, 0);
+        if (*endptr == '\0' && intval > 0)
+        {
+            gateway.rebalance_period = intval;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for '%s': %s", CN_REBALANCE_PERIOD, value);
+            return 0;
+        }
+    }
+    else if (strcmp(name, CN_PROFILER_FREQUENCY) == 0)
+    {
+        char* endptr;
+        int intval = strtol(value, &endptr, 0);
+        if (*endptr == '\0' && intval >= 0 && intval <= mxb::Profiler::MAX_FREQUENCY)
+        {
+            gateway.profiler_frequency = intval;
+        }
+        else
+        {
+            MXS_ERROR("Invalid value for '%s', expected a frequency between 0 and %d: %s",
+                      CN_PROFILER_FREQUENCY, mxb::Profiler::MAX_FREQUENCY, value);
+            return 0;
+        }
+    }
     else if (strcmp(name, CN_RETAIN_LAST_STATEMENTS) == 0)
     {
         char* endptr;
@@ -2683,6 +2786,11 @@ bool config_can_modify_at_runtime(const char* name)
     {
         CN_USERS_REFRESH_TIME,
         CN_LOCAL_ADDRESS,
+        CN_LISTENER_MODE,
+        CN_REBALANCE_PERIOD,
+        CN_REBALANCE_THRESHOLD,
+        CN_THREAD_AFFINITY,
+        CN_RPS_INTERFACE,
         CN_ADMIN_ENABLED,
         CN_ADMIN_SSL_CA_CERT,
         CN_ADMIN_SSL_CERT,
@@ -2830,6 +2938,12 @@ void config_set_global_defaults()
     gateway.peer_user[0] = '\0';
     gateway.peer_password[0] = '\0';
     gateway.log_target = MXB_LOG_TARGET_DEFAULT;
+    gateway.listener_mode = MXS_LISTENER_MODE_SHARED;
+    gateway.rebalance_threshold = 0;
+    gateway.rebalance_period = 1;
+    gateway.thread_affinity = NULL;
+    gateway.rps_interface = NULL;
+    gateway.profiler_frequency = 0;
 
     gateway.qc_cache_properties.max_size = get_total_memory() * 0.4;
 
@@ -4520,6 +4634,17 @@ json_t* config_maxscale_to_json(const char* host)
     json_object_set_new(param, CN_ADMIN_SSL_CA_CERT, json_string(cnf->admin_ssl_ca_cert));
     json_object_set_new(param, CN_PASSIVE, json_boolean(cnf->passive));
 
+    const char* listener_mode = cnf->listener_mode == MXS_LISTENER_MODE_REUSEPORT ? "reuseport" :
+        cnf->listener_mode == MXS_LISTENER_MODE_REUSEPORT_CPU ? "reuseport_cpu" : "shared";
+    json_object_set_new(param, CN_LISTENER_MODE, json_string(listener_mode));
+    json_object_set_new(param, CN_REBALANCE_THRESHOLD, json_integer(cnf->rebalance_threshold));
+    json_object_set_new(param, CN_REBALANCE_PERIOD, json_integer(cnf->rebalance_period));
+    json_object_set_new(param, CN_THREAD_AFFINITY,
+                        json_string(cnf->thread_affinity ? cnf->thread_affinity : "none"));
+    json_object_set_new(param, CN_RPS_INTERFACE,
+                        cnf->rps_interface ? json_string(cnf->rps_interface) : json_null());
+    json_object_set_new(param, CN_PROFILER_FREQUENCY, json_integer(cnf->profiler_frequency));
+
     json_object_set_new(param, CN_QUERY_CLASSIFIER, json_string(cnf->qc_name));
 
     if (cnf->qc_args)
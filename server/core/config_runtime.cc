@@ -27,11 +27,13 @@
 #include <vector>
 
 #include <maxbase/atomic.h>
+#include <maxbase/profiler.hh>
 #include <maxscale/clock.h>
 #include <maxscale/jansson.hh>
 #include <maxscale/json_api.h>
 #include <maxscale/paths.h>
 #include <maxscale/router.h>
+#include <maxscale/routingworker.hh>
 #include <maxscale/users.h>
 
 #include "internal/config.hh"
@@ -973,6 +975,27 @@ bool runtime_alter_maxscale(const char* name, const char* value)
             config_runtime_error("Invalid timeout value for '%s': %s", CN_QUERY_RETRY_TIMEOUT, value);
         }
     }
+    else if (key == CN_PROFILER_FREQUENCY)
+    {
+        char* endptr;
+        long intval = strtol(value, &endptr, 10);
+
+        if (*value && *endptr == '\0' && intval >= 0 && intval <= mxb::Profiler::MAX_FREQUENCY)
+        {
+            MXS_NOTICE("Updated '%s' from %d to %ld",
+                       CN_PROFILER_FREQUENCY,
+                       cnf.profiler_frequency,
+                       intval);
+            cnf.profiler_frequency = intval;
+            mxs::RoutingWorker::set_profiler_frequency(intval);
+            rval = true;
+        }
+        else
+        {
+            config_runtime_error("Invalid value for '%s', expected a frequency between 0 and %d: %s",
+                                 CN_PROFILER_FREQUENCY, mxb::Profiler::MAX_FREQUENCY, value);
+        }
+    }
     else if (key == CN_RETAIN_LAST_STATEMENTS)
     {
         int intval = get_positive_int(value);
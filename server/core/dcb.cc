@@ -25,6 +25,7 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <linux/filter.h>
 #include <netinet/tcp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -32,15 +33,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
-#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <time.h>
 
 #include <maxscale/alloc.h>
 #include <maxbase/atomic.h>
 #include <maxbase/atomic.hh>
+#include <maxbase/fixedsizepool.hh>
+#include <maxbase/timerwheel.hh>
 #include <maxscale/clock.h>
 #include <maxscale/limits.h>
 #include <maxscale/listener.h>
@@ -53,11 +56,14 @@
 #include <maxscale/routingworker.hh>
 
 #include <atomic>
+#include <vector>
 
 #include "internal/modules.h"
 #include "internal/session.h"
+#include "internal/session.hh"
 
 using maxscale::RoutingWorker;
+using maxscale::Session;
 using maxbase::Worker;
 
 // #define DCB_LOG_EVENT_HANDLING
@@ -73,9 +79,44 @@ constexpr uint32_t poll_events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLHUP | EP
 constexpr uint32_t poll_events = EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLET;
 #endif
 
+/**
+ * One of the listening sockets of a listener whose port is shared between
+ * the routing workers using SO_REUSEPORT. Each shard is polled only by the
+ * worker with the same index.
+ */
+struct dcb_listener_shard
+{
+    MXB_POLL_DATA poll;     /** Must be first, the events are delivered with this. */
+    DCB*          dcb;      /** The listener DCB the shard belongs to. */
+    int           fd;       /** The listening socket of the shard. */
+};
+
 namespace
 {
 
+/** The maximum number of buffers gathered into one writev() call. */
+const int DCB_WRITEV_MAX_BUFFERS = 128;
+
+/** The maximum number of bytes coalesced into one SSL_write() call, one TLS record. */
+const size_t DCB_SSL_WRITE_SIZE = 16 * 1024;
+
+/** The initial, minimum and maximum size of the buffer a DCB reads into. */
+const uint32_t DCB_DEFAULT_READ_SIZE = 4 * 1024;
+const uint32_t DCB_MIN_READ_SIZE = 512;
+const uint32_t DCB_MAX_READ_SIZE = MXS_SO_RCVBUF_SIZE;
+
+/** How long the client must have been silent before its session can be moved, in 100ms ticks. */
+const int64_t DCB_MOVE_MIN_IDLE = 10;
+
+/** The resolution of the idle timeouts, in 100ms ticks. */
+const int64_t DCB_IDLE_CHECK_INTERVAL = 10;
+
+/** The idle timeout of a client DCB. */
+struct DcbIdleTimer : public mxb::TimerWheel::Entry
+{
+    DCB* dcb;
+};
+
 static struct
 {
     DCB   dcb_initialized;  /** A DCB with null values, used for initialization. */
@@ -86,9 +127,51 @@ static struct
 
 static thread_local struct
 {
-    long next_timeout_check;/** When to next check for idle sessions. */
-    DCB* current_dcb;       /** The DCB currently being handled by event handlers. */
+    DCB*         current_dcb;       /** The DCB currently being handled by event handlers. */
+    DCB_IO_STATS io_stats;          /** I/O statistics of the DCBs of this thread. */
+    uint8_t      ssl_write_buffer[DCB_SSL_WRITE_SIZE]; /** Buffer where SSL writes are coalesced. */
 } this_thread;
+
+/**
+ * The idle timeouts of the client DCBs of a thread. Kept apart from `this_thread`,
+ * as they need to be constructed.
+ */
+static thread_local struct
+{
+    mxb::TimerWheel                          wheel {DCB_IDLE_CHECK_INTERVAL};
+    mxb::FixedSizePool<sizeof(DcbIdleTimer)> pool;
+} idle_timers;
+
+/**
+ * Times the invocation of an event handler and adds it to the statistics
+ * of the handler type.
+ */
+class HandlerTimer
+{
+public:
+    HandlerTimer(dcb_handler_t handler)
+        : m_handler(handler)
+        , m_start(now())
+    {
+    }
+
+    ~HandlerTimer()
+    {
+        this_thread.io_stats.handler_calls[m_handler]++;
+        this_thread.io_stats.handler_time[m_handler] += now() - m_start;
+    }
+
+private:
+    static int64_t now()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    dcb_handler_t m_handler;
+    int64_t       m_start;
+};
 }
 
 static void        dcb_initialize(DCB* dcb);
@@ -100,15 +183,11 @@ static inline DCB* dcb_find_in_list(DCB* dcb);
 static void        dcb_stop_polling_and_shutdown(DCB* dcb);
 static bool        dcb_maybe_add_persistent(DCB*);
 static inline bool dcb_write_parameter_check(DCB* dcb, GWBUF* queue);
-static int         dcb_bytes_readable(DCB* dcb);
-static int         dcb_read_no_bytes_available(DCB* dcb, int nreadtotal);
+static int         dcb_read_no_bytes_available(DCB* dcb, int nreadtotal, int eno);
+static void        dcb_adjust_read_size(DCB* dcb, int bufsize, int nread);
 static int         dcb_create_SSL(DCB* dcb, SSL_LISTENER* ssl);
 static int         dcb_read_SSL(DCB* dcb, GWBUF** head);
-static GWBUF*      dcb_basic_read(DCB* dcb,
-                                  int bytesavailable,
-                                  int maxbytes,
-                                  int nreadtotal,
-                                  int* nsingleread);
+static GWBUF*      dcb_basic_read(DCB* dcb, int bufsize, int* nsingleread);
 static GWBUF* dcb_basic_read_SSL(DCB* dcb, int* nsingleread);
 static void   dcb_log_write_failure(DCB* dcb, GWBUF* queue, int eno);
 static int    gw_write(DCB* dcb, GWBUF* writeq, bool* stop_writing);
@@ -117,14 +196,20 @@ static int    dcb_log_errors_SSL(DCB* dcb, int ret);
 static int    dcb_accept_one_connection(DCB* dcb, struct sockaddr* client_conn);
 static int    dcb_listen_create_socket_inet(const char* host, uint16_t port);
 static int    dcb_listen_create_socket_unix(const char* path);
+static int    dcb_listen_create_shards(DCB* dcb, const char* host, uint16_t port);
+static void   dcb_free_listener_shards(DCB* dcb);
+static int    dcb_listener_fd(DCB* dcb);
 static int    dcb_set_socket_option(int sockfd, int level, int optname, void* optval, socklen_t optlen);
 static void   dcb_add_to_all_list(DCB* dcb);
 static void   dcb_add_to_list(DCB* dcb);
 static bool   dcb_add_to_worker(Worker* worker, DCB* dcb, uint32_t events);
 static DCB*   dcb_find_free();
 static void   dcb_remove_from_list(DCB* dcb);
+static void   dcb_schedule_idle_timeout(DCB* dcb);
+static void   dcb_cancel_idle_timeout(DCB* dcb);
 
 static uint32_t dcb_poll_handler(MXB_POLL_DATA* data, MXB_WORKER* worker, uint32_t events);
+static uint32_t dcb_listener_shard_handler(MXB_POLL_DATA* data, MXB_WORKER* worker, uint32_t events);
 static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t ev);
 static bool     dcb_session_check(DCB* dcb, const char*);
 static int      upstream_throttle_callback(DCB* dcb, DCB_REASON reason, void* userdata);
@@ -139,6 +224,7 @@ void dcb_global_init()
     this_unit.dcb_initialized.high_water_reached = false;
     this_unit.dcb_initialized.low_water = config_writeq_low_water();
     this_unit.dcb_initialized.high_water = config_writeq_high_water();
+    this_unit.dcb_initialized.read_size = DCB_DEFAULT_READ_SIZE;
 
     int nthreads = config_threadcount();
 
@@ -349,6 +435,11 @@ void dcb_free_all_memory(DCB* dcb)
         MXS_FREE(dcb->path);
     }
 
+    if (dcb->listener_shards)
+    {
+        dcb_free_listener_shards(dcb);
+    }
+
     // Ensure that id is immediately the wrong one.
     dcb->poll.owner = reinterpret_cast<MXB_WORKER*>(0xdeadbeef);
     MXS_FREE(dcb);
@@ -593,118 +684,109 @@ int dcb_read(DCB* dcb,
         return 0;
     }
 
+    this_thread.io_stats.n_read_events++;
+
     while (0 == maxbytes || nreadtotal < maxbytes)
     {
-        int bytes_available;
+        int bufsize = maxbytes == 0 ? dcb->read_size : MXS_MIN((int)dcb->read_size, maxbytes - nreadtotal);
+        GWBUF* buffer = dcb_basic_read(dcb, bufsize, &nsingleread);
 
-        bytes_available = dcb_bytes_readable(dcb);
-        if (bytes_available <= 0)
-        {
-            return bytes_available < 0 ? -1
-                                       :/** Handle closed client socket */
-                   dcb_read_no_bytes_available(dcb, nreadtotal);
-        }
-        else
+        if (buffer)
         {
-            GWBUF* buffer;
             dcb->last_read = mxs_clock();
+            nreadtotal += nsingleread;
+            MXS_DEBUG("Read %d bytes from dcb %p in state %s fd %d.",
+                      nsingleread,
+                      dcb,
+                      STRDCBSTATE(dcb->state),
+                      dcb->fd);
 
-            buffer = dcb_basic_read(dcb, bytes_available, maxbytes, nreadtotal, &nsingleread);
-            if (buffer)
-            {
-                nreadtotal += nsingleread;
-                MXS_DEBUG("Read %d bytes from dcb %p in state %s fd %d.",
-                          nsingleread,
-                          dcb,
-                          STRDCBSTATE(dcb->state),
-                          dcb->fd);
+            /*< Assign the target server for the gwbuf */
+            buffer->server = dcb->server;
+            /*< Append read data to the gwbuf */
+            *head = gwbuf_append(*head, buffer);
 
-                /*< Assign the target server for the gwbuf */
-                buffer->server = dcb->server;
-                /*< Append read data to the gwbuf */
-                *head = gwbuf_append(*head, buffer);
-            }
-            else
+            dcb_adjust_read_size(dcb, bufsize, nsingleread);
+
+            if (nsingleread < bufsize)
             {
+                // A short read means that the socket has been drained; another
+                // read would only return EAGAIN.
                 break;
             }
         }
+        else
+        {
+            return dcb_read_no_bytes_available(dcb, nreadtotal, nsingleread < 0 ? errno : 0);
+        }
     }   /*< while (0 == maxbytes || nreadtotal < maxbytes) */
 
     return nreadtotal;
 }
 
 /**
- * Find the number of bytes available for the DCB's socket
+ * Determine the return code needed when read has run out of data
  *
- * @param dcb       The DCB to read from
- * @return          -1 on error, otherwise the total number of bytes available
+ * @param dcb           The DCB to read from
+ * @param nreadtotal    Number of bytes that have been read
+ * @param eno           The errno of the last read, 0 if it returned end of file
+ * @return              -1 on error, 0 for conditions not treated as error
  */
-static int dcb_bytes_readable(DCB* dcb)
+static int dcb_read_no_bytes_available(DCB* dcb, int nreadtotal, int eno)
 {
-    int bytesavailable;
-
-    if (-1 == ioctl(dcb->fd, FIONREAD, &bytesavailable))
+    /** Handle closed client socket */
+    if (nreadtotal == 0
+        && DCB_ROLE_CLIENT_HANDLER == dcb->dcb_role
+        && eno != EAGAIN
+        && eno != EWOULDBLOCK
+        && eno != 0)
     {
-        MXS_ERROR("ioctl FIONREAD for dcb %p in state %s fd %d failed: %d, %s",
-                  dcb,
-                  STRDCBSTATE(dcb->state),
-                  dcb->fd,
-                  errno,
-                  mxs_strerror(errno));
         return -1;
     }
-    else
-    {
-        return bytesavailable;
-    }
+
+    return nreadtotal;
 }
 
 /**
- * Determine the return code needed when read has run out of data
+ * Adapt the size of the buffer the DCB reads into to the observed reads.
  *
- * @param dcb           The DCB to read from
- * @param nreadtotal    Number of bytes that have been read
- * @return              -1 on error, 0 for conditions not treated as error
+ * If a read fills the whole buffer the size is doubled and if a read uses
+ * only a small part of it the size is halved. That way a DCB receiving large
+ * result sets reads them in few system calls, while a DCB receiving small
+ * packets does not allocate more memory than it needs. A large buffer that a
+ * read used only a small part of is not kept, see dcb_basic_read().
+ *
+ * @param dcb      The DCB that was read from
+ * @param bufsize  The size of the buffer that was read into
+ * @param nread    The number of bytes that were read
  */
-static int dcb_read_no_bytes_available(DCB* dcb, int nreadtotal)
+static void dcb_adjust_read_size(DCB* dcb, int bufsize, int nread)
 {
-    /** Handle closed client socket */
-    if (nreadtotal == 0 && DCB_ROLE_CLIENT_HANDLER == dcb->dcb_role)
+    if (nread == bufsize && (uint32_t)bufsize == dcb->read_size)
     {
-        char c;
-        int l_errno = 0;
-        long r = -1;
-
-        /* try to read 1 byte, without consuming the socket buffer */
-        r = recv(dcb->fd, &c, sizeof(char), MSG_PEEK);
-        l_errno = errno;
-
-        if (r <= 0
-            && l_errno != EAGAIN
-            && l_errno != EWOULDBLOCK
-            && l_errno != 0)
+        if (dcb->read_size < DCB_MAX_READ_SIZE)
         {
-            return -1;
+            dcb->read_size *= 2;
         }
     }
-    return nreadtotal;
+    else if ((uint32_t)nread < dcb->read_size / 4 && dcb->read_size > DCB_MIN_READ_SIZE)
+    {
+        dcb->read_size /= 2;
+    }
 }
 
 /**
  * Basic read function to carry out a single read operation on the DCB socket.
  *
  * @param dcb               The DCB to read from
- * @param bytesavailable    Pointer to linked list to append data to
- * @param maxbytes          Maximum bytes to read (0 = no limit)
- * @param nreadtotal        Total number of bytes already read
- * @param nsingleread       To be set as the number of bytes read this time
+ * @param bufsize           The size of the buffer to read into
+ * @param nsingleread       To be set as the number of bytes read this time,
+ *                          0 if nothing could be read and -1 on error
  * @return                  GWBUF* buffer containing new data, or null.
  */
-static GWBUF* dcb_basic_read(DCB* dcb, int bytesavailable, int maxbytes, int nreadtotal, int* nsingleread)
+static GWBUF* dcb_basic_read(DCB* dcb, int bufsize, int* nsingleread)
 {
     GWBUF* buffer;
-    int bufsize = maxbytes == 0 ? bytesavailable : MXS_MIN(bytesavailable, maxbytes - nreadtotal);
 
     if ((buffer = gwbuf_alloc(bufsize)) == NULL)
     {
@@ -712,23 +794,53 @@ static GWBUF* dcb_basic_read(DCB* dcb, int bytesavailable, int maxbytes, int nre
     }
     else
     {
+        errno = 0;
         *nsingleread = read(dcb->fd, GWBUF_DATA(buffer), bufsize);
         dcb->stats.n_reads++;
+        this_thread.io_stats.n_read_calls++;
 
         if (*nsingleread <= 0)
         {
-            if (errno != 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            int eno = errno;
+
+            if (eno != 0 && eno != EAGAIN && eno != EWOULDBLOCK)
             {
                 MXS_ERROR("Read failed, dcb %p in state %s fd %d: %d, %s",
                           dcb,
                           STRDCBSTATE(dcb->state),
                           dcb->fd,
-                          errno,
-                          mxs_strerror(errno));
+                          eno,
+                          mxs_strerror(eno));
             }
             gwbuf_free(buffer);
+            errno = eno;
             buffer = NULL;
         }
+        else
+        {
+            this_thread.io_stats.n_read_bytes += *nsingleread;
+
+            if ((uint32_t)bufsize > DCB_DEFAULT_READ_SIZE && *nsingleread <= bufsize / 2)
+            {
+                // The data can stay in the queues of the DCB or the session for a long
+                // time, don't keep a large buffer for a small amount of it.
+                GWBUF* copy = gwbuf_alloc_and_load(*nsingleread, GWBUF_DATA(buffer));
+
+                if (copy)
+                {
+                    gwbuf_free(buffer);
+                    buffer = copy;
+                }
+                else
+                {
+                    gwbuf_rtrim(buffer, bufsize - *nsingleread);
+                }
+            }
+            else if (*nsingleread < bufsize)
+            {
+                gwbuf_rtrim(buffer, bufsize - *nsingleread);
+            }
+        }
     }
     return buffer;
 }
@@ -760,6 +872,8 @@ static int dcb_read_SSL(DCB* dcb, GWBUF** head)
         dcb_drain_writeq(dcb);
     }
 
+    this_thread.io_stats.n_read_events++;
+
     dcb->last_read = mxs_clock();
     buffer = dcb_basic_read_SSL(dcb, &nsingleread);
     if (buffer)
@@ -800,6 +914,7 @@ static GWBUF* dcb_basic_read_SSL(DCB* dcb, int* nsingleread)
     *nsingleread = SSL_read(dcb->ssl, temp_buffer, MXS_SO_RCVBUF_SIZE);
 
     dcb->stats.n_reads++;
+    this_thread.io_stats.n_read_calls++;
 
     switch (SSL_get_error(dcb->ssl, *nsingleread))
     {
@@ -810,6 +925,7 @@ static GWBUF* dcb_basic_read_SSL(DCB* dcb, int* nsingleread)
             *nsingleread = -1;
             return NULL;
         }
+        this_thread.io_stats.n_read_bytes += *nsingleread;
         /* If we were in a retry situation, need to clear flag and attempt write */
         if (dcb->ssl_read_want_write || dcb->ssl_read_want_read)
         {
@@ -1018,7 +1134,11 @@ int dcb_drain_writeq(DCB* dcb)
     {
         int written;
         bool stop_writing = false;
-        /* The value put into written will be >= 0 */
+        /*
+         * The whole chain is handed to the write function, which writes as
+         * much of it as it can with a single call. The value put into written
+         * will be >= 0.
+         */
         if (dcb->ssl)
         {
             written = gw_write_SSL(dcb, local_writeq, &stop_writing);
@@ -1027,6 +1147,12 @@ int dcb_drain_writeq(DCB* dcb)
         {
             written = gw_write(dcb, local_writeq, &stop_writing);
         }
+
+        /** Consume the bytes we have written from the list of buffers,
+         * and increment the total bytes written. */
+        local_writeq = gwbuf_consume(local_writeq, written);
+        total_written += written;
+
         /*
          * If the stop_writing boolean is set, writing has become blocked,
          * so the remaining data is put back at the front of the write
@@ -1037,13 +1163,6 @@ int dcb_drain_writeq(DCB* dcb)
             dcb->writeq = gwbuf_append(local_writeq, dcb->writeq);
             local_writeq = NULL;
         }
-        else
-        {
-            /** Consume the bytes we have written from the list of buffers,
-             * and increment the total bytes written. */
-            local_writeq = gwbuf_consume(local_writeq, written);
-            total_written += written;
-        }
     }
 
     if (dcb->writeq == NULL)
@@ -1055,6 +1174,11 @@ int dcb_drain_writeq(DCB* dcb)
     mxb_assert(dcb->writeqlen >= (uint32_t)total_written);
     dcb->writeqlen -= total_written;
 
+    if (total_written > 0)
+    {
+        dcb->last_write = mxs_clock();
+    }
+
     if (dcb->high_water_reached && DCB_BELOW_LOW_WATER(dcb))
     {
         dcb_call_callback(dcb, DCB_REASON_LOW_WATER);
@@ -1351,6 +1475,7 @@ static bool dcb_maybe_add_persistent(DCB* dcb)
         dcb->readq = NULL;
         dcb->delayq = NULL;
         dcb->writeq = NULL;
+        dcb->ssl_write_pending = 0;
 
         dcb->nextpersistent = dcb->server->persistent[owner->id()];
         dcb->server->persistent[owner->id()] = dcb;
@@ -1787,6 +1912,15 @@ void dcb_printf(DCB* dcb, const char* fmt, ...)
  * linked from the DCB. All communication is encrypted and done via the SSL
  * structure. Data is written from the DCB write queue.
  *
+ * If the first buffer of the queue is small, the following buffers are
+ * coalesced into a thread specific buffer so that the data of several
+ * buffers is written with one SSL_write(), that is, in one TLS record.
+ *
+ * A write that failed with SSL_ERROR_WANT_READ or SSL_ERROR_WANT_WRITE must be
+ * retried with the same data and length. As nothing is consumed from the queue
+ * until the write succeeds, the retry writes the same number of bytes from the
+ * start of the queue even if more data has been queued since then.
+ *
  * @param dcb           The DCB having an SSL connection
  * @param writeq        A buffer list containing the data to be written
  * @param stop_writing  Set to true if the caller should stop writing, false otherwise
@@ -1795,16 +1929,49 @@ void dcb_printf(DCB* dcb, const char* fmt, ...)
 static int gw_write_SSL(DCB* dcb, GWBUF* writeq, bool* stop_writing)
 {
     int written;
+    const uint8_t* data = GWBUF_DATA(writeq);
+    size_t nbytes = GWBUF_LENGTH(writeq);
+    size_t pending = dcb->ssl_write_pending;
+    int nbuffers = 1;
 
-    written = SSL_write(dcb->ssl, GWBUF_DATA(writeq), GWBUF_LENGTH(writeq));
+    // A retried write is at least as long as the first buffer, it is only
+    // longer if the buffers were coalesced
+    mxb_assert(pending == 0 || pending >= nbytes);
+
+    if (pending > nbytes || (pending == 0 && writeq->next && nbytes < DCB_SSL_WRITE_SIZE))
+    {
+        uint8_t* ptr = this_thread.ssl_write_buffer;
+        size_t limit = pending ? pending : DCB_SSL_WRITE_SIZE;
+        nbytes = 0;
+        nbuffers = 0;
+
+        for (GWBUF* buf = writeq; buf && nbytes < limit; buf = buf->next)
+        {
+            size_t len = MXS_MIN(GWBUF_LENGTH(buf), limit - nbytes);
+            memcpy(ptr + nbytes, GWBUF_DATA(buf), len);
+            nbytes += len;
+            ++nbuffers;
+        }
+
+        data = ptr;
+    }
+
+    mxb_assert(pending == 0 || nbytes == pending);
+    written = SSL_write(dcb->ssl, data, nbytes);
+
+    this_thread.io_stats.n_write_calls++;
+    this_thread.io_stats.n_write_buffers += nbuffers;
 
     *stop_writing = false;
+    dcb->ssl_write_pending = 0;
+
     switch ((SSL_get_error(dcb->ssl, written)))
     {
     case SSL_ERROR_NONE:
         /* Successful write */
         dcb->ssl_write_want_read = false;
         dcb->ssl_write_want_write = false;
+        this_thread.io_stats.n_write_bytes += written;
         break;
 
     case SSL_ERROR_ZERO_RETURN:
@@ -1818,6 +1985,7 @@ static int gw_write_SSL(DCB* dcb, GWBUF* writeq, bool* stop_writing)
         *stop_writing = true;
         dcb->ssl_write_want_read = true;
         dcb->ssl_write_want_write = false;
+        dcb->ssl_write_pending = nbytes;
         break;
 
     case SSL_ERROR_WANT_WRITE:
@@ -1825,6 +1993,7 @@ static int gw_write_SSL(DCB* dcb, GWBUF* writeq, bool* stop_writing)
         *stop_writing = true;
         dcb->ssl_write_want_read = false;
         dcb->ssl_write_want_write = true;
+        dcb->ssl_write_pending = nbytes;
         break;
 
     case SSL_ERROR_SYSCALL:
@@ -1851,6 +2020,10 @@ static int gw_write_SSL(DCB* dcb, GWBUF* writeq, bool* stop_writing)
 /**
  * Write data to a DCB. The data is taken from the DCB's write queue.
  *
+ * The buffers of the queue are gathered into an iovec array and written
+ * with a single writev(), so that a queue consisting of many small
+ * packets does not cost one system call per packet.
+ *
  * @param dcb           The DCB to write buffer
  * @param writeq        A buffer list containing the data to be written
  * @param stop_writing  Set to true if the caller should stop writing, false otherwise
@@ -1858,17 +2031,33 @@ static int gw_write_SSL(DCB* dcb, GWBUF* writeq, bool* stop_writing)
  */
 static int gw_write(DCB* dcb, GWBUF* writeq, bool* stop_writing)
 {
-    int written = 0;
+    ssize_t written = 0;
     int fd = dcb->fd;
-    size_t nbytes = GWBUF_LENGTH(writeq);
-    void* buf = GWBUF_DATA(writeq);
+    struct iovec iov[DCB_WRITEV_MAX_BUFFERS];
+    int niov = 0;
+    size_t nbytes = 0;
     int saved_errno;
 
+    for (GWBUF* buf = writeq; buf && niov < DCB_WRITEV_MAX_BUFFERS; buf = buf->next)
+    {
+        size_t len = GWBUF_LENGTH(buf);
+
+        if (len > 0)
+        {
+            iov[niov].iov_base = GWBUF_DATA(buf);
+            iov[niov].iov_len = len;
+            nbytes += len;
+            ++niov;
+        }
+    }
+
     errno = 0;
 
     if (fd > 0)
     {
-        written = write(fd, buf, nbytes);
+        written = writev(fd, iov, niov);
+        this_thread.io_stats.n_write_calls++;
+        this_thread.io_stats.n_write_buffers += niov;
     }
 
     saved_errno = errno;
@@ -1889,7 +2078,10 @@ static int gw_write(DCB* dcb, GWBUF* writeq, bool* stop_writing)
     }
     else
     {
-        *stop_writing = false;
+        // A short write means that the socket buffer is full. There is no
+        // point in trying again, as that would just return EAGAIN.
+        *stop_writing = (size_t)written < nbytes;
+        this_thread.io_stats.n_write_bytes += written;
     }
 
     return written > 0 ? written : 0;
@@ -2215,6 +2407,10 @@ static int dcb_create_SSL(DCB* dcb, SSL_LISTENER* ssl)
         return -1;
     }
 
+    // A retried write has the same data and length but it is not required to
+    // be made from the same address as the write queue may have been rebuilt.
+    SSL_set_mode(dcb->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     return 0;
 }
 
@@ -2400,6 +2596,7 @@ DCB* dcb_accept(DCB* dcb)
     if ((c_sock = dcb_accept_one_connection(dcb, (struct sockaddr*)&client_conn)) >= 0)
     {
         dcb->stats.n_accepts++;
+        this_thread.io_stats.n_accepts++;
 
         configure_network_socket(c_sock, client_conn.ss_family);
 
@@ -2536,7 +2733,7 @@ static int dcb_accept_one_connection(DCB* dcb, struct sockaddr* client_conn)
         int eno = 0;
 
         /* new connection from client */
-        c_sock = accept(dcb->fd,
+        c_sock = accept(dcb_listener_fd(dcb),
                         client_conn,
                         &client_len);
         eno = errno;
@@ -2634,6 +2831,10 @@ int dcb_listen(DCB* dcb, const char* config, const char* protocol_name)
             dcb->path = MXS_STRDUP_A(host);
         }
     }
+    else if (port > 0 && config_get_global_options()->listener_mode != MXS_LISTENER_MODE_SHARED)
+    {
+        listener_socket = dcb_listen_create_shards(dcb, host, port);
+    }
     else if (port > 0)
     {
         listener_socket = dcb_listen_create_socket_inet(host, port);
@@ -2666,7 +2867,13 @@ int dcb_listen(DCB* dcb, const char* config, const char* protocol_name)
      *
      * @see man 2 listen
      */
-    if (listen(listener_socket, INT_MAX) != 0)
+    if (dcb->listener_shards)
+    {
+        // The sockets of the shards have already been put into listening mode.
+        MXS_NOTICE("Listening for connections at [%s]:%u with protocol %s, using %d SO_REUSEPORT sockets",
+                   host, port, protocol_name, dcb->n_listener_shards);
+    }
+    else if (listen(listener_socket, INT_MAX) != 0)
     {
         MXS_ERROR("Failed to start listening on [%s]:%u with protocol '%s': %d, %s",
                   host,
@@ -2677,8 +2884,10 @@ int dcb_listen(DCB* dcb, const char* config, const char* protocol_name)
         close(listener_socket);
         return -1;
     }
-
-    MXS_NOTICE("Listening for connections at [%s]:%u with protocol %s", host, port, protocol_name);
+    else
+    {
+        MXS_NOTICE("Listening for connections at [%s]:%u with protocol %s", host, port, protocol_name);
+    }
 
     // assign listener_socket to dcb
     dcb->fd = listener_socket;
@@ -2706,6 +2915,170 @@ static int dcb_listen_create_socket_inet(const char* host, uint16_t port)
     return open_network_socket(MXS_SOCKET_LISTENER, &server_address, host, port);
 }
 
+/**
+ * Attach a classic BPF program to a SO_REUSEPORT group that selects the
+ * socket whose index is the number of the CPU that received the connection,
+ * modulo the number of sockets. When the routing workers are pinned to the
+ * CPUs in the same order, a connection is then accepted on the CPU that
+ * handled its packets.
+ *
+ * @param fd        A socket in the group
+ * @param nsockets  The number of sockets in the group
+ *
+ * @return True, if the program could be attached.
+ */
+static bool dcb_attach_reuseport_cpu_steering(int fd, int nsockets)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    struct sock_filter code[] =
+    {
+        // A = the current CPU
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        // A = A % nsockets
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)nsockets},
+        // return A
+        {BPF_RET | BPF_A, 0, 0, 0}
+    };
+
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0)
+    {
+        MXS_ERROR("Failed to attach CPU steering program to listener socket: %d, %s",
+                  errno,
+                  mxs_strerror(errno));
+        return false;
+    }
+
+    return true;
+#else
+    MXS_ERROR("CPU steering of listener sockets is not supported on this system.");
+    return false;
+#endif
+}
+
+/**
+ * @brief Create one SO_REUSEPORT listener socket per routing worker
+ *
+ * The sockets are bound to the same address and put into listening mode in
+ * the order of the workers, so that the index of a socket in the SO_REUSEPORT
+ * group is the same as the id of the worker that polls it.
+ *
+ * @param dcb  The listener DCB, the sockets are stored in it
+ * @param host The network address to listen on
+ * @param port The port to listen on
+ * @return     The socket of the first shard or -1 on error
+ */
+static int dcb_listen_create_shards(DCB* dcb, const char* host, uint16_t port)
+{
+    int n = config_threadcount();
+    dcb_listener_shard* shards = (dcb_listener_shard*)MXS_CALLOC(n, sizeof(dcb_listener_shard));
+
+    if (!shards)
+    {
+        return -1;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        shards[i].fd = DCBFD_CLOSED;
+    }
+
+    dcb->listener_shards = shards;
+    dcb->n_listener_shards = n;
+
+    bool ok = true;
+
+    for (int i = 0; ok && i < n; ++i)
+    {
+        struct sockaddr_storage server_address = {};
+        int fd = open_network_socket(MXS_SOCKET_REUSEPORT_LISTENER, &server_address, host, port);
+
+        if (fd == -1)
+        {
+            ok = false;
+        }
+        else
+        {
+            shards[i].poll.handler = dcb_listener_shard_handler;
+            shards[i].dcb = dcb;
+            shards[i].fd = fd;
+
+            if (listen(fd, INT_MAX) != 0)
+            {
+                MXS_ERROR("Failed to start listening on [%s]:%u: %d, %s",
+                          host,
+                          port,
+                          errno,
+                          mxs_strerror(errno));
+                ok = false;
+            }
+        }
+    }
+
+    if (ok && config_get_global_options()->listener_mode == MXS_LISTENER_MODE_REUSEPORT_CPU)
+    {
+        ok = dcb_attach_reuseport_cpu_steering(shards[0].fd, n);
+    }
+
+    if (!ok)
+    {
+        dcb_free_listener_shards(dcb);
+        return -1;
+    }
+
+    return shards[0].fd;
+}
+
+/**
+ * Close the sockets of the shards of a listener and free the shards.
+ *
+ * The socket of the first shard is also the socket of the DCB and is only
+ * closed here if the DCB does not refer to it.
+ *
+ * @param dcb  The listener DCB
+ */
+static void dcb_free_listener_shards(DCB* dcb)
+{
+    for (int i = 0; i < dcb->n_listener_shards; ++i)
+    {
+        int fd = dcb->listener_shards[i].fd;
+
+        if (fd != DCBFD_CLOSED && (i != 0 || dcb->fd != fd))
+        {
+            close(fd);
+        }
+    }
+
+    MXS_FREE(dcb->listener_shards);
+    dcb->listener_shards = NULL;
+    dcb->n_listener_shards = 0;
+}
+
+/**
+ * Get the socket a listener should accept connections from.
+ *
+ * @param dcb  The listener DCB
+ * @return     The socket of the shard of the calling worker, if the listener
+ *             is sharded, otherwise the socket of the DCB.
+ */
+static int dcb_listener_fd(DCB* dcb)
+{
+    if (dcb->listener_shards)
+    {
+        int id = RoutingWorker::get_current_id();
+
+        if (id >= 0 && id < dcb->n_listener_shards)
+        {
+            return dcb->listener_shards[id].fd;
+        }
+    }
+
+    return dcb->fd;
+}
+
 /**
  * @brief Create a Unix domain socket
  *
@@ -2832,6 +3205,11 @@ static void dcb_add_to_list(DCB* dcb)
             this_unit.all_dcbs[id]->thread.tail->thread.next = dcb;
             this_unit.all_dcbs[id]->thread.tail = dcb;
         }
+
+        if (this_unit.check_timeouts && dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+        {
+            dcb_schedule_idle_timeout(dcb);
+        }
     }
 }
 
@@ -2844,6 +3222,8 @@ static void dcb_remove_from_list(DCB* dcb)
 {
     int id = static_cast<RoutingWorker*>(dcb->poll.owner)->id();
 
+    dcb_cancel_idle_timeout(dcb);
+
     if (dcb == this_unit.all_dcbs[id])
     {
         DCB* tail = this_unit.all_dcbs[id]->thread.tail;
@@ -2884,12 +3264,73 @@ static void dcb_remove_from_list(DCB* dcb)
     dcb->thread.tail = NULL;
 }
 
+/**
+ * Schedule the idle timeout of a client DCB according to the current setting
+ * of its service. Called in the worker that owns the DCB.
+ *
+ * @param dcb  The client DCB.
+ */
+static void dcb_schedule_idle_timeout(DCB* dcb)
+{
+    mxb_assert(dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER && dcb->listener);
+    int64_t timeout = dcb->listener->service->conn_idle_timeout * 10;
+
+    if (timeout && dcb->state == DCB_STATE_POLLING)
+    {
+        DcbIdleTimer* timer = static_cast<DcbIdleTimer*>(dcb->idle_timer);
+
+        if (!timer)
+        {
+            timer = new(idle_timers.pool.allocate()) DcbIdleTimer;
+            timer->dcb = dcb;
+            dcb->idle_timer = timer;
+        }
+
+        // The session times out once it has been idle for longer than the timeout.
+        idle_timers.wheel.schedule(timer, dcb->last_read + timeout + 1);
+    }
+}
+
+/**
+ * Remove the idle timeout of a DCB, if it has one.
+ *
+ * @param dcb  The DCB.
+ */
+static void dcb_cancel_idle_timeout(DCB* dcb)
+{
+    DcbIdleTimer* timer = static_cast<DcbIdleTimer*>(dcb->idle_timer);
+
+    if (timer)
+    {
+        idle_timers.wheel.cancel(timer);
+        timer->~DcbIdleTimer();
+        idle_timers.pool.deallocate(timer);
+        dcb->idle_timer = NULL;
+    }
+}
+
 /**
  * Enable the timing out of idle connections.
+ *
+ * Called when the idle timeout of a service is set. The timeouts of the existing
+ * client connections are rescheduled, so that the new value takes effect at once.
  */
 void dcb_enable_session_timeouts()
 {
     this_unit.check_timeouts = true;
+
+    RoutingWorker::broadcast([]() {
+                                 int id = RoutingWorker::get_current_id();
+
+                                 for (DCB* dcb = this_unit.all_dcbs[id]; dcb; dcb = dcb->thread.next)
+                                 {
+                                     if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
+                                     {
+                                         dcb_schedule_idle_timeout(dcb);
+                                     }
+                                 }
+                             },
+                             Worker::EXECUTE_AUTO);
 }
 
 /**
@@ -2897,40 +3338,282 @@ void dcb_enable_session_timeouts()
  *
  * If the time since a session last sent data is greater than the set value in the
  * service, it is disconnected. The connection timeout is disabled by default.
+ *
+ * Each client DCB with a timeout has an entry in the timer wheel of its worker,
+ * expiring when the timeout would be exceeded unless more data is read. As data
+ * is read the entry is not moved; instead, when it expires the DCB is checked
+ * and either timed out or rescheduled based on when data was last read.
  */
 void dcb_process_idle_sessions(int thr)
 {
-    if (this_unit.check_timeouts && mxs_clock() >= this_thread.next_timeout_check)
+    int64_t now = mxs_clock();
+
+    idle_timers.wheel.advance(now, [now](mxb::TimerWheel::Entry* pEntry) {
+                                  DCB* dcb = static_cast<DcbIdleTimer*>(pEntry)->dcb;
+                                  SERVICE* service = dcb->listener->service;
+
+                                  if (service->conn_idle_timeout && dcb->state == DCB_STATE_POLLING)
+                                  {
+                                      int64_t idle = now - dcb->last_read;
+                                      int64_t timeout = service->conn_idle_timeout * 10;
+
+                                      if (idle > timeout)
+                                      {
+                                          MXS_WARNING("Timing out '%s'@%s, idle for %.1f seconds",
+                                                      dcb->user ? dcb->user : "<unknown>",
+                                                      dcb->remote ? dcb->remote : "<unknown>",
+                                                      (float)idle / 10.f);
+                                          dcb->session->close_reason = SESSION_CLOSE_TIMEOUT;
+                                          poll_fake_hangup_event(dcb);
+                                      }
+                                      else
+                                      {
+                                          dcb_schedule_idle_timeout(dcb);
+                                      }
+                                  }
+                              });
+}
+
+/**
+ * Check whether a DCB has nothing pending that would tie it to its current worker.
+ *
+ * @param dcb  The DCB to check.
+ *
+ * @return True, if the DCB can be moved to another worker.
+ */
+static bool dcb_is_movable(const DCB* dcb)
+{
+    return dcb->state == DCB_STATE_POLLING
+           && dcb->fd > 0
+           && dcb->persistentstart == 0
+           && !dcb->writeq
+           && !dcb->delayq
+           && !dcb->readq
+           && !dcb->fakeq
+           && !dcb->high_water_reached
+           && !dcb->ssl_read_want_read
+           && !dcb->ssl_read_want_write
+           && !dcb->ssl_write_want_read
+           && !dcb->ssl_write_want_write;
+}
+
+/**
+ * Check whether a session can be moved to another worker.
+ *
+ * A session can be moved if it is not processing anything: the client has been
+ * silent for a while, nothing is queued, no routing is delayed and no backend
+ * has data sent to it after it last replied. Sessions with filters are never
+ * moved, as a filter may keep state that is bound to the worker. For the same
+ * reason only the sessions of routers that declare RCAP_TYPE_MOVABLE_SESSIONS
+ * are moved.
+ *
+ * @param ses  The session to check.
+ *
+ * @return True, if the session can be moved.
+ */
+static bool session_is_movable(MXS_SESSION* ses)
+{
+    Session* session = static_cast<Session*>(ses);
+    DCB* client = ses->client_dcb;
+
+    if (ses->state != SESSION_STATE_ROUTER_READY
+        || ses->response.buffer
+        || ses->load_active
+        || !session->get_filters().empty()
+        || session->has_delayed_routing()
+        || !dcb_is_movable(client)
+        || mxs_clock() - client->last_read < DCB_MOVE_MIN_IDLE
+        || !rcap_type_required(service_get_capabilities(ses->service), RCAP_TYPE_MOVABLE_SESSIONS))
     {
-        /** Because the resolution of the timeout is one second, we only need to
-         * check for it once per second. One heartbeat is 100 milliseconds. */
-        this_thread.next_timeout_check = mxs_clock() + 10;
+        return false;
+    }
 
-        for (DCB* dcb = this_unit.all_dcbs[thr]; dcb; dcb = dcb->thread.next)
+    for (DCB* backend : session->dcb_set())
+    {
+        if (!dcb_is_movable(backend) || backend->last_write > backend->last_read)
         {
-            if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
-            {
-                mxb_assert(dcb->listener);
-                SERVICE* service = dcb->listener->service;
+            return false;
+        }
+    }
 
-                if (service->conn_idle_timeout && dcb->state == DCB_STATE_POLLING)
-                {
-                    int64_t idle = mxs_clock() - dcb->last_read;
-                    int64_t timeout = service->conn_idle_timeout * 10;
+    return true;
+}
 
-                    if (idle > timeout)
-                    {
-                        MXS_WARNING("Timing out '%s'@%s, idle for %.1f seconds",
-                                    dcb->user ? dcb->user : "<unknown>",
-                                    dcb->remote ? dcb->remote : "<unknown>",
-                                    (float)idle / 10.f);
-                        dcb->session->close_reason = SESSION_CLOSE_TIMEOUT;
-                        poll_fake_hangup_event(dcb);
-                    }
-                }
+#ifdef SS_DEBUG
+static void gwbuf_set_owner(GWBUF* buffer, int owner)
+{
+    for (; buffer; buffer = buffer->next)
+    {
+        buffer->owner = owner;
+    }
+}
+#endif
+
+/**
+ * Add moved DCBs to the current worker. Called in the worker the DCBs were moved to.
+ *
+ * @param dcbs        The client DCB followed by the backend DCBs of the session.
+ * @param registered  Whether the session was registered in the worker it was moved from.
+ */
+static void session_attach_to_current_worker(const std::vector<DCB*>& dcbs, bool registered)
+{
+    RoutingWorker* worker = RoutingWorker::get_current();
+    DCB* client = dcbs.front();
+    MXS_SESSION* session = client->session;
+    bool ok = true;
+
+    for (DCB* dcb : dcbs)
+    {
+        mxb_assert(dcb->poll.owner == worker);
+
+#ifdef SS_DEBUG
+        gwbuf_set_owner(dcb->writeq, worker->id());
+        gwbuf_set_owner(dcb->delayq, worker->id());
+        gwbuf_set_owner(dcb->readq, worker->id());
+        gwbuf_set_owner(dcb->fakeq, worker->id());
+#endif
+
+        if (!worker->add_fd(dcb->fd, poll_events, (MXB_POLL_DATA*)dcb))
+        {
+            ok = false;
+        }
+
+        dcb_add_to_list(dcb);
+    }
+
+    if (registered)
+    {
+        MXB_AT_DEBUG(bool added = ) worker->session_registry().add(session);
+        mxb_assert(added);
+    }
+
+    if (ok)
+    {
+        this_thread.io_stats.n_sessions_moved_in++;
+    }
+    else
+    {
+        MXS_ERROR("Could not add the descriptors of session %lu to worker %d, closing the session.",
+                  session->ses_id, worker->id());
+        poll_fake_hangup_event(client);
+    }
+
+    session_put_ref(session);
+}
+
+/**
+ * Move a session from the current worker to another one.
+ *
+ * The descriptors are removed from the epoll instance and the DCB list of the
+ * current worker, after which the rest of the operation is posted to the
+ * message queue of the target worker. Data that arrives in between is seen
+ * once the descriptors are added to the epoll instance of the target worker.
+ *
+ * @param session  The session to move.
+ * @param to       The worker to move the session to.
+ *
+ * @return True, if the session was handed over to the other worker.
+ */
+static bool session_move_to_worker(MXS_SESSION* session, RoutingWorker* to)
+{
+    RoutingWorker* from = RoutingWorker::get_current();
+    mxb_assert(session->client_dcb->poll.owner == from);
+
+    std::vector<DCB*> dcbs;
+    dcbs.push_back(session->client_dcb);
+
+    for (DCB* backend : static_cast<Session*>(session)->dcb_set())
+    {
+        dcbs.push_back(backend);
+    }
+
+    size_t n_removed = 0;
+
+    while (n_removed < dcbs.size() && from->remove_fd(dcbs[n_removed]->fd))
+    {
+        ++n_removed;
+    }
+
+    if (n_removed != dcbs.size())
+    {
+        for (size_t i = 0; i < n_removed; ++i)
+        {
+            from->add_fd(dcbs[i]->fd, poll_events, (MXB_POLL_DATA*)dcbs[i]);
+        }
+
+        return false;
+    }
+
+    for (DCB* dcb : dcbs)
+    {
+        dcb_remove_from_list(dcb);
+        dcb->poll.owner = to;
+    }
+
+    bool registered = from->session_registry().remove(session->ses_id);
+    session_get_ref(session);
+
+    auto attach = [dcbs, registered]() {
+            session_attach_to_current_worker(dcbs, registered);
+        };
+
+    if (!to->execute(attach, Worker::EXECUTE_QUEUED))
+    {
+        // Could not post the message, take the session back.
+        for (DCB* dcb : dcbs)
+        {
+            dcb->poll.owner = from;
+        }
+
+        session_attach_to_current_worker(dcbs, registered);
+        return false;
+    }
+
+    this_thread.io_stats.n_sessions_moved_out++;
+    return true;
+}
+
+int dcb_move_idle_sessions(int to_id, int percent)
+{
+    RoutingWorker* from = RoutingWorker::get_current();
+    RoutingWorker* to = RoutingWorker::get(to_id);
+    mxb_assert(from && to && from != to);
+
+    // The DCB list must not be modified while it is being iterated, so the
+    // candidates are collected first.
+    std::vector<MXS_SESSION*> candidates;
+    int n_sessions = 0;
+
+    for (DCB* dcb = this_unit.all_dcbs[from->id()]; dcb; dcb = dcb->thread.next)
+    {
+        if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER && dcb->session)
+        {
+            ++n_sessions;
+
+            if (session_is_movable(dcb->session))
+            {
+                candidates.push_back(dcb->session);
             }
         }
     }
+
+    size_t n_wanted = MXS_MAX(1, n_sessions * percent / 100);
+    int n_moved = 0;
+
+    for (size_t i = 0; i < candidates.size() && i < n_wanted; ++i)
+    {
+        if (session_move_to_worker(candidates[i], to))
+        {
+            ++n_moved;
+        }
+    }
+
+    if (n_moved != 0)
+    {
+        MXS_INFO("Moved %d idle sessions from worker %d to worker %d.", n_moved, from->id(), to->id());
+    }
+
+    return n_moved;
 }
 
 /** Helper class for serial iteration over all DCBs */
@@ -3074,6 +3757,7 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
             if (dcb_session_check(dcb, "write_ready"))
             {
                 DCB_EH_NOTICE("Calling dcb->func.write_ready(%p)", dcb);
+                HandlerTimer timer(DCB_HANDLER_WRITE);
                 dcb->func.write_ready(dcb);
             }
         }
@@ -3103,6 +3787,7 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
             if (dcb_session_check(dcb, "accept"))
             {
                 DCB_EH_NOTICE("Calling dcb->func.accept(%p)", dcb);
+                HandlerTimer timer(DCB_HANDLER_ACCEPT);
                 dcb->func.accept(dcb);
             }
         }
@@ -3117,6 +3802,8 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
 
             if (dcb_session_check(dcb, "read"))
             {
+                HandlerTimer timer(dcb->dcb_role == DCB_ROLE_BACKEND_HANDLER ?
+                                   DCB_HANDLER_BACKEND_READ : DCB_HANDLER_CLIENT_READ);
                 int return_code = 1;
                 /** SSL authentication is still going on, we need to call dcb_accept_SSL
                  * until it return 1 for success or -1 for error */
@@ -3151,6 +3838,7 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
         if (dcb_session_check(dcb, "error"))
         {
             DCB_EH_NOTICE("Calling dcb->func.error(%p)", dcb);
+            HandlerTimer timer(DCB_HANDLER_HANGUP);
             dcb->func.error(dcb);
         }
     }
@@ -3175,6 +3863,7 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
             if (dcb_session_check(dcb, "hangup EPOLLHUP"))
             {
                 DCB_EH_NOTICE("Calling dcb->func.hangup(%p)", dcb);
+                HandlerTimer timer(DCB_HANDLER_HANGUP);
                 dcb->func.hangup(dcb);
             }
         }
@@ -3202,6 +3891,7 @@ static uint32_t dcb_process_poll_events(DCB* dcb, uint32_t events)
             if (dcb_session_check(dcb, "hangup EPOLLRDHUP"))
             {
                 DCB_EH_NOTICE("Calling dcb->func.hangup(%p)", dcb);
+                HandlerTimer timer(DCB_HANDLER_HANGUP);
                 dcb->func.hangup(dcb);
             }
         }
@@ -3256,6 +3946,16 @@ static uint32_t dcb_poll_handler(MXB_POLL_DATA* data, MXB_WORKER* worker, uint32
     return rval;
 }
 
+static uint32_t dcb_listener_shard_handler(MXB_POLL_DATA* data, MXB_WORKER* worker, uint32_t events)
+{
+    dcb_listener_shard* shard = (dcb_listener_shard*)data;
+
+    // The listener DCB is owned by the main worker, but the events of a shard
+    // are handled by the worker polling it; dcb_accept() will use the socket
+    // of that worker.
+    return dcb_poll_handler((MXB_POLL_DATA*)shard->dcb, worker, events);
+}
+
 static bool dcb_is_still_valid(DCB* target, int id)
 {
     bool rval = false;
@@ -3487,6 +4187,49 @@ static bool add_fd_to_routing_workers(int fd, uint32_t events, MXB_POLL_DATA* da
     return rv;
 }
 
+/**
+ * Add the shards of a SO_REUSEPORT listener, each to its own routing worker.
+ *
+ * @param dcb     The listener DCB
+ * @param events  The epoll events
+ *
+ * @return True, if all shards could be added.
+ */
+static bool add_shards_to_routing_workers(DCB* dcb, uint32_t events)
+{
+    int n_added = 0;
+
+    for (int i = 0; i < dcb->n_listener_shards; ++i)
+    {
+        dcb_listener_shard* shard = &dcb->listener_shards[i];
+
+        if (!RoutingWorker::get(i)->add_fd(shard->fd, events, &shard->poll))
+        {
+            break;
+        }
+
+        ++n_added;
+    }
+
+    bool rv = (n_added == dcb->n_listener_shards);
+
+    if (rv)
+    {
+        // As with shared listeners, the DCB is kept on the list of the main worker.
+        RoutingWorker* worker = RoutingWorker::get_current();
+        dcb->poll.owner = worker ? worker : RoutingWorker::get(RoutingWorker::MAIN);
+    }
+    else
+    {
+        for (int i = 0; i < n_added; ++i)
+        {
+            RoutingWorker::get(i)->remove_fd(dcb->listener_shards[i].fd);
+        }
+    }
+
+    return rv;
+}
+
 static bool dcb_add_to_worker(Worker* worker, DCB* dcb, uint32_t events)
 {
     bool rv = false;
@@ -3497,7 +4240,11 @@ static bool dcb_add_to_worker(Worker* worker, DCB* dcb, uint32_t events)
         mxb_assert(dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER);
 
         // A listening DCB, we add it immediately.
-        if (add_fd_to_routing_workers(dcb->fd, events, (MXB_POLL_DATA*)dcb))
+        bool added = dcb->listener_shards ?
+            add_shards_to_routing_workers(dcb, events) :
+            add_fd_to_routing_workers(dcb->fd, events, (MXB_POLL_DATA*)dcb);
+
+        if (added)
         {
             // If this takes place on the main thread (all listening DCBs are
             // stored on the main thread)...
@@ -3542,8 +4289,8 @@ static bool dcb_add_to_worker(Worker* worker, DCB* dcb, uint32_t events)
         else
         {
             // Otherwise we'll move the whole operation to the correct worker.
-            // This will only happen for "cli" and "maxinfo" services that must
-            // be served by one thread as there otherwise deadlocks can occur.
+            // This will only happen for services with RCAP_TYPE_MAIN_WORKER that
+            // must be served by one thread as there otherwise deadlocks can occur.
             AddDcbToWorker* task = new(std::nothrow) AddDcbToWorker(dcb, events);
             mxb_assert(task);
 
@@ -3593,8 +4340,7 @@ int poll_add_dcb(DCB* dcb)
     }
     else if (dcb->dcb_role == DCB_ROLE_CLIENT_HANDLER)
     {
-        if (strcasecmp(dcb->service->routerModule, "cli") == 0
-            || strcasecmp(dcb->service->routerModule, "maxinfo") == 0)
+        if (rcap_type_required(service_get_capabilities(dcb->service), RCAP_TYPE_MAIN_WORKER))
         {
             // If the DCB refers to an accepted maxadmin/maxinfo socket, we force it
             // to the main thread. That's done in order to prevent a deadlock
@@ -3686,7 +4432,19 @@ int poll_remove_dcb(DCB* dcb)
     {
         rc = -1;
 
-        if (dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER)
+        if (dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER && dcb->listener_shards)
+        {
+            rc = 0;
+
+            for (int i = 0; i < dcb->n_listener_shards; ++i)
+            {
+                if (!RoutingWorker::get(i)->remove_fd(dcb->listener_shards[i].fd))
+                {
+                    rc = -1;
+                }
+            }
+        }
+        else if (dcb->dcb_role == DCB_ROLE_SERVICE_LISTENER)
         {
             if (RoutingWorker::remove_shared_fd(dcbfd))
             {
@@ -3712,6 +4470,36 @@ DCB* dcb_get_current()
     return this_thread.current_dcb;
 }
 
+void dcb_get_io_stats(DCB_IO_STATS* stats)
+{
+    *stats = this_thread.io_stats;
+}
+
+const char* dcb_handler_to_string(dcb_handler_t handler)
+{
+    switch (handler)
+    {
+    case DCB_HANDLER_CLIENT_READ:
+        return "client_read";
+
+    case DCB_HANDLER_BACKEND_READ:
+        return "backend_read";
+
+    case DCB_HANDLER_WRITE:
+        return "write";
+
+    case DCB_HANDLER_ACCEPT:
+        return "accept";
+
+    case DCB_HANDLER_HANGUP:
+        return "hangup";
+
+    default:
+        mxb_assert(!true);
+        return "unknown";
+    }
+}
+
 /**
  * @brief DCB callback for upstream throtting
  * Called by any backend dcb when its writeq is above high water mark or
@@ -16,7 +16,71 @@
 
 MXS_BEGIN_DECLS
 
+/**
+ * The types of DCB event handlers whose time is accounted for separately.
+ */
+typedef enum dcb_handler
+{
+    DCB_HANDLER_CLIENT_READ,    /*< Reading from a client */
+    DCB_HANDLER_BACKEND_READ,   /*< Reading from a backend */
+    DCB_HANDLER_WRITE,          /*< Draining the write queue of a writable DCB */
+    DCB_HANDLER_ACCEPT,         /*< Accepting client connections */
+    DCB_HANDLER_HANGUP,         /*< Handling errors and hangups */
+    DCB_HANDLER_COUNT
+} dcb_handler_t;
+
+/**
+ * I/O and session statistics of the DCBs handled by one routing worker thread.
+ */
+typedef struct dcb_io_stats
+{
+    uint64_t n_read_events;        /*< Number of read events handled */
+    uint64_t n_read_calls;         /*< Number of read system calls */
+    uint64_t n_read_bytes;         /*< Number of bytes read */
+    uint64_t n_write_calls;        /*< Number of write system calls */
+    uint64_t n_write_buffers;      /*< Number of buffers handed to the write calls */
+    uint64_t n_write_bytes;        /*< Number of bytes written */
+    uint64_t n_accepts;            /*< Number of client connections accepted */
+    uint64_t n_sessions_moved_in;  /*< Number of sessions moved to this worker */
+    uint64_t n_sessions_moved_out; /*< Number of sessions moved away from this worker */
+    uint64_t handler_calls[DCB_HANDLER_COUNT]; /*< Number of calls of each type of handler */
+    uint64_t handler_time[DCB_HANDLER_COUNT];  /*< Time spent in each type of handler, in nanoseconds */
+} DCB_IO_STATS;
+
+/**
+ * Get the name of a DCB handler type.
+ *
+ * @param handler  The handler type.
+ *
+ * @return The name, as used in the statistics.
+ */
+const char* dcb_handler_to_string(dcb_handler_t handler);
+
 void dcb_free_all_memory(DCB* dcb);
 void dcb_final_close(DCB* dcb);
 
+/**
+ * Get the DCB I/O statistics of the calling thread.
+ *
+ * @param stats  The statistics are copied here.
+ */
+void dcb_get_io_stats(DCB_IO_STATS* stats);
+
+/**
+ * Move idle sessions of the calling worker to another worker.
+ *
+ * A session is idle if it is not processing a query and has nothing queued.
+ * The client and backend descriptors of the session are moved together.
+ *
+ * @note Must be called between poll cycles, so that no events returned by
+ *       epoll_wait() are left unhandled for the moved descriptors.
+ *
+ * @param to_id    The id of the worker to move the sessions to.
+ * @param percent  At most this percentage of the sessions of the calling worker
+ *                 is moved, but at least one session if there are idle ones.
+ *
+ * @return The number of sessions that were moved.
+ */
+int dcb_move_idle_sessions(int to_id, int percent);
+
 MXS_END_DECLS
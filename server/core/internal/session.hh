@@ -141,6 +141,26 @@ public:
         return m_dcb_set;
     }
 
+    void add_delayed_routing()
+    {
+        ++m_n_delayed_routing;
+    }
+
+    void remove_delayed_routing()
+    {
+        mxb_assert(m_n_delayed_routing > 0);
+        --m_n_delayed_routing;
+    }
+
+    /**
+     * @return True, if the session has queries whose routing has been delayed
+     *         using a delayed call of the current worker.
+     */
+    bool has_delayed_routing() const
+    {
+        return m_n_delayed_routing != 0;
+    }
+
 private:
     FilterList        m_filters;
     SessionVarsByName m_variables;
@@ -148,6 +168,7 @@ private:
     int               m_current_query = -1;     /*< The index of the current query */
     DCBSet            m_dcb_set;                /*< Set of associated backend DCBs */
     uint32_t          m_retain_last_statements; /*< How many statements be retained */
+    int               m_n_delayed_routing = 0;  /*< Number of pending delayed routing calls */
 };
 }
 
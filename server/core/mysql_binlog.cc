@@ -591,9 +591,54 @@ static bool is_zero_date(struct tm* tm)
         && tm->tm_mday == 1 && tm->tm_mon == 0 && tm->tm_year == 70;
 }
 
+/**
+ * Append a number in the same format as strftime() does for the temporal fields
+ *
+ * @param ptr   Where to write the number
+ * @param value The value to write
+ * @param width Minimum width, padded with zeros
+ *
+ * @return Pointer to the byte after the written number
+ */
+static char* format_number(char* ptr, int value, int width)
+{
+    char digits[16];
+    int n = 0;
+    unsigned int v = value < 0 ? -(unsigned int)value : value;
+
+    do
+    {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    }
+    while (v);
+
+    // Like printf, the sign is counted in the width
+    int len = n;
+
+    if (value < 0)
+    {
+        *ptr++ = '-';
+        len++;
+    }
+
+    for (; len < width; len++)
+    {
+        *ptr++ = '0';
+    }
+
+    while (n)
+    {
+        *ptr++ = digits[--n];
+    }
+
+    return ptr;
+}
+
 void format_temporal_value(char* str, size_t size, uint8_t type, struct tm* tm)
 {
-    const char* format = "";
+    bool date = false;
+    bool time = false;
 
     switch (type)
     {
@@ -601,20 +646,20 @@ void format_temporal_value(char* str, size_t size, uint8_t type, struct tm* tm)
     case TABLE_COL_TYPE_DATETIME2:
     case TABLE_COL_TYPE_TIMESTAMP:
     case TABLE_COL_TYPE_TIMESTAMP2:
-        format = "%Y-%m-%d %H:%M:%S";
+        date = true;
+        time = true;
         break;
 
     case TABLE_COL_TYPE_TIME:
     case TABLE_COL_TYPE_TIME2:
-        format = "%H:%M:%S";
+        time = true;
         break;
 
     case TABLE_COL_TYPE_DATE:
-        format = "%Y-%m-%d";
+        date = true;
         break;
 
     case TABLE_COL_TYPE_YEAR:
-        format = "%Y";
         break;
 
     default:
@@ -626,11 +671,47 @@ void format_temporal_value(char* str, size_t size, uint8_t type, struct tm* tm)
     if ((type == TABLE_COL_TYPE_TIMESTAMP || type == TABLE_COL_TYPE_TIMESTAMP2) && is_zero_date(tm))
     {
         strcpy(str, "0-00-00 00:00:00");
+        return;
     }
-    else
+
+    /**
+     * The value is formatted by hand as strftime() is relatively slow due
+     * to the locale handling. The output is identical to what strftime()
+     * would produce with "%Y-%m-%d %H:%M:%S" and its subsets.
+     */
+    char buf[80];
+    char* ptr = buf;
+
+    if (date || type == TABLE_COL_TYPE_YEAR)
+    {
+        ptr = format_number(ptr, tm->tm_year + 1900, 0);
+    }
+
+    if (date)
     {
-        strftime(str, size, format, tm);
+        *ptr++ = '-';
+        ptr = format_number(ptr, tm->tm_mon + 1, 2);
+        *ptr++ = '-';
+        ptr = format_number(ptr, tm->tm_mday, 2);
+    }
+
+    if (time)
+    {
+        if (date)
+        {
+            *ptr++ = ' ';
+        }
+
+        ptr = format_number(ptr, tm->tm_hour, 2);
+        *ptr++ = ':';
+        ptr = format_number(ptr, tm->tm_min, 2);
+        *ptr++ = ':';
+        ptr = format_number(ptr, tm->tm_sec, 2);
     }
+
+    size_t len = MXS_MIN((size_t)(ptr - buf), size - 1);
+    memcpy(str, buf, len);
+    str[len] = '\0';
 }
 
 /**
@@ -741,11 +822,27 @@ static uint64_t unpack_bytes(uint8_t* ptr, size_t bytes)
     return val;
 }
 
+/**
+ * @brief Unpack a DECIMAL field
+ * @param ptr Pointer to packed value
+ * @param metadata Pointer to field metadata
+ * @param val_float Destination where the value is stored
+ * @return Length of the processed field in bytes or 0 if the metadata is invalid
+ */
 size_t unpack_decimal_field(uint8_t* ptr, uint8_t* metadata, double* val_float)
 {
     const int dec_dig = 9;
     int precision = metadata[0];
     int decimals = metadata[1];
+
+    /** DECIMAL(65, 30) is the largest one the server allows */
+    if (precision == 0 || precision > 65 || decimals > 30 || decimals > precision)
+    {
+        MXS_ERROR("Invalid DECIMAL(%d, %d) column metadata in row event.", precision, decimals);
+        *val_float = 0;
+        return 0;
+    }
+
     int dig_bytes[] = {0, 1, 1, 2, 2, 3, 3, 4, 4, 4};
     int ipart = precision - decimals;
     int ipart1 = ipart / dec_dig;
@@ -756,6 +853,13 @@ size_t unpack_decimal_field(uint8_t* ptr, uint8_t* metadata, double* val_float)
     int fbytes = fpart1 * 4 + dig_bytes[fpart2];
     int field_size = ibytes + fbytes;
 
+    /** The value is decoded from a copy as the row event must not be modified.
+     * The largest DECIMAL takes 30 bytes. */
+    uint8_t value[32];
+    mxb_assert(field_size <= (int)sizeof(value));
+    memcpy(value, ptr, field_size);
+    ptr = value;
+
     /** Remove the sign bit and store it locally */
     bool negative = (ptr[0] & 0x80) == 0;
     ptr[0] ^= 0x80;
@@ -672,6 +672,17 @@ HttpResponse cb_all_threads(const HttpRequest& request)
     return HttpResponse(MHD_HTTP_OK, mxs_rworker_list_to_json(request.host()));
 }
 
+HttpResponse cb_profile(const HttpRequest& request)
+{
+    return HttpResponse(MHD_HTTP_OK, mxs::RoutingWorker::get_profile_as_json(request.host()).release());
+}
+
+HttpResponse cb_reset_profile(const HttpRequest& request)
+{
+    mxs::RoutingWorker::reset_profile();
+    return HttpResponse(MHD_HTTP_NO_CONTENT);
+}
+
 HttpResponse cb_qc(const HttpRequest& request)
 {
     return HttpResponse(MHD_HTTP_OK, qc_as_json(request.host()).release());
@@ -968,6 +979,7 @@ public:
         m_get.push_back(SResource(new Resource(cb_all_threads, 2, "maxscale", "threads")));
         m_get.push_back(SResource(new Resource(cb_thread, 3, "maxscale", "threads", ":thread")));
         m_get.push_back(SResource(new Resource(cb_logs, 2, "maxscale", "logs")));
+        m_get.push_back(SResource(new Resource(cb_profile, 2, "maxscale", "profile")));
         m_get.push_back(SResource(new Resource(cb_tasks, 2, "maxscale", "tasks")));
         m_get.push_back(SResource(new Resource(cb_all_modules, 2, "maxscale", "modules")));
         m_get.push_back(SResource(new Resource(cb_module, 3, "maxscale", "modules", ":module")));
@@ -1075,6 +1087,7 @@ public:
         m_delete.push_back(SResource(new Resource(cb_delete_monitor, 2, "monitors", ":monitor")));
         m_delete.push_back(SResource(new Resource(cb_delete_service, 2, "services", ":service")));
         m_delete.push_back(SResource(new Resource(cb_delete_filter, 2, "filters", ":filter")));
+        m_delete.push_back(SResource(new Resource(cb_reset_profile, 2, "maxscale", "profile")));
 
         m_delete.push_back(SResource(new Resource(cb_delete_user, 3, "users", "inet", ":inetuser")));
         m_delete.push_back(SResource(new Resource(cb_delete_user, 3, "users", "unix", ":unixuser")));
@@ -1332,6 +1345,9 @@ HttpResponse resource_handle_request(const HttpRequest& request)
     HttpResponse response;
     worker->call([&request, &response, worker]() {
                      mxs::WatchdogWorkaround workaround(worker);
+                     // The threads of the monitors and services that are created
+                     // must not inherit the CPU of the worker.
+                     mxs::RoutingWorker::Unpinned unpinned(worker);
                      response = handle_request(request);
                  },
                  mxb::Worker::EXECUTE_AUTO);
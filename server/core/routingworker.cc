@@ -13,14 +13,20 @@
 
 #include <maxscale/routingworker.hh>
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
 #ifdef HAVE_SYSTEMD
 #include <systemd/sd-daemon.h>
 #endif
+#include <mutex>
 #include <vector>
 #include <sstream>
 
@@ -69,6 +75,7 @@ struct this_unit
     int id_main_worker;     // The id of the worker running in the main thread.
     int id_min_worker;      // The smallest routing worker id.
     int id_max_worker;      // The largest routing worker id.
+    int64_t next_rebalance; // When the load of the workers is checked the next time, in 100ms ticks.
 } this_unit =
 {
     false,              // initialized
@@ -81,6 +88,7 @@ struct this_unit
     WORKER_ABSENT_ID,   // id_main_worker
     WORKER_ABSENT_ID,   // id_min_worker
     WORKER_ABSENT_ID,   // id_max_worker
+    0,                  // next_rebalance
 };
 
 int next_worker_id()
@@ -161,6 +169,224 @@ void modules_thread_finish()
         }
     }
 }
+
+/**
+ * Returns the CPUs the routing workers should be pinned to.
+ *
+ * @param zAffinity  The value of thread_affinity: NULL, "auto" or a list of CPUs.
+ *
+ * @return The CPUs in the order they are assigned to the workers, empty if
+ *         the workers should not be pinned.
+ */
+std::vector<int> get_worker_cpus(const char* zAffinity)
+{
+    std::vector<int> cpus;
+
+    if (!zAffinity)
+    {
+        // Not pinned.
+    }
+    else if (strcmp(zAffinity, CN_AUTO) == 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            {
+                if (CPU_ISSET(cpu, &set))
+                {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        else
+        {
+            MXS_ERROR("Could not get the CPU affinity of the process, the routing "
+                      "threads will not be pinned: %s", mxs_strerror(errno));
+        }
+    }
+    else
+    {
+        // The value has been validated when the configuration was read.
+        MXB_AT_DEBUG(bool parsed = ) mxs::parse_cpu_list(zAffinity, &cpus);
+        mxb_assert(parsed);
+    }
+
+    return cpus;
+}
+
+/**
+ * Returns the NUMA node of a CPU.
+ *
+ * @param cpu  A CPU.
+ *
+ * @return The NUMA node, or -1 if it is not known.
+ */
+int get_numa_node(int cpu)
+{
+    // The node of a CPU is shown as a nodeN entry in the sysfs directory of the CPU.
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    int node = -1;
+
+    if (DIR* pDir = opendir(path.c_str()))
+    {
+        while (struct dirent* pEntry = readdir(pDir))
+        {
+            if (sscanf(pEntry->d_name, "node%d", &node) == 1)
+            {
+                break;
+            }
+        }
+
+        closedir(pDir);
+    }
+
+    return node;
+}
+
+/**
+ * Returns a CPU mask in the format the kernel uses in sysfs.
+ *
+ * @param cpu  The only CPU in the mask.
+ *
+ * @return Comma separated groups of 32 bits, the most significant group first.
+ */
+std::string cpu_mask(int cpu)
+{
+    std::string mask;
+
+    for (int group = cpu / 32; group >= 0; --group)
+    {
+        char buf[9];
+        snprintf(buf, sizeof(buf), "%08x", group == cpu / 32 ? 1u << (cpu % 32) : 0);
+
+        if (!mask.empty())
+        {
+            mask += ",";
+        }
+
+        mask += buf;
+    }
+
+    return mask;
+}
+
+/**
+ * Steers the receive packet processing (RPS) of the queues of a network
+ * interface to the CPUs of the routing workers, one CPU per queue.
+ *
+ * @param zInterface  The network interface.
+ * @param cpus        The CPUs of the workers, in worker order.
+ */
+void steer_receive_queues(const char* zInterface, const std::vector<int>& cpus)
+{
+    std::string dir_path = std::string("/sys/class/net/") + zInterface + "/queues";
+    DIR* pDir = opendir(dir_path.c_str());
+
+    if (!pDir)
+    {
+        MXS_ERROR("Could not open '%s', the receive queues of '%s' will not be steered: %s",
+                  dir_path.c_str(), zInterface, mxs_strerror(errno));
+        return;
+    }
+
+    while (struct dirent* pEntry = readdir(pDir))
+    {
+        int queue;
+
+        if (sscanf(pEntry->d_name, "rx-%d", &queue) == 1)
+        {
+            int cpu = cpus[queue % cpus.size()];
+            std::string path = dir_path + "/" + pEntry->d_name + "/rps_cpus";
+            std::string mask = cpu_mask(cpu);
+            int fd = open(path.c_str(), O_WRONLY);
+
+            if (fd == -1 || write(fd, mask.c_str(), mask.length()) == -1)
+            {
+                MXS_WARNING("Could not steer receive queue %d of '%s' to CPU %d: %s",
+                            queue, zInterface, cpu, mxs_strerror(errno));
+            }
+            else
+            {
+                MXS_NOTICE("Receive queue %d of '%s' steered to CPU %d.", queue, zInterface, cpu);
+            }
+
+            if (fd != -1)
+            {
+                close(fd);
+            }
+        }
+    }
+
+    closedir(pDir);
+}
+
+/**
+ * Moves idle sessions from the most loaded worker to the least loaded one, if
+ * the difference in their load exceeds the configured threshold. Called
+ * periodically by the main worker.
+ */
+void rebalance_sessions()
+{
+    const MXS_CONFIG* config = config_get_global_options();
+    int64_t now = mxs_clock();
+
+    if (config->rebalance_threshold == 0
+        || this_unit.nWorkers < 2
+        || now < this_unit.next_rebalance)
+    {
+        return;
+    }
+
+    this_unit.next_rebalance = now + config->rebalance_period * 10;
+
+    RoutingWorker* pBusiest = nullptr;
+    RoutingWorker* pIdlest = nullptr;
+    int max_load = -1;
+    int min_load = INT_MAX;
+
+    for (int i = this_unit.id_min_worker; i <= this_unit.id_max_worker; ++i)
+    {
+        RoutingWorker* pWorker = RoutingWorker::get(i);
+
+        // The load is updated by the worker itself, so the value is approximate.
+        int load = pWorker->load(Worker::Load::ONE_SECOND);
+
+        if (load > max_load)
+        {
+            max_load = load;
+            pBusiest = pWorker;
+        }
+
+        if (load < min_load)
+        {
+            min_load = load;
+            pIdlest = pWorker;
+        }
+    }
+
+    if (pBusiest != pIdlest && max_load - min_load >= config->rebalance_threshold)
+    {
+        // Assuming the sessions generate roughly equal load, moving this share
+        // of the sessions evens out the load of the two workers.
+        int percent = 100 * (max_load - min_load) / (2 * max_load);
+        int to = pIdlest->id();
+
+        MXS_INFO("Load of worker %d is %d%% and load of worker %d is %d%%, moving idle sessions.",
+                 pBusiest->id(), max_load, to, min_load);
+
+        auto move = [to, percent]() {
+                RoutingWorker::get_current()->move_idle_sessions(to, percent);
+            };
+
+        if (!pBusiest->execute(move, Worker::EXECUTE_QUEUED))
+        {
+            MXS_ERROR("Could not post session rebalancing task to worker %d.", pBusiest->id());
+        }
+    }
+}
 }
 
 namespace maxscale
@@ -252,6 +478,10 @@ private:
 
 RoutingWorker::RoutingWorker()
     : m_id(next_worker_id())
+    , m_cpu(-1)
+    , m_numa_node(-1)
+    , m_move_to(-1)
+    , m_move_percent(0)
     , m_alive(true)
     , m_pWatchdog_notifier(nullptr)
 {
@@ -333,6 +563,27 @@ bool RoutingWorker::init()
 
             if (ppWorkers)
             {
+                const MXS_CONFIG* config = config_get_global_options();
+                std::vector<int> cpus = get_worker_cpus(config->thread_affinity);
+
+                if (!cpus.empty())
+                {
+                    std::vector<int> worker_cpus;
+
+                    for (i = 0; i < nWorkers; ++i)
+                    {
+                        RoutingWorker* pWorker = ppWorkers[i];
+                        pWorker->m_cpu = cpus[i % cpus.size()];
+                        pWorker->m_numa_node = get_numa_node(pWorker->m_cpu);
+                        worker_cpus.push_back(pWorker->m_cpu);
+                    }
+
+                    if (config->rps_interface)
+                    {
+                        steer_receive_queues(config->rps_interface, worker_cpus);
+                    }
+                }
+
                 this_unit.ppWorkers = ppWorkers;
                 this_unit.nWorkers = nWorkers;
                 this_unit.id_main_worker = id_main_worker;
@@ -554,10 +805,86 @@ void RoutingWorker::delete_zombies()
     }
 }
 
+bool RoutingWorker::pin()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(m_cpu, &set);
+
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (rc != 0)
+    {
+        MXS_ERROR("Could not pin routing worker %d to CPU %d: %s", m_id, m_cpu, mxs_strerror(rc));
+    }
+
+    return rc == 0;
+}
+
+void RoutingWorker::apply_placement()
+{
+    if (m_cpu != -1)
+    {
+        if (pin())
+        {
+            // Prefer the node the thread now runs on, so that the memory the worker
+            // allocates for itself in the thread initialization is local to it.
+            if (syscall(SYS_set_mempolicy, MPOL_LOCAL, NULL, 0) != 0)
+            {
+                MXS_WARNING("Could not set the memory policy of routing worker %d: %s",
+                            m_id, mxs_strerror(errno));
+            }
+
+            MXS_INFO("Routing worker %d pinned to CPU %d on NUMA node %d.", m_id, m_cpu, m_numa_node);
+        }
+    }
+}
+
+json_t* RoutingWorker::placement_to_json() const
+{
+    mxb_assert(this == get_current());
+
+    int current_cpu = sched_getcpu();
+    int current_node = current_cpu != -1 ? get_numa_node(current_cpu) : -1;
+
+    json_t* pPlacement = json_object();
+    json_object_set_new(pPlacement, "cpu", m_cpu != -1 ? json_integer(m_cpu) : json_null());
+    json_object_set_new(pPlacement, "numa_node",
+                        m_numa_node != -1 ? json_integer(m_numa_node) : json_null());
+    json_object_set_new(pPlacement, "current_cpu",
+                        current_cpu != -1 ? json_integer(current_cpu) : json_null());
+    json_object_set_new(pPlacement, "current_numa_node",
+                        current_node != -1 ? json_integer(current_node) : json_null());
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+    {
+        json_t* pCpus = json_array();
+
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &set))
+            {
+                json_array_append_new(pCpus, json_integer(cpu));
+            }
+        }
+
+        json_object_set_new(pPlacement, "allowed_cpus", pCpus);
+    }
+
+    return pPlacement;
+}
+
 bool RoutingWorker::pre_run()
 {
     this_thread.current_worker_id = m_id;
 
+    // Placed first, so that the thread specific initialization allocates
+    // its memory on the NUMA node of the worker.
+    apply_placement();
+
     bool rv = modules_thread_init() && service_thread_init() && qc_thread_init(QC_INIT_SELF);
 
     if (!rv)
@@ -565,6 +892,10 @@ bool RoutingWorker::pre_run()
         MXS_ERROR("Could not perform thread initialization for all modules. Thread exits.");
         this_thread.current_worker_id = WORKER_ABSENT_ID;
     }
+    else if (config_get_global_options()->profiler_frequency > 0)
+    {
+        update_profiler(config_get_global_options()->profiler_frequency);
+    }
 
     return rv;
 }
@@ -573,6 +904,8 @@ void RoutingWorker::post_run()
 {
     modules_thread_finish();
     qc_thread_end(QC_INIT_SELF);
+    // The timer of the profiler is bound to this thread.
+    m_sProfiler.reset();
     // TODO: Add service_thread_finish().
     this_thread.current_worker_id = WORKER_ABSENT_ID;
 }
@@ -580,7 +913,7 @@ void RoutingWorker::post_run()
 /**
  * Creates a worker instance.
  * - Allocates the structure.
- * - Creates a pipe.
+ * - Creates a message queue.
  * - Adds the read descriptor to the polling mechanism.
  *
  * @param epoll_listener_fd  The file descriptor of the epoll set to which listening
@@ -633,13 +966,69 @@ void RoutingWorker::epoll_tick()
 {
     dcb_process_idle_sessions(m_id);
 
+    if (m_move_to != -1)
+    {
+        // All events returned by epoll_wait() have been handled, so none of them
+        // can refer to the descriptors that are moved.
+        dcb_move_idle_sessions(m_move_to, m_move_percent);
+        m_move_to = -1;
+    }
+
+    if (m_id == this_unit.id_main_worker)
+    {
+        rebalance_sessions();
+    }
+
     m_state = ZPROCESSING;
 
     delete_zombies();
 
+    if (m_sProfiler)
+    {
+        m_sProfiler->collect();
+    }
+
     check_systemd_watchdog();
 }
 
+void RoutingWorker::move_idle_sessions(int to, int percent)
+{
+    mxb_assert(Worker::get_current() == this);
+    m_move_to = to;
+    m_move_percent = percent;
+}
+
+void RoutingWorker::update_profiler(int frequency)
+{
+    mxb_assert(Worker::get_current() == this);
+
+    if (frequency > 0)
+    {
+        if (!m_sProfiler)
+        {
+            m_sProfiler.reset(new mxb::Profiler);
+        }
+
+        if (!m_sProfiler->start(frequency))
+        {
+            MXS_ERROR("Could not start the profiler of worker %d.", m_id);
+        }
+    }
+    else if (m_sProfiler)
+    {
+        // The stacks are kept, so that they can be fetched after profiling.
+        m_sProfiler->stop();
+    }
+}
+
+// static
+void RoutingWorker::set_profiler_frequency(int frequency)
+{
+    broadcast([frequency]() {
+                  RoutingWorker::get_current()->update_profiler(frequency);
+              }, EXECUTE_AUTO);
+}
+
 /**
  * Callback for events occurring on the shared epoll instance.
  *
@@ -1059,9 +1448,93 @@ std::unique_ptr<json_t> RoutingWorker::get_qc_stats_as_json(const char* zHost)
     return std::unique_ptr<json_t>(mxs_json_resource(zHost, MXS_JSON_API_QC_STATS, sAll_stats.release()));
 }
 
+namespace
+{
+
+class ProfileTask : public Worker::Task
+{
+public:
+    ProfileTask()
+        : m_samples(0)
+        , m_dropped(0)
+    {
+    }
+
+    void execute(Worker& worker)
+    {
+        const std::unique_ptr<mxb::Profiler>& sProfiler = static_cast<RoutingWorker&>(worker).profiler();
+
+        if (sProfiler)
+        {
+            sProfiler->collect();
+
+            std::lock_guard<std::mutex> guard(m_lock);
+            mxb::Profiler::merge(&m_stacks, sProfiler->stacks());
+            m_samples += sProfiler->n_samples();
+            m_dropped += sProfiler->n_dropped();
+        }
+    }
+
+    json_t* to_json(const char* zHost) const
+    {
+        json_t* pAttr = json_object();
+        json_object_set_new(pAttr, "frequency", json_integer(config_get_global_options()->profiler_frequency));
+        json_object_set_new(pAttr, "samples", json_integer(m_samples));
+        json_object_set_new(pAttr, "dropped", json_integer(m_dropped));
+        json_object_set_new(pAttr, "folded", json_string(mxb::Profiler::to_folded(m_stacks).c_str()));
+
+        json_t* pJson = json_object();
+        json_object_set_new(pJson, CN_ID, json_string("profile"));
+        json_object_set_new(pJson, CN_TYPE, json_string("profile"));
+        json_object_set_new(pJson, CN_ATTRIBUTES, pAttr);
+
+        return mxs_json_resource(zHost, MXS_JSON_API_PROFILE, pJson);
+    }
+
+private:
+    std::mutex             m_lock;
+    mxb::Profiler::Stacks  m_stacks;
+    uint64_t               m_samples;
+    uint64_t               m_dropped;
+};
+}
+
+// static
+std::unique_ptr<json_t> RoutingWorker::get_profile_as_json(const char* zHost)
+{
+    ProfileTask task;
+    execute_concurrently(task);
+
+    return std::unique_ptr<json_t>(task.to_json(zHost));
+}
+
+// static
+void RoutingWorker::reset_profile()
+{
+    Semaphore sem;
+    size_t n = broadcast([]() {
+                             const auto& sProfiler = RoutingWorker::get_current()->m_sProfiler;
+
+                             if (sProfiler)
+                             {
+                                 sProfiler->reset();
+                             }
+                         }, &sem, EXECUTE_AUTO);
+    sem.wait_n(n);
+}
+
 // static
 RoutingWorker* RoutingWorker::pick_worker()
 {
+    RoutingWorker* pCurrent = get_current();
+
+    if (pCurrent && config_get_global_options()->listener_mode != MXS_LISTENER_MODE_SHARED)
+    {
+        // With per-worker listener sockets, the kernel has already distributed
+        // the connections and a connection is best handled where it was accepted.
+        return pCurrent;
+    }
+
     static int id_generator = 0;
     int id = this_unit.id_min_worker
         + (mxb::atomic::add(&id_generator, 1, mxb::atomic::RELAXED) % this_unit.nWorkers);
@@ -1188,6 +1661,52 @@ namespace
 
 using namespace maxscale;
 
+const char* stage_to_string(Worker::STATISTICS::stage_t stage)
+{
+    switch (stage)
+    {
+    case Worker::STATISTICS::STAGE_WAIT:
+        return "wait";
+
+    case Worker::STATISTICS::STAGE_EVENTS:
+        return "events";
+
+    case Worker::STATISTICS::STAGE_DELAYED_CALLS:
+        return "delayed_calls";
+
+    case Worker::STATISTICS::STAGE_MESSAGES:
+        return "messages";
+
+    case Worker::STATISTICS::STAGE_TICK:
+        return "tick";
+
+    default:
+        mxb_assert(!true);
+        return "unknown";
+    }
+}
+
+json_t* histogram_to_json(const mxb::Histogram& histogram)
+{
+    json_t* pBuckets = json_array();
+
+    for (int i = 0; i < mxb::Histogram::N_BUCKETS; ++i)
+    {
+        json_array_append_new(pBuckets, json_integer(histogram.bucket(i)));
+    }
+
+    json_t* pHistogram = json_object();
+    json_object_set_new(pHistogram, "count", json_integer(histogram.count()));
+    json_object_set_new(pHistogram, "avg_us",
+                        json_real(histogram.count() ? (double)histogram.total() / histogram.count() / 1000 : 0));
+    json_object_set_new(pHistogram, "max_us", json_integer(histogram.max() / 1000));
+    json_object_set_new(pHistogram, "p50_us", json_integer(histogram.percentile(0.5)));
+    json_object_set_new(pHistogram, "p99_us", json_integer(histogram.percentile(0.99)));
+    json_object_set_new(pHistogram, "buckets", pBuckets);
+
+    return pHistogram;
+}
+
 class WorkerInfoTask : public Worker::Task
 {
 public:
@@ -1219,12 +1738,63 @@ public:
         json_object_set_new(pStats, "current_descriptors", json_integer(nCurrent));
         json_object_set_new(pStats, "total_descriptors", json_integer(nTotal));
 
+        DCB_IO_STATS io;
+        dcb_get_io_stats(&io);
+        json_object_set_new(pStats, "accepted_connections", json_integer(io.n_accepts));
+        json_object_set_new(pStats, "sessions_moved_in", json_integer(io.n_sessions_moved_in));
+        json_object_set_new(pStats, "sessions_moved_out", json_integer(io.n_sessions_moved_out));
+
+        json_t* pIo = json_object();
+        json_object_set_new(pIo, "read_events", json_integer(io.n_read_events));
+        json_object_set_new(pIo, "read_calls", json_integer(io.n_read_calls));
+        json_object_set_new(pIo, "read_bytes", json_integer(io.n_read_bytes));
+        json_object_set_new(pIo, "avg_read_size",
+                            json_real(io.n_read_calls ? (double)io.n_read_bytes / io.n_read_calls : 0));
+        json_object_set_new(pIo, "read_calls_per_event",
+                            json_real(io.n_read_events ? (double)io.n_read_calls / io.n_read_events : 0));
+        json_object_set_new(pIo, "write_calls", json_integer(io.n_write_calls));
+        json_object_set_new(pIo, "write_buffers", json_integer(io.n_write_buffers));
+        json_object_set_new(pIo, "write_bytes", json_integer(io.n_write_bytes));
+        json_object_set_new(pIo, "bytes_per_write_call",
+                            json_real(io.n_write_calls ? (double)io.n_write_bytes / io.n_write_calls : 0));
+        json_object_set_new(pStats, "io", pIo);
+
+        json_t* pTime = json_object();
+
+        for (int i = 0; i < Worker::STATISTICS::N_STAGES; ++i)
+        {
+            auto stage = static_cast<Worker::STATISTICS::stage_t>(i);
+            json_object_set_new(pTime, stage_to_string(stage), json_integer(s.stage_time[i] / 1000000));
+        }
+
+        json_t* pHandlers = json_object();
+
+        for (int i = 0; i < DCB_HANDLER_COUNT; ++i)
+        {
+            json_t* pHandler = json_object();
+            json_object_set_new(pHandler, "calls", json_integer(io.handler_calls[i]));
+            json_object_set_new(pHandler, "time", json_integer(io.handler_time[i] / 1000000));
+            json_object_set_new(pHandler, "avg_time_us",
+                                json_real(io.handler_calls[i] ?
+                                          (double)io.handler_time[i] / io.handler_calls[i] / 1000 : 0));
+            json_object_set_new(pHandlers, dcb_handler_to_string(static_cast<dcb_handler_t>(i)), pHandler);
+        }
+
+        json_t* pLoop = json_object();
+        json_object_set_new(pLoop, "time", pTime);
+        json_object_set_new(pLoop, "handlers", pHandlers);
+        json_object_set_new(pLoop, "event_time", histogram_to_json(s.event_time));
+        json_object_set_new(pLoop, "event_latency", histogram_to_json(s.event_latency));
+        json_object_set_new(pStats, "event_loop", pLoop);
+
         json_t* load = json_object();
         json_object_set_new(load, "last_second", json_integer(rworker.load(Worker::Load::ONE_SECOND)));
         json_object_set_new(load, "last_minute", json_integer(rworker.load(Worker::Load::ONE_MINUTE)));
         json_object_set_new(load, "last_hour", json_integer(rworker.load(Worker::Load::ONE_HOUR)));
         json_object_set_new(pStats, "load", load);
 
+        json_object_set_new(pStats, "placement", rworker.placement_to_json());
+
         json_t* qc = qc_get_cache_stats_as_json();
 
         if (qc)
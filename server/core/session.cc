@@ -1097,10 +1097,12 @@ public:
         , m_down(down)
         , m_buffer(buffer)
     {
+        static_cast<Session*>(m_session)->add_delayed_routing();
     }
 
     ~DelayedRoutingTask()
     {
+        static_cast<Session*>(m_session)->remove_delayed_routing();
         session_put_ref(m_session);
         gwbuf_free(m_buffer);
     }
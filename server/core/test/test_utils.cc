@@ -169,6 +169,37 @@ int test_checksums()
     return 0;
 }
 
+int test_parse_cpu_list()
+{
+    cout << "parse_cpu_list()" << endl;
+    int rv = 0;
+    std::vector<int> cpus;
+
+    if (!mxs::parse_cpu_list("0-3,8, 10-11", &cpus)
+        || cpus != std::vector<int>({0, 1, 2, 3, 8, 10, 11}))
+    {
+        ++rv;
+    }
+
+    if (!mxs::parse_cpu_list("5", &cpus) || cpus != std::vector<int>({5}))
+    {
+        ++rv;
+    }
+
+    const char* invalid[] = {"", "a", "1-", "-1", "3-1", "1,,2", "1-2-3", "100000"};
+
+    for (auto zList : invalid)
+    {
+        if (mxs::parse_cpu_list(zList, &cpus))
+        {
+            cout << "'" << zList << "' was accepted." << endl;
+            ++rv;
+        }
+    }
+
+    return rv;
+}
+
 int main(int argc, char* argv[])
 {
     int rv = 0;
@@ -176,6 +207,7 @@ int main(int argc, char* argv[])
     rv += test_trim();
     rv += test_trim_leading();
     rv += test_trim_trailing();
+    rv += test_parse_cpu_list();
     rv += test_checksums<mxs::SHA1Checksum>();
     rv += test_checksums<mxs::CRC32Checksum>();
 
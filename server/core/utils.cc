@@ -34,6 +34,7 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <regex.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -1001,7 +1002,7 @@ bool configure_network_socket(int so, int type)
     return setnonblocking(so) == 0;
 }
 
-static bool configure_listener_socket(int so)
+static bool configure_listener_socket(int so, bool reuseport)
 {
     int one = 1;
 
@@ -1012,6 +1013,12 @@ static bool configure_listener_socket(int so)
         return false;
     }
 
+    if (reuseport && setsockopt(so, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0)
+    {
+        MXS_ERROR("Failed to set SO_REUSEPORT on listener socket: %d, %s.", errno, mxs_strerror(errno));
+        return false;
+    }
+
     return setnonblocking(so) == 0;
 }
 
@@ -1039,7 +1046,10 @@ int open_network_socket(enum mxs_socket_type type,
                         const char* host,
                         uint16_t port)
 {
-    mxb_assert(type == MXS_SOCKET_NETWORK || type == MXS_SOCKET_LISTENER);
+    mxb_assert(type == MXS_SOCKET_NETWORK
+               || type == MXS_SOCKET_LISTENER
+               || type == MXS_SOCKET_REUSEPORT_LISTENER);
+    bool listener = type != MXS_SOCKET_NETWORK;
     struct addrinfo* ai = NULL, hint = {};
     int so = 0, rc = 0;
     hint.ai_socktype = SOCK_STREAM;
@@ -1065,12 +1075,12 @@ int open_network_socket(enum mxs_socket_type type,
             set_port(addr, port);
 
             if ((type == MXS_SOCKET_NETWORK && !configure_network_socket(so, addr->ss_family))
-                || (type == MXS_SOCKET_LISTENER && !configure_listener_socket(so)))
+                || (listener && !configure_listener_socket(so, type == MXS_SOCKET_REUSEPORT_LISTENER)))
             {
                 close(so);
                 so = -1;
             }
-            else if (type == MXS_SOCKET_LISTENER && bind(so, (struct sockaddr*)addr, sizeof(*addr)) < 0)
+            else if (listener && bind(so, (struct sockaddr*)addr, sizeof(*addr)) < 0)
             {
                 MXS_ERROR("Failed to bind on '%s:%u': %d, %s",
                           host,
@@ -1229,6 +1239,64 @@ uint8_t* set_byteN(uint8_t* ptr, uint64_t value, int bytes)
     return ptr + bytes;
 }
 
+bool parse_cpu_list(const char* zList, std::vector<int>* pCpus)
+{
+    std::vector<int> cpus;
+    const char* z = zList;
+
+    while (true)
+    {
+        char* end;
+        long first = strtol(z, &end, 10);
+        long last = first;
+
+        if (end == z || first < 0)
+        {
+            return false;
+        }
+
+        if (*end == '-')
+        {
+            z = end + 1;
+            last = strtol(z, &end, 10);
+
+            if (end == z || last < first)
+            {
+                return false;
+            }
+        }
+
+        if (last >= CPU_SETSIZE)
+        {
+            return false;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+
+        while (isspace(*end))
+        {
+            ++end;
+        }
+
+        if (*end == '\0')
+        {
+            break;
+        }
+        else if (*end != ',')
+        {
+            return false;
+        }
+
+        z = end + 1;
+    }
+
+    pCpus->swap(cpus);
+    return true;
+}
+
 std::string string_printf(const char* format, ...)
 {
     /* Use 'vsnprintf' for the formatted printing. It outputs the optimal buffer length - 1. */
@@ -373,6 +373,11 @@ int MySQLSendHandshake(DCB* dcb)
         mysql_server_capabilities_one[1] |= (int)GW_MYSQL_CAPABILITIES_SSL >> 8;
     }
 
+    if (rcap_type_required(service_get_capabilities(dcb->service), RCAP_TYPE_COMPRESSION))
+    {
+        mysql_server_capabilities_one[0] |= (uint8_t)GW_MYSQL_CAPABILITIES_COMPRESS;
+    }
+
     memcpy(mysql_handshake_payload, mysql_server_capabilities_one, sizeof(mysql_server_capabilities_one));
     mysql_handshake_payload = mysql_handshake_payload + sizeof(mysql_server_capabilities_one);
 
@@ -440,9 +445,47 @@ int gw_MySQLWrite_client(DCB* dcb, GWBUF* queue)
     {
         parse_and_set_trx_state(dcb->session, queue);
     }
+
+    MySQLProtocol* protocol = (MySQLProtocol*)dcb->protocol;
+
+    if (protocol->compress && (queue = mxs_mysql_compress(protocol, queue)) == NULL)
+    {
+        return 0;
+    }
+
     return dcb_write(dcb, queue);
 }
 
+/**
+ * Read from a client using the compressed protocol
+ *
+ * The decompressed data is appended to the data in the read queues of the DCB,
+ * which has already been decompressed.
+ *
+ * @param dcb    Client DCB
+ * @param head   Pointer to the buffer where the data is stored
+ * @return -1 on error, otherwise the return value of dcb_read()
+ */
+static int read_compressed(DCB* dcb, GWBUF** head)
+{
+    MySQLProtocol* protocol = (MySQLProtocol*)dcb->protocol;
+    GWBUF* pending = gwbuf_append(dcb->readq, dcb->fakeq);
+    GWBUF* compressed = NULL;
+    dcb->readq = NULL;
+    dcb->fakeq = NULL;
+
+    int rc = dcb_read(dcb, &compressed, 0);
+    GWBUF* data = NULL;
+
+    if (!mxs_mysql_decompress(protocol, compressed, &data))
+    {
+        rc = -1;
+    }
+
+    *head = gwbuf_append(pending, data);
+    return rc;
+}
+
 /**
  * @brief Client read event triggered by EPOLLIN
  *
@@ -489,7 +532,15 @@ int gw_read_client_event(DCB* dcb)
     {
         max_bytes = 36;
     }
-    return_code = dcb_read(dcb, &read_buffer, max_bytes);
+    if (protocol->compress)
+    {
+        return_code = read_compressed(dcb, &read_buffer);
+    }
+    else
+    {
+        return_code = dcb_read(dcb, &read_buffer, max_bytes);
+    }
+
     if (return_code < 0)
     {
         dcb_close(dcb);
@@ -794,7 +845,16 @@ static int gw_read_do_authentication(DCB* dcb, GWBUF* read_buffer, int nbytes_re
             mxb_assert(check);
             mxs_mysql_send_ok(dcb, next_sequence, 0, NULL);
 
-            if (dcb->readq)
+            if ((protocol->client_capabilities & GW_MYSQL_CAPABILITIES_COMPRESS)
+                && rcap_type_required(service_get_capabilities(dcb->service), RCAP_TYPE_COMPRESSION))
+            {
+                // Everything after the OK packet is compressed
+                protocol->compress = true;
+                protocol->compressed_readq = dcb->readq;
+                dcb->readq = NULL;
+            }
+
+            if (dcb->readq || protocol->compressed_readq)
             {
                 // The user has already send more data, process it
                 poll_fake_read_event(dcb);
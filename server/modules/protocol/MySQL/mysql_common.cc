@@ -20,6 +20,7 @@
 #include <set>
 #include <sstream>
 #include <map>
+#include <zlib.h>
 
 #include <maxscale/alloc.h>
 #include <maxscale/clock.h>
@@ -64,6 +65,9 @@ MySQLProtocol* mysql_protocol_init(DCB* dcb, int fd)
     p->num_eof_packets = 0;
     p->large_query = false;
     p->track_state = false;
+    p->compress = false;
+    p->compress_seq = 0;
+    p->compressed_readq = NULL;
     /*< Assign fd with protocol */
     p->fd = fd;
     p->owner_dcb = dcb;
@@ -80,6 +84,8 @@ bool mysql_protocol_done(DCB* dcb)
     if (p->protocol_state == MYSQL_PROTOCOL_ACTIVE)
     {
         gwbuf_free(p->stored_query);
+        gwbuf_free(p->compressed_readq);
+        p->compressed_readq = NULL;
         p->protocol_state = MYSQL_PROTOCOL_DONE;
         rval = true;
     }
@@ -1706,3 +1712,112 @@ mysql_tx_state_t parse_trx_state(const char* str)
 
     return (mysql_tx_state_t)s;
 }
+
+/** Packets shorter than this are sent uncompressed */
+#define MYSQL_MIN_COMPRESS_LEN 50
+
+GWBUF* mxs_mysql_compress(MySQLProtocol* proto, GWBUF* buffer)
+{
+    size_t len = gwbuf_length(buffer);
+    GWBUF* rval = NULL;
+
+    if (len == 0)
+    {
+        return buffer;
+    }
+
+    buffer = gwbuf_make_contiguous(buffer);
+
+    const uint8_t* data = GWBUF_DATA(buffer);
+
+    for (size_t offset = 0; offset < len;)
+    {
+        size_t chunk = MXS_MIN(len - offset, (size_t)MYSQL_PACKET_LENGTH_MAX);
+        uLongf compressed_len = compressBound(chunk);
+        size_t alloc_len = MYSQL_COMPRESSED_HEADER_LEN + MXS_MAX(compressed_len, chunk);
+        GWBUF* packet = gwbuf_alloc(alloc_len);
+
+        if (packet == NULL)
+        {
+            gwbuf_free(rval);
+            rval = NULL;
+            break;
+        }
+
+        uint8_t* ptr = GWBUF_DATA(packet);
+        uint32_t uncompressed_len = chunk;
+
+        // A zero uncompressed length tells that the payload is not compressed
+        if (chunk < MYSQL_MIN_COMPRESS_LEN
+            || compress(ptr + MYSQL_COMPRESSED_HEADER_LEN, &compressed_len, data + offset, chunk) != Z_OK
+            || compressed_len >= chunk)
+        {
+            memcpy(ptr + MYSQL_COMPRESSED_HEADER_LEN, data + offset, chunk);
+            compressed_len = chunk;
+            uncompressed_len = 0;
+        }
+
+        gw_mysql_set_byte3(ptr, compressed_len);
+        ptr[3] = proto->compress_seq++;
+        gw_mysql_set_byte3(ptr + 4, uncompressed_len);
+
+        packet = gwbuf_rtrim(packet, alloc_len - MYSQL_COMPRESSED_HEADER_LEN - compressed_len);
+        rval = gwbuf_append(rval, packet);
+        offset += chunk;
+    }
+
+    gwbuf_free(buffer);
+    return rval;
+}
+
+bool mxs_mysql_decompress(MySQLProtocol* proto, GWBUF* input, GWBUF** output)
+{
+    uint8_t header[MYSQL_COMPRESSED_HEADER_LEN];
+    proto->compressed_readq = gwbuf_append(proto->compressed_readq, input);
+
+    while (gwbuf_copy_data(proto->compressed_readq, 0, sizeof(header), header) == sizeof(header))
+    {
+        uint32_t compressed_len = gw_mysql_get_byte3(header);
+        uint32_t uncompressed_len = gw_mysql_get_byte3(header + 4);
+
+        if (gwbuf_length(proto->compressed_readq) < sizeof(header) + compressed_len)
+        {
+            break;
+        }
+
+        proto->compressed_readq = gwbuf_consume(proto->compressed_readq, sizeof(header));
+        // The responses continue the sequence of the client
+        proto->compress_seq = header[3] + 1;
+
+        if (compressed_len == 0)
+        {
+            continue;
+        }
+
+        GWBUF* packet = gwbuf_split(&proto->compressed_readq, compressed_len);
+
+        if (uncompressed_len != 0)
+        {
+            GWBUF* data = gwbuf_alloc(uncompressed_len);
+            uLongf len = uncompressed_len;
+            packet = gwbuf_make_contiguous(packet);
+
+            if (data == NULL || packet == NULL
+                || uncompress(GWBUF_DATA(data), &len, GWBUF_DATA(packet), compressed_len) != Z_OK
+                || len != uncompressed_len)
+            {
+                MXS_ERROR("Failed to decompress a packet of %u bytes.", compressed_len);
+                gwbuf_free(data);
+                gwbuf_free(packet);
+                return false;
+            }
+
+            gwbuf_free(packet);
+            packet = data;
+        }
+
+        *output = gwbuf_append(*output, packet);
+    }
+
+    return true;
+}
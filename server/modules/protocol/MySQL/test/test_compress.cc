@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include <maxscale/cdefs.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <maxscale/buffer.h>
+#include <maxscale/protocol/mysql.h>
+
+/**
+ * Compress data, feed the packets back in small pieces and check that the
+ * original data and the packet sequence come out.
+ */
+int test_one(size_t len, size_t piece)
+{
+    std::vector<uint8_t> data(len);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        // Half compressible, half random
+        data[i] = i % 100 < 50 ? 'a' : random();
+    }
+
+    MySQLProtocol sender = {};
+    MySQLProtocol receiver = {};
+    sender.compress_seq = 3;
+
+    GWBUF* compressed = mxs_mysql_compress(&sender, gwbuf_alloc_and_load(len, data.data()));
+    GWBUF* output = NULL;
+    bool ok = true;
+
+    while (compressed && ok)
+    {
+        GWBUF* part = gwbuf_split(&compressed, MXS_MIN(gwbuf_length(compressed), piece));
+        ok = mxs_mysql_decompress(&receiver, part, &output);
+    }
+
+    std::vector<uint8_t> result(gwbuf_length(output));
+    gwbuf_copy_data(output, 0, result.size(), result.data());
+    gwbuf_free(output);
+    gwbuf_free(receiver.compressed_readq);
+
+    if (!ok || result != data || receiver.compress_seq != sender.compress_seq)
+    {
+        printf("Compression of %lu bytes failed: %s, sequence %u, expected %u.\n",
+               len,
+               ok ? "wrong data" : "decompression error",
+               receiver.compress_seq,
+               sender.compress_seq);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int result = 0;
+
+    // Uncompressed, compressed and split into several packets
+    size_t sizes[] = {1, 49, 50, 1000, 100000, MYSQL_PACKET_LENGTH_MAX, MYSQL_PACKET_LENGTH_MAX + 100};
+
+    for (size_t len : sizes)
+    {
+        // The packet headers are split too
+        result += test_one(len, len < 100000 ? 1 : 4000);
+        result += test_one(len, 65536);
+    }
+
+    return result;
+}
@@ -142,6 +142,7 @@ Avro::Avro(SERVICE* service, MXS_CONFIG_PARAMETER* params, SERVICE* source, SRow
     , task_handle(0)
     , handler(service, handler, config_get_compiled_regex(params, "match", 0, NULL),
               config_get_compiled_regex(params, "exclude", 0, NULL))
+    , offsets(avrodir)
 {
     if (source)
     {
@@ -303,158 +303,559 @@ std::pair<std::string, std::string> get_avrofile_and_gtid(std::string file)
 }
 
 /**
- * Process command from client
+ * Strip the file version from a table name
  *
- * @param data Buffer containing the command
+ * @param table Table name, optionally followed by the file version e.g. test.t1.000002
  *
+ * @return The table in `database.table` format
+ */
+static std::string table_name(const std::string& table)
+{
+    auto first_dot = table.find_first_of('.');
+    auto second_dot = first_dot != std::string::npos ? table.find_first_of('.', first_dot + 1) : first_dot;
+    return table.substr(0, second_dot);
+}
+
+/**
+ * Process commands from client
+ *
+ * Each line of the buffer is processed as a separate command.
+ *
+ * @param queue Buffer containing the commands
  */
 void AvroSession::process_command(GWBUF* queue)
 {
-    const char req_data[] = "REQUEST-DATA";
-    const size_t req_data_len = sizeof(req_data) - 1;
     size_t buflen = gwbuf_length(queue);
-    uint8_t data[buflen + 1];
-    gwbuf_copy_data(queue, 0, buflen, data);
-    data[buflen] = '\0';
-    char* command_ptr = strstr((char*)data, req_data);
+    std::string data(buflen, '\0');
+    gwbuf_copy_data(queue, 0, buflen, (uint8_t*)&data[0]);
+
+    // Older clients send the request as a null-terminated string
+    data.resize(strnlen(data.c_str(), buflen));
+
+    std::istringstream is(data);
+    std::string line;
+
+    while (std::getline(is, line))
+    {
+        mxs::trim(line);
+
+        if (!line.empty())
+        {
+            process_command(line);
+        }
+    }
+}
+
+void AvroSession::process_command(const std::string& command)
+{
+    const char req_batch[] = "REQUEST-BATCH";
+    const char req_data[] = "REQUEST-DATA";
+    const char commit[] = "COMMIT-OFFSET";
+    size_t pos;
+
+    if ((pos = command.find(req_batch)) != std::string::npos)
+    {
+        request_batch(command.substr(pos + sizeof(req_batch) - 1));
+    }
+    else if ((pos = command.find(req_data)) != std::string::npos)
+    {
+        request_data(command.substr(pos + sizeof(req_data) - 1));
+    }
+    else if ((pos = command.find(commit)) != std::string::npos)
+    {
+        commit_offset(command.substr(pos + sizeof(commit) - 1));
+    }
+    else if (batched)
+    {
+        reply(0, CDC_FRAME_ERROR, "Unknown command");
+    }
+    else
+    {
+        const char err[] = "ERR: Unknown command\n";
+        GWBUF* reply = gwbuf_alloc_and_load(sizeof(err), err);
+        dcb->func.write(dcb, reply);
+    }
+}
+
+/**
+ * Handle a REQUEST-DATA command
+ *
+ * @param args The requested file and the optional GTID
+ */
+void AvroSession::request_data(const std::string& args)
+{
+    if (!streams.empty())
+    {
+        dcb_printf(dcb, "ERR Data has already been requested\n");
+    }
+    else if (args.find_first_not_of(' ') != std::string::npos)
+    {
+        auto file_and_gtid = get_avrofile_and_gtid(args);
+        SAvroStream stream(new AvroStream(this, 0, file_and_gtid.first));
+
+        if (!file_and_gtid.second.empty())
+        {
+            stream->requested_gtid = true;
+            extract_gtid_request(&stream->gtid, file_and_gtid.second.c_str(), file_and_gtid.second.size());
+            memcpy(&stream->gtid_start, &stream->gtid, sizeof(stream->gtid_start));
+        }
 
-    if (command_ptr != NULL)
+        if (file_in_dir(router->avrodir.c_str(), stream->avro_binfile.c_str()))
+        {
+            streams.push_back(std::move(stream));
+            start_streaming();
+        }
+        else
+        {
+            dcb_printf(dcb, "ERR NO-FILE File '%s' not found.\n", stream->avro_binfile.c_str());
+        }
+    }
+    else
     {
-        char* file_ptr = command_ptr + req_data_len;
-        int data_len = GWBUF_LENGTH(queue) - req_data_len;
+        dcb_printf(dcb, "ERR REQUEST-DATA with no data\n");
+    }
+}
 
-        if (data_len > 1)
+/**
+ * Handle a REQUEST-BATCH command
+ *
+ * Each argument is a table with an optional GTID range: `TABLE[@[START][:END]]`.
+ * Without a range the table is streamed from the offset the client last
+ * committed for it or from the start if no offset has been committed.
+ *
+ * @param args The requested tables
+ */
+void AvroSession::request_batch(const std::string& args)
+{
+    // From now on all replies are sent as frames
+    batched = true;
+
+    if (!streams.empty())
+    {
+        reply(0, CDC_FRAME_ERROR, "Data has already been requested");
+        return;
+    }
+
+    std::vector<SAvroStream> requested;
+    std::istringstream is(args);
+    std::string token;
+
+    while (is >> token)
+    {
+        auto at = token.find('@');
+        std::string table = token.substr(0, at);
+        SAvroStream stream(new AvroStream(this, requested.size() + 1, get_avrofile_and_gtid(table).first));
+
+        if (!file_in_dir(router->avrodir.c_str(), stream->avro_binfile.c_str()))
         {
-            auto file_and_gtid = get_avrofile_and_gtid(file_ptr);
+            reply(0, CDC_FRAME_ERROR, "File '" + stream->avro_binfile + "' not found");
+            return;
+        }
 
-            if (!file_and_gtid.second.empty())
+        if (at == std::string::npos)
+        {
+            gtid_pos_t committed;
+
+            if (router->offsets.get(uuid, table_name(table), &committed))
             {
-                requested_gtid = true;
-                extract_gtid_request(&gtid, file_and_gtid.second.c_str(), file_and_gtid.second.size());
-                memcpy(&gtid_start, &gtid, sizeof(gtid_start));
+                // Continue from the transaction that follows the committed one
+                stream->requested_gtid = true;
+                stream->gtid = committed;
+                stream->gtid.seq++;
             }
+        }
+        else
+        {
+            std::string range = token.substr(at + 1);
+            auto colon = range.find(':');
+            std::string start = range.substr(0, colon);
+            std::string end = colon != std::string::npos ? range.substr(colon + 1) : "";
 
-            avro_binfile = file_and_gtid.first;
-
-            if (file_in_dir(router->avrodir.c_str(), avro_binfile.c_str()))
+            if (!start.empty())
             {
-                /* set callback routine for data sending */
-                dcb_add_callback(dcb, DCB_REASON_DRAINED, avro_client_callback, this);
+                if (!stream->gtid.parse(start.c_str()))
+                {
+                    reply(0, CDC_FRAME_ERROR, "Invalid GTID: " + start);
+                    return;
+                }
 
-                /* Add fake event that will call the avro_client_callback() routine */
-                poll_fake_write_event(dcb);
+                stream->requested_gtid = true;
             }
-            else
+
+            if (!end.empty())
             {
-                dcb_printf(dcb, "ERR NO-FILE File '%s' not found.\n", avro_binfile.c_str());
+                if (format != AVRO_FORMAT_JSON)
+                {
+                    reply(0, CDC_FRAME_ERROR, "The end of a range can only be used with the JSON format");
+                    return;
+                }
+                else if (!stream->gtid_end.parse(end.c_str()))
+                {
+                    reply(0, CDC_FRAME_ERROR, "Invalid GTID: " + end);
+                    return;
+                }
+
+                stream->has_end = true;
             }
         }
+
+        stream->gtid_start = stream->gtid;
+        requested.push_back(std::move(stream));
+    }
+
+    if (requested.empty())
+    {
+        reply(0, CDC_FRAME_ERROR, "REQUEST-BATCH with no tables");
+    }
+    else
+    {
+        streams = std::move(requested);
+        start_streaming();
+    }
+}
+
+/**
+ * Reply to a COMMIT-OFFSET command once the offset has been written
+ *
+ * Must be called in the worker of the session, the session is not replied to
+ * if it was closed while the offset was being written.
+ *
+ * @param id The ID of the client session
+ * @param ok Whether the offset was written
+ */
+static void offset_committed(uint64_t id, bool ok)
+{
+    MXS_SESSION* session = mxs_rworker_find_session(id);
+
+    if (session && session->state == SESSION_STATE_ROUTER_READY)
+    {
+        AvroSession* client = static_cast<AvroSession*>(session->router_session);
+
+        if (ok)
+        {
+            client->reply(0, CDC_FRAME_OK, "");
+        }
         else
         {
-            dcb_printf(dcb, "ERR REQUEST-DATA with no data\n");
+            client->reply(0, CDC_FRAME_ERROR, "Failed to commit offset");
         }
     }
+}
+
+/**
+ * Handle a COMMIT-OFFSET command
+ *
+ * @param args The table and the GTID up to which the client has processed it
+ */
+void AvroSession::commit_offset(const std::string& args)
+{
+    std::istringstream is(args);
+    std::string table;
+    std::string value;
+    gtid_pos_t gtid;
+
+    if (!(is >> table >> value) || !gtid.parse(value.c_str()))
+    {
+        reply(0, CDC_FRAME_ERROR, "Invalid COMMIT-OFFSET, expected a table and a GTID");
+    }
     else
     {
-        const char err[] = "ERR: Unknown command\n";
-        GWBUF* reply = gwbuf_alloc_and_load(sizeof(err), err);
-        dcb->func.write(dcb, reply);
+        // The offset is written by another thread, the reply is sent from this worker once it's done
+        uint64_t id = dcb->session->ses_id;
+        mxs::RoutingWorker* worker = mxs::RoutingWorker::get_current();
+
+        auto done = [id, worker](bool ok) {
+                worker->execute([id, ok]() {
+                                    offset_committed(id, ok);
+                                }, mxb::Worker::EXECUTE_QUEUED);
+            };
+
+        if (!router->offsets.commit(uuid, table_name(table), gtid, done))
+        {
+            reply(0, CDC_FRAME_ERROR, "Failed to commit offset");
+        }
+    }
+}
+
+void AvroSession::start_streaming()
+{
+    /* set callback routine for data sending */
+    dcb_add_callback(dcb, DCB_REASON_DRAINED, avro_client_callback, this);
+
+    /* Add fake event that will call the avro_client_callback() routine */
+    poll_fake_write_event(dcb);
+}
+
+GWBUF* cdc_frame(uint32_t id, cdc_frame_type type, GWBUF* payload)
+{
+    GWBUF* frame = gwbuf_alloc(CDC_FRAME_HEADER_LEN);
+
+    if (!frame)
+    {
+        gwbuf_free(payload);
+        return NULL;
     }
+
+    uint8_t* ptr = GWBUF_DATA(frame);
+    gw_mysql_set_byte4(ptr, payload ? gwbuf_length(payload) : 0);
+    gw_mysql_set_byte4(ptr + 4, id);
+    ptr[8] = type;
+
+    if (payload)
+    {
+        frame = gwbuf_append(frame, payload);
+    }
+
+    return frame;
+}
+
+int AvroSession::write_frame(uint32_t id, cdc_frame_type type, GWBUF* payload)
+{
+    GWBUF* frame = cdc_frame(id, type, payload);
+    return frame ? dcb->func.write(dcb, frame) : 0;
 }
 
-static int send_row(DCB* dcb, json_t* row)
+void AvroSession::reply(uint32_t id, cdc_frame_type type, const std::string& msg)
 {
-    char* json = json_dumps(row, JSON_PRESERVE_ORDER);
-    size_t len = strlen(json);
-    GWBUF* buf = gwbuf_alloc(len + 1);
-    int rc = 0;
+    mxb_assert(type == CDC_FRAME_OK || type == CDC_FRAME_ERROR);
 
-    if (json && buf)
+    if (batched)
     {
-        uint8_t* data = GWBUF_DATA(buf);
-        memcpy(data, json, len);
-        data[len] = '\n';
-        rc = dcb->func.write(dcb, buf);
+        write_frame(id, type, msg.empty() ? NULL : gwbuf_alloc_and_load(msg.size(), msg.c_str()));
     }
     else
     {
-        MXS_ERROR("Failed to dump JSON value.");
-        rc = 0;
+        dcb_printf(dcb, "%s%s%s\n", type == CDC_FRAME_OK ? "OK" : "ERR", msg.empty() ? "" : " ", msg.c_str());
     }
-    MXS_FREE(json);
-    return rc;
 }
 
-void AvroSession::set_current_gtid(json_t* row)
+int AvroStream::write(GWBUF* buffer, cdc_frame_type type)
 {
-    json_t* obj = json_object_get(row, avro_sequence);
-    mxb_assert(json_is_integer(obj));
-    gtid.seq = json_integer_value(obj);
+    DCB* dcb = session->dcb;
+    return session->batched ? session->write_frame(id, type, buffer) : dcb->func.write(dcb, buffer);
+}
 
-    obj = json_object_get(row, avro_server_id);
-    mxb_assert(json_is_integer(obj));
-    gtid.server_id = json_integer_value(obj);
+/**
+ * Find the index of a field in an Avro schema
+ *
+ * @param schema Schema to search
+ * @param name   Name of the field
+ * @return Index of the field or -1 if the schema has no such field
+ */
+static int schema_field_index(MAXAVRO_SCHEMA* schema, const char* name)
+{
+    for (size_t i = 0; i < schema->num_fields; i++)
+    {
+        if (strcmp(schema->fields[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
 
-    obj = json_object_get(row, avro_domain);
-    mxb_assert(json_is_integer(obj));
-    gtid.domain = json_integer_value(obj);
+    return -1;
+}
+
+void AvroStream::set_current_gtid(const uint64_t* values, int domain, int server_id, int seq)
+{
+    if (domain >= 0 && server_id >= 0 && seq >= 0)
+    {
+        gtid.seq = values[seq];
+        gtid.server_id = values[server_id];
+        gtid.domain = values[domain];
+    }
+}
+
+/**
+ * Check if a row is past the end of the requested range
+ *
+ * @return True if the row belongs to a transaction that follows the end of the range
+ */
+bool AvroStream::past_end(const uint64_t* values, int domain, int server_id, int seq)
+{
+    return has_end && domain >= 0 && server_id >= 0 && seq >= 0
+           && values[domain] == gtid_end.domain
+           && values[server_id] == gtid_end.server_id
+           && values[seq] > gtid_end.seq;
+}
+
+/**
+ * Send the JSON rows collected into the text buffer
+ *
+ * @return The return value of the DCB write or 1 if there was nothing to send
+ */
+int AvroStream::send_json_text()
+{
+    int rc = 1;
+
+    if (json_text.length > 0)
+    {
+        GWBUF* buf = gwbuf_alloc_and_load(json_text.length, json_text.data);
+        json_text.length = 0;
+
+        if (buf)
+        {
+            rc = write(buf);
+        }
+        else
+        {
+            MXS_ERROR("Failed to allocate buffer for JSON rows.");
+            rc = 0;
+        }
+    }
+
+    return rc;
 }
 
 /**
  * @brief Stream Avro data in JSON format
  *
- * @param file File to stream from
- * @param dcb DCB to stream to
+ * The records are serialized directly into the stream's text buffer and
+ * several rows are sent in one network buffer.
+ *
  * @return True if more data is readable, false if all data was sent
  */
-bool AvroSession::stream_json()
+bool AvroStream::stream_json()
 {
     int bytes = 0;
+    int burst = session->batched ? AVRO_BATCH_BURST_SIZE : AVRO_DATA_BURST_SIZE;
+    MAXAVRO_SCHEMA* schema = file_handle->schema;
+    std::vector<uint64_t> values(schema->num_fields);
+    int domain = schema_field_index(schema, avro_domain);
+    int server_id = schema_field_index(schema, avro_server_id);
+    int seq = schema_field_index(schema, avro_sequence);
 
     do
     {
-        json_t* row;
+        if (tail_pos)
+        {
+            // The block was sent from the tail
+            continue;
+        }
+
         int rc = 1;
-        while (rc > 0 && (row = maxavro_record_read_json(file_handle)))
+        size_t length = json_text.length;
+
+        while (rc > 0 && maxavro_record_read_json_text(file_handle, &json_text, values.data()))
         {
-            rc = send_row(dcb, row);
-            set_current_gtid(row);
-            json_decref(row);
+            if (past_end(values.data(), domain, server_id, seq))
+            {
+                // Drop the row, it belongs to the first transaction after the range
+                json_text.length = length;
+                done = true;
+                break;
+            }
+
+            maxavro_text_append(&json_text, "\n", 1);
+            set_current_gtid(values.data(), domain, server_id, seq);
+
+            if (json_text.length >= (size_t)burst)
+            {
+                rc = send_json_text();
+            }
+
+            length = json_text.length;
+        }
+
+        if (rc > 0)
+        {
+            send_json_text();
         }
+
+        json_text.length = 0;
         bytes += file_handle->buffer_size;
     }
-    while (maxavro_next_block(file_handle) && bytes < AVRO_DATA_BURST_SIZE);
+    while (!done && next_block(&bytes) && bytes < burst);
 
-    return bytes >= AVRO_DATA_BURST_SIZE;
+    return !done && bytes >= burst;
 }
 
 /**
  * @brief Stream Avro data in native Avro format
  *
- * @param file File to stream from
- * @param dcb DCB to stream to
- * @return True if streaming was successful, false if an error occurred
+ * @return True if more data is readable, false if all data was sent
  */
-bool AvroSession::stream_binary()
+bool AvroStream::stream_binary()
 {
     GWBUF* buffer;
-    uint64_t bytes = 0;
+    int bytes = 0;
+    int burst = session->batched ? AVRO_BATCH_BURST_SIZE : AVRO_DATA_BURST_SIZE;
     int rc = 1;
 
-    while (rc > 0 && bytes < AVRO_DATA_BURST_SIZE)
+    while (rc > 0 && bytes < burst)
     {
-        bytes += file_handle->buffer_size;
-        if ((buffer = maxavro_record_read_binary(file_handle)))
+        if (!tail_pos && file_handle->metadata_read)
         {
-            rc = dcb->func.write(dcb, buffer);
+            // The current block of the file has not been sent yet
+            bytes += file_handle->buffer_size;
+
+            if ((buffer = maxavro_record_read_binary(file_handle)))
+            {
+                rc = write(buffer);
+            }
+            else
+            {
+                rc = 0;
+            }
         }
-        else
+        else if (!next_block(&bytes))
         {
             rc = 0;
         }
     }
 
-    return bytes >= AVRO_DATA_BURST_SIZE;
+    return bytes >= burst;
+}
+
+/**
+ * Move to the next data block
+ *
+ * If the tail of the file has the block, the encoded block is sent to the client.
+ * Otherwise the block is read from the stream's own file handle.
+ *
+ * @param bytes Incremented by the size of the block if it was sent from the tail
+ *
+ * @return True if the next block was sent or read
+ */
+bool AvroStream::next_block(int* bytes)
+{
+    long pos = tail_pos ? tail_pos : file_handle->next_block_pos;
+    GWBUF* buffer = NULL;
+    SAvroTailBlock block;
+    avro_data_format format = session->format;
+
+    switch (tail ? tail->read(pos, format, &buffer, &block) : AvroTail::BEHIND)
+    {
+    case AvroTail::OK:
+        *bytes += gwbuf_length(buffer);
+        tail_pos = block->end;
+        tail_records += block->records;
+
+        if (format == AVRO_FORMAT_JSON && block->records > 0)
+        {
+            gtid.domain = block->gtid.domain;
+            gtid.server_id = block->gtid.server_id;
+            gtid.seq = block->gtid.seq;
+        }
+
+        write(buffer);
+        return true;
+
+    case AvroTail::NO_DATA:
+        return false;
+
+    case AvroTail::BEHIND:
+    default:
+        break;
+    }
+
+    if (tail_pos)
+    {
+        // The client fell behind the tail, continue from where it left off
+        tail_pos = 0;
+        return maxavro_record_set_pos(file_handle, pos);
+    }
+
+    return maxavro_next_block(file_handle);
 }
 
 static int sqlite_cb(void* data, int rows, char** values, char** names)
@@ -470,53 +871,57 @@ static int sqlite_cb(void* data, int rows, char** values, char** names)
     return 0;
 }
 
-bool AvroSession::seek_to_gtid()
+bool AvroStream::seek_to_gtid()
 {
     bool seeking = true;
+    MAXAVRO_SCHEMA* schema = file_handle->schema;
+    std::vector<uint64_t> values(schema->num_fields);
+    int domain = schema_field_index(schema, avro_domain);
+    int server_id = schema_field_index(schema, avro_server_id);
+    int seq = schema_field_index(schema, avro_sequence);
+    mxb_assert(domain >= 0 && server_id >= 0 && seq >= 0);
+
+    if (file_handle->records_read == 0)
+    {
+        // Skip the data blocks that the GTID index says only contain older GTIDs
+        avro_index_seek(file_handle, session->router->avrodir + '/' + avro_binfile, gtid);
+    }
 
     do
     {
-        json_t* row;
-        while ((row = maxavro_record_read_json(file_handle)))
+        while (seeking && maxavro_record_read_json_text(file_handle, &json_text, values.data()))
         {
-            json_t* obj = json_object_get(row, avro_sequence);
-            mxb_assert(json_is_integer(obj));
-            uint64_t value = json_integer_value(obj);
-
             /** If a larger GTID is found, use that */
-            if (value >= gtid.seq)
+            if (values[seq] >= gtid.seq
+                && values[server_id] == gtid.server_id
+                && values[domain] == gtid.domain)
             {
-                obj = json_object_get(row, avro_server_id);
-                mxb_assert(json_is_integer(obj));
-                value = json_integer_value(obj);
-
-                if (value == gtid.server_id)
+                MXS_INFO("Found GTID %lu-%lu-%lu for %s@%s",
+                         gtid.domain,
+                         gtid.server_id,
+                         gtid.seq,
+                         session->dcb->user,
+                         session->dcb->remote);
+                seeking = false;
+
+                if (past_end(values.data(), domain, server_id, seq))
                 {
-                    obj = json_object_get(row, avro_domain);
-                    mxb_assert(json_is_integer(obj));
-                    value = json_integer_value(obj);
-
-                    if (value == gtid.domain)
-                    {
-                        MXS_INFO("Found GTID %lu-%lu-%lu for %s@%s",
-                                 gtid.domain,
-                                 gtid.server_id,
-                                 gtid.seq,
-                                 dcb->user,
-                                 dcb->remote);
-                        seeking = false;
-                    }
+                    json_text.length = 0;
+                    done = true;
+                }
+                else
+                {
+                    /** We'll send the first found row immediately since we have already
+                     * read the row into memory */
+                    maxavro_text_append(&json_text, "\n", 1);
+                    set_current_gtid(values.data(), domain, server_id, seq);
+                    send_json_text();
                 }
             }
-
-            /** We'll send the first found row immediately since we have already
-             * read the row into memory */
-            if (!seeking)
+            else
             {
-                send_row(dcb, row);
+                json_text.length = 0;
             }
-
-            json_decref(row);
         }
     }
     while (seeking && maxavro_next_block(file_handle));
@@ -529,9 +934,10 @@ bool AvroSession::seek_to_gtid()
  *
  * @return True if more data needs to be read
  */
-bool AvroSession::stream_data()
+bool AvroStream::stream_data()
 {
     bool read_more = false;
+    Avro* router = session->router;
 
     if (!avro_binfile.empty())
     {
@@ -542,27 +948,42 @@ bool AvroSession::stream_data()
         {
             ok = false;
         }
+        else if (!tail && !has_end)
+        {
+            // The blocks in the tail are sent as a whole which means they can't be used
+            // when the stream must stop at a specific transaction
+            tail = router->tails.get(filename);
+        }
 
         if (ok)
         {
-            switch (format)
+            switch (session->format)
             {
             case AVRO_FORMAT_JSON:
-                /** Currently only JSON format supports seeking to a GTID */
                 if (requested_gtid && seek_to_gtid())
                 {
                     requested_gtid = false;
                 }
 
-                read_more = stream_json();
+                if (!requested_gtid && !done)
+                {
+                    read_more = stream_json();
+                }
                 break;
 
             case AVRO_FORMAT_AVRO:
+                if (requested_gtid)
+                {
+                    // Avro data is sent in whole blocks, start from the block that has the GTID
+                    avro_index_seek(file_handle, filename, gtid);
+                    requested_gtid = false;
+                }
+
                 read_more = stream_binary();
                 break;
 
             default:
-                MXS_ERROR("Unexpected format: %d", format);
+                MXS_ERROR("Unexpected format: %d", session->format);
                 break;
             }
 
@@ -573,12 +994,15 @@ bool AvroSession::stream_data()
                           maxavro_get_error_string(file_handle));
             }
 
-            last_sent_pos = file_handle->records_read;
+            if (done)
+            {
+                write(NULL, CDC_FRAME_END);
+            }
         }
     }
     else
     {
-        dcb_printf(dcb, "ERR avro file not specified\n");
+        session->reply(id, CDC_FRAME_ERROR, "avro file not specified");
     }
 
     return read_more;
@@ -632,15 +1056,18 @@ GWBUF* read_avro_binary_schema(std::string avrofile, std::string dir)
 
 /**
  * Rotate to a new Avro file
- * @param client Avro client session
+ *
  * @param fullname Absolute path to the file to rotate to
  */
-void AvroSession::rotate_avro_file(std::string fullname)
+void AvroStream::rotate_avro_file(std::string fullname)
 {
     auto pos = fullname.find_last_of('/');
     mxb_assert(pos != std::string::npos);
     avro_binfile = fullname.substr(pos + 1);
-    last_sent_pos = 0;
+    schema_sent = false;
+    tail.reset();
+    tail_pos = 0;
+    tail_records = 0;
 
     maxavro_file_close(file_handle);
 
@@ -651,8 +1078,8 @@ void AvroSession::rotate_avro_file(std::string fullname)
     else
     {
         MXS_INFO("Rotated '%s'@'%s' to file: %s",
-                 dcb->user,
-                 dcb->remote,
+                 session->dcb->user,
+                 session->dcb->remote,
                  fullname.c_str());
     }
 }
@@ -690,49 +1117,96 @@ static std::string get_next_filename(std::string file, std::string dir)
     return std::string(outbuf);
 }
 
-void AvroSession::client_callback()
+/**
+ * Send the schema of the current file
+ */
+void AvroStream::send_schema()
 {
-    if (last_sent_pos == 0)
+    GWBUF* schema = NULL;
+    Avro* router = session->router;
+
+    switch (session->format)
     {
-        // TODO: Don't use DCB callbacks to stream the data
-        last_sent_pos = 1;
+    case AVRO_FORMAT_JSON:
+        schema = read_avro_json_schema(avro_binfile, router->avrodir);
+        break;
 
-        /** Send the schema of the current file */
-        GWBUF* schema = NULL;
+    case AVRO_FORMAT_AVRO:
+        schema = read_avro_binary_schema(avro_binfile, router->avrodir);
+        break;
 
-        switch (format)
-        {
-        case AVRO_FORMAT_JSON:
-            schema = read_avro_json_schema(avro_binfile, router->avrodir);
-            break;
+    default:
+        MXS_ERROR("Unknown client format: %d", session->format);
+        break;
+    }
 
-        case AVRO_FORMAT_AVRO:
-            schema = read_avro_binary_schema(avro_binfile, router->avrodir);
-            break;
+    if (schema)
+    {
+        write(schema, CDC_FRAME_SCHEMA);
+    }
+}
 
-        default:
-            MXS_ERROR("Unknown client format: %d", format);
-            break;
-        }
+bool AvroStream::stream()
+{
+    if (!schema_sent)
+    {
+        schema_sent = true;
+        send_schema();
+    }
 
-        if (schema)
+    /** Stream the data to the client */
+    bool read_more = stream_data();
+    bool next_file = false;
+
+    if (!read_more && !done)
+    {
+        /** If the next file is available, send it to the client */
+        std::string filename = get_next_filename(avro_binfile, session->router->avrodir);
+
+        if ((next_file = (access(filename.c_str(), R_OK) == 0)))
         {
-            dcb->func.write(dcb, schema);
+            rotate_avro_file(filename);
         }
     }
 
-    /** Stream the data to the client */
-    bool read_more = stream_data();
-    std::string filename = get_next_filename(avro_binfile, router->avrodir);
+    return next_file || read_more;
+}
 
-    bool next_file;
-    /** If the next file is available, send it to the client */
-    if ((next_file = (access(filename.c_str(), R_OK) == 0)))
+AvroStream::AvroStream(AvroSession* session, uint32_t id, const std::string& binfile)
+    : session(session)
+    , id(id)
+    , file_handle(NULL)
+    , schema_sent(false)
+    , avro_binfile(binfile)
+    , requested_gtid(false)
+    , has_end(false)
+    , done(false)
+    , json_text()
+    , tail_pos(0)
+    , tail_records(0)
+{
+}
+
+AvroStream::~AvroStream()
+{
+    maxavro_file_close(file_handle);
+    maxavro_text_free(&json_text);
+}
+
+void AvroSession::client_callback()
+{
+    bool read_more = false;
+
+    // Each stream sends one burst of data before the next one gets its turn
+    for (auto& stream : streams)
     {
-        rotate_avro_file(filename);
+        if (!stream->done && stream->stream())
+        {
+            read_more = true;
+        }
     }
 
-    if (next_file || read_more)
+    if (read_more)
     {
         poll_fake_write_event(dcb);
     }
@@ -749,14 +1223,11 @@ AvroSession::AvroSession(Avro* instance, MXS_SESSION* session)
     , state(AVRO_CLIENT_UNREGISTERED)
     , format(AVRO_FORMAT_UNDEFINED)
     , router(instance)
-    , file_handle(NULL)
-    , last_sent_pos(0)
     , connect_time(time(NULL))
-    , requested_gtid(false)
+    , batched(false)
 {
 }
 
 AvroSession::~AvroSession()
 {
-    maxavro_file_close(file_handle);
 }
@@ -74,7 +74,7 @@ AvroTable* avro_table_alloc(const char* filepath,
         return NULL;
     }
 
-    AvroTable* table = new(std::nothrow) AvroTable(avro_file, avro_writer_iface, avro_schema);
+    AvroTable* table = new(std::nothrow) AvroTable(avro_file, avro_writer_iface, avro_schema, filepath);
 
     if (!table)
     {
@@ -87,6 +87,35 @@ AvroTable* avro_table_alloc(const char* filepath,
     return table;
 }
 
+bool AvroTable::flush()
+{
+    if (avro_file_writer_flush(avro_file))
+    {
+        MXS_ERROR("Failed to flush '%s': %s", filename.c_str(), avro_strerror());
+        return false;
+    }
+
+    if (unindexed)
+    {
+        struct stat st;
+
+        // The flush wrote out complete data blocks which means the file now ends at a block
+        // boundary. The rows written since the previous flush start where the file ended then.
+        if (stat(filename.c_str(), &st) == 0)
+        {
+            avro_index_add(filename, first_gtid, flushed_pos);
+            flushed_pos = st.st_size;
+            unindexed = false;
+        }
+        else
+        {
+            MXS_ERROR("Failed to stat '%s': %d, %s", filename.c_str(), errno, mxs_strerror(errno));
+        }
+    }
+
+    return true;
+}
+
 /**
  * @brief Convert the MySQL column type to a compatible Avro type
  *
@@ -303,11 +332,225 @@ static const char* codec_to_string(enum mxs_avro_codec_type type)
     }
 }
 
-AvroConverter::AvroConverter(std::string avrodir, uint64_t block_size, mxs_avro_codec_type codec)
-    : m_avrodir(avrodir)
+namespace
+{
+/** Number of rows handed to a writer at a time */
+const size_t WRITER_BATCH_SIZE = 128;
+
+/** Maximum number of batches queued for one writer */
+const size_t WRITER_MAX_QUEUED = 64;
+}
+
+AvroWriter::AvroWriter()
+    : m_busy(false)
+    , m_running(true)
+    , m_failed(false)
+    , m_thread(&AvroWriter::run, this)
+{
+}
+
+AvroWriter::~AvroWriter()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_running = false;
+    }
+
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+void AvroWriter::enqueue(AvroRows& rows)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    // Stop the decoding from running too far ahead of the writer
+    m_idle.wait(guard, [this]() {
+                    return m_queue.size() < WRITER_MAX_QUEUED;
+                });
+
+    m_queue.emplace_back();
+    m_queue.back().swap(rows);
+    guard.unlock();
+    m_cond.notify_one();
+}
+
+void AvroWriter::flush(const SAvroTable& table)
+{
+    AvroRows rows(1);
+    rows[0].table = table;
+    rows[0].flush = true;
+    enqueue(rows);
+}
+
+void AvroWriter::sync()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_idle.wait(guard, [this]() {
+                    return m_queue.empty() && !m_busy;
+                });
+}
+
+void AvroWriter::run()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    while (true)
+    {
+        m_cond.wait(guard, [this]() {
+                        return !m_queue.empty() || !m_running;
+                    });
+
+        if (m_queue.empty())
+        {
+            break;
+        }
+
+        AvroRows rows;
+        rows.swap(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+        guard.unlock();
+
+        bool ok = true;
+
+        if (rows.size() == 1 && rows[0].flush)
+        {
+            ok = rows[0].table->flush();
+        }
+        else
+        {
+            for (const auto& row : rows)
+            {
+                ok = write_row(row) && ok;
+            }
+        }
+
+        if (!ok)
+        {
+            m_failed.store(true, std::memory_order_release);
+        }
+
+        // Release the table references before taking the lock, the last one closes the file
+        rows.clear();
+
+        guard.lock();
+        m_busy = false;
+        m_idle.notify_all();
+    }
+}
+
+bool AvroWriter::write_row(const AvroRow& row)
+{
+    bool rval = true;
+    avro_value_t record;
+    avro_value_t field;
+    avro_value_t union_value;
+
+    avro_generic_value_new(row.table->avro_writer_iface, &record);
+    avro_value_get_by_name(&record, avro_domain, &field, NULL);
+    avro_value_set_int(&field, row.gtid.domain);
+
+    avro_value_get_by_name(&record, avro_server_id, &field, NULL);
+    avro_value_set_int(&field, row.gtid.server_id);
+
+    avro_value_get_by_name(&record, avro_sequence, &field, NULL);
+    avro_value_set_int(&field, row.gtid.seq);
+
+    avro_value_get_by_name(&record, avro_event_number, &field, NULL);
+    avro_value_set_int(&field, row.gtid.event_num);
+
+    avro_value_get_by_name(&record, avro_timestamp, &field, NULL);
+    avro_value_set_int(&field, row.timestamp);
+
+    avro_value_get_by_name(&record, avro_event_type, &field, NULL);
+    avro_value_set_enum(&field, row.event_type);
+
+    for (const auto& col : row.columns)
+    {
+        mxb_assert(col.index < (int)row.table->columns.size());
+        MXB_AT_DEBUG(int rc = ) avro_value_get_by_name(&record,
+                                                       row.table->columns[col.index].c_str(),
+                                                       &union_value,
+                                                       NULL);
+        mxb_assert(rc == 0);
+        avro_value_set_branch(&union_value, col.type == AvroColumn::NUL ? 0 : 1, &field);
+
+        switch (col.type)
+        {
+        case AvroColumn::NUL:
+            avro_value_set_null(&field);
+            break;
+
+        case AvroColumn::INT:
+            avro_value_set_int(&field, col.integer);
+            break;
+
+        case AvroColumn::LONG:
+            avro_value_set_long(&field, col.integer);
+            break;
+
+        case AvroColumn::FLOAT:
+            avro_value_set_float(&field, col.real);
+            break;
+
+        case AvroColumn::DOUBLE:
+            avro_value_set_double(&field, col.real);
+            break;
+
+        case AvroColumn::STRING:
+            avro_value_set_string(&field, col.str.c_str());
+            break;
+
+        case AvroColumn::BYTES:
+            avro_value_set_bytes(&field, (void*)col.str.data(), col.str.size());
+            break;
+
+        case AvroColumn::TEMPORAL:
+            {
+                char buf[TEMPORAL_VALUE_MAXLEN];
+                col.temporal.format(buf);
+                avro_value_set_string(&field, buf);
+            }
+            break;
+        }
+    }
+
+    if (avro_file_writer_append_value(row.table->avro_file, &record))
+    {
+        MXS_ERROR("Failed to write value: %s", avro_strerror());
+        rval = false;
+    }
+    else
+    {
+        row.table->row_written(row.gtid);
+    }
+
+    avro_value_decref(&record);
+    return rval;
+}
+
+AvroConverter::AvroConverter(std::string avrodir,
+                             uint64_t block_size,
+                             mxs_avro_codec_type codec,
+                             int writer_threads)
+    : m_columns(0)
+    , m_avrodir(avrodir)
     , m_block_size(block_size)
     , m_codec(codec)
+    , m_pending(writer_threads)
+    , m_writer(0)
+{
+    for (int i = 0; i < writer_threads; i++)
+    {
+        m_writers.emplace_back(new AvroWriter);
+    }
+}
+
+AvroConverter::~AvroConverter()
 {
+    sync();
+    m_writers.clear();
 }
 
 bool AvroConverter::open_table(const STableMapEvent& map, const STableCreateEvent& create)
@@ -326,6 +569,9 @@ bool AvroConverter::open_table(const STableMapEvent& map, const STableCreateEven
                  map->table.c_str(),
                  map->version);
 
+        // The file might already be open, make sure the writers are done with it
+        sync();
+
         SAvroTable avro_table(avro_table_alloc(filepath,
                                                json_schema,
                                                codec_to_string(m_codec),
@@ -333,6 +579,13 @@ bool AvroConverter::open_table(const STableMapEvent& map, const STableCreateEven
 
         if (avro_table)
         {
+            // The writers use a copy of the column names of the schema: the
+            // table definition is modified by DDL while older rows are written
+            for (uint64_t i = 0; i < map->columns() && i < create->columns.size(); i++)
+            {
+                avro_table->columns.push_back(create->columns[i].name);
+            }
+
             m_open_tables[map->database + "." + map->table] = avro_table;
             save_avro_schema(m_avrodir.c_str(), json_schema, map, create);
             m_map = map;
@@ -356,58 +609,93 @@ bool AvroConverter::open_table(const STableMapEvent& map, const STableCreateEven
 bool AvroConverter::prepare_table(const STableMapEvent& map, const STableCreateEvent& create)
 {
     bool rval = false;
-    auto it = m_open_tables.find(map->database + "." + map->table);
+    std::string ident = map->database + "." + map->table;
+    auto it = m_open_tables.find(ident);
 
     if (it != m_open_tables.end())
     {
-        m_writer_iface = it->second->avro_writer_iface;
-        m_avro_file = &it->second->avro_file;
+        m_table = it->second;
         m_map = map;
         m_create = create;
+
+        if (!m_writers.empty())
+        {
+            m_writer = std::hash<std::string>()(ident) % m_writers.size();
+        }
+
         rval = true;
     }
 
     return rval;
 }
 
-void AvroConverter::flush_tables()
+bool AvroConverter::flush_tables()
 {
-    for (auto it = m_open_tables.begin(); it != m_open_tables.end(); it++)
+    bool rval = true;
+
+    if (m_writers.empty())
     {
-        avro_file_writer_flush(it->second->avro_file);
+        for (auto it = m_open_tables.begin(); it != m_open_tables.end(); it++)
+        {
+            rval = it->second->flush() && rval;
+        }
     }
-}
-
-void AvroConverter::prepare_row(const gtid_pos_t& gtid, const REP_HEADER& hdr, int event_type)
-{
-    avro_generic_value_new(m_writer_iface, &m_record);
-    avro_value_get_by_name(&m_record, avro_domain, &m_field, NULL);
-    avro_value_set_int(&m_field, gtid.domain);
-
-    avro_value_get_by_name(&m_record, avro_server_id, &m_field, NULL);
-    avro_value_set_int(&m_field, gtid.server_id);
+    else
+    {
+        // Each table is flushed by its own writer after its pending rows are written
+        for (size_t i = 0; i < m_writers.size(); i++)
+        {
+            submit(i);
+        }
 
-    avro_value_get_by_name(&m_record, avro_sequence, &m_field, NULL);
-    avro_value_set_int(&m_field, gtid.seq);
+        for (auto it = m_open_tables.begin(); it != m_open_tables.end(); it++)
+        {
+            m_writers[std::hash<std::string>()(it->first) % m_writers.size()]->flush(it->second);
+        }
 
-    avro_value_get_by_name(&m_record, avro_event_number, &m_field, NULL);
-    avro_value_set_int(&m_field, gtid.event_num);
+        // The caller stores the conversion state after this so everything
+        // up to this point must be on disk
+        sync();
+        rval = writers_ok();
+    }
 
-    avro_value_get_by_name(&m_record, avro_timestamp, &m_field, NULL);
-    avro_value_set_int(&m_field, hdr.timestamp);
+    return rval;
+}
 
-    avro_value_get_by_name(&m_record, avro_event_type, &m_field, NULL);
-    avro_value_set_enum(&m_field, event_type);
+void AvroConverter::prepare_row(const gtid_pos_t& gtid, const REP_HEADER& hdr, int event_type)
+{
+    m_row.table = m_table;
+    m_row.flush = false;
+    m_row.gtid = gtid;
+    m_row.timestamp = hdr.timestamp;
+    m_row.event_type = event_type;
+    m_row.columns.reserve(m_create->columns.size());
+    m_columns = 0;
 }
 
 bool AvroConverter::commit(const gtid_pos_t& gtid)
 {
     bool rval = true;
+    m_row.columns.resize(m_columns);
 
-    if (avro_file_writer_append_value(*m_avro_file, &m_record))
+    if (m_writers.empty())
     {
-        MXS_ERROR("Failed to write value: %s", avro_strerror());
-        rval = false;
+        rval = AvroWriter::write_row(m_row);
+    }
+    else
+    {
+        AvroRows& pending = m_pending[m_writer];
+        pending.push_back(std::move(m_row));
+        m_row = AvroRow();
+
+        if (pending.size() >= WRITER_BATCH_SIZE)
+        {
+            submit(m_writer);
+        }
+
+        // The rows are written asynchronously, a failure is seen with the rows
+        // committed after it. The conversion stops at the first one either way.
+        rval = writers_ok();
     }
 
     return rval;
@@ -415,53 +703,135 @@ bool AvroConverter::commit(const gtid_pos_t& gtid)
 
 void AvroConverter::column(int i, int32_t value)
 {
-    set_active(i);
-    avro_value_set_int(&m_field, value);
+    add_column(i, AvroColumn::INT).integer = value;
 }
 
 void AvroConverter::column(int i, int64_t value)
 {
-    set_active(i);
-    avro_value_set_long(&m_field, value);
+    add_column(i, AvroColumn::LONG).integer = value;
 }
 
 void AvroConverter::column(int i, float value)
 {
-    set_active(i);
-    avro_value_set_float(&m_field, value);
+    add_column(i, AvroColumn::FLOAT).real = value;
 }
 
 void AvroConverter::column(int i, double value)
 {
-    set_active(i);
-    avro_value_set_double(&m_field, value);
+    add_column(i, AvroColumn::DOUBLE).real = value;
 }
 
 void AvroConverter::column(int i, std::string value)
 {
-    set_active(i);
-    avro_value_set_string(&m_field, value.c_str());
+    add_column(i, AvroColumn::STRING).str = std::move(value);
 }
 
 void AvroConverter::column(int i, uint8_t* value, int len)
 {
-    set_active(i);
-    avro_value_set_bytes(&m_field, value, len);
+    add_column(i, AvroColumn::BYTES).str.assign((char*)value, len);
 }
 
 void AvroConverter::column(int i)
 {
-    set_active(i);
-    avro_value_set_branch(&m_union_value, 0, &m_field);
-    avro_value_set_null(&m_field);
+    add_column(i, AvroColumn::NUL);
+}
+
+void AvroConverter::column(int i, const char* value, size_t len)
+{
+    add_column(i, AvroColumn::STRING).str.assign(value, len);
+}
+
+void AvroConverter::column(int i, const TemporalValue& value)
+{
+    add_column(i, AvroColumn::TEMPORAL).temporal = value;
 }
 
-void AvroConverter::set_active(int i)
+void AvroConverter::row(const ColumnValues& values)
 {
-    MXB_AT_DEBUG(int rc = ) avro_value_get_by_name(&m_record,
-                                                   m_create->columns[i].name.c_str(),
-                                                   &m_union_value,
-                                                   NULL);
-    mxb_assert(rc == 0);
-    avro_value_set_branch(&m_union_value, 1, &m_field);
+    for (const auto& value : values)
+    {
+        switch (value.type)
+        {
+        case ColumnValue::NUL:
+            add_column(value.index, AvroColumn::NUL);
+            break;
+
+        case ColumnValue::INT:
+            add_column(value.index, AvroColumn::INT).integer = value.integer;
+            break;
+
+        case ColumnValue::LONG:
+            add_column(value.index, AvroColumn::LONG).integer = value.integer;
+            break;
+
+        case ColumnValue::FLOAT:
+            add_column(value.index, AvroColumn::FLOAT).real = value.real;
+            break;
+
+        case ColumnValue::DOUBLE:
+            add_column(value.index, AvroColumn::DOUBLE).real = value.real;
+            break;
+
+        case ColumnValue::STRING:
+            add_column(value.index, AvroColumn::STRING).str.assign(value.data, value.size);
+            break;
+
+        case ColumnValue::BYTES:
+            add_column(value.index, AvroColumn::BYTES).str.assign(value.data, value.size);
+            break;
+
+        case ColumnValue::TEMPORAL:
+            add_column(value.index, AvroColumn::TEMPORAL).temporal = value.temporal;
+            break;
+        }
+    }
+}
+
+AvroColumn& AvroConverter::add_column(int i, AvroColumn::Type type)
+{
+    if (m_columns == m_row.columns.size())
+    {
+        m_row.columns.emplace_back();
+    }
+
+    // The columns of the previous row are reused which means the strings
+    // keep their buffers when the rows are written inline
+    AvroColumn& col = m_row.columns[m_columns++];
+    col.index = i;
+    col.type = type;
+    return col;
+}
+
+void AvroConverter::submit(size_t writer)
+{
+    if (!m_pending[writer].empty())
+    {
+        m_writers[writer]->enqueue(m_pending[writer]);
+    }
+}
+
+void AvroConverter::sync()
+{
+    for (size_t i = 0; i < m_writers.size(); i++)
+    {
+        submit(i);
+    }
+
+    for (auto& writer : m_writers)
+    {
+        writer->sync();
+    }
+}
+
+bool AvroConverter::writers_ok() const
+{
+    for (const auto& writer : m_writers)
+    {
+        if (writer->failed())
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
@@ -15,42 +15,172 @@
 #include "avrorouter.hh"
 #include "rpl.hh"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
 #include <avro.h>
 
 struct AvroTable
 {
-    AvroTable(avro_file_writer_t file, avro_value_iface_t* iface, avro_schema_t schema)
+    AvroTable(avro_file_writer_t file, avro_value_iface_t* iface, avro_schema_t schema,
+              const std::string& filename)
         : avro_file(file)
         , avro_writer_iface(iface)
         , avro_schema(schema)
+        , filename(filename)
+        , flushed_pos(0)
+        , unindexed(false)
     {
+        struct stat st;
+
+        if (stat(filename.c_str(), &st) == 0)
+        {
+            flushed_pos = st.st_size;
+        }
     }
 
     ~AvroTable()
     {
-        avro_file_writer_flush(avro_file);
+        flush();
         avro_file_writer_close(avro_file);
         avro_value_iface_decref(avro_writer_iface);
         avro_schema_decref(avro_schema);
     }
 
-    avro_file_writer_t  avro_file;          /*< Current Avro data file */
-    avro_value_iface_t* avro_writer_iface;  /*< Avro C API writer interface */
-    avro_schema_t       avro_schema;        /*< Native Avro schema of the table */
+    /**
+     * Flush the file and add the rows written since the last flush to the GTID index
+     *
+     * @return True if the file was flushed
+     */
+    bool flush();
+
+    /**
+     * Called after a row is appended to the file
+     *
+     * @param gtid GTID of the row
+     */
+    void row_written(const gtid_pos_t& gtid)
+    {
+        if (!unindexed)
+        {
+            first_gtid = gtid;
+            unindexed = true;
+        }
+    }
+
+    avro_file_writer_t       avro_file;         /*< Current Avro data file */
+    avro_value_iface_t*      avro_writer_iface; /*< Avro C API writer interface */
+    avro_schema_t            avro_schema;       /*< Native Avro schema of the table */
+    std::string              filename;          /*< Path to the Avro file */
+    long                     flushed_pos;       /*< File size after the last flush */
+    gtid_pos_t               first_gtid;        /*< First GTID written after the last flush */
+    bool                     unindexed;         /*< Whether rows were written after the last flush */
+    std::vector<std::string> columns;           /*< Column names of the schema, never modified
+                                                 *  after the file is opened */
 };
 
 typedef std::shared_ptr<AvroTable>                  SAvroTable;
 typedef std::unordered_map<std::string, SAvroTable> AvroTables;
 
+// A decoded column value waiting to be encoded into an Avro record
+struct AvroColumn
+{
+    enum Type
+    {
+        NUL,
+        INT,
+        LONG,
+        FLOAT,
+        DOUBLE,
+        STRING,
+        BYTES,
+        TEMPORAL
+    };
+
+    int           index;    /*< Column index in the table */
+    Type          type;
+    int64_t       integer;  /*< INT and LONG values */
+    double        real;     /*< FLOAT and DOUBLE values */
+    std::string   str;      /*< STRING and BYTES values */
+    TemporalValue temporal; /*< TEMPORAL values, formatted by the writer */
+};
+
+// A decoded row, encoded and appended to the Avro file of its table by a writer.
+// The row must not refer to the table definition: DDL events modify it while
+// the writers are still writing older rows.
+struct AvroRow
+{
+    SAvroTable              table;      /*< Table the row is written into */
+    bool                    flush;      /*< Not a row but a request to flush the table */
+    gtid_pos_t              gtid;       /*< GTID of the row */
+    uint32_t                timestamp;  /*< Timestamp of the row event */
+    int                     event_type; /*< Type of the row event */
+    std::vector<AvroColumn> columns;    /*< Column values in table order */
+};
+
+typedef std::vector<AvroRow> AvroRows;
+
+/**
+ * A writer thread that encodes rows and appends them to Avro files
+ *
+ * Each table is always assigned to the same writer which means the rows of a
+ * table are written in the order they were decoded.
+ */
+class AvroWriter
+{
+public:
+    AvroWriter();
+    ~AvroWriter();
+
+    // Queue a batch of rows for writing, the batch is emptied
+    void enqueue(AvroRows& rows);
+
+    // Wait until all queued rows have been written
+    void sync();
+
+    // Flush a table once all rows queued before it have been written
+    void flush(const SAvroTable& table);
+
+    // Whether writing a row or flushing a table has failed
+    bool failed() const
+    {
+        return m_failed.load(std::memory_order_acquire);
+    }
+
+    // Encode and append one row to its table
+    static bool write_row(const AvroRow& row);
+
+private:
+    std::mutex              m_lock;
+    std::condition_variable m_cond;     /*< Signaled when work is queued */
+    std::condition_variable m_idle;     /*< Signaled when the queue is drained */
+    std::deque<AvroRows>    m_queue;
+    bool                    m_busy;
+    bool                    m_running;
+    std::atomic<bool>       m_failed;   /*< Set once a write fails, the rows after it are lost */
+    std::thread             m_thread;
+
+    void run();
+};
+
+typedef std::unique_ptr<AvroWriter> SAvroWriter;
+
 // Converts replicated events into CDC events
 class AvroConverter : public RowEventHandler
 {
 public:
 
-    AvroConverter(std::string avrodir, uint64_t block_size, mxs_avro_codec_type codec);
+    AvroConverter(std::string avrodir, uint64_t block_size, mxs_avro_codec_type codec,
+                  int writer_threads = 0);
+    ~AvroConverter();
     bool open_table(const STableMapEvent& map, const STableCreateEvent& create);
     bool prepare_table(const STableMapEvent& map, const STableCreateEvent& create);
-    void flush_tables();
+    bool flush_tables();
     void prepare_row(const gtid_pos_t& gtid, const REP_HEADER& hdr, int event_type);
     bool commit(const gtid_pos_t& gtid);
     void column(int i, int32_t value);
@@ -60,19 +190,26 @@ public:
     void column(int i, std::string value);
     void column(int i, uint8_t* value, int len);
     void column(int i);
+    void column(int i, const char* value, size_t len);
+    void column(int i, const TemporalValue& value);
+    void row(const ColumnValues& values);
 
 private:
-    avro_value_iface_t* m_writer_iface;
-    avro_file_writer_t* m_avro_file;
-    avro_value_t        m_record;
-    avro_value_t        m_union_value;
-    avro_value_t        m_field;
-    std::string         m_avrodir;
-    AvroTables          m_open_tables;
-    uint64_t            m_block_size;
-    mxs_avro_codec_type m_codec;
-    STableMapEvent      m_map;
-    STableCreateEvent   m_create;
-
-    void set_active(int i);
+    SAvroTable               m_table;   /*< The table of the current row */
+    AvroRow                  m_row;     /*< The row being decoded */
+    size_t                   m_columns; /*< Number of columns in the row being decoded */
+    std::string              m_avrodir;
+    AvroTables               m_open_tables;
+    uint64_t                 m_block_size;
+    mxs_avro_codec_type      m_codec;
+    STableMapEvent           m_map;
+    STableCreateEvent        m_create;
+    std::vector<SAvroWriter> m_writers;     /*< Writer threads, empty if rows are written inline */
+    std::vector<AvroRows>    m_pending;     /*< Rows batched for each writer */
+    size_t                   m_writer;      /*< The writer of the current table */
+
+    AvroColumn& add_column(int i, AvroColumn::Type type);
+    void        submit(size_t writer);
+    void        sync();
+    bool        writers_ok() const;
 };
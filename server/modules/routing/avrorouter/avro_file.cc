@@ -388,12 +388,18 @@ void notify_all_clients(SERVICE* service)
     dcb_foreach(notify_cb, service);
 }
 
-void do_checkpoint(Avro* router)
+bool do_checkpoint(Avro* router)
 {
-    router->handler.flush();
+    // The position is only stored if everything before it is on disk
+    if (!router->handler.flush())
+    {
+        return false;
+    }
+
     avro_save_conversion_state(router);
     notify_all_clients(router->service);
     router->row_count = router->trx_count = 0;
+    return true;
 }
 
 bool read_header(Avro* router, unsigned long long pos, REP_HEADER* hdr, avro_binlog_end_t* rc)
@@ -551,7 +557,10 @@ avro_binlog_end_t avro_read_all_events(Avro* router)
         {
             if (rc == AVRO_OK)
             {
-                do_checkpoint(router);
+                if (!do_checkpoint(router))
+                {
+                    return AVRO_CONVERSION_ERROR;
+                }
 
                 if (rotate_seen)
                 {
@@ -575,6 +584,7 @@ avro_binlog_end_t avro_read_all_events(Avro* router)
 
         /* get event content */
         uint8_t* ptr = GWBUF_DATA(result);
+        bool converted = true;
 
         // These events are only related to binary log files
         if (hdr.event_type == ROTATE_EVENT)
@@ -606,15 +616,20 @@ avro_binlog_end_t avro_read_all_events(Avro* router)
                 router->trx_count++;
             }
 
-            router->handler.handle_event(hdr, ptr);
+            converted = router->handler.handle_event(hdr, ptr);
         }
 
         gwbuf_free(result);
 
-        if (router->row_count >= router->row_target
-            || router->trx_count >= router->trx_target)
+        if (!converted)
+        {
+            return AVRO_CONVERSION_ERROR;
+        }
+        else if ((router->row_count >= router->row_target
+                  || router->trx_count >= router->trx_target)
+                 && !do_checkpoint(router))
         {
-            do_checkpoint(router);
+            return AVRO_CONVERSION_ERROR;
         }
 
         if (pos_is_ok(router, hdr, pos))
@@ -703,3 +718,156 @@ void avro_load_metadata_from_schemas(Avro* router)
 
     globfree(&files);
 }
+
+namespace
+{
+/** One entry in a GTID index file, stored in host byte order */
+struct AvroIndexEntry
+{
+    uint64_t server_id;
+    uint64_t seq;
+    uint64_t offset;    /*< File offset of the data block where the GTID starts */
+};
+
+/**
+ * Each replication domain has its own index file. The sequence numbers of a
+ * domain only grow, so the entries of an index file are sorted.
+ */
+std::string index_filename(const std::string& avrofile, uint64_t domain)
+{
+    return avrofile + '.' + std::to_string(domain) + AVRO_INDEX_SUFFIX;
+}
+}
+
+/**
+ * Add an entry to the GTID index of an Avro file
+ *
+ * The index is sparse: an entry is added each time the Avro file is flushed
+ * and it points to the first data block written after the previous flush.
+ *
+ * @param avrofile Path to the Avro file
+ * @param gtid     GTID of the first row written at @c offset
+ * @param offset   File offset of the data block
+ *
+ * @return True if the entry was added
+ */
+bool avro_index_add(const std::string& avrofile, const gtid_pos_t& gtid, long offset)
+{
+    bool rval = false;
+    std::string filename = index_filename(avrofile, gtid.domain);
+    int fd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+
+    if (fd != -1)
+    {
+        AvroIndexEntry entry = {gtid.server_id, gtid.seq, (uint64_t)offset};
+
+        if (write(fd, &entry, sizeof(entry)) == sizeof(entry))
+        {
+            rval = true;
+        }
+        else
+        {
+            MXS_ERROR("Failed to write to GTID index '%s': %d, %s",
+                      filename.c_str(), errno, mxs_strerror(errno));
+        }
+
+        close(fd);
+    }
+    else
+    {
+        MXS_ERROR("Failed to open GTID index '%s': %d, %s",
+                  filename.c_str(), errno, mxs_strerror(errno));
+    }
+
+    return rval;
+}
+
+/**
+ * Find the data block from which to start looking for a GTID
+ *
+ * The index file of the GTID's domain is sorted, so the last entry before the
+ * GTID is found with a binary search that only reads the entries it compares.
+ *
+ * @param avrofile Path to the Avro file
+ * @param gtid     The GTID to look for
+ *
+ * @return File offset of the data block or 0 if the file must be read from
+ *         the start
+ */
+long avro_index_find(const std::string& avrofile, const gtid_pos_t& gtid)
+{
+    long rval = 0;
+    std::string filename = index_filename(avrofile, gtid.domain);
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+
+    if (fd != -1 && fstat(fd, &st) == 0)
+    {
+        // A partially written entry at the end is ignored
+        uint64_t lo = 0;
+        uint64_t hi = st.st_size / sizeof(AvroIndexEntry);
+        AvroIndexEntry entry;
+        bool ok = true;
+
+        // Find the first entry that is not before the GTID
+        while (lo < hi && ok)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+
+            if (pread(fd, &entry, sizeof(entry), mid * sizeof(entry)) != sizeof(entry))
+            {
+                ok = false;
+            }
+            else if (entry.seq < gtid.seq)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        if (ok && lo > 0)
+        {
+            ok = pread(fd, &entry, sizeof(entry), (lo - 1) * sizeof(entry)) == sizeof(entry);
+            rval = ok ? entry.offset : 0;
+        }
+
+        if (!ok)
+        {
+            MXS_ERROR("Failed to read GTID index '%s': %d, %s",
+                      filename.c_str(), errno, mxs_strerror(errno));
+        }
+    }
+    else if (errno != ENOENT)
+    {
+        MXS_ERROR("Failed to open GTID index '%s': %d, %s",
+                  filename.c_str(), errno, mxs_strerror(errno));
+    }
+
+    if (fd != -1)
+    {
+        close(fd);
+    }
+
+    return rval;
+}
+
+/**
+ * Move to the data block from which to start looking for a GTID
+ *
+ * The file is only moved forwards, a file that is already past the block
+ * found from the GTID index is left where it is.
+ *
+ * @param file     The Avro file
+ * @param avrofile Path to the Avro file
+ * @param gtid     The GTID to look for
+ *
+ * @return True if the file was moved
+ */
+bool avro_index_seek(MAXAVRO_FILE* file, const std::string& avrofile, const gtid_pos_t& gtid)
+{
+    long pos = avro_index_find(avrofile, gtid);
+    return pos > file->block_start_pos && maxavro_record_set_pos(file, pos);
+}
@@ -66,7 +66,8 @@ MXS_ROUTER* createInstance(SERVICE* service, MXS_CONFIG_PARAMETER* params)
                                                                                  "codec",
                                                                                  codec_values));
     std::string avrodir = config_get_string(service->svc_config_param, "avrodir");
-    SRowEventHandler handler(new AvroConverter(avrodir, block_size, codec));
+    int writer_threads = config_get_integer(service->svc_config_param, "writer_threads");
+    SRowEventHandler handler(new AvroConverter(avrodir, block_size, codec, writer_threads));
 
     Avro* router = Avro::create(service, handler);
 
@@ -287,11 +288,29 @@ bool converter_func(Worker::Call::action_t action, Avro* router)
     static int logged = true;
 
     /** We reached end of file, flush unwritten records to disk */
-    if (progress)
+    if (progress && binlog_end != AVRO_CONVERSION_ERROR)
     {
-        router->handler.flush();
-        avro_save_conversion_state(router);
-        logged = false;
+        if (router->handler.flush())
+        {
+            avro_save_conversion_state(router);
+            logged = false;
+        }
+        else
+        {
+            binlog_end = AVRO_CONVERSION_ERROR;
+        }
+    }
+
+    if (binlog_end == AVRO_CONVERSION_ERROR)
+    {
+        // The rows are not written past the error, the conversion state is
+        // left at the last position that was completely written
+        MXS_ERROR("Stopping the conversion of binlog '%s' at position %lu, "
+                  "the rows could not be written to the Avro files.",
+                  router->binlog_name.c_str(),
+                  router->current_pos);
+        router->task_handle = 0;
+        return false;
     }
 
     if (binlog_end == AVRO_LAST_FILE && !logged)
@@ -433,10 +452,16 @@ static bool avro_handle_purge(const MODULECMD_ARG* args, json_t** output)
     // First stop the conversion service
     conversion_task_ctl(inst, false);
 
+    // Stop writing the client offsets, they refer to the files that are deleted
+    inst->offsets.clear();
+
     // Then delete the files
     return do_unlink("%s/%s", inst->avrodir.c_str(), AVRO_PROGRESS_FILE)    // State file
            && do_unlink_with_pattern("/%s/*.avro", inst->avrodir.c_str())   // .avro files
-           && do_unlink_with_pattern("/%s/*.avsc", inst->avrodir.c_str());  // .avsc files
+           && do_unlink_with_pattern("/%s/*.avsc", inst->avrodir.c_str())   // .avsc files
+           && do_unlink_with_pattern("/%s/*.avro.*" AVRO_INDEX_SUFFIX,
+                                     inst->avrodir.c_str())                 // GTID indexes
+           && do_unlink_with_pattern("/%s/*.offsets", inst->avrodir.c_str());  // Client offsets
 }
 
 /**
@@ -542,6 +567,8 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
             {"codec",                             MXS_MODULE_PARAM_ENUM,  "null",
              MXS_MODULE_OPT_ENUM_UNIQUE,
              codec_values},
+            {"writer_threads",                    MXS_MODULE_PARAM_COUNT,
+             "0"},
             {"match",
              MXS_MODULE_PARAM_REGEX},
             {"exclude",
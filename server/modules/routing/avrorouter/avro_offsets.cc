@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "avrorouter.hh"
+
+#include <ctype.h>
+#include <errno.h>
+#include <ini.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <maxscale/log.h>
+
+static const char offsets_section[] = "offsets";
+
+static int offsets_handler(void* data, const char* section, const char* key, const char* value)
+{
+    auto offsets = static_cast<std::unordered_map<std::string, gtid_pos_t>*>(data);
+
+    if (strcmp(section, offsets_section) == 0)
+    {
+        gtid_pos_t gtid;
+
+        if (!gtid.parse(value))
+        {
+            MXS_ERROR("Invalid offset for table '%s': %s", key, value);
+            return 0;
+        }
+
+        (*offsets)[key] = gtid;
+    }
+
+    return 1;
+}
+
+/**
+ * Check that a client UUID can be used as a part of a file name
+ */
+static bool valid_uuid(const std::string& uuid)
+{
+    for (char c : uuid)
+    {
+        if (!isalnum(c) && c != '-' && c != '_')
+        {
+            return false;
+        }
+    }
+
+    return !uuid.empty();
+}
+
+CdcOffsets::CdcOffsets(const std::string& dir)
+    : m_dir(dir)
+    , m_busy(false)
+    , m_running(true)
+    , m_thread(&CdcOffsets::run, this)
+{
+}
+
+CdcOffsets::~CdcOffsets()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_running = false;
+    }
+
+    // The thread writes the offsets that are still waiting before it stops
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+std::string CdcOffsets::filename(const std::string& uuid) const
+{
+    return m_dir + '/' + uuid + ".offsets";
+}
+
+CdcOffsets::Offsets& CdcOffsets::load(const std::string& uuid)
+{
+    auto it = m_offsets.find(uuid);
+
+    if (it == m_offsets.end())
+    {
+        Offsets& offsets = m_offsets[uuid];
+        std::string file = filename(uuid);
+
+        if (access(file.c_str(), F_OK) == 0 && ini_parse(file.c_str(), offsets_handler, &offsets) != 0)
+        {
+            MXS_ERROR("Failed to load the offsets of client '%s' from '%s'.", uuid.c_str(), file.c_str());
+        }
+
+        return offsets;
+    }
+
+    return it->second;
+}
+
+bool CdcOffsets::save(const std::string& uuid, const Offsets& offsets)
+{
+    std::string file = filename(uuid);
+    std::string tmp = file + ".tmp";
+    FILE* config_file = fopen(tmp.c_str(), "wb");
+
+    if (config_file == NULL)
+    {
+        MXS_ERROR("Failed to open file '%s': %d, %s", tmp.c_str(), errno, mxs_strerror(errno));
+        return false;
+    }
+
+    fprintf(config_file, "[%s]\n", offsets_section);
+
+    for (const auto& a : offsets)
+    {
+        fprintf(config_file, "%s=%s\n", a.first.c_str(), a.second.to_string().c_str());
+    }
+
+    // The offset must survive a crash once the client has been told it was committed
+    bool ok = fflush(config_file) == 0 && fsync(fileno(config_file)) == 0;
+
+    if (fclose(config_file) != 0 || !ok)
+    {
+        MXS_ERROR("Failed to write file '%s': %d, %s", tmp.c_str(), errno, mxs_strerror(errno));
+        return false;
+    }
+
+    if (rename(tmp.c_str(), file.c_str()) == -1)
+    {
+        MXS_ERROR("Failed to rename file '%s' to '%s': %d, %s",
+                  tmp.c_str(),
+                  file.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool CdcOffsets::commit(const std::string& uuid, const std::string& table, const gtid_pos_t& gtid,
+                        Callback callback)
+{
+    if (!valid_uuid(uuid))
+    {
+        MXS_ERROR("Client UUID '%s' can't be used to store offsets, only alphanumeric "
+                  "characters, hyphens and underscores are allowed.", uuid.c_str());
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        Pending& pending = m_pending[uuid];
+        pending.offsets[table] = gtid;
+        pending.callbacks.push_back(std::move(callback));
+    }
+
+    m_cond.notify_one();
+    return true;
+}
+
+bool CdcOffsets::get(const std::string& uuid, const std::string& table, gtid_pos_t* gtid)
+{
+    if (!valid_uuid(uuid))
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_lock);
+    Offsets& offsets = load(uuid);
+    auto it = offsets.find(table);
+
+    if (it != offsets.end())
+    {
+        *gtid = it->second;
+        return true;
+    }
+
+    return false;
+}
+
+void CdcOffsets::clear()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_idle.wait(guard, [this]() {
+                    return !m_busy;
+                });
+
+    std::unordered_map<std::string, Pending> pending;
+    pending.swap(m_pending);
+    m_offsets.clear();
+    guard.unlock();
+
+    for (auto& a : pending)
+    {
+        for (auto& callback : a.second.callbacks)
+        {
+            callback(false);
+        }
+    }
+}
+
+void CdcOffsets::run()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+
+    while (true)
+    {
+        m_cond.wait(guard, [this]() {
+                        return !m_pending.empty() || !m_running;
+                    });
+
+        if (m_pending.empty())
+        {
+            break;
+        }
+
+        // Everything committed since the previous round is written with one file per client
+        std::unordered_map<std::string, Pending> pending;
+        pending.swap(m_pending);
+        m_busy = true;
+
+        for (auto& a : pending)
+        {
+            Offsets updated = load(a.first);
+
+            for (const auto& offset : a.second.offsets)
+            {
+                updated[offset.first] = offset.second;
+            }
+
+            a.second.offsets.swap(updated);
+        }
+
+        guard.unlock();
+
+        std::vector<std::pair<Callback, bool>> results;
+
+        for (auto& a : pending)
+        {
+            bool ok = save(a.first, a.second.offsets);
+
+            for (auto& callback : a.second.callbacks)
+            {
+                results.emplace_back(std::move(callback), ok);
+            }
+
+            a.second.callbacks.clear();
+
+            if (!ok)
+            {
+                a.second.offsets.clear();
+            }
+        }
+
+        guard.lock();
+
+        for (auto& a : pending)
+        {
+            if (!a.second.offsets.empty())
+            {
+                m_offsets[a.first].swap(a.second.offsets);
+            }
+        }
+
+        m_busy = false;
+        m_idle.notify_all();
+        guard.unlock();
+
+        for (auto& result : results)
+        {
+            result.first(result.second);
+        }
+
+        guard.lock();
+    }
+}
@@ -28,7 +28,7 @@
 static bool warn_decimal = false;       /**< Remove when support for DECIMAL is added */
 static bool warn_bit = false;           /**< Remove when support for BIT is added */
 static bool warn_large_enumset = false; /**< Remove when support for ENUM/SET values
-                                         * larger than 255 is added */
+                                         * larger than 8 bytes is added */
 
 /**
  * @brief Get row event name
@@ -66,78 +66,84 @@ static int get_event_type(uint8_t event)
  *
  * Convert the raw binary data into actual numeric types.
  *
- * @param conv     Event converter to use
- * @param idx      Position of this column in the row
- * @param type     Event type
+ * @param value    Where the value is stored
+ * @param type     Column type
  * @param metadata Field metadata
- * @param value    Pointer to the start of the in-memory representation of the data
+ * @param data     Pointer to the start of the in-memory representation of the data
  */
-void set_numeric_field_value(SRowEventHandler& conv,
-                             int idx,
-                             uint8_t type,
-                             uint8_t* metadata,
-                             uint8_t* value)
+static void set_numeric_field_value(ColumnValue& value,
+                                    uint8_t type,
+                                    uint8_t* metadata,
+                                    uint8_t* data)
 {
     switch (type)
     {
     case TABLE_COL_TYPE_TINY:
         {
-            char c = *value;
-            conv->column(idx, c);
+            char c = *data;
+            value.type = ColumnValue::INT;
+            value.integer = c;
             break;
         }
 
     case TABLE_COL_TYPE_SHORT:
         {
-            short s = gw_mysql_get_byte2(value);
-            conv->column(idx, s);
+            short s = gw_mysql_get_byte2(data);
+            value.type = ColumnValue::INT;
+            value.integer = s;
             break;
         }
 
     case TABLE_COL_TYPE_INT24:
         {
-            int x = gw_mysql_get_byte3(value);
+            int x = gw_mysql_get_byte3(data);
 
             if (x & 0x800000)
             {
                 x = -((0xffffff & (~x)) + 1);
             }
 
-            conv->column(idx, x);
+            value.type = ColumnValue::INT;
+            value.integer = x;
             break;
         }
 
     case TABLE_COL_TYPE_LONG:
         {
-            int x = gw_mysql_get_byte4(value);
-            conv->column(idx, x);
+            int x = gw_mysql_get_byte4(data);
+            value.type = ColumnValue::INT;
+            value.integer = x;
             break;
         }
 
     case TABLE_COL_TYPE_LONGLONG:
         {
-            long l = gw_mysql_get_byte8(value);
-            conv->column(idx, l);
+            long l = gw_mysql_get_byte8(data);
+            value.type = ColumnValue::LONG;
+            value.integer = l;
             break;
         }
 
     case TABLE_COL_TYPE_FLOAT:
         {
             float f = 0;
-            memcpy(&f, value, 4);
-            conv->column(idx, f);
+            memcpy(&f, data, 4);
+            value.type = ColumnValue::FLOAT;
+            value.real = f;
             break;
         }
 
     case TABLE_COL_TYPE_DOUBLE:
         {
             double d = 0;
-            memcpy(&d, value, 8);
-            conv->column(idx, d);
+            memcpy(&d, data, 8);
+            value.type = ColumnValue::DOUBLE;
+            value.real = d;
             break;
         }
 
     default:
+        value.type = ColumnValue::NUL;
         break;
     }
 }
@@ -194,16 +200,65 @@ int get_metadata_len(uint8_t type)
     }
 }
 
-// Make sure that both `i` and `trace` are defined before using this macro
+/**
+ * @brief Describe a decoded column for the trace log
+ *
+ * @param dest  Destination buffer
+ * @param size  Size of the destination buffer
+ * @param type  Column type
+ * @param value The decoded value
+ */
+static void trace_column(char* dest, size_t size, uint8_t type, const ColumnValue& value)
+{
+    switch (value.type)
+    {
+    case ColumnValue::NUL:
+        snprintf(dest, size, "[%d] NULL", value.index);
+        break;
+
+    case ColumnValue::STRING:
+    case ColumnValue::BYTES:
+        snprintf(dest, size, "[%d] %s: %lu bytes", value.index, column_type_to_string(type), value.size);
+        break;
+
+    case ColumnValue::TEMPORAL:
+        {
+            char buf[TEMPORAL_VALUE_MAXLEN];
+            value.temporal.format(buf);
+            snprintf(dest, size, "[%d] %s: %s", value.index, column_type_to_string(type), buf);
+        }
+        break;
+
+    default:
+        snprintf(dest, size, "[%d] %s", value.index, column_type_to_string(type));
+        break;
+    }
+}
+
+/**
+ * @brief Log the columns decoded before a row event overflow was detected
+ *
+ * @param map    Table map event of the row
+ * @param values Decoded values
+ * @param n      Number of decoded values
+ */
+static void log_decoded_columns(const STableMapEvent& map, const ColumnValues& values, size_t n)
+{
+    for (size_t x = 0; x < n; x++)
+    {
+        char trace[768];
+        trace_column(trace, sizeof(trace), map->column_types[values[x].index], values[x]);
+        MXS_ALERT("%s", trace);
+    }
+}
+
+// Make sure that both `values` and `n` are defined before using this macro
 #define check_overflow(t) \
     do \
     { \
         if (!(t)) \
         { \
-            for (long x = 0; x < i; x++) \
-            { \
-                MXS_ALERT("%s", trace[x]); \
-            } \
+            log_decoded_columns(map, values, n); \
             raise(SIGABRT); \
         } \
     } while (false)
@@ -225,29 +280,26 @@ static bool all_fields_null(uint8_t* null_bitmap, int ncolumns)
     return rval;
 }
 
-/**
- * @brief Extract the values from a single row  in a row event
- *
- * @param map Table map event associated with this row
- * @param create Table creation associated with this row
- * @param record Avro record used for storing this row
- * @param ptr Pointer to the start of the row data, should be after the row event header
- * @param columns_present The bitfield holding the columns that are present for
- * this row event. Currently this should be a bitfield which has all bits set.
- * @return Pointer to the first byte after the current row event
- */
-uint8_t* process_row_event_data(STableMapEvent map,
-                                STableCreateEvent create,
-                                SRowEventHandler& conv,
+/** Returned as the value of empty BLOBs */
+static uint8_t empty_blob = 0;
+
+uint8_t* process_row_event_data(const STableMapEvent& map,
+                                const STableCreateEvent& create,
                                 uint8_t* ptr,
                                 uint8_t* columns_present,
-                                uint8_t* end)
+                                uint8_t* end,
+                                ColumnValues& values)
 {
     mxb_assert(create->database == map->database && create->table == map->table);
-    int npresent = 0;
     long ncolumns = map->columns();
     uint8_t* metadata = &map->column_metadata[0];
     size_t metadata_offset = 0;
+    bool trace = mxs_log_is_priority_enabled(LOG_INFO);
+    size_t n = 0;
+
+    /** The values are stored in place, this also keeps the pointers to the
+     * hex encoded ENUM values valid until the whole row is decoded. */
+    values.resize(ncolumns);
 
     /** BIT type values use the extra bits in the row event header */
     int extra_bits = (((ncolumns + 7) / 8) * 8) - ncolumns;
@@ -258,177 +310,191 @@ uint8_t* process_row_event_data(STableMapEvent map,
     ptr += (ncolumns + 7) / 8;
     mxb_assert(ptr < end || (bit_is_set(null_bitmap, ncolumns, 0)));
 
-    char trace[ncolumns][768];
-    memset(trace, 0, sizeof(trace));
-
-    for (long i = 0; i < ncolumns && npresent < ncolumns; i++)
+    for (long i = 0; i < ncolumns && (long)n < ncolumns; i++)
     {
-        if (bit_is_set(columns_present, ncolumns, i))
-        {
-            npresent++;
+        uint8_t type = map->column_types[i];
 
-            if (bit_is_set(null_bitmap, ncolumns, i))
+        if (!bit_is_set(columns_present, ncolumns, i))
+        {
+            if (trace)
             {
-                sprintf(trace[i], "[%ld] NULL", i);
-                conv->column(i);
+                MXS_INFO("[%ld] %s: Not present", i, column_type_to_string(type));
             }
-            else if (column_is_fixed_string(map->column_types[i]))
+            continue;
+        }
+
+        ColumnValue& value = values[n];
+        value.index = i;
+
+        if (bit_is_set(null_bitmap, ncolumns, i))
+        {
+            value.type = ColumnValue::NUL;
+        }
+        else if (column_is_fixed_string(type))
+        {
+            /** ENUM and SET are stored as STRING types with the type stored
+             * in the metadata. */
+            if (fixed_string_is_enum(metadata[metadata_offset]))
             {
-                /** ENUM and SET are stored as STRING types with the type stored
-                 * in the metadata. */
-                if (fixed_string_is_enum(metadata[metadata_offset]))
+                uint8_t bytes = metadata[metadata_offset + 1];
+
+                if ((size_t)bytes * 2 < sizeof(value.hex))
                 {
-                    uint8_t val[metadata[metadata_offset + 1]];
-                    uint64_t bytes = unpack_enum(ptr, &metadata[metadata_offset], val);
-                    char strval[bytes * 2 + 1];
-                    gw_bin2hex(strval, val, bytes);
-                    conv->column(i, strval);
-                    sprintf(trace[i], "[%ld] ENUM: %lu bytes", i, bytes);
-                    ptr += bytes;
-                    check_overflow(ptr <= end);
+                    gw_bin2hex(value.hex, ptr, bytes);
+                    value.type = ColumnValue::STRING;
+                    value.data = value.hex;
+                    value.size = bytes * 2;
                 }
                 else
                 {
-                    /**
-                     * The first byte in the metadata stores the real type of
-                     * the string (ENUM and SET types are also stored as fixed
-                     * length strings).
-                     *
-                     * The first two bits of the second byte contain the XOR'ed
-                     * field length but as that information is not relevant for
-                     * us, we just use this information to know whether to read
-                     * one or two bytes for string length.
-                     */
-
-                    uint16_t meta = metadata[metadata_offset + 1] + (metadata[metadata_offset] << 8);
-                    int bytes = 0;
-                    uint16_t extra_length = (((meta >> 4) & 0x300) ^ 0x300);
-                    uint16_t field_length = (meta & 0xff) + extra_length;
-
-                    if (field_length > 255)
+                    if (!warn_large_enumset)
                     {
-                        bytes = ptr[0] + (ptr[1] << 8);
-                        ptr += 2;
+                        warn_large_enumset = true;
+                        MXS_WARNING("ENUM/SET values larger than 8 bytes are not supported, "
+                                    "values are stored as NULL.");
                     }
-                    else
-                    {
-                        bytes = *ptr++;
-                    }
-
-                    sprintf(trace[i], "[%ld] CHAR: field: %d bytes, data: %d bytes", i, field_length, bytes);
-                    char str[bytes + 1];
-                    memcpy(str, ptr, bytes);
-                    str[bytes] = '\0';
-                    conv->column(i, str);
-                    ptr += bytes;
-                    check_overflow(ptr <= end);
+                    value.type = ColumnValue::NUL;
                 }
-            }
-            else if (column_is_bit(map->column_types[i]))
-            {
-                uint8_t len = metadata[metadata_offset + 1];
-                uint8_t bit_len = metadata[metadata_offset] > 0 ? 1 : 0;
-                size_t bytes = len + bit_len;
 
-                // TODO: extract the bytes
-                if (!warn_bit)
-                {
-                    warn_bit = true;
-                    MXS_WARNING("BIT is not currently supported, values are stored as 0.");
-                }
-                conv->column(i, 0);
-                sprintf(trace[i], "[%ld] BIT", i);
                 ptr += bytes;
                 check_overflow(ptr <= end);
             }
-            else if (column_is_decimal(map->column_types[i]))
-            {
-                double f_value = 0.0;
-                ptr += unpack_decimal_field(ptr, metadata + metadata_offset, &f_value);
-                conv->column(i, f_value);
-                sprintf(trace[i], "[%ld] DECIMAL", i);
-                check_overflow(ptr <= end);
-            }
-            else if (column_is_variable_string(map->column_types[i]))
+            else
             {
-                size_t sz;
-                int bytes = metadata[metadata_offset] | metadata[metadata_offset + 1] << 8;
-                if (bytes > 255)
+                /**
+                 * The first byte in the metadata stores the real type of
+                 * the string (ENUM and SET types are also stored as fixed
+                 * length strings).
+                 *
+                 * The first two bits of the second byte contain the XOR'ed
+                 * field length but as that information is not relevant for
+                 * us, we just use this information to know whether to read
+                 * one or two bytes for string length.
+                 */
+
+                uint16_t meta = metadata[metadata_offset + 1] + (metadata[metadata_offset] << 8);
+                int bytes = 0;
+                uint16_t extra_length = (((meta >> 4) & 0x300) ^ 0x300);
+                uint16_t field_length = (meta & 0xff) + extra_length;
+
+                if (field_length > 255)
                 {
-                    sz = gw_mysql_get_byte2(ptr);
+                    bytes = ptr[0] + (ptr[1] << 8);
                     ptr += 2;
                 }
                 else
                 {
-                    sz = *ptr;
-                    ptr++;
+                    bytes = *ptr++;
                 }
 
-                sprintf(trace[i], "[%ld] VARCHAR: field: %d bytes, data: %lu bytes", i, bytes, sz);
-                char buf[sz + 1];
-                memcpy(buf, ptr, sz);
-                buf[sz] = '\0';
-                ptr += sz;
-                conv->column(i, buf);
+                value.type = ColumnValue::STRING;
+                value.data = (const char*)ptr;
+                value.size = bytes;
+                ptr += bytes;
                 check_overflow(ptr <= end);
             }
-            else if (column_is_blob(map->column_types[i]))
+        }
+        else if (column_is_bit(type))
+        {
+            uint8_t len = metadata[metadata_offset + 1];
+            uint8_t bit_len = metadata[metadata_offset] > 0 ? 1 : 0;
+            size_t bytes = len + bit_len;
+
+            // TODO: extract the bytes
+            if (!warn_bit)
             {
-                uint8_t bytes = metadata[metadata_offset];
-                uint64_t len = 0;
-                memcpy(&len, ptr, bytes);
-                ptr += bytes;
-                sprintf(trace[i], "[%ld] BLOB: field: %d bytes, data: %lu bytes", i, bytes, len);
-                if (len)
-                {
-                    conv->column(i, ptr, len);
-                    ptr += len;
-                }
-                else
-                {
-                    uint8_t nullvalue = 0;
-                    conv->column(i, &nullvalue, 1);
-                }
-                check_overflow(ptr <= end);
+                warn_bit = true;
+                MXS_WARNING("BIT is not currently supported, values are stored as 0.");
             }
-            else if (column_is_temporal(map->column_types[i]))
+            value.type = ColumnValue::INT;
+            value.integer = 0;
+            ptr += bytes;
+            check_overflow(ptr <= end);
+        }
+        else if (column_is_decimal(type))
+        {
+            value.type = ColumnValue::DOUBLE;
+            value.real = 0.0;
+            size_t sz = unpack_decimal_field(ptr, metadata + metadata_offset, &value.real);
+            ptr += sz;
+            check_overflow(sz && ptr <= end);
+        }
+        else if (column_is_variable_string(type))
+        {
+            size_t sz;
+            int bytes = metadata[metadata_offset] | metadata[metadata_offset + 1] << 8;
+            if (bytes > 255)
             {
-                char buf[80];
-                struct tm tm;
-                ptr += unpack_temporal_value(map->column_types[i],
-                                             ptr,
-                                             &metadata[metadata_offset],
-                                             create->columns[i].length,
-                                             &tm);
-                format_temporal_value(buf, sizeof(buf), map->column_types[i], &tm);
-                conv->column(i, buf);
-                sprintf(trace[i], "[%ld] %s: %s", i, column_type_to_string(map->column_types[i]), buf);
-                check_overflow(ptr <= end);
+                sz = gw_mysql_get_byte2(ptr);
+                ptr += 2;
             }
-            /** All numeric types (INT, LONG, FLOAT etc.) */
             else
             {
-                uint8_t lval[16];
-                memset(lval, 0, sizeof(lval));
-                ptr += unpack_numeric_field(ptr,
-                                            map->column_types[i],
-                                            &metadata[metadata_offset],
-                                            lval);
-                set_numeric_field_value(conv, i, map->column_types[i], &metadata[metadata_offset], lval);
-                sprintf(trace[i], "[%ld] %s", i, column_type_to_string(map->column_types[i]));
-                check_overflow(ptr <= end);
+                sz = *ptr;
+                ptr++;
             }
-            mxb_assert(metadata_offset <= map->column_metadata.size());
-            metadata_offset += get_metadata_len(map->column_types[i]);
+
+            value.type = ColumnValue::STRING;
+            value.data = (const char*)ptr;
+            value.size = sz;
+            ptr += sz;
+            check_overflow(ptr <= end);
+        }
+        else if (column_is_blob(type))
+        {
+            uint8_t bytes = metadata[metadata_offset];
+            uint64_t len = 0;
+            memcpy(&len, ptr, bytes);
+            ptr += bytes;
+            value.type = ColumnValue::BYTES;
+
+            if (len)
+            {
+                value.data = (const char*)ptr;
+                value.size = len;
+                ptr += len;
+            }
+            else
+            {
+                value.data = (const char*)&empty_blob;
+                value.size = 1;
+            }
+            check_overflow(ptr <= end);
         }
+        else if (column_is_temporal(type))
+        {
+            value.type = ColumnValue::TEMPORAL;
+            value.temporal.type = type;
+            ptr += unpack_temporal_value(type,
+                                         ptr,
+                                         &metadata[metadata_offset],
+                                         create->columns[i].length,
+                                         &value.temporal.tm);
+            check_overflow(ptr <= end);
+        }
+        /** All numeric types (INT, LONG, FLOAT etc.) */
         else
         {
-            sprintf(trace[i], "[%ld] %s: Not present", i, column_type_to_string(map->column_types[i]));
+            uint8_t lval[16];
+            memset(lval, 0, sizeof(lval));
+            ptr += unpack_numeric_field(ptr, type, &metadata[metadata_offset], lval);
+            set_numeric_field_value(value, type, &metadata[metadata_offset], lval);
+            check_overflow(ptr <= end);
         }
 
-        MXS_INFO("%s", trace[i]);
+        mxb_assert(metadata_offset <= map->column_metadata.size());
+        metadata_offset += get_metadata_len(type);
+        n++;
+
+        if (trace)
+        {
+            char buf[768];
+            trace_column(buf, sizeof(buf), type, value);
+            MXS_INFO("%s", buf);
+        }
     }
 
+    values.resize(n);
     return ptr;
 }
 
@@ -550,11 +616,12 @@ bool Rpl::handle_table_map_event(REP_HEADER* hdr, uint8_t* ptr)
  * @param router Avro router instance
  * @param hdr Replication header
  * @param ptr Pointer to the start of the event
- * @return True on succcess, false on error
+ * @return False if a row could not be written. Events that can't be converted
+ *         are logged and skipped.
  */
 bool Rpl::handle_row_event(REP_HEADER* hdr, uint8_t* ptr)
 {
-    bool rval = false;
+    bool rval = true;
     uint8_t* end = ptr + hdr->event_size - BINLOG_EVENT_HDR_LEN;
     uint8_t table_id_size = m_event_type_hdr_lens[hdr->event_type] == 6 ? 4 : 6;
     uint64_t table_id = 0;
@@ -643,7 +710,7 @@ bool Rpl::handle_row_event(REP_HEADER* hdr, uint8_t* ptr)
             int rows = 0;
             MXS_INFO("Row Event for '%s' at %u", table_ident, hdr->next_pos - hdr->event_size);
 
-            while (ptr < end)
+            while (ptr < end && rval)
             {
                 int event_type = get_event_type(hdr->event_type);
 
@@ -651,24 +718,31 @@ bool Rpl::handle_row_event(REP_HEADER* hdr, uint8_t* ptr)
                 m_gtid.event_num++;
 
                 m_handler->prepare_row(m_gtid, *hdr, event_type);
-                ptr = process_row_event_data(map, create->second, m_handler, ptr, col_present, end);
-                m_handler->commit(m_gtid);
+                ptr = process_row_event_data(map, create->second, ptr, col_present, end, m_values);
+                m_handler->row(m_values);
+                rval = m_handler->commit(m_gtid);
 
                 /** Update rows events have the before and after images of the
                  * affected rows so we'll process them as another record with
                  * a different type */
-                if (event_type == UPDATE_EVENT)
+                if (event_type == UPDATE_EVENT && rval)
                 {
                     m_gtid.event_num++;
                     m_handler->prepare_row(m_gtid, *hdr, UPDATE_EVENT_AFTER);
-                    ptr = process_row_event_data(map, create->second, m_handler, ptr, col_present, end);
-                    m_handler->commit(m_gtid);
+                    ptr = process_row_event_data(map, create->second, ptr, col_present, end, m_values);
+                    m_handler->row(m_values);
+                    rval = m_handler->commit(m_gtid);
                 }
 
                 rows++;
             }
 
-            rval = true;
+            if (!rval)
+            {
+                MXS_ERROR("Failed to write a row of table %s.%s.",
+                          map->database.c_str(),
+                          map->table.c_str());
+            }
         }
         else if (!ok)
         {
@@ -969,8 +1043,10 @@ void Rpl::handle_query_event(REP_HEADER* hdr, uint8_t* ptr)
     MXS_FREE(tmp);
 }
 
-void Rpl::handle_event(REP_HEADER hdr, uint8_t* ptr)
+bool Rpl::handle_event(REP_HEADER hdr, uint8_t* ptr)
 {
+    bool rval = true;
+
     if (m_binlog_checksum)
     {
         // We don't care about the checksum at this point so we ignore it
@@ -996,7 +1072,7 @@ void Rpl::handle_event(REP_HEADER hdr, uint8_t* ptr)
     else if ((hdr.event_type >= WRITE_ROWS_EVENTv0 && hdr.event_type <= DELETE_ROWS_EVENTv1)
              || (hdr.event_type >= WRITE_ROWS_EVENTv2 && hdr.event_type <= DELETE_ROWS_EVENTv2))
     {
-        handle_row_event(&hdr, ptr);
+        rval = handle_row_event(&hdr, ptr);
     }
     else if (hdr.event_type == MARIADB10_GTID_EVENT)
     {
@@ -1006,4 +1082,6 @@ void Rpl::handle_event(REP_HEADER hdr, uint8_t* ptr)
     {
         handle_query_event(&hdr, ptr);
     }
+
+    return rval;
 }
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "avrorouter.hh"
+
+#include <maxscale/buffer.hh>
+#include <maxscale/log.h>
+
+AvroTail::AvroTail(const std::string& filename)
+    : m_filename(filename)
+    , m_file(nullptr)
+    , m_text()
+    , m_end(0)
+    , m_next_id(1)
+    , m_json(false)
+    , m_avro(false)
+{
+}
+
+AvroTail::~AvroTail()
+{
+    maxavro_file_close(m_file);
+    maxavro_text_free(&m_text);
+}
+
+AvroTail::Result AvroTail::read(long pos, avro_data_format format, GWBUF** buffer, SAvroTailBlock* block)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    bool json = format == AVRO_FORMAT_JSON;
+
+    // Blocks are only encoded into the formats that the clients use
+    (json ? m_json : m_avro) = true;
+
+    SAvroTailBlock found = find(pos);
+
+    if (!found && pos >= m_end)
+    {
+        if (pos > m_end)
+        {
+            // The client is ahead of the tail, move the tail to it
+            m_blocks.clear();
+            m_end = pos;
+        }
+
+        if (load(pos) && (found = encode()))
+        {
+            m_blocks.push_back(found);
+            m_end = found->end;
+
+            if (m_blocks.size() > AVRO_TAIL_BLOCKS)
+            {
+                m_blocks.pop_front();
+            }
+        }
+        else if (m_file && maxavro_get_error(m_file) == MAXAVRO_ERR_NONE)
+        {
+            return NO_DATA;
+        }
+    }
+
+    guard.unlock();
+
+    if (found && (json ? found->has_json : found->has_avro) && (*buffer = to_buffer(found, format)))
+    {
+        *block = found;
+        return OK;
+    }
+
+    return BEHIND;
+}
+
+SAvroTailBlock AvroTail::find(long pos) const
+{
+    // The blocks are in file order which means a binary search could be used but
+    // the clients are usually asking for one of the last blocks
+    for (auto it = m_blocks.rbegin(); it != m_blocks.rend(); it++)
+    {
+        if ((*it)->start == pos)
+        {
+            return *it;
+        }
+        else if ((*it)->start < pos)
+        {
+            break;
+        }
+    }
+
+    return SAvroTailBlock();
+}
+
+bool AvroTail::load(long pos)
+{
+    if (!m_file && !(m_file = maxavro_file_open(m_filename.c_str())))
+    {
+        return false;
+    }
+
+    if (m_file->metadata_read && m_file->block_start_pos == pos)
+    {
+        // The block was read when the file was opened or when the previous block was copied
+        return true;
+    }
+    else if (m_file->next_block_pos == pos)
+    {
+        return maxavro_next_block(m_file);
+    }
+
+    return maxavro_record_set_pos(m_file, pos);
+}
+
+SAvroTailBlock AvroTail::encode()
+{
+    std::shared_ptr<AvroTailBlock> block(new(std::nothrow) AvroTailBlock);
+
+    if (!block)
+    {
+        MXS_OOM();
+        return SAvroTailBlock();
+    }
+
+    block->id = m_next_id++;
+    block->start = m_file->block_start_pos;
+    block->end = m_file->next_block_pos;
+    block->records = m_file->records_in_block;
+    block->has_json = m_json;
+    block->has_avro = m_avro;
+
+    if (m_avro)
+    {
+        // The block is sent as-is, no need to decode it
+        block->avro.assign((const char*)m_file->map + block->start, block->end - block->start);
+    }
+
+    if (m_json)
+    {
+        MAXAVRO_SCHEMA* schema = m_file->schema;
+        std::vector<uint64_t> values(schema->num_fields);
+        int domain = -1;
+        int server_id = -1;
+        int seq = -1;
+
+        for (size_t i = 0; i < schema->num_fields; i++)
+        {
+            if (strcmp(schema->fields[i].name, avro_domain) == 0)
+            {
+                domain = i;
+            }
+            else if (strcmp(schema->fields[i].name, avro_server_id) == 0)
+            {
+                server_id = i;
+            }
+            else if (strcmp(schema->fields[i].name, avro_sequence) == 0)
+            {
+                seq = i;
+            }
+        }
+
+        m_text.length = 0;
+
+        while (maxavro_record_read_json_text(m_file, &m_text, values.data()))
+        {
+            maxavro_text_append(&m_text, "\n", 1);
+        }
+
+        if (maxavro_get_error(m_file) != MAXAVRO_ERR_NONE)
+        {
+            return SAvroTailBlock();
+        }
+
+        if (domain >= 0 && server_id >= 0 && seq >= 0 && block->records > 0)
+        {
+            block->gtid.domain = values[domain];
+            block->gtid.server_id = values[server_id];
+            block->gtid.seq = values[seq];
+        }
+
+        block->json.assign(m_text.data, m_text.length);
+    }
+
+    return block;
+}
+
+GWBUF* AvroTail::to_buffer(const SAvroTailBlock& block, avro_data_format format)
+{
+    // Buffers can't be shared between workers, only the clients of one worker can share a copy
+    WorkerBuffer& cache = format == AVRO_FORMAT_JSON ? *m_json_buffer : *m_avro_buffer;
+
+    if (cache.id != block->id)
+    {
+        const std::string& data = format == AVRO_FORMAT_JSON ? block->json : block->avro;
+        gwbuf_free(cache.buffer);
+        cache.buffer = gwbuf_alloc_and_load(data.size(), data.data());
+        cache.id = cache.buffer ? block->id : 0;
+    }
+
+    return cache.buffer ? gwbuf_clone(cache.buffer) : nullptr;
+}
+
+SAvroTail AvroTails::get(const std::string& filename)
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    SAvroTail tail = m_tails[filename].lock();
+
+    if (!tail)
+    {
+        // Remove the tails of the files that no client reads anymore
+        for (auto it = m_tails.begin(); it != m_tails.end();)
+        {
+            if (it->second.expired())
+            {
+                it = m_tails.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        tail = std::make_shared<AvroTail>(filename);
+        m_tails[filename] = tail;
+    }
+
+    return tail;
+}
@@ -17,7 +17,14 @@
 #include <maxscale/cdefs.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <maxscale/alloc.h>
 #include <maxscale/dcb.h>
@@ -28,6 +35,7 @@
 #include <maxavro.h>
 #include <binlog_common.h>
 #include <maxscale/protocol/mysql.h>
+#include <maxscale/routingworker.hh>
 #include <blr_constants.h>
 
 #include "rpl.hh"
@@ -72,9 +80,13 @@ typedef enum avro_binlog_end
     AVRO_OK = 0,                /**< A newer binlog file exists with a rotate event to that file */
     AVRO_LAST_FILE,             /**< Last binlog which is closed */
     AVRO_OPEN_TRANSACTION,      /**< The binlog ends with an open transaction */
-    AVRO_BINLOG_ERROR           /**< An error occurred while processing the binlog file */
+    AVRO_BINLOG_ERROR,          /**< An error occurred while processing the binlog file */
+    AVRO_CONVERSION_ERROR       /**< The converted rows could not be written */
 } avro_binlog_end_t;
 
+/** Suffix of the GTID index of a domain of an Avro file (db.table.000001.avro.0.idx) */
+#define AVRO_INDEX_SUFFIX ".idx"
+
 /** How many numbers each table version has (db.table.000001.avro) */
 #define TABLE_MAP_VERSION_DIGITS 6
 
@@ -87,6 +99,36 @@ typedef enum avro_binlog_end
 /** How many bytes each thread tries to send */
 #define AVRO_DATA_BURST_SIZE (32 * 1024)
 
+/** How many of the latest data blocks of a file are kept encoded for the clients */
+#define AVRO_TAIL_BLOCKS 16
+
+/** How many bytes each stream of a batched client tries to send */
+#define AVRO_BATCH_BURST_SIZE (256 * 1024)
+
+/** Frame types of the batched CDC protocol */
+enum cdc_frame_type
+{
+    CDC_FRAME_SCHEMA = 1,   /**< Table schema, sent before the data of each file */
+    CDC_FRAME_DATA   = 2,   /**< JSON rows or an Avro data block */
+    CDC_FRAME_END    = 3,   /**< The end of the requested range was reached */
+    CDC_FRAME_ERROR  = 4,   /**< A request failed, the payload is the error message */
+    CDC_FRAME_OK     = 5,   /**< A command was successful */
+};
+
+/** Frame header: payload length, stream ID and frame type */
+#define CDC_FRAME_HEADER_LEN 9
+
+/**
+ * Create a frame of the batched CDC protocol
+ *
+ * @param id      Stream ID
+ * @param type    Frame type
+ * @param payload Frame payload, can be NULL. The payload is freed on error.
+ *
+ * @return The frame or NULL on memory allocation failure
+ */
+GWBUF* cdc_frame(uint32_t id, cdc_frame_type type, GWBUF* payload);
+
 /** Data format used when streaming data to the clients */
 enum avro_data_format
 {
@@ -99,18 +141,222 @@ enum mxs_avro_codec_type
 {
     MXS_AVRO_CODEC_NULL,
     MXS_AVRO_CODEC_DEFLATE,
-    MXS_AVRO_CODEC_SNAPPY,      /**< Not yet implemented */
+    MXS_AVRO_CODEC_SNAPPY,      /**< Requires the Avro C library to be built with snappy */
 };
 
 static const MXS_ENUM_VALUE codec_values[] =
 {
     {"null",    MXS_AVRO_CODEC_NULL   },
     {"deflate", MXS_AVRO_CODEC_DEFLATE},
-// Not yet implemented
-//    {"snappy", MXS_AVRO_CODEC_SNAPPY},
+#ifdef HAVE_AVRO_SNAPPY
+    {"snappy",  MXS_AVRO_CODEC_SNAPPY },
+#endif
     {NULL}
 };
 
+/** A data block encoded for sending to the clients */
+struct AvroTailBlock
+{
+    uint64_t    id;         /*< Unique ID of the block in its tail */
+    long        start;      /*< File offset of the block */
+    long        end;        /*< File offset of the next block */
+    uint64_t    records;    /*< Number of records in the block */
+    gtid_pos_t  gtid;       /*< GTID of the last record in the block */
+    bool        has_json;   /*< Whether the block was encoded as JSON */
+    bool        has_avro;   /*< Whether the block was copied in the Avro format */
+    std::string json;       /*< The records as newline separated JSON */
+    std::string avro;       /*< The block in the Avro format, including the sync marker */
+};
+
+typedef std::shared_ptr<const AvroTailBlock> SAvroTailBlock;
+
+/**
+ * The latest data blocks of one Avro file, shared by all clients that read it
+ *
+ * Clients that have caught up with the file read the same blocks at roughly
+ * the same time. Instead of each one of them reading, uncompressing and encoding
+ * the blocks, the tail does it once and the clients send copies of the result.
+ * A client that falls behind by more than AVRO_TAIL_BLOCKS blocks goes back to
+ * reading the file on its own.
+ */
+class AvroTail
+{
+    AvroTail(const AvroTail&) = delete;
+    AvroTail& operator=(const AvroTail&) = delete;
+
+public:
+    enum Result
+    {
+        OK,         /*< The block was found */
+        BEHIND,     /*< The block is not in the tail, the client must read the file itself */
+        NO_DATA     /*< The block has not been written yet */
+    };
+
+    AvroTail(const std::string& filename);
+    ~AvroTail();
+
+    /**
+     * Read an encoded data block
+     *
+     * @param pos    File offset of the block
+     * @param format The format the client uses
+     * @param buffer The encoded block if the block was found
+     * @param block  The metadata of the block if the block was found
+     *
+     * @return Whether the block was found
+     */
+    Result read(long pos, avro_data_format format, GWBUF** buffer, SAvroTailBlock* block);
+
+private:
+    // Each worker keeps a copy of the block it last sent, the clients get clones of it
+    struct WorkerBuffer
+    {
+        WorkerBuffer()
+            : id(0)
+            , buffer(nullptr)
+        {
+        }
+
+        WorkerBuffer(const WorkerBuffer&)
+            : id(0)
+            , buffer(nullptr)
+        {
+        }
+
+        ~WorkerBuffer()
+        {
+            gwbuf_free(buffer);
+        }
+
+        uint64_t id;
+        GWBUF*   buffer;
+    };
+
+    std::string                      m_filename;
+    std::mutex                       m_lock;
+    MAXAVRO_FILE*                    m_file;    /*< The file the blocks are read from */
+    MAXAVRO_TEXT                     m_text;    /*< Buffer for encoding JSON */
+    std::deque<SAvroTailBlock>       m_blocks;  /*< The latest blocks, oldest first */
+    long                             m_end;     /*< File offset of the next block to read */
+    uint64_t                         m_next_id;
+    bool                             m_json;    /*< Whether any client wants JSON */
+    bool                             m_avro;    /*< Whether any client wants Avro */
+    mxs::rworker_local<WorkerBuffer> m_json_buffer;
+    mxs::rworker_local<WorkerBuffer> m_avro_buffer;
+
+    SAvroTailBlock find(long pos) const;
+    bool           load(long pos);
+    SAvroTailBlock encode();
+    GWBUF*         to_buffer(const SAvroTailBlock& block, avro_data_format format);
+};
+
+typedef std::shared_ptr<AvroTail> SAvroTail;
+
+// The tails of the files that are being read by the clients of a router
+class AvroTails
+{
+public:
+    /**
+     * Get the tail of a file
+     *
+     * @param filename Path to the Avro file
+     *
+     * @return The tail of the file, created if no client has it
+     */
+    SAvroTail get(const std::string& filename);
+
+private:
+    typedef std::unordered_map<std::string, std::weak_ptr<AvroTail>> TailMap;
+
+    std::mutex m_lock;
+    TailMap    m_tails;
+};
+
+/**
+ * Durable consumer offsets
+ *
+ * A client commits the GTID up to which it has processed a table and a later
+ * batch request resumes from it. The offsets of each client UUID are stored
+ * in a file in the Avro directory.
+ *
+ * The files are written by a thread of their own so that the routing workers
+ * never wait for the disk. The commits that arrive while a file is being
+ * written are written together in the next round.
+ */
+class CdcOffsets
+{
+    CdcOffsets(const CdcOffsets&) = delete;
+    CdcOffsets& operator=(const CdcOffsets&) = delete;
+
+public:
+    /**
+     * Called once the offset has been written, with true if it was written
+     * successfully. The callback is called in the thread that writes the files.
+     */
+    typedef std::function<void (bool)> Callback;
+
+    CdcOffsets(const std::string& dir);
+    ~CdcOffsets();
+
+    /**
+     * Commit the offset of a table
+     *
+     * @param uuid     Client UUID
+     * @param table    The table, in `database.table` format
+     * @param gtid     The GTID up to which the client has processed the table
+     * @param callback Called once the offset has been written to disk
+     *
+     * @return True if the offset was queued for writing, false if the UUID
+     *         can't be used to store offsets in which case the callback is not called
+     */
+    bool commit(const std::string& uuid, const std::string& table, const gtid_pos_t& gtid,
+                Callback callback);
+
+    /**
+     * Get the committed offset of a table
+     *
+     * @param uuid  Client UUID
+     * @param table The table, in `database.table` format
+     * @param gtid  Where the offset is stored
+     *
+     * @return True if the client has an offset for the table on disk
+     */
+    bool get(const std::string& uuid, const std::string& table, gtid_pos_t* gtid);
+
+    /**
+     * Forget all offsets
+     *
+     * The offsets waiting to be written are discarded and their callbacks are
+     * called with false. Once this returns, no offset is being written and
+     * the files can be removed.
+     */
+    void clear();
+
+private:
+    typedef std::unordered_map<std::string, gtid_pos_t> Offsets;
+
+    // Offsets of one client waiting to be written
+    struct Pending
+    {
+        Offsets               offsets;
+        std::vector<Callback> callbacks;
+    };
+
+    std::mutex                               m_lock;
+    std::condition_variable                  m_cond;    /*< Signaled when offsets are committed */
+    std::condition_variable                  m_idle;    /*< Signaled when a round of writes is done */
+    std::string                              m_dir;
+    std::unordered_map<std::string, Offsets> m_offsets; /*< Offsets of each client on disk */
+    std::unordered_map<std::string, Pending> m_pending; /*< Offsets waiting to be written */
+    bool                                     m_busy;
+    bool                                     m_running;
+    std::thread                              m_thread;
+
+    void        run();
+    Offsets&    load(const std::string& uuid);
+    bool        save(const std::string& uuid, const Offsets& offsets);
+    std::string filename(const std::string& uuid) const;
+};
 
 class Avro : public MXS_ROUTER
 {
@@ -133,12 +379,88 @@ public:
     uint64_t    row_target; /*< Number of row events that trigger a flush */
     uint32_t    task_handle;/**< Delayed task handle */
     Rpl         handler;
+    AvroTails   tails;      /*< Shared readers of the files the clients are at the end of */
+    CdcOffsets  offsets;    /*< Committed offsets of the clients */
 
 private:
     Avro(SERVICE* service, MXS_CONFIG_PARAMETER* params, SERVICE* source, SRowEventHandler handler);
     void read_source_service_options(SERVICE* source);
 };
 
+class AvroSession;
+
+/**
+ * A stream of one table to a client
+ *
+ * A client that uses REQUEST-DATA has one stream and the data is sent as-is.
+ * A client that uses REQUEST-BATCH has a stream for each requested table and
+ * the data of each stream is sent in frames tagged with the stream ID.
+ */
+class AvroStream
+{
+    AvroStream(const AvroStream&) = delete;
+    AvroStream& operator=(const AvroStream&) = delete;
+public:
+
+    /**
+     * Create a new stream
+     *
+     * @param session The client session
+     * @param id      Stream ID, 0 for an unframed stream
+     * @param binfile The Avro file the stream starts from
+     */
+    AvroStream(AvroSession* session, uint32_t id, const std::string& binfile);
+    ~AvroStream();
+
+    AvroSession*  session;
+    uint32_t      id;               /*< Stream ID, 0 if the data is not framed */
+    MAXAVRO_FILE* file_handle;      /*< Current open file handle */
+    bool          schema_sent;      /*< Whether the schema of the current file was sent */
+    std::string   avro_binfile;
+    bool          requested_gtid;   /*< If the client requested */
+    gtid_pos_t    gtid;             /*< Current/requested GTID */
+    gtid_pos_t    gtid_start;       /*< First sent GTID */
+    bool          has_end;          /*< Whether the stream stops at gtid_end */
+    gtid_pos_t    gtid_end;         /*< Last GTID of a requested range */
+    bool          done;             /*< The end of the requested range was sent */
+    MAXAVRO_TEXT  json_text;        /*< Buffer for JSON rows */
+    SAvroTail     tail;             /*< Shared reader of the current file */
+    long          tail_pos;         /*< Next block to send from the tail, 0 if
+                                     * the blocks are read from file_handle */
+    uint64_t      tail_records;     /*< Records sent from the tail */
+
+    /**
+     * Send the next burst of data
+     *
+     * @return True if more data can be sent right away
+     */
+    bool stream();
+
+    /**
+     * Send data to the client, framed if this is a batched stream
+     *
+     * @param buffer Data to send
+     * @param type   Frame type
+     *
+     * @return The return value of the DCB write
+     */
+    int write(GWBUF* buffer, cdc_frame_type type = CDC_FRAME_DATA);
+
+private:
+    void set_current_gtid(const uint64_t* values, int domain, int server_id, int seq);
+    bool past_end(const uint64_t* values, int domain, int server_id, int seq);
+    int  send_json_text();
+    bool next_block(int* bytes);
+    bool stream_json();
+    bool stream_binary();
+    bool seek_to_gtid();
+    bool stream_data();
+    void send_schema();
+    void rotate_avro_file(std::string fullname);
+};
+
+typedef std::unique_ptr<AvroStream> SAvroStream;
+
 class AvroSession : public MXS_ROUTER_SESSION
 {
     AvroSession(const AvroSession&) = delete;
@@ -148,18 +470,14 @@ public:
     static AvroSession* create(Avro* router, MXS_SESSION* session);
     ~AvroSession();
 
-    DCB*                  dcb;          /*< The client DCB */
-    int                   state;        /*< The state of this client */
-    enum avro_data_format format;       /*< Stream JSON or Avro data */
-    std::string           uuid;         /*< Client UUID */
-    Avro*                 router;       /*< Pointer to the owning router */
-    MAXAVRO_FILE*         file_handle;  /*< Current open file handle */
-    uint64_t              last_sent_pos;/*< The last record we sent */
-    time_t                connect_time; /*< Connect time of slave */
-    std::string           avro_binfile;
-    bool                  requested_gtid;   /*< If the client requested */
-    gtid_pos_t            gtid;             /*< Current/requested GTID */
-    gtid_pos_t            gtid_start;       /*< First sent GTID */
+    DCB*                     dcb;           /*< The client DCB */
+    int                      state;         /*< The state of this client */
+    enum avro_data_format    format;        /*< Stream JSON or Avro data */
+    std::string              uuid;          /*< Client UUID */
+    Avro*                    router;        /*< Pointer to the owning router */
+    time_t                   connect_time;  /*< Connect time of slave */
+    bool                     batched;       /*< Whether the client uses REQUEST-BATCH */
+    std::vector<SAvroStream> streams;       /*< The streams of the client */
 
     /**
      * Process a client request
@@ -175,18 +493,38 @@ public:
      */
     void client_callback();
 
+    /**
+     * Send a frame to a batched client
+     *
+     * @param id      Stream ID
+     * @param type    Frame type
+     * @param payload Frame payload, can be NULL
+     *
+     * @return The return value of the DCB write
+     */
+    int write_frame(uint32_t id, cdc_frame_type type, GWBUF* payload);
+
+    /**
+     * Send a reply to a command
+     *
+     * Batched clients get the reply as a frame, other clients as a line of text.
+     *
+     * @param id   Stream ID of the frame
+     * @param type CDC_FRAME_OK or CDC_FRAME_ERROR
+     * @param msg  The message
+     */
+    void reply(uint32_t id, cdc_frame_type type, const std::string& msg);
+
 private:
     AvroSession(Avro* instance, MXS_SESSION* session);
 
     int  do_registration(GWBUF* data);
     void process_command(GWBUF* queue);
-    void send_gtid_info(gtid_pos_t* gtid_pos);
-    void set_current_gtid(json_t* row);
-    bool stream_json();
-    bool stream_binary();
-    bool seek_to_gtid();
-    bool stream_data();
-    void rotate_avro_file(std::string fullname);
+    void process_command(const std::string& command);
+    void request_data(const std::string& args);
+    void request_batch(const std::string& args);
+    void commit_offset(const std::string& args);
+    void start_streaming();
 };
 
 void read_table_info(uint8_t* ptr,
@@ -220,5 +558,8 @@ bool              avro_save_conversion_state(Avro* router);
 bool              avro_load_conversion_state(Avro* router);
 void              avro_load_metadata_from_schemas(Avro* router);
 void              notify_all_clients(Avro* router);
+bool              avro_index_add(const std::string& avrofile, const gtid_pos_t& gtid, long offset);
+long              avro_index_find(const std::string& avrofile, const gtid_pos_t& gtid);
+bool              avro_index_seek(MAXAVRO_FILE* file, const std::string& avrofile, const gtid_pos_t& gtid);
 
 MXS_END_DECLS
@@ -153,6 +153,61 @@ STableCreateEvent TableCreateEvent::from_json(json_t* obj)
     return rval;
 }
 
+size_t TemporalValue::format(char* dest) const
+{
+    struct tm value = tm;
+    format_temporal_value(dest, TEMPORAL_VALUE_MAXLEN, type, &value);
+    return strlen(dest);
+}
+
+void RowEventHandler::column(int i, const TemporalValue& value)
+{
+    char buf[TEMPORAL_VALUE_MAXLEN];
+    size_t len = value.format(buf);
+    column(i, buf, len);
+}
+
+void RowEventHandler::row(const ColumnValues& values)
+{
+    for (const auto& value : values)
+    {
+        switch (value.type)
+        {
+        case ColumnValue::NUL:
+            column(value.index);
+            break;
+
+        case ColumnValue::INT:
+            column(value.index, (int32_t)value.integer);
+            break;
+
+        case ColumnValue::LONG:
+            column(value.index, value.integer);
+            break;
+
+        case ColumnValue::FLOAT:
+            column(value.index, (float)value.real);
+            break;
+
+        case ColumnValue::DOUBLE:
+            column(value.index, value.real);
+            break;
+
+        case ColumnValue::STRING:
+            column(value.index, value.data, value.size);
+            break;
+
+        case ColumnValue::BYTES:
+            column(value.index, (uint8_t*)value.data, value.size);
+            break;
+
+        case ColumnValue::TEMPORAL:
+            column(value.index, value.temporal);
+            break;
+        }
+    }
+}
+
 /**
  * Extract the table definition from a CREATE TABLE statement
  * @param sql The SQL statement
@@ -645,9 +700,9 @@ Rpl::Rpl(SERVICE* service,
                        "CREATE TABLE and ALTER TABLE regex compilation should not fail");
 }
 
-void Rpl::flush()
+bool Rpl::flush()
 {
-    m_handler->flush_tables();
+    return m_handler->flush_tables();
 }
 
 void Rpl::add_create(STableCreateEvent create)
@@ -163,6 +163,56 @@ typedef std::unordered_map<std::string, STableCreateEvent> CreatedTables;
 typedef std::unordered_map<std::string, STableMapEvent>    MappedTables;
 typedef std::unordered_map<uint64_t, STableMapEvent>       ActiveMaps;
 
+// A decoded DATE, TIME, DATETIME, TIMESTAMP or YEAR value
+struct TemporalValue
+{
+    uint8_t   type; /*< The column type, one of the temporal TABLE_COL_TYPE_ values */
+    struct tm tm;   /*< The unpacked value */
+
+    /**
+     * Format the value as text
+     *
+     * @param dest Destination buffer, at least TEMPORAL_VALUE_MAXLEN bytes
+     *
+     * @return Length of the formatted value
+     */
+    size_t format(char* dest) const;
+};
+
+#define TEMPORAL_VALUE_MAXLEN 80
+
+/**
+ * A column value decoded from a row image
+ *
+ * String and byte values are not copied: they point into the row event and
+ * are only valid until the handler that received them returns.
+ */
+struct ColumnValue
+{
+    enum Type
+    {
+        NUL,
+        INT,
+        LONG,
+        FLOAT,
+        DOUBLE,
+        STRING,
+        BYTES,
+        TEMPORAL
+    };
+
+    int           index;    /*< Column index in the table */
+    Type          type;
+    int64_t       integer;  /*< INT and LONG values */
+    double        real;     /*< FLOAT and DOUBLE values */
+    const char*   data;     /*< STRING and BYTES values */
+    size_t        size;     /*< Length of `data` */
+    TemporalValue temporal; /*< TEMPORAL values */
+    char          hex[17];  /*< Storage for hex encoded ENUM and SET values */
+};
+
+typedef std::vector<ColumnValue> ColumnValues;
+
 // Handler class for row based replication events
 class RowEventHandler
 {
@@ -189,9 +239,10 @@ public:
         return true;
     }
 
-    // Flush open tables
-    virtual void flush_tables()
+    // Flush open tables, returns false on error
+    virtual bool flush_tables()
     {
+        return true;
     }
 
     // Prepare a new row for processing
@@ -220,10 +271,45 @@ public:
 
     // Empty (NULL) value type handler
     virtual void column(int i) = 0;
+
+    // String handler that doesn't copy the value, it is only valid during the call
+    virtual void column(int i, const char* value, size_t len)
+    {
+        column(i, std::string(value, len));
+    }
+
+    // Temporal value handler, by default the value is handled as a string
+    virtual void column(int i, const TemporalValue& value);
+
+    // Called with all the columns of a row image, by default each value is
+    // passed to the matching column handler
+    virtual void row(const ColumnValues& values);
 };
 
 typedef std::auto_ptr<RowEventHandler> SRowEventHandler;
 
+/**
+ * Decode one row image of a row event
+ *
+ * All columns of the row are decoded in one pass into `values` which can be
+ * reused between calls to avoid reallocating it for every row.
+ *
+ * @param map             Table map event of the row
+ * @param create          Table definition of the row
+ * @param ptr             Start of the row image
+ * @param columns_present Bitfield of the columns present in the row image
+ * @param end             End of the row event
+ * @param values          Where the decoded values are stored
+ *
+ * @return Pointer to the first byte after the row image
+ */
+uint8_t* process_row_event_data(const STableMapEvent& map,
+                                const STableCreateEvent& create,
+                                uint8_t* ptr,
+                                uint8_t* columns_present,
+                                uint8_t* end,
+                                ColumnValues& values);
+
 class Rpl
 {
 public:
@@ -242,11 +328,11 @@ public:
     // Add a stored TableCreateEvent
     void add_create(STableCreateEvent create);
 
-    // Handle a replicated binary log event
-    void handle_event(REP_HEADER hdr, uint8_t* ptr);
+    // Handle a replicated binary log event, returns false if its rows could not be written
+    bool handle_event(REP_HEADER hdr, uint8_t* ptr);
 
-    // Called when processed events need to be persisted to disk
-    void flush();
+    // Called when processed events need to be persisted to disk, returns false on error
+    bool flush();
 
     // Check if binlog checksums are enabled
     bool have_checksums() const
@@ -278,6 +364,7 @@ private:
     ActiveMaps        m_active_maps;
     MappedTables      m_table_maps;
     CreatedTables     m_created_tables;
+    ColumnValues      m_values;
     pcre2_code*       m_match;
     pcre2_code*       m_exclude;
     pcre2_match_data* m_md_match;
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the batched CDC protocol
+ *
+ * The frames sent to the REQUEST-BATCH clients must have the documented
+ * layout and the offsets committed with COMMIT-OFFSET must be on disk once
+ * the commit is reported done and must be found by a new router instance.
+ */
+
+#include "../avrorouter.hh"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <maxbase/semaphore.hh>
+#include <maxscale/buffer.hh>
+#include <maxscale/log.h>
+
+namespace
+{
+
+const int N_THREADS = 8;
+const int N_COMMITS = 500;
+
+std::atomic<int> errors {0};
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+std::string to_string(GWBUF* buffer)
+{
+    std::string str(gwbuf_length(buffer), '\0');
+    gwbuf_copy_data(buffer, 0, str.size(), (uint8_t*)&str[0]);
+    gwbuf_free(buffer);
+    return str;
+}
+
+gtid_pos_t make_gtid(uint64_t seq)
+{
+    gtid_pos_t gtid;
+    gtid.domain = 0;
+    gtid.server_id = 1;
+    gtid.seq = seq;
+    return gtid;
+}
+
+std::string committed(CdcOffsets& offsets, const std::string& uuid, const std::string& table)
+{
+    gtid_pos_t gtid;
+    return offsets.get(uuid, table, &gtid) ? gtid.to_string() : "";
+}
+
+void test_frames()
+{
+    const char data[] = "{\"id\": 1}\n";
+    GWBUF* frame = cdc_frame(3, CDC_FRAME_DATA, gwbuf_alloc_and_load(sizeof(data) - 1, data));
+    std::string expected("\x0a\0\0\0\x03\0\0\0\x02", CDC_FRAME_HEADER_LEN);
+    EXPECT(frame && to_string(frame) == expected + data);
+
+    // Replies are sent with the stream ID 0 and an empty OK has no payload
+    frame = cdc_frame(0, CDC_FRAME_OK, NULL);
+    EXPECT(frame && to_string(frame) == std::string("\0\0\0\0\0\0\0\0\x05", CDC_FRAME_HEADER_LEN));
+
+    frame = cdc_frame(0x01020304, CDC_FRAME_END, NULL);
+    EXPECT(frame && to_string(frame) == std::string("\0\0\0\0\x04\x03\x02\x01\x03", CDC_FRAME_HEADER_LEN));
+}
+
+void test_offsets(const std::string& dir)
+{
+    {
+        CdcOffsets offsets(dir);
+        mxb::Semaphore sem;
+        std::atomic<int> failed {0};
+        std::vector<std::thread> threads;
+
+        auto done = [&](bool ok) {
+                if (!ok)
+                {
+                    failed++;
+                }
+
+                sem.post();
+            };
+
+        // Concurrent commits of the same client, each thread commits its own table
+        for (int i = 0; i < N_THREADS; i++)
+        {
+            threads.emplace_back([&, i]() {
+                                     std::string table = "test.t" + std::to_string(i);
+
+                                     for (int j = 1; j <= N_COMMITS; j++)
+                                     {
+                                         EXPECT(offsets.commit("client-1", table, make_gtid(j), done));
+                                     }
+                                 });
+        }
+
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+
+        sem.wait_n(N_THREADS * N_COMMITS);
+        EXPECT(failed == 0);
+
+        for (int i = 0; i < N_THREADS; i++)
+        {
+            std::string table = "test.t" + std::to_string(i);
+            EXPECT(committed(offsets, "client-1", table) == make_gtid(N_COMMITS).to_string());
+        }
+
+        // Offsets that are still being written when the router stops are not lost
+        EXPECT(offsets.commit("client-2", "test.t1", make_gtid(1000), [](bool) {
+                              }));
+
+        // UUIDs that can't be a part of a file name are rejected
+        EXPECT(!offsets.commit("../client", "test.t1", make_gtid(1), done));
+        EXPECT(committed(offsets, "no-such-client", "test.t1").empty());
+    }
+
+    // A new instance reads the offsets from disk
+    CdcOffsets offsets(dir);
+
+    for (int i = 0; i < N_THREADS; i++)
+    {
+        std::string table = "test.t" + std::to_string(i);
+        EXPECT(committed(offsets, "client-1", table) == make_gtid(N_COMMITS).to_string());
+    }
+
+    EXPECT(committed(offsets, "client-2", "test.t1") == make_gtid(1000).to_string());
+    EXPECT(access((dir + "/client-1.offsets").c_str(), F_OK) == 0);
+    EXPECT(access((dir + "/client-1.offsets.tmp").c_str(), F_OK) != 0);
+
+    // Once cleared and the files are removed, like the purge command does, the offsets are gone
+    offsets.clear();
+    unlink((dir + "/client-1.offsets").c_str());
+    unlink((dir + "/client-2.offsets").c_str());
+    EXPECT(committed(offsets, "client-1", "test.t1").empty());
+    EXPECT(committed(offsets, "client-2", "test.t1").empty());
+}
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_avro_batch.XXXXXX";
+
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT) || !mkdtemp(dir))
+    {
+        return 1;
+    }
+
+    test_frames();
+    test_offsets(dir);
+
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+    mxs_log_finish();
+
+    return errors ? 1 : 0;
+}
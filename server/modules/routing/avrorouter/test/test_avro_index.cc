@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the GTID index of the Avro files
+ *
+ * The index must point to the last block that starts before the requested
+ * GTID in the GTID's domain and a file seeked with the index must contain the
+ * GTID in the block it was moved to or in one of the following blocks.
+ */
+
+#include "../avrorouter.hh"
+#include "../../../../../avro/test/avro_test_file.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <maxscale/log.h>
+
+namespace
+{
+
+const int N_BLOCKS = 10;
+const int N_ROWS = 10;
+
+/** An index entry is added every INDEX_INTERVAL blocks, like a flush of the converter does */
+const int INDEX_INTERVAL = 2;
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+gtid_pos_t make_gtid(uint64_t domain, uint64_t seq)
+{
+    gtid_pos_t gtid;
+    gtid.domain = domain;
+    gtid.server_id = 1;
+    gtid.seq = seq;
+    return gtid;
+}
+
+void test_find(const std::string& dir)
+{
+    std::string file = dir + "/test.find.000001.avro";
+
+    // No index, the file is read from the start
+    EXPECT(avro_index_find(file, make_gtid(0, 5)) == 0);
+
+    EXPECT(avro_index_add(file, make_gtid(0, 1), 100));
+    EXPECT(avro_index_add(file, make_gtid(0, 11), 200));
+    EXPECT(avro_index_add(file, make_gtid(1, 5), 300));
+    EXPECT(avro_index_add(file, make_gtid(0, 21), 400));
+    EXPECT(avro_index_add(file, make_gtid(1, 50), 500));
+
+    // Nothing before the first entry of the domain
+    EXPECT(avro_index_find(file, make_gtid(0, 1)) == 0);
+    EXPECT(avro_index_find(file, make_gtid(1, 5)) == 0);
+
+    // The rows of a transaction can start in the block before the entry which is
+    // why an exact match returns the previous entry
+    EXPECT(avro_index_find(file, make_gtid(0, 11)) == 100);
+    EXPECT(avro_index_find(file, make_gtid(0, 12)) == 200);
+    EXPECT(avro_index_find(file, make_gtid(0, 21)) == 200);
+    EXPECT(avro_index_find(file, make_gtid(0, 1000)) == 400);
+
+    // The entries of the other domains are ignored
+    EXPECT(avro_index_find(file, make_gtid(1, 6)) == 300);
+    EXPECT(avro_index_find(file, make_gtid(1, 51)) == 500);
+    EXPECT(avro_index_find(file, make_gtid(2, 1000)) == 0);
+
+    // A partially written entry at the end is ignored
+    FILE* idx = fopen((file + ".1" AVRO_INDEX_SUFFIX).c_str(), "ab");
+    fwrite("\x01\x02\x03", 1, 3, idx);
+    fclose(idx);
+    EXPECT(avro_index_find(file, make_gtid(1, 51)) == 500);
+
+    // Every entry of a larger index is found
+    std::string large = dir + "/test.large.000001.avro";
+
+    for (int i = 1; i <= 1000; i++)
+    {
+        EXPECT(avro_index_add(large, make_gtid(0, i * 10), i * 100));
+    }
+
+    for (int i = 1; i <= 1000; i++)
+    {
+        EXPECT(avro_index_find(large, make_gtid(0, i * 10)) == (i - 1) * 100);
+        EXPECT(avro_index_find(large, make_gtid(0, i * 10 + 1)) == i * 100);
+    }
+}
+
+// The first row read from the file or -1 if no rows could be read
+int64_t next_seq(MAXAVRO_FILE* file)
+{
+    json_t* row = maxavro_record_read_json(file);
+    int64_t rval = -1;
+
+    if (row)
+    {
+        rval = json_integer_value(json_object_get(row, avro_sequence));
+        json_decref(row);
+    }
+
+    return rval;
+}
+
+// Seek to a GTID like a client that requests it does and return the first row at or after it
+int64_t seek(const std::string& path, uint64_t seq, long* block)
+{
+    MAXAVRO_FILE* file = maxavro_file_open(path.c_str());
+    int64_t rval = -1;
+
+    if (file)
+    {
+        avro_index_seek(file, path, make_gtid(0, seq));
+        *block = file->block_start_pos;
+
+        do
+        {
+            while ((rval = next_seq(file)) != -1 && rval < (int64_t)seq)
+            {
+            }
+        }
+        while (rval == -1 && maxavro_next_block(file));
+
+        maxavro_file_close(file);
+    }
+
+    return rval;
+}
+
+void test_seek(const std::string& dir)
+{
+    std::string path = dir + "/test.seek.000001.avro";
+    EXPECT(create_file(path.c_str(), gtid_schema, "null"));
+    std::vector<long> offsets;
+
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        uint64_t first_seq = i * N_ROWS + 1;
+        offsets.push_back(append_gtid_block(path.c_str(), first_seq, N_ROWS));
+
+        if (i % INDEX_INTERVAL == 0)
+        {
+            EXPECT(avro_index_add(path, make_gtid(0, first_seq), offsets.back()));
+        }
+    }
+
+    long block = 0;
+
+    // The first block with an index entry before the GTID
+    EXPECT(seek(path, 57, &block) == 57);
+    EXPECT(block == offsets[4]);
+
+    // Rows past the block of the index entry are found
+    EXPECT(seek(path, 79, &block) == 79);
+    EXPECT(block == offsets[6]);
+
+    // The first row of an indexed block starts from the previous entry
+    EXPECT(seek(path, 61, &block) == 61);
+    EXPECT(block == offsets[4]);
+
+    EXPECT(seek(path, 5, &block) == 5);
+    EXPECT(block == offsets[0]);
+
+    EXPECT(seek(path, N_BLOCKS * N_ROWS, &block) == N_BLOCKS * N_ROWS);
+    EXPECT(block == offsets[N_BLOCKS - 2]);
+
+    // A GTID that is not in the file is not found
+    EXPECT(seek(path, N_BLOCKS * N_ROWS + 1, &block) == -1);
+
+    // A file is not moved backwards
+    MAXAVRO_FILE* handle = maxavro_file_open(path.c_str());
+    EXPECT(handle && maxavro_record_set_pos(handle, offsets[8]));
+    EXPECT(handle && !avro_index_seek(handle, path, make_gtid(0, 25)));
+    EXPECT(handle && handle->block_start_pos == offsets[8]);
+    maxavro_file_close(handle);
+}
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_avro_index.XXXXXX";
+
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT) || !mkdtemp(dir))
+    {
+        return 1;
+    }
+
+    test_find(dir);
+    test_seek(dir);
+
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+    mxs_log_finish();
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the shared tail of an Avro file
+ *
+ * The blocks read through the tail must be the same as the ones read directly
+ * from the file, only the latest AVRO_TAIL_BLOCKS blocks must be kept and the
+ * blocks appended to the file after the tail reached its end must be found.
+ */
+
+#include "../avrorouter.hh"
+#include "../../../../../avro/test/avro_test_file.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <maxbase/maxbase.hh>
+#include <maxscale/buffer.hh>
+#include <maxscale/config.h>
+#include <maxscale/log.h>
+#include <maxscale/routingworker.hh>
+
+#include "../../../../core/internal/poll.hh"
+
+namespace
+{
+
+const int N_BLOCKS = AVRO_TAIL_BLOCKS + 4;
+const int N_ROWS = 10;
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+std::string to_string(GWBUF* buffer)
+{
+    std::string str(gwbuf_length(buffer), '\0');
+    gwbuf_copy_data(buffer, 0, str.size(), (uint8_t*)&str[0]);
+    gwbuf_free(buffer);
+    return str;
+}
+
+// The records of a block as newline separated JSON, read directly from the file
+std::string read_json(const std::string& path, long pos)
+{
+    std::string rval;
+    MAXAVRO_FILE* file = maxavro_file_open(path.c_str());
+
+    if (file && maxavro_record_set_pos(file, pos))
+    {
+        MAXAVRO_TEXT text = {};
+
+        while (maxavro_record_read_json_text(file, &text, NULL))
+        {
+            maxavro_text_append(&text, "\n", 1);
+        }
+
+        rval.assign(text.data, text.length);
+        maxavro_text_free(&text);
+    }
+
+    maxavro_file_close(file);
+    return rval;
+}
+
+// The raw bytes of a block
+std::string read_avro(const std::string& path, long start, long end)
+{
+    std::string rval(end - start, '\0');
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd == -1 || pread(fd, &rval[0], rval.size(), start) != (ssize_t)rval.size())
+    {
+        rval.clear();
+    }
+
+    close(fd);
+    return rval;
+}
+
+void test_tail(const std::string& path)
+{
+    EXPECT(create_file(path.c_str(), gtid_schema, "null"));
+    std::vector<long> offsets;
+
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        offsets.push_back(append_gtid_block(path.c_str(), i * N_ROWS + 1, N_ROWS));
+    }
+
+    AvroTail tail(path);
+    GWBUF* buffer = nullptr;
+    SAvroTailBlock block;
+    long pos = offsets[0];
+
+    // All blocks are found, in order, with the same records as in the file
+    for (int i = 0; i < N_BLOCKS; i++)
+    {
+        EXPECT(tail.read(pos, AVRO_FORMAT_JSON, &buffer, &block) == AvroTail::OK);
+
+        if (!block)
+        {
+            return;
+        }
+
+        EXPECT(block->start == offsets[i]);
+        EXPECT(block->records == (uint64_t)N_ROWS);
+        EXPECT(block->gtid.seq == (uint64_t)(i + 1) * N_ROWS);
+
+        std::string json = to_string(buffer);
+        EXPECT(json == read_json(path, pos));
+        EXPECT(json.find("row number " + std::to_string(i * N_ROWS + 1)) != std::string::npos);
+
+        pos = block->end;
+        block.reset();
+    }
+
+    // Nothing has been written after the last block
+    EXPECT(tail.read(pos, AVRO_FORMAT_JSON, &buffer, &block) == AvroTail::NO_DATA);
+
+    // Only the latest blocks are kept
+    EXPECT(tail.read(offsets[0], AVRO_FORMAT_JSON, &buffer, &block) == AvroTail::BEHIND);
+    EXPECT(tail.read(offsets.back(), AVRO_FORMAT_JSON, &buffer, &block) == AvroTail::OK);
+    gwbuf_free(buffer);
+
+    // The blocks were encoded before any client wanted Avro
+    EXPECT(tail.read(offsets.back(), AVRO_FORMAT_AVRO, &buffer, &block) == AvroTail::BEHIND);
+
+    // A block written after the tail reached the end of the file is found in both formats
+    long offset = append_gtid_block(path.c_str(), N_BLOCKS * N_ROWS + 1, N_ROWS);
+    EXPECT(offset == pos);
+
+    EXPECT(tail.read(pos, AVRO_FORMAT_JSON, &buffer, &block) == AvroTail::OK);
+    EXPECT(block && block->gtid.seq == (uint64_t)(N_BLOCKS + 1) * N_ROWS);
+    EXPECT(to_string(buffer) == read_json(path, pos));
+
+    EXPECT(tail.read(pos, AVRO_FORMAT_AVRO, &buffer, &block) == AvroTail::OK);
+    EXPECT(block && to_string(buffer) == read_avro(path, block->start, block->end));
+}
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_avro_tail.XXXXXX";
+    config_get_global_options()->n_threads = 1;
+
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT) || !mkdtemp(dir))
+    {
+        return 1;
+    }
+
+    maxbase::init();
+    poll_init();
+
+    if (!mxs::RoutingWorker::init())
+    {
+        return 1;
+    }
+
+    // The tail keeps a buffer for each routing worker, run the test in one
+    mxs::RoutingWorker* worker = mxs::RoutingWorker::get(mxs::RoutingWorker::MAIN);
+    worker->execute([dir, worker]() {
+                        test_tail(std::string(dir) + "/test.t1.000001.avro");
+                        worker->shutdown();
+                    }, mxb::Worker::EXECUTE_QUEUED);
+    worker->run();
+
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+
+    mxs::RoutingWorker::finish();
+    maxbase::finish();
+    mxs_log_finish();
+
+    return errors ? 1 : 0;
+}
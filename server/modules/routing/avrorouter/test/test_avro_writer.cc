@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the Avro writer threads
+ *
+ * Rows are converted with writer threads and the table definition is
+ * modified, like an ALTER TABLE does, while the writers are still writing
+ * them. The rows must be written with the columns of the schema of their
+ * file and the rows of the new table version into a new file.
+ *
+ * A row that can't be written must make the converter fail, with and without
+ * writer threads.
+ */
+
+#include "../avro_converter.hh"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <maxavro.h>
+#include <maxscale/log.h>
+#include <maxscale/mysql_binlog.h>
+
+namespace
+{
+
+const int N_WRITERS = 4;
+const int N_ROWS = 20000;
+
+/** The insert event type, see avro_rbr.cc */
+const int WRITE_EVENT = 0;
+
+STableMapEvent make_map(int version, uint8_t type1, uint8_t type2)
+{
+    Bytes types {type1, type2};
+    Bytes metadata;
+
+    for (auto type : types)
+    {
+        if (type == TABLE_COL_TYPE_VARCHAR)
+        {
+            metadata.push_back(100);
+            metadata.push_back(0);
+        }
+    }
+
+    return STableMapEvent(new TableMapEvent("test", "t1", 1, version, std::move(types),
+                                            Bytes {0x03}, std::move(metadata)));
+}
+
+gtid_pos_t make_gtid(int row)
+{
+    gtid_pos_t gtid;
+    gtid.domain = 0;
+    gtid.server_id = 1;
+    gtid.seq = row + 1;
+    gtid.event_num = 1;
+    return gtid;
+}
+
+std::string value_of(int row)
+{
+    return "value of row " + std::to_string(row);
+}
+
+// The rows of the first version are an ID and a string
+void write_v1(AvroConverter& conv, const STableMapEvent& map, const STableCreateEvent& create)
+{
+    REP_HEADER hdr = {};
+    conv.prepare_table(map, create);
+
+    for (int i = 0; i < N_ROWS; i++)
+    {
+        gtid_pos_t gtid = make_gtid(i);
+        hdr.timestamp = i;
+        conv.prepare_row(gtid, hdr, WRITE_EVENT);
+        conv.column(0, (int64_t)i);
+        conv.column(1, value_of(i));
+        conv.commit(gtid);
+    }
+}
+
+// The rows of the second version are a string and an integer
+void write_v2(AvroConverter& conv, const STableMapEvent& map, const STableCreateEvent& create)
+{
+    REP_HEADER hdr = {};
+    conv.prepare_table(map, create);
+
+    for (int i = N_ROWS; i < 2 * N_ROWS; i++)
+    {
+        gtid_pos_t gtid = make_gtid(i);
+        hdr.timestamp = i;
+        conv.prepare_row(gtid, hdr, WRITE_EVENT);
+        conv.column(0, value_of(i));
+        conv.column(1, (int32_t)i);
+        conv.commit(gtid);
+    }
+}
+
+int check_file(const std::string& path, const char* str_field, const char* int_field, int first)
+{
+    MAXAVRO_FILE* file = maxavro_file_open(path.c_str());
+
+    if (!file)
+    {
+        printf("Failed to open %s\n", path.c_str());
+        return 1;
+    }
+
+    int errors = 0;
+    int row = first;
+
+    do
+    {
+        while (json_t* js = maxavro_record_read_json(file))
+        {
+            json_t* str = json_object_get(js, str_field);
+            json_t* num = json_object_get(js, int_field);
+            json_t* seq = json_object_get(js, avro_sequence);
+
+            if (!str || !json_is_string(str) || json_string_value(str) != value_of(row)
+                || !num || json_integer_value(num) != row
+                || !seq || json_integer_value(seq) != row + 1)
+            {
+                char* dump = json_dumps(js, JSON_COMPACT);
+                printf("%s: row %d is wrong: %s\n", path.c_str(), row, dump);
+                free(dump);
+                errors++;
+            }
+
+            json_decref(js);
+            row++;
+        }
+    }
+    while (errors < 10 && maxavro_next_block(file));
+
+    maxavro_file_close(file);
+
+    if (row != first + N_ROWS)
+    {
+        printf("%s: %d rows instead of %d\n", path.c_str(), row - first, N_ROWS);
+        errors++;
+    }
+
+    return errors;
+}
+
+// Writes rows until the commit or the flush fails, with the file size limited
+int test_write_error(const std::string& dir, int writers)
+{
+    std::string subdir = dir + "/error" + std::to_string(writers);
+    mkdir(subdir.c_str(), 0775);
+
+    STableCreateEvent create(new TableCreateEvent("test", "t1", 1,
+                                                  {Column("id", "bigint"), Column("data", "varchar", 100)}));
+    STableMapEvent map = make_map(1, TABLE_COL_TYPE_LONGLONG, TABLE_COL_TYPE_VARCHAR);
+    AvroConverter conv(subdir, 16 * 1024, MXS_AVRO_CODEC_NULL, writers);
+
+    if (!conv.open_table(map, create))
+    {
+        printf("Failed to open the table\n");
+        return 1;
+    }
+
+    // Writes past the limit fail with EFBIG instead of raising SIGXFSZ
+    struct rlimit old_limit;
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = 64 * 1024;
+    signal(SIGXFSZ, SIG_IGN);
+    setrlimit(RLIMIT_FSIZE, &limit);
+
+    REP_HEADER hdr = {};
+    conv.prepare_table(map, create);
+    bool ok = true;
+
+    for (int i = 0; i < N_ROWS && ok; i++)
+    {
+        gtid_pos_t gtid = make_gtid(i);
+        conv.prepare_row(gtid, hdr, WRITE_EVENT);
+        conv.column(0, (int64_t)i);
+        conv.column(1, value_of(i));
+        ok = conv.commit(gtid);
+    }
+
+    ok = conv.flush_tables() && ok;
+
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    signal(SIGXFSZ, SIG_DFL);
+
+    if (ok)
+    {
+        printf("%d writers: writing past the file size limit did not fail\n", writers);
+        return 1;
+    }
+
+    return 0;
+}
+}
+
+int main()
+{
+    char dir[] = "/tmp/test_avro_writer.XXXXXX";
+
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT) || !mkdtemp(dir))
+    {
+        return 1;
+    }
+
+    STableCreateEvent create(new TableCreateEvent("test", "t1", 1,
+                                                  {Column("id", "bigint"), Column("data", "varchar", 100)}));
+    STableMapEvent map = make_map(1, TABLE_COL_TYPE_LONGLONG, TABLE_COL_TYPE_VARCHAR);
+    int errors = 0;
+
+    {
+        AvroConverter conv(dir, 16 * 1024, MXS_AVRO_CODEC_NULL, N_WRITERS);
+
+        if (!conv.open_table(map, create))
+        {
+            printf("Failed to open the table\n");
+            return 1;
+        }
+
+        write_v1(conv, map, create);
+
+        // ALTER TABLE t1 DROP COLUMN id, CHANGE data renamed VARCHAR(100), ADD added INT
+        // while the writers are still writing the rows of the first version
+        create->columns.erase(create->columns.begin());
+        create->columns[0].name = "renamed";
+        create->columns.emplace_back("added", "int", -1);
+        create->version++;
+
+        STableMapEvent map2 = make_map(2, TABLE_COL_TYPE_VARCHAR, TABLE_COL_TYPE_LONG);
+
+        if (!conv.open_table(map2, create))
+        {
+            printf("Failed to open the new version of the table\n");
+            return 1;
+        }
+
+        write_v2(conv, map2, create);
+
+        if (!conv.flush_tables())
+        {
+            printf("Failed to flush the tables\n");
+            errors++;
+        }
+    }
+
+    errors += check_file(std::string(dir) + "/test.t1.000001.avro", "data", "id", 0);
+    errors += check_file(std::string(dir) + "/test.t1.000002.avro", "renamed", "added", N_ROWS);
+    errors += test_write_error(dir, 0);
+    errors += test_write_error(dir, N_WRITERS);
+
+    std::string cmd = std::string("rm -rf ") + dir;
+    system(cmd.c_str());
+    mxs_log_finish();
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,612 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test and benchmark for the row image decoding
+ *
+ * Builds row events for a few typical table shapes, checks that the decoded
+ * values are correct and then measures the rows per second when the values
+ * are handled as strings and when the typed values are used.
+ *
+ * Usage: test_row_decoding [ROWS]
+ */
+
+#include "../rpl.hh"
+
+#include <chrono>
+#include <cmath>
+#include <maxscale/mysql_binlog.h>
+
+namespace
+{
+
+struct ColumnDef
+{
+    uint8_t type;
+    Bytes   metadata;
+};
+
+ColumnDef col_long()
+{
+    return {TABLE_COL_TYPE_LONG, {}};
+}
+
+ColumnDef col_longlong()
+{
+    return {TABLE_COL_TYPE_LONGLONG, {}};
+}
+
+ColumnDef col_double()
+{
+    return {TABLE_COL_TYPE_DOUBLE, {8}};
+}
+
+ColumnDef col_varchar(int len)
+{
+    return {TABLE_COL_TYPE_VARCHAR, {(uint8_t)(len & 0xff), (uint8_t)(len >> 8)}};
+}
+
+ColumnDef col_decimal()
+{
+    // DECIMAL(10, 2)
+    return {TABLE_COL_TYPE_NEWDECIMAL, {10, 2}};
+}
+
+ColumnDef col_blob()
+{
+    return {TABLE_COL_TYPE_BLOB, {2}};
+}
+
+ColumnDef col_temporal(uint8_t type)
+{
+    return {type, type == TABLE_COL_TYPE_DATE || type == TABLE_COL_TYPE_YEAR ? Bytes() : Bytes {0}};
+}
+
+void put_be(Bytes& dest, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        dest.push_back(value >> (8 * i));
+    }
+}
+
+void put_le(Bytes& dest, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        dest.push_back(value >> (8 * i));
+    }
+}
+
+// The values stored in each row
+struct Expected
+{
+    Expected(long row, int col)
+        : integer(row * 7 + col)
+        , bigint(row * 1000003L + col)
+        , real(row * 0.25 + col)
+        , decimal(row % 1000000 + ((row + col) % 100) / 100.0)
+        , timestamp(1500000000 + row * 37 + col)
+        , blob_size(300 + (row + col) % 200)
+    {
+        len = snprintf(str, sizeof(str), "value %ld of column %d", row, col);
+        memset(&tm, 0, sizeof(tm));
+        tm.tm_sec = (row + col) % 60;
+        tm.tm_min = (row / 60) % 60;
+        tm.tm_hour = (row / 3600 + col) % 24;
+        tm.tm_mday = row % 28 + 1;
+        tm.tm_mon = (row + col) % 12;
+        tm.tm_year = 90 + (row + col) % 40;
+    }
+
+    int64_t   integer;
+    int64_t   bigint;
+    double    real;
+    double    decimal;
+    time_t    timestamp;
+    int       blob_size;
+    char      str[64];
+    int       len;
+    struct tm tm;
+};
+
+void encode(Bytes& dest, const ColumnDef& def, long row, int col)
+{
+    Expected e(row, col);
+    const struct tm& tm = e.tm;
+
+    switch (def.type)
+    {
+    case TABLE_COL_TYPE_LONG:
+        put_le(dest, e.integer, 4);
+        break;
+
+    case TABLE_COL_TYPE_LONGLONG:
+        put_le(dest, e.bigint, 8);
+        break;
+
+    case TABLE_COL_TYPE_DOUBLE:
+        {
+            uint64_t bits;
+            memcpy(&bits, &e.real, sizeof(bits));
+            put_le(dest, bits, 8);
+        }
+        break;
+
+    case TABLE_COL_TYPE_VARCHAR:
+        if ((def.metadata[0] | def.metadata[1] << 8) > 255)
+        {
+            put_le(dest, e.len, 2);
+        }
+        else
+        {
+            dest.push_back(e.len);
+        }
+        dest.insert(dest.end(), e.str, e.str + e.len);
+        break;
+
+    case TABLE_COL_TYPE_NEWDECIMAL:
+        // Four bytes for the integer part and one for the fraction, the sign
+        // bit is set for positive values
+        put_be(dest, (row % 1000000) | 0x80000000, 4);
+        dest.push_back((row + col) % 100);
+        break;
+
+    case TABLE_COL_TYPE_BLOB:
+        put_le(dest, e.blob_size, 2);
+        for (int i = 0; i < e.blob_size; i++)
+        {
+            dest.push_back(i * 31 + row);
+        }
+        break;
+
+    case TABLE_COL_TYPE_DATETIME2:
+        {
+            uint64_t yearmonth = (tm.tm_year + 1900) * 13 + tm.tm_mon + 1;
+            uint64_t date = yearmonth << 5 | tm.tm_mday;
+            uint64_t time = tm.tm_hour << 12 | tm.tm_min << 6 | tm.tm_sec;
+            put_be(dest, (date << 17 | time) + 0x8000000000LL, 5);
+        }
+        break;
+
+    case TABLE_COL_TYPE_TIMESTAMP2:
+        put_be(dest, e.timestamp, 4);
+        break;
+
+    case TABLE_COL_TYPE_TIME2:
+        put_be(dest, 0x800000 + (tm.tm_hour << 12 | tm.tm_min << 6 | tm.tm_sec), 3);
+        break;
+
+    case TABLE_COL_TYPE_DATE:
+        put_le(dest, tm.tm_mday | (tm.tm_mon + 1) << 5 | (tm.tm_year + 1900) << 9, 3);
+        break;
+
+    case TABLE_COL_TYPE_YEAR:
+        dest.push_back(tm.tm_year);
+        break;
+
+    default:
+        mxb_assert(false);
+        break;
+    }
+}
+
+struct Shape
+{
+    const char*            name;
+    std::vector<ColumnDef> defs;
+    STableMapEvent         map;
+    STableCreateEvent      create;
+    Bytes                  rows;    // Row images stored back to back
+    long                   nrows;
+};
+
+Shape make_shape(const char* name, std::vector<ColumnDef> defs, long nrows)
+{
+    Bytes types;
+    Bytes metadata;
+    Bytes nulls((defs.size() + 7) / 8, 0xff);
+    std::vector<Column> columns;
+
+    for (size_t i = 0; i < defs.size(); i++)
+    {
+        types.push_back(defs[i].type);
+        metadata.insert(metadata.end(), defs[i].metadata.begin(), defs[i].metadata.end());
+        columns.emplace_back("c" + std::to_string(i), column_type_to_string(defs[i].type));
+    }
+
+    Shape shape;
+    shape.name = name;
+    shape.defs = defs;
+    shape.nrows = nrows;
+    shape.map.reset(new TableMapEvent("test", name, 1, 1, std::move(types), std::move(nulls),
+                                      std::move(metadata)));
+    shape.create.reset(new TableCreateEvent("test", name, 1, std::move(columns)));
+
+    for (long row = 0; row < nrows; row++)
+    {
+        // Every 10th row has the first column as NULL
+        shape.rows.push_back(row % 10 == 0 ? 1 : 0);
+        shape.rows.insert(shape.rows.end(), (defs.size() + 7) / 8 - 1, 0);
+
+        for (size_t i = 0; i < defs.size(); i++)
+        {
+            if (i > 0 || row % 10)
+            {
+                encode(shape.rows, defs[i], row, i);
+            }
+        }
+    }
+
+    return shape;
+}
+
+std::vector<Shape> make_shapes(long nrows)
+{
+    std::vector<ColumnDef> wide;
+
+    for (int i = 0; i < 12; i++)
+    {
+        wide.push_back(col_long());
+        wide.push_back(col_varchar(64));
+        wide.push_back(col_temporal(TABLE_COL_TYPE_DATETIME2));
+        wide.push_back(col_decimal());
+    }
+
+    std::vector<Shape> shapes;
+    shapes.push_back(make_shape("narrow",
+                                {col_longlong(), col_varchar(100), col_long(), col_double(),
+                                 col_temporal(TABLE_COL_TYPE_DATETIME2)},
+                                nrows));
+    shapes.push_back(make_shape("wide", wide, nrows));
+    shapes.push_back(make_shape("temporal",
+                                {col_longlong(),
+                                 col_temporal(TABLE_COL_TYPE_DATE),
+                                 col_temporal(TABLE_COL_TYPE_DATETIME2),
+                                 col_temporal(TABLE_COL_TYPE_TIMESTAMP2),
+                                 col_temporal(TABLE_COL_TYPE_TIME2),
+                                 col_temporal(TABLE_COL_TYPE_YEAR),
+                                 col_temporal(TABLE_COL_TYPE_DATE),
+                                 col_temporal(TABLE_COL_TYPE_DATETIME2),
+                                 col_temporal(TABLE_COL_TYPE_TIMESTAMP2),
+                                 col_temporal(TABLE_COL_TYPE_TIME2),
+                                 col_temporal(TABLE_COL_TYPE_YEAR)},
+                                nrows));
+    shapes.push_back(make_shape("text", {col_long(), col_blob(), col_blob(), col_varchar(1000)}, nrows));
+    return shapes;
+}
+
+std::string expected_temporal(uint8_t type, long row, int col)
+{
+    Expected e(row, col);
+    const char* format = "%Y";
+    char buf[80];
+
+    switch (type)
+    {
+    case TABLE_COL_TYPE_TIMESTAMP2:
+        localtime_r(&e.timestamp, &e.tm);
+        format = "%Y-%m-%d %H:%M:%S";
+        break;
+
+    case TABLE_COL_TYPE_DATETIME2:
+        format = "%Y-%m-%d %H:%M:%S";
+        break;
+
+    case TABLE_COL_TYPE_DATE:
+        format = "%Y-%m-%d";
+        break;
+
+    case TABLE_COL_TYPE_TIME2:
+        format = "%H:%M:%S";
+        break;
+    }
+
+    strftime(buf, sizeof(buf), format, &e.tm);
+    return buf;
+}
+
+int check_value(const Shape& shape, long row, const ColumnValue& value)
+{
+    Expected e(row, value.index);
+    uint8_t type = shape.defs[value.index].type;
+    bool ok = false;
+
+    if (value.index == 0 && row % 10 == 0)
+    {
+        ok = value.type == ColumnValue::NUL;
+    }
+    else if (column_is_temporal(type))
+    {
+        char buf[TEMPORAL_VALUE_MAXLEN];
+        value.temporal.format(buf);
+        ok = value.type == ColumnValue::TEMPORAL
+            && expected_temporal(type, row, value.index) == buf;
+    }
+    else
+    {
+        switch (type)
+        {
+        case TABLE_COL_TYPE_LONG:
+            ok = value.type == ColumnValue::INT && value.integer == e.integer;
+            break;
+
+        case TABLE_COL_TYPE_LONGLONG:
+            ok = value.type == ColumnValue::LONG && value.integer == e.bigint;
+            break;
+
+        case TABLE_COL_TYPE_DOUBLE:
+            ok = value.type == ColumnValue::DOUBLE && value.real == e.real;
+            break;
+
+        case TABLE_COL_TYPE_NEWDECIMAL:
+            ok = value.type == ColumnValue::DOUBLE && fabs(value.real - e.decimal) < 0.001;
+            break;
+
+        case TABLE_COL_TYPE_VARCHAR:
+            ok = value.type == ColumnValue::STRING && std::string(value.data, value.size) == e.str;
+            break;
+
+        case TABLE_COL_TYPE_BLOB:
+            ok = value.type == ColumnValue::BYTES && (int)value.size == e.blob_size
+                && (uint8_t)value.data[1] == (uint8_t)(31 + row);
+            break;
+        }
+    }
+
+    if (!ok)
+    {
+        printf("%s: row %ld, column %d (%s) has the wrong value\n",
+               shape.name, row, value.index, column_type_to_string(type));
+    }
+
+    return ok ? 0 : 1;
+}
+
+int check_shape(const Shape& shape)
+{
+    Bytes rows = shape.rows;
+    Bytes present((shape.defs.size() + 7) / 8, 0xff);
+    ColumnValues values;
+    uint8_t* end = rows.data() + rows.size();
+    uint8_t* ptr = rows.data();
+    long row = 0;
+    int errors = 0;
+
+    for (; ptr < end && errors < 10; row++)
+    {
+        ptr = process_row_event_data(shape.map, shape.create, ptr, present.data(), end, values);
+
+        if (values.size() != shape.defs.size())
+        {
+            printf("%s: row %ld has %lu values instead of %lu\n",
+                   shape.name, row, values.size(), shape.defs.size());
+            errors++;
+            break;
+        }
+
+        for (const auto& value : values)
+        {
+            errors += check_value(shape, row, value);
+        }
+    }
+
+    if (errors == 0 && (row != shape.nrows || ptr != end))
+    {
+        printf("%s: decoded %ld rows out of %ld\n", shape.name, row, shape.nrows);
+        errors++;
+    }
+
+    if (rows != shape.rows)
+    {
+        printf("%s: the row event was modified while it was decoded\n", shape.name);
+        errors++;
+    }
+
+    return errors;
+}
+
+int check_temporal_format()
+{
+    static const int years[] = {-1900, -1899, -1850, -1, 0, 99, 118, 8099};
+    static const uint8_t types[] =
+    {
+        TABLE_COL_TYPE_DATETIME2, TABLE_COL_TYPE_DATE, TABLE_COL_TYPE_TIME2, TABLE_COL_TYPE_YEAR
+    };
+    static const char* formats[] = {"%Y-%m-%d %H:%M:%S", "%Y-%m-%d", "%H:%M:%S", "%Y"};
+    int errors = 0;
+
+    for (auto year : years)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            struct tm tm;
+            memset(&tm, 0, sizeof(tm));
+            tm.tm_year = year;
+            tm.tm_mon = year % 13 - 1;
+            tm.tm_mday = year % 32;
+            tm.tm_hour = year == 118 ? 838 : year % 24;
+            tm.tm_min = 59;
+
+            char expected[80];
+            char result[80];
+            strftime(expected, sizeof(expected), formats[i], &tm);
+            format_temporal_value(result, sizeof(result), types[i], &tm);
+
+            if (strcmp(expected, result) != 0)
+            {
+                printf("Temporal value formatted as '%s' instead of '%s'\n", result, expected);
+                errors++;
+            }
+        }
+    }
+
+    return errors;
+}
+
+// A stored column value, like the ones the avrorouter queues for its writers
+struct StoredValue
+{
+    int           index;
+    int           type;
+    int64_t       integer;
+    double        real;
+    std::string   str;
+    TemporalValue temporal;
+};
+
+// Stores every value through the per-column handlers: strings are copied
+// into new std::string objects and temporal values are formatted as text
+class StringHandler : public RowEventHandler
+{
+public:
+    void prepare_row(const gtid_pos_t& gtid, const REP_HEADER& hdr, int event_type)
+    {
+        m_values.clear();
+    }
+
+    bool commit(const gtid_pos_t& gtid)
+    {
+        return true;
+    }
+
+    void column(int i, int32_t value)
+    {
+        add(i, ColumnValue::INT).integer = value;
+    }
+
+    void column(int i, int64_t value)
+    {
+        add(i, ColumnValue::LONG).integer = value;
+    }
+
+    void column(int i, float value)
+    {
+        add(i, ColumnValue::FLOAT).real = value;
+    }
+
+    void column(int i, double value)
+    {
+        add(i, ColumnValue::DOUBLE).real = value;
+    }
+
+    void column(int i, std::string value)
+    {
+        add(i, ColumnValue::STRING).str = std::move(value);
+    }
+
+    void column(int i, uint8_t* value, int len)
+    {
+        add(i, ColumnValue::BYTES).str.assign((char*)value, len);
+    }
+
+    void column(int i)
+    {
+        add(i, ColumnValue::NUL);
+    }
+
+protected:
+    std::vector<StoredValue> m_values;
+
+    StoredValue& add(int i, int type)
+    {
+        m_values.emplace_back();
+        m_values.back().index = i;
+        m_values.back().type = type;
+        return m_values.back();
+    }
+};
+
+// Stores the typed values: the stored values are reused between rows and
+// temporal values are kept in their unpacked form
+class TypedHandler : public StringHandler
+{
+public:
+    void prepare_row(const gtid_pos_t& gtid, const REP_HEADER& hdr, int event_type)
+    {
+    }
+
+    void row(const ColumnValues& values)
+    {
+        m_values.resize(values.size());
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            StoredValue& stored = m_values[i];
+            const ColumnValue& value = values[i];
+            stored.index = value.index;
+            stored.type = value.type;
+            stored.integer = value.integer;
+            stored.real = value.real;
+
+            if (value.type == ColumnValue::STRING || value.type == ColumnValue::BYTES)
+            {
+                stored.str.assign(value.data, value.size);
+            }
+            else if (value.type == ColumnValue::TEMPORAL)
+            {
+                stored.temporal = value.temporal;
+            }
+        }
+    }
+};
+
+double bench(const Shape& shape, RowEventHandler* handler)
+{
+    Bytes present((shape.defs.size() + 7) / 8, 0xff);
+    Bytes rows = shape.rows;
+    ColumnValues values;
+    gtid_pos_t gtid;
+    REP_HEADER hdr = {};
+    uint8_t* end = rows.data() + rows.size();
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint8_t* ptr = rows.data(); ptr < end;)
+    {
+        handler->prepare_row(gtid, hdr, 0);
+        ptr = process_row_event_data(shape.map, shape.create, ptr, present.data(), end, values);
+        handler->row(values);
+        handler->commit(gtid);
+    }
+
+    std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+    return shape.nrows / secs.count();
+}
+}
+
+int main(int argc, char** argv)
+{
+    long nrows = argc > 1 ? strtol(argv[1], NULL, 10) : 20000;
+    int errors = check_temporal_format();
+    std::vector<Shape> shapes = make_shapes(nrows);
+
+    for (const auto& shape : shapes)
+    {
+        errors += check_shape(shape);
+    }
+
+    if (errors == 0)
+    {
+        for (const auto& shape : shapes)
+        {
+            StringHandler strings;
+            TypedHandler typed;
+            double str_rate = bench(shape, &strings);
+            double typed_rate = bench(shape, &typed);
+            printf("%-10s %3lu columns: strings %9.0f rows/s, typed %9.0f rows/s (%.1fx)\n",
+                   shape.name, shape.defs.size(), str_rate, typed_rate, typed_rate / str_rate);
+        }
+    }
+
+    return errors ? 1 : 0;
+}
@@ -118,6 +118,13 @@ static const MXS_ENUM_VALUE binlog_storage_values[] =
     {NULL}
 };
 
+static const MXS_ENUM_VALUE binlog_compression_values[] =
+{
+    {"none", BLR_COMPRESSION_NONE},
+    {"zlib", BLR_COMPRESSION_ZLIB},
+    {NULL}
+};
+
 /**
  * The module entry point routine. It is this routine that
  * must populate the structure that is referred to as the
@@ -155,7 +162,7 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
         "Binlogrouter",
         "V2.1.0",
         RCAP_TYPE_NO_RSESSION | RCAP_TYPE_CONTIGUOUS_OUTPUT
-        | RCAP_TYPE_RESULTSET_OUTPUT | RCAP_TYPE_NO_AUTH,
+        | RCAP_TYPE_RESULTSET_OUTPUT | RCAP_TYPE_NO_AUTH | RCAP_TYPE_COMPRESSION,
         &MyObject,
         NULL,                                           /* Process init. */
         NULL,                                           /* Process finish. */
@@ -211,6 +218,19 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
              DEF_LONG_BURST},
             {"burstsize",                                MXS_MODULE_PARAM_SIZE,
              DEF_BURST_SIZE},
+            {"event_cache_size",                         MXS_MODULE_PARAM_SIZE,
+             DEF_EVENT_CACHE_SIZE},
+            {"group_commit_delay",                       MXS_MODULE_PARAM_COUNT,
+             DEF_GROUP_COMMIT_DELAY},
+            {"group_commit_size",                        MXS_MODULE_PARAM_SIZE,
+             DEF_GROUP_COMMIT_SIZE},
+            {"send_durable_only",                        MXS_MODULE_PARAM_BOOL,
+             "false"},
+            {
+                "binlog_compression",                    MXS_MODULE_PARAM_ENUM,
+                "none",
+                MXS_MODULE_OPT_NONE,                     binlog_compression_values
+            },
             {"heartbeat",                                MXS_MODULE_PARAM_COUNT,
              BLR_HEARTBEAT_DEFAULT_INTERVAL},
             {"connect_retry",                            MXS_MODULE_PARAM_COUNT,
@@ -344,6 +364,13 @@ static MXS_ROUTER* createInstance(SERVICE* service, MXS_CONFIG_PARAMETER* params
     inst->short_burst = config_get_integer(params, "shortburst");
     inst->long_burst = config_get_integer(params, "longburst");
     inst->burst_size = config_get_size(params, "burstsize");
+    inst->event_cache_size = config_get_size(params, "event_cache_size");
+    inst->group_commit_delay = config_get_integer(params, "group_commit_delay");
+    inst->group_commit_size = config_get_size(params, "group_commit_size");
+    inst->send_durable_only = config_get_bool(params, "send_durable_only");
+    inst->binlog_compression = (enum blr_binlog_compression)config_get_enum(params,
+                                                                            "binlog_compression",
+                                                                            binlog_compression_values);
     inst->binlogdir = config_copy_string(params, "binlogdir");
     inst->heartbeat = config_get_integer(params, "heartbeat");
     inst->retry_interval = config_get_integer(params, "connect_retry");
@@ -795,6 +822,14 @@ static MXS_ROUTER* createInstance(SERVICE* service, MXS_CONFIG_PARAMETER* params
             free_instance(inst);
             return NULL;
         }
+
+        /* Load the GTID index */
+        if (!blr_gtid_index_open(inst))
+        {
+            sqlite3_close_v2(inst->gtid_maps);
+            free_instance(inst);
+            return NULL;
+        }
     }
 
     /* Dynamically allocate master_host server struct, not written in any cnf file */
@@ -984,6 +1019,9 @@ static MXS_ROUTER* createInstance(SERVICE* service, MXS_CONFIG_PARAMETER* params
      */
     blr_init_cache(inst);
 
+    /* Compress the binlog files that are no longer written */
+    blr_compress_start(inst);
+
     /*
      * Add tasks for statistic computation
      */
@@ -1150,6 +1188,11 @@ static void free_instance(ROUTER_INSTANCE* instance)
     MXS_FREE(instance->ssl_key);
     MXS_FREE(instance->ssl_version);
 
+    blr_file_stop_sync(instance);
+    blr_compress_stop(instance);
+    blr_free_cache(instance);
+    blr_gtid_index_close(instance);
+
     MXS_FREE(instance);
 }
 
@@ -1646,6 +1689,15 @@ static void diagnostics(MXS_ROUTER* router, DCB* dcb)
     dcb_printf(dcb,
                "\tNumber of residual data packets:             %u\n",
                router_inst->stats.n_residuals);
+    dcb_printf(dcb,
+               "\tNumber of events read from the event cache:  %lu\n",
+               router_inst->stats.n_cachehits);
+    dcb_printf(dcb,
+               "\tNumber of event cache misses:                %lu\n",
+               router_inst->stats.n_cachemisses);
+    dcb_printf(dcb,
+               "\tNumber of binlog syncs:                      %lu\n",
+               router_inst->stats.n_syncs);
     dcb_printf(dcb,
                "\tAverage events per packet:                   %.1f\n",
                router_inst->stats.n_reads != 0 ?
@@ -2101,6 +2153,9 @@ static json_t* diagnostics_json(const MXS_ROUTER* router)
     json_object_set_new(rval, "heartbeat_events", json_integer(router_inst->stats.n_heartbeats));
     json_object_set_new(rval, "events_read", json_integer(router_inst->stats.n_reads));
     json_object_set_new(rval, "residual_packets", json_integer(router_inst->stats.n_residuals));
+    json_object_set_new(rval, "event_cache_hits", json_integer(router_inst->stats.n_cachehits));
+    json_object_set_new(rval, "event_cache_misses", json_integer(router_inst->stats.n_cachemisses));
+    json_object_set_new(rval, "binlog_syncs", json_integer(router_inst->stats.n_syncs));
 
     double average_packets = router_inst->stats.n_reads != 0 ?
         ((double)router_inst->stats.n_binlogs / router_inst->stats.n_reads) : 0;
@@ -3022,8 +3077,15 @@ static void destroyInstance(MXS_ROUTER* instance)
                     inst->binlog_position);
     }
 
+    /* Sync the events a delayed sync would have covered */
+    blr_file_stop_sync(inst);
+
     /* Close GTID maps database */
     sqlite3_close_v2(inst->gtid_maps);
+    blr_gtid_index_close(inst);
+
+    blr_compress_stop(inst);
+    blr_free_cache(inst);
 }
 
 /**
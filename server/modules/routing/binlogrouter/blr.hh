@@ -27,6 +27,7 @@
 #include <stdint.h>
 #include <zlib.h>
 
+#include <atomic>
 #include <string>
 #include <thread>
 #include <vector>
@@ -74,6 +75,7 @@
 
 /* GTID slite3 database name */
 #define GTID_MAPS_DB "gtid_maps.db"
+#define GTID_INDEX_DIR "gtid_index"
 
 /* Number of reties for a missing binlog file */
 #define MISSING_FILE_READ_RETRIES 20
@@ -92,6 +94,13 @@ enum binlog_storage_type
     BLR_BINLOG_STORAGE_TREE
 };
 
+/** Compression of the binlog files that are no longer written */
+enum blr_binlog_compression
+{
+    BLR_COMPRESSION_NONE,
+    BLR_COMPRESSION_ZLIB
+};
+
 /** Conecting slave checks */
 enum blr_slave_check
 {
@@ -219,6 +228,17 @@ typedef enum
 #define DEF_LONG_BURST  "500"
 #define DEF_BURST_SIZE  "1024000"           /* 1 Mb */
 
+/**
+ * Default size of the cache of recently written events
+ */
+#define DEF_EVENT_CACHE_SIZE "4096000"      /* 4 Mb */
+
+/**
+ * Default group commit settings: the binlog is synced after every read from the master
+ */
+#define DEF_GROUP_COMMIT_DELAY "0"
+#define DEF_GROUP_COMMIT_SIZE  "0"
+
 /**
  * master reconnect backoff constants
  * BLR_MASTER_BACKOFF_TIME      The increments of the back off time (seconds)
@@ -505,6 +525,8 @@ typedef struct
     mutable pthread_mutex_t lock;   /*< The spinlock for the cache */
 } BLCACHE;
 
+struct BLR_COMPRESSED_FILE;
+
 typedef struct blfile
 {
     char binlog_name[BINLOG_FNAMELEN + 1];
@@ -514,6 +536,7 @@ typedef struct blfile
     BLCACHE*                cache;      /*< Record cache for this file */
     mutable pthread_mutex_t lock;       /*< The file lock */
     MARIADB_GTID_ELEMS      gtid_elms;  /*< Elements for file prefix */
+    BLR_COMPRESSED_FILE*    compressed; /*< The compressed file, NULL if not compressed */
     struct blfile*          next;       /*< Next file in list */
 } BLFILE;
 
@@ -646,6 +669,7 @@ typedef struct
     uint64_t n_rotates;         /*< Number of binlog rotate events */
     uint64_t n_cachehits;       /*< Number of hits on the binlog cache */
     uint64_t n_cachemisses;     /*< Number of misses on the binlog cache */
+    uint64_t n_syncs;           /*< Number of times the binlog was synced to disk */
     int      n_registered;      /*< Number of registered slaves */
     int      n_masterstarts;    /*< Number of times connection restarted */
     int      n_delayedreconnects;
@@ -739,6 +763,13 @@ typedef struct binlog_encryption_ctx
     char* binlog_file;              /**< Current binlog file being encrypted */
 } BINLOG_ENCRYPTION_CTX;
 
+/**
+ * The recently written events of the current binlog file, see blr_cache.cc
+ */
+struct BLR_EVENT_CACHE;
+struct BLR_GTID_INDEX;
+struct BLR_COMPRESSOR;
+
 /**
  * The per instance data for the router.
  */
@@ -798,6 +829,19 @@ struct ROUTER_INSTANCE : public MXS_ROUTER
     unsigned int            short_burst;/*< Short burst for slave catchup */
     unsigned int            long_burst; /*< Long burst for slave catchup */
     unsigned long           burst_size; /*< Maximum size of burst to send */
+    uint64_t                event_cache_size;   /*< Maximum size of the event cache, 0 if disabled */
+    BLR_EVENT_CACHE*        event_cache;        /*< Recent events, read by the slaves that
+                                                 *  are caught up */
+    int                     group_commit_delay; /*< Milliseconds a written event may wait
+                                                 *  for the binlog to be synced */
+    uint64_t                group_commit_size;  /*< Unsynced bytes that force a sync,
+                                                 *  0 for no limit */
+    bool                    send_durable_only;  /*< Send only synced events to the slaves */
+    uint64_t                synced_pos;         /*< Position up to which the current
+                                                 *  binlog file has been synced */
+    int64_t                 unsynced_since;     /*< When unsynced data was first seen, in
+                                                 *  milliseconds, 0 if all data is synced */
+    uint32_t                sync_dcid;          /*< Id of the pending delayed sync, 0 if none */
     unsigned long           heartbeat;  /*< Configured heartbeat value */
     ROUTER_STATS            stats;      /*< Statistics for this router */
     int                     active_logs;
@@ -838,7 +882,10 @@ struct ROUTER_INSTANCE : public MXS_ROUTER
                                                              */
     uint32_t                        mariadb10_gtid_domain;  /*< MariaDB 10 GTID Domain ID */
     sqlite3*                        gtid_maps;              /*< MariaDB 10 GTID storage */
+    BLR_GTID_INDEX*                 gtid_index;             /*< Positions of the MariaDB 10 GTIDs */
     enum binlog_storage_type        storage_type;           /*< Enables hierachical binlog file storage */
+    enum blr_binlog_compression     binlog_compression;     /*< Compression of the old binlog files */
+    BLR_COMPRESSOR*                 compressor;             /*< The binlog file compression thread */
     char*                           set_slave_hostname;     /*< Send custom Hostname to Master */
     ROUTER_INSTANCE*                next;
     std::vector<ChangeMasterConfig> configs;        /*< Available configs. */
@@ -1058,7 +1105,15 @@ extern void blr_slave_rotate(ROUTER_INSTANCE*,
 extern int blr_slave_catchup(ROUTER_INSTANCE* router,
                              ROUTER_SLAVE* slave,
                              bool large);
-extern void blr_init_cache(ROUTER_INSTANCE*);
+extern void   blr_init_cache(ROUTER_INSTANCE*);
+extern void   blr_free_cache(ROUTER_INSTANCE*);
+extern void   blr_cache_add_event(ROUTER_INSTANCE* router,
+                                  uint64_t pos,
+                                  const uint8_t* event,
+                                  uint32_t size);
+extern GWBUF* blr_cache_read_event(ROUTER_INSTANCE* router,
+                                   ROUTER_SLAVE* slave,
+                                   REP_HEADER* hdr);
 
 extern int blr_file_init(ROUTER_INSTANCE*);
 extern int blr_write_binlog_record(ROUTER_INSTANCE*,
@@ -1071,6 +1126,9 @@ extern int blr_file_rotate(ROUTER_INSTANCE*,
 extern int     blr_file_read_master_config(ROUTER_INSTANCE* router);
 extern int     blr_file_write_master_config(ROUTER_INSTANCE* router, char* error);
 extern void    blr_file_flush(ROUTER_INSTANCE*);
+extern void    blr_file_sync(ROUTER_INSTANCE*);
+extern void    blr_file_stop_sync(ROUTER_INSTANCE*);
+extern uint64_t blr_slave_safe_pos(const ROUTER_INSTANCE*);
 extern BLFILE* blr_open_binlog(ROUTER_INSTANCE*,
                                const char*,
                                const MARIADB_GTID_INFO*);
@@ -1132,6 +1190,62 @@ void blr_master_close(ROUTER_INSTANCE*);
 void blr_notify_all_slaves(ROUTER_INSTANCE* router);
 bool blr_save_mariadb_gtid(ROUTER_INSTANCE* inst);
 
+/** The GTID index, in blr_gtid_index.cc */
+bool blr_gtid_index_open(ROUTER_INSTANCE* router);
+void blr_gtid_index_close(ROUTER_INSTANCE* router);
+bool blr_gtid_index_add(ROUTER_INSTANCE* router,
+                        const MARIADB_GTID_ELEMS* gtid,
+                        uint64_t start,
+                        uint64_t end);
+void blr_gtid_index_sync(ROUTER_INSTANCE* router);
+bool blr_gtid_index_find(ROUTER_INSTANCE* router,
+                         const MARIADB_GTID_ELEMS* gtid,
+                         MARIADB_GTID_INFO* result);
+bool blr_gtid_index_last(ROUTER_INSTANCE* router, MARIADB_GTID_INFO* result);
+void blr_gtid_index_remove(ROUTER_INSTANCE* router, const char* file);
+
+/** A transaction with a MariaDB 10 GTID, found by the binlog scanner */
+struct BLR_SCAN_TRX
+{
+    MARIADB_GTID_ELEMS gtid;    /*< The GTID of the transaction */
+    uint64_t           start;   /*< Position of the GTID event */
+    uint64_t           end;     /*< Position after the transaction */
+};
+
+/** The result of scanning one binlog file */
+struct BLR_SCAN_RESULT
+{
+    std::string               path;             /*< The binlog file */
+    uint64_t                  size = 0;         /*< The file size */
+    uint64_t                  n_events = 0;     /*< Number of intact events */
+    uint64_t                  n_trx = 0;        /*< Number of complete transactions */
+    uint64_t                  end_pos = 0;      /*< Position after the last intact event */
+    uint64_t                  safe_pos = 0;     /*< Position after the last complete transaction */
+    bool                      checksum = false; /*< The events have a CRC32 checksum */
+    bool                      encrypted = false;/*< The events are encrypted */
+    std::string               error;            /*< The first error, empty if the file is intact */
+    std::vector<BLR_SCAN_TRX> trx;              /*< The transactions with a GTID */
+};
+
+/** Binlog file compression, in blr_compress.cc */
+void    blr_compress_start(ROUTER_INSTANCE* router);
+void    blr_compress_stop(ROUTER_INSTANCE* router);
+void    blr_compress_rotated(ROUTER_INSTANCE* router);
+bool    blr_compress_file(const char* path, const std::atomic<bool>* stop);
+bool    blr_compressed_open(int fd, BLR_COMPRESSED_FILE** file);
+void    blr_compressed_close(BLR_COMPRESSED_FILE* file);
+uint64_t blr_compressed_size(const BLR_COMPRESSED_FILE* file);
+ssize_t blr_compressed_pread(BLR_COMPRESSED_FILE* file, void* buf, size_t len, uint64_t pos);
+bool    blr_compressed_file_size(const char* path, uint64_t* size);
+
+/** The parallel binlog scanner, in blr_scan.cc */
+void   blr_scan_files(ROUTER_INSTANCE* router, std::vector<BLR_SCAN_RESULT>* files, int n_threads);
+GWBUF* blr_decrypt_event(ROUTER_INSTANCE* router,
+                         const uint8_t* event,
+                         uint32_t size,
+                         uint32_t pos,
+                         const uint8_t* nonce);
+
 /**
  * Handler for binlog events
  *
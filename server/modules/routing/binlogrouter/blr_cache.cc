@@ -19,9 +19,14 @@
  * mechanism to read the binlog entries for multiple slaves while requiring
  * only a single connection to the actual master to support the slaves.
  *
- * The current prototype implement is designed to support MySQL 5.6 and has
- * a number of limitations. This prototype is merely a proof of concept and
- * should not be considered production ready.
+ * The cache holds the most recent events written to the current binlog file.
+ * Every event is written once by the master connection, but it is read by every
+ * slave. A slave that has caught up with the master finds the events it needs
+ * in the cache and does not have to read, decrypt and check them from the file.
+ * Only the slaves lagging behind the cache read the binlog files.
+ *
+ * The events are stored as they were received from the master, that is,
+ * unencrypted, so they are identical to what blr_read_binlog() returns.
  */
 
 #include "blr.hh"
@@ -29,22 +34,227 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <maxbase/atomic.hh>
 #include <maxscale/service.h>
 #include <maxscale/server.h>
 #include <maxscale/router.h>
-#include <maxbase/atomic.h>
 #include <maxscale/dcb.h>
 
 #include <maxscale/log.h>
 
+extern uint32_t extract_field(uint8_t* src, int bits);
+extern bool     blr_is_current_binlog(ROUTER_INSTANCE* router,
+                                      ROUTER_SLAVE* slave);
+
+/**
+ * An event of the binlog file and its position in it.
+ */
+struct BLR_CACHED_EVENT
+{
+    uint64_t             pos;
+    std::vector<uint8_t> data;
+};
+
+struct BLR_EVENT_CACHE
+{
+    BLR_EVENT_CACHE(uint64_t max_size)
+        : max_size(max_size)
+        , size(0)
+    {
+        binlog_name[0] = '\0';
+        memset(&gtid_elms, 0, sizeof(gtid_elms));
+    }
+
+    std::mutex                   lock;
+    uint64_t                     max_size;      /*< Maximum total size of the events */
+    uint64_t                     size;          /*< Current total size of the events */
+    char                         binlog_name[BINLOG_FNAMELEN + 1];
+    MARIADB_GTID_ELEMS           gtid_elms;     /*< The file in the tree storage */
+    std::deque<BLR_CACHED_EVENT> events;        /*< In ascending order of position */
+};
+
+namespace
+{
+
+void cache_clear(BLR_EVENT_CACHE* cache)
+{
+    cache->events.clear();
+    cache->size = 0;
+}
 
 /**
- * Initialise the cache for this instanceof the binlog router. As a side
- * effect also determine the binlog file to read and the position to read
- * from.
+ * Check whether the cache holds the events of a particular binlog file.
+ */
+bool cache_holds_file(const ROUTER_INSTANCE* router,
+                      const BLR_EVENT_CACHE* cache,
+                      const MARIADB_GTID_ELEMS* gtid_elms,
+                      const char* binlog_name)
+{
+    return strcmp(cache->binlog_name, binlog_name) == 0
+           && (router->storage_type == BLR_BINLOG_STORAGE_FLAT
+               || (cache->gtid_elms.domain_id == gtid_elms->domain_id
+                   && cache->gtid_elms.server_id == gtid_elms->server_id));
+}
+
+bool event_is_before(const BLR_CACHED_EVENT& event, uint64_t pos)
+{
+    return event.pos < pos;
+}
+}
+
+/**
+ * Initialise the event cache for this instance of the binlog router.
  *
  * @param   router      The router instance
  */
 void blr_init_cache(ROUTER_INSTANCE* router)
 {
+    if (router->event_cache_size > 0)
+    {
+        router->event_cache = new BLR_EVENT_CACHE(router->event_cache_size);
+    }
+}
+
+/**
+ * Free the event cache of a router instance.
+ *
+ * @param   router      The router instance
+ */
+void blr_free_cache(ROUTER_INSTANCE* router)
+{
+    delete router->event_cache;
+    router->event_cache = NULL;
+}
+
+/**
+ * Add an event written to the current binlog file to the cache. The oldest
+ * events are dropped if the cache becomes too large. Called by the master
+ * connection after the event has been written to the file.
+ *
+ * @param   router      The router instance
+ * @param   pos         The position of the event in router->binlog_name
+ * @param   event       The unencrypted event, including the header
+ * @param   size        The size of the event
+ */
+void blr_cache_add_event(ROUTER_INSTANCE* router,
+                         uint64_t pos,
+                         const uint8_t* event,
+                         uint32_t size)
+{
+    BLR_EVENT_CACHE* cache = router->event_cache;
+
+    if (!cache)
+    {
+        return;
+    }
+
+    MARIADB_GTID_ELEMS gtid_elms = {};
+    gtid_elms.domain_id = router->mariadb10_gtid_domain;
+    gtid_elms.server_id = router->orig_masterid;
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+
+    if (!cache_holds_file(router, cache, &gtid_elms, router->binlog_name))
+    {
+        cache_clear(cache);
+        strcpy(cache->binlog_name, router->binlog_name);
+        cache->gtid_elms = gtid_elms;
+    }
+
+    /**
+     * If the file was truncated after a partial transaction, the events at
+     * and after the position are stale.
+     */
+    while (!cache->events.empty() && cache->events.back().pos >= pos)
+    {
+        cache->size -= cache->events.back().data.size();
+        cache->events.pop_back();
+    }
+
+    if (size > cache->max_size)
+    {
+        return;
+    }
+
+    while (cache->size + size > cache->max_size)
+    {
+        cache->size -= cache->events.front().data.size();
+        cache->events.pop_front();
+    }
+
+    cache->events.push_back(BLR_CACHED_EVENT {pos, std::vector<uint8_t>(event, event + size)});
+    cache->size += size;
+}
+
+/**
+ * Read the next event of a slave from the cache.
+ *
+ * Only events that blr_read_binlog() would return are returned: the event
+ * must be in the binlog file currently written and before the position of
+ * the last complete transaction.
+ *
+ * @param   router      The router instance
+ * @param   slave       The slave, whose binlog_name and binlog_pos are read
+ * @param   hdr         The header of the event is stored here
+ * @return  The event, or NULL if it is not in the cache
+ */
+GWBUF* blr_cache_read_event(ROUTER_INSTANCE* router,
+                            ROUTER_SLAVE* slave,
+                            REP_HEADER* hdr)
+{
+    BLR_EVENT_CACHE* cache = router->event_cache;
+
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&router->binlog_lock);
+    bool safe = blr_is_current_binlog(router, slave) && slave->binlog_pos < blr_slave_safe_pos(router);
+    pthread_mutex_unlock(&router->binlog_lock);
+
+    GWBUF* result = NULL;
+
+    if (safe)
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+
+        if (cache_holds_file(router, cache, &slave->f_info.gtid_elms, slave->binlog_name))
+        {
+            auto it = std::lower_bound(cache->events.begin(),
+                                       cache->events.end(),
+                                       slave->binlog_pos,
+                                       event_is_before);
+
+            if (it != cache->events.end() && it->pos == slave->binlog_pos)
+            {
+                result = gwbuf_alloc_and_load(it->data.size(), it->data.data());
+            }
+        }
+    }
+
+    if (result)
+    {
+        uint8_t* data = GWBUF_DATA(result);
+
+        hdr->timestamp = EXTRACT32(data);
+        hdr->event_type = data[4];
+        hdr->serverid = EXTRACT32(&data[5]);
+        hdr->event_size = extract_field(&data[9], 32);
+        hdr->next_pos = EXTRACT32(&data[13]);
+        hdr->flags = EXTRACT16(&data[17]);
+        hdr->ok = SLAVE_POS_READ_OK;
+
+        mxb::atomic::add(&router->stats.n_cachehits, 1, mxb::atomic::RELAXED);
+    }
+    else
+    {
+        mxb::atomic::add(&router->stats.n_cachemisses, 1, mxb::atomic::RELAXED);
+    }
+
+    return result;
 }
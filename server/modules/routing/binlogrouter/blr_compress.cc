@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file blr_compress.cc - binlog router binlog file compression
+ *
+ * Binlog files that are no longer written are compressed in the background.
+ * The binlog file being written and the one before it, which may still be
+ * truncated when a partial transaction is removed, are left as they are.
+ *
+ * A compressed file replaces the binlog file under the same name. It begins
+ * with a header, followed by the blocks of the original file compressed one
+ * by one and an index of the file offsets of the blocks. The events keep
+ * their positions, which are positions in the original file: a read at a
+ * position decompresses only the blocks it covers, so that slaves and the
+ * GTID index work with compressed files as they do with the others.
+ */
+
+#include "blr.hh"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <maxscale/log.h>
+
+namespace
+{
+
+const char COMPRESSED_MAGIC[8] = {'M', 'X', 'S', 'B', 'I', 'N', 'L', 'Z'};
+const uint32_t COMPRESSED_VERSION = 1;
+
+/** The size of the blocks the file is compressed in */
+const uint32_t COMPRESSED_BLOCK_SIZE = 64 * 1024;
+
+/** The number of decompressed blocks kept for each file */
+const int N_CACHED_BLOCKS = 4;
+
+struct CompressedHeader
+{
+    char     magic[8];      /*< COMPRESSED_MAGIC */
+    uint32_t version;       /*< COMPRESSED_VERSION */
+    uint32_t algorithm;     /*< The compression algorithm */
+    uint32_t block_size;    /*< Uncompressed size of a block */
+    uint32_t n_blocks;      /*< Number of blocks */
+    uint64_t size;          /*< Size of the original file */
+    uint64_t index_offset;  /*< Offset of the n_blocks + 1 block offsets */
+};
+
+static_assert(sizeof(CompressedHeader) == 40, "The header layout must not change");
+
+/** A request to compress the old binlog files of a directory */
+struct Sweep
+{
+    std::string dir;        /*< The directory of the binlog files */
+    std::string stem;       /*< The binlog file stem */
+    uint64_t    max_seq;    /*< The sequence number of the newest file to compress */
+};
+
+bool read_header(int fd, CompressedHeader* hdr)
+{
+    return pread(fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr)
+           && memcmp(hdr->magic, COMPRESSED_MAGIC, sizeof(COMPRESSED_MAGIC)) == 0;
+}
+
+bool write_all(int fd, const void* data, size_t len, uint64_t offset)
+{
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, ptr, len, offset);
+
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        ptr += n;
+        len -= n;
+        offset += n;
+    }
+
+    return true;
+}
+
+/**
+ * Check whether a binlog file is one the compressor can take.
+ *
+ * @return True if the file begins with the binlog magic
+ */
+bool is_plain_binlog(int fd)
+{
+    static const uint8_t magic[] = BINLOG_MAGIC;
+    uint8_t buf[BINLOG_MAGIC_SIZE];
+
+    return pread(fd, buf, sizeof(buf), 0) == sizeof(buf) && memcmp(buf, magic, sizeof(buf)) == 0;
+}
+}
+
+/** A compressed binlog file opened for reading */
+struct BLR_COMPRESSED_FILE
+{
+    struct Block
+    {
+        int64_t              n = -1;    /*< The block number, -1 if unused */
+        std::vector<uint8_t> data;      /*< The decompressed block */
+    };
+
+    int                   fd;
+    CompressedHeader      hdr;
+    std::vector<uint64_t> offsets;
+    std::mutex            lock;
+    Block                 cache[N_CACHED_BLOCKS];
+    int                   next_victim = 0;
+
+    const Block* get(uint64_t n);
+};
+
+/**
+ * Get a decompressed block. Must be called with the lock held.
+ *
+ * @param n    The block number
+ * @return     The block or NULL on error
+ */
+const BLR_COMPRESSED_FILE::Block* BLR_COMPRESSED_FILE::get(uint64_t n)
+{
+    for (const Block& block : cache)
+    {
+        if (block.n == (int64_t)n)
+        {
+            return &block;
+        }
+    }
+
+    Block& block = cache[next_victim];
+    next_victim = (next_victim + 1) % N_CACHED_BLOCKS;
+    block.n = -1;
+
+    uint64_t len = offsets[n + 1] - offsets[n];
+    std::vector<uint8_t> compressed(len);
+
+    if (pread(fd, compressed.data(), len, offsets[n]) != (ssize_t)len)
+    {
+        return NULL;
+    }
+
+    uLongf out_len = std::min<uint64_t>(hdr.block_size, hdr.size - n * hdr.block_size);
+    block.data.resize(out_len);
+
+    if (uncompress(block.data.data(), &out_len, compressed.data(), len) != Z_OK
+        || out_len != block.data.size())
+    {
+        return NULL;
+    }
+
+    block.n = n;
+    return &block;
+}
+
+/**
+ * Check whether an open binlog file is compressed and prepare it for reading.
+ *
+ * @param fd    The file descriptor
+ * @param file  Set to the compressed file, or NULL if the file is not compressed
+ * @return      False if the file is compressed but could not be read
+ */
+bool blr_compressed_open(int fd, BLR_COMPRESSED_FILE** file)
+{
+    *file = NULL;
+    CompressedHeader hdr;
+
+    if (!read_header(fd, &hdr))
+    {
+        return true;
+    }
+
+    if (hdr.version != COMPRESSED_VERSION
+        || hdr.algorithm != BLR_COMPRESSION_ZLIB
+        || hdr.block_size == 0
+        || hdr.n_blocks != (hdr.size + hdr.block_size - 1) / hdr.block_size)
+    {
+        MXS_ERROR("Unsupported compressed binlog file, version %u, algorithm %u.",
+                  hdr.version,
+                  hdr.algorithm);
+        return false;
+    }
+
+    BLR_COMPRESSED_FILE* rval = new BLR_COMPRESSED_FILE;
+    rval->fd = fd;
+    rval->hdr = hdr;
+    rval->offsets.resize(hdr.n_blocks + 1);
+    size_t len = rval->offsets.size() * sizeof(uint64_t);
+
+    if (pread(fd, rval->offsets.data(), len, hdr.index_offset) != (ssize_t)len)
+    {
+        MXS_ERROR("Failed to read the block index of a compressed binlog file: %s",
+                  mxs_strerror(errno));
+        delete rval;
+        return false;
+    }
+
+    *file = rval;
+    return true;
+}
+
+void blr_compressed_close(BLR_COMPRESSED_FILE* file)
+{
+    delete file;
+}
+
+/**
+ * @return The size of the original binlog file
+ */
+uint64_t blr_compressed_size(const BLR_COMPRESSED_FILE* file)
+{
+    return file->hdr.size;
+}
+
+/**
+ * Read from a compressed binlog file as if it were not compressed.
+ *
+ * @param file  The compressed file
+ * @param buf   Where the data is stored
+ * @param len   Number of bytes to read
+ * @param pos   Position in the original binlog file
+ * @return      Number of bytes read, 0 at the end of the file and -1 on error
+ */
+ssize_t blr_compressed_pread(BLR_COMPRESSED_FILE* file, void* buf, size_t len, uint64_t pos)
+{
+    uint8_t* ptr = static_cast<uint8_t*>(buf);
+    size_t total = 0;
+    std::lock_guard<std::mutex> guard(file->lock);
+
+    while (total < len && pos < file->hdr.size)
+    {
+        uint64_t n = pos / file->hdr.block_size;
+        const BLR_COMPRESSED_FILE::Block* block = file->get(n);
+
+        if (!block)
+        {
+            errno = EIO;
+            return -1;
+        }
+
+        uint64_t offset = pos - n * file->hdr.block_size;
+        size_t count = std::min<uint64_t>(len - total, block->data.size() - offset);
+        memcpy(ptr + total, block->data.data() + offset, count);
+        total += count;
+        pos += count;
+    }
+
+    return total;
+}
+
+/**
+ * Get the size of a binlog file, which may be compressed.
+ *
+ * @param path  The binlog file
+ * @param size  Set to the size of the original file if it is compressed
+ * @return      True if the file is compressed
+ */
+bool blr_compressed_file_size(const char* path, uint64_t* size)
+{
+    bool rval = false;
+    int fd = open(path, O_RDONLY);
+
+    if (fd != -1)
+    {
+        CompressedHeader hdr;
+
+        if (read_header(fd, &hdr))
+        {
+            *size = hdr.size;
+            rval = true;
+        }
+
+        close(fd);
+    }
+
+    return rval;
+}
+
+/**
+ * Compress a binlog file. The compressed file is written next to the binlog
+ * file and renamed over it once complete, so a reader sees either of them.
+ *
+ * @param path      The binlog file
+ * @param stop      If set during the compression, the compression is abandoned
+ * @return          True if the file was compressed or needed no compression
+ */
+bool blr_compress_file(const char* path, const std::atomic<bool>* stop)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        // Purged in the meantime
+        return errno == ENOENT;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1 || !is_plain_binlog(fd))
+    {
+        close(fd);
+        return true;
+    }
+
+    std::string tmp = std::string(path) + ".compressing";
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0660);
+
+    if (out == -1)
+    {
+        MXS_ERROR("Failed to create compressed binlog file '%s': %s",
+                  tmp.c_str(),
+                  mxs_strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    CompressedHeader hdr = {};
+    memcpy(hdr.magic, COMPRESSED_MAGIC, sizeof(hdr.magic));
+    hdr.version = COMPRESSED_VERSION;
+    hdr.algorithm = BLR_COMPRESSION_ZLIB;
+    hdr.block_size = COMPRESSED_BLOCK_SIZE;
+    hdr.size = st.st_size;
+    hdr.n_blocks = (hdr.size + hdr.block_size - 1) / hdr.block_size;
+
+    std::vector<uint64_t> offsets;
+    std::vector<uint8_t> in(hdr.block_size);
+    std::vector<uint8_t> compressed(compressBound(hdr.block_size));
+    uint64_t offset = sizeof(hdr);
+    bool ok = true;
+
+    for (uint64_t pos = 0; ok && pos < hdr.size; pos += hdr.block_size)
+    {
+        size_t len = std::min<uint64_t>(hdr.block_size, hdr.size - pos);
+        uLongf out_len = compressed.size();
+
+        ok = !*stop
+            && pread(fd, in.data(), len, pos) == (ssize_t)len
+            && compress2(compressed.data(), &out_len, in.data(), len, Z_DEFAULT_COMPRESSION) == Z_OK
+            && write_all(out, compressed.data(), out_len, offset);
+
+        offsets.push_back(offset);
+        offset += out_len;
+    }
+
+    offsets.push_back(offset);
+    hdr.index_offset = offset;
+
+    ok = ok
+        && write_all(out, offsets.data(), offsets.size() * sizeof(uint64_t), offset)
+        && write_all(out, &hdr, sizeof(hdr), 0)
+        && fdatasync(out) == 0;
+
+    close(out);
+    close(fd);
+
+    // A binlog file purged during the compression must not be recreated
+    if (ok && access(path, F_OK) == 0 && rename(tmp.c_str(), path) == 0)
+    {
+        MXS_NOTICE("Compressed binlog file '%s' from %lu to %lu bytes.",
+                   path,
+                   hdr.size,
+                   offset + offsets.size() * sizeof(uint64_t));
+        return true;
+    }
+
+    if (ok || !*stop)
+    {
+        MXS_ERROR("Failed to compress binlog file '%s': %s", path, mxs_strerror(errno));
+    }
+
+    unlink(tmp.c_str());
+    return false;
+}
+
+/** The thread compressing the binlog files of a router */
+struct BLR_COMPRESSOR
+{
+    std::mutex              lock;
+    std::condition_variable cond;
+    std::deque<Sweep>       queue;
+    std::atomic<bool>       stop {false};
+    std::thread             thread;
+
+    void run();
+    void sweep(const Sweep& sweep);
+};
+
+void BLR_COMPRESSOR::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    while (true)
+    {
+        cond.wait(guard, [this]() {
+                      return stop || !queue.empty();
+                  });
+
+        if (stop)
+        {
+            break;
+        }
+
+        Sweep s = queue.front();
+        queue.pop_front();
+
+        guard.unlock();
+        sweep(s);
+        guard.lock();
+    }
+}
+
+void BLR_COMPRESSOR::sweep(const Sweep& s)
+{
+    std::vector<std::string> files;
+    DIR* dir = opendir(s.dir.c_str());
+
+    if (!dir)
+    {
+        return;
+    }
+
+    struct dirent* ent;
+
+    while ((ent = readdir(dir)))
+    {
+        const char* name = ent->d_name;
+        size_t stem_len = s.stem.length();
+
+        if (strncmp(name, s.stem.c_str(), stem_len) == 0
+            && name[stem_len] == '.'
+            && name[stem_len + 1]
+            && strspn(name + stem_len + 1, "0123456789") == strlen(name + stem_len + 1)
+            && strtoull(name + stem_len + 1, NULL, 10) <= s.max_seq)
+        {
+            files.push_back(s.dir + name);
+        }
+    }
+
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+
+    for (const auto& file : files)
+    {
+        if (stop || !blr_compress_file(file.c_str(), &stop))
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Start the thread compressing the binlog files, if compression is enabled.
+ * The old binlog files that are not yet compressed are compressed.
+ *
+ * @param router    The router instance
+ */
+void blr_compress_start(ROUTER_INSTANCE* router)
+{
+    if (router->binlog_compression == BLR_COMPRESSION_NONE || router->compressor)
+    {
+        return;
+    }
+
+    BLR_COMPRESSOR* compressor = new BLR_COMPRESSOR;
+    compressor->thread = std::thread([compressor]() {
+                                         compressor->run();
+                                     });
+    router->compressor = compressor;
+
+    blr_compress_rotated(router);
+}
+
+/**
+ * Stop the compression thread. A file being compressed is left as it was.
+ *
+ * @param router    The router instance
+ */
+void blr_compress_stop(ROUTER_INSTANCE* router)
+{
+    BLR_COMPRESSOR* compressor = router->compressor;
+
+    if (compressor)
+    {
+        {
+            std::lock_guard<std::mutex> guard(compressor->lock);
+            compressor->stop = true;
+        }
+
+        compressor->cond.notify_one();
+        compressor->thread.join();
+        delete compressor;
+        router->compressor = NULL;
+    }
+}
+
+/**
+ * Queue the binlog files older than the previous binlog file for compression.
+ * Called when a new binlog file is created.
+ *
+ * @param router    The router instance
+ */
+void blr_compress_rotated(ROUTER_INSTANCE* router)
+{
+    BLR_COMPRESSOR* compressor = router->compressor;
+    const char* seq = strrchr(router->binlog_name, '.');
+
+    if (!compressor || !seq || !router->fileroot)
+    {
+        return;
+    }
+
+    uint64_t current = strtoull(seq + 1, NULL, 10);
+
+    if (current < 3)
+    {
+        return;
+    }
+
+    Sweep s;
+    s.dir = std::string(router->binlogdir) + "/";
+    s.stem = router->fileroot;
+    s.max_seq = current - 2;
+
+    if (router->mariadb10_compat
+        && router->mariadb10_master_gtid
+        && router->storage_type == BLR_BINLOG_STORAGE_TREE)
+    {
+        char prefix[BINLOG_FILE_EXTRA_INFO];
+        snprintf(prefix,
+                 sizeof(prefix),
+                 "%" PRIu32 "/%" PRIu32 "/",
+                 router->mariadb10_gtid_domain,
+                 router->orig_masterid);
+        s.dir += prefix;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(compressor->lock);
+        compressor->queue.push_back(s);
+    }
+
+    compressor->cond.notify_one();
+}
@@ -378,9 +378,12 @@ bool blr_handle_one_event(MXS_ROUTER* instance, REP_HEADER& hdr, uint8_t* ptr, u
                             strcpy(router->last_mariadb_gtid,
                                    router->pending_transaction.gtid);
                             /**
-                             * Save MariaDB GTID into repo
+                             * Add MariaDB GTID into the GTID index
                              */
-                            blr_save_mariadb_gtid(router);
+                            blr_gtid_index_add(router,
+                                               &router->pending_transaction.gtid_elms,
+                                               router->pending_transaction.start_pos,
+                                               router->pending_transaction.end_pos);
                         }
                     }
 
@@ -27,6 +27,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <memory>
 
 #include <ini.h>
 
@@ -41,6 +42,9 @@
 #include <maxscale/server.h>
 #include <maxscale/service.h>
 #include <maxscale/utils.h>
+#include <maxscale/routingworker.h>
+#include <maxbase/stopwatch.hh>
+#include <maxbase/worker.hh>
 
 using std::string;
 using std::vector;
@@ -525,6 +529,8 @@ static int blr_file_create(ROUTER_INSTANCE* router, char* orig_file)
     {
         if (blr_file_add_magic(fd))
         {
+            /* The slaves must be able to read all of the previous file */
+            blr_file_sync(router);
             close(router->binlog_fd);
             pthread_mutex_lock(&router->binlog_lock);
 
@@ -539,10 +545,16 @@ static int blr_file_create(ROUTER_INSTANCE* router, char* orig_file)
             router->binlog_position = BINLOG_MAGIC_SIZE;
             router->current_safe_event = BINLOG_MAGIC_SIZE;
             router->last_written = BINLOG_MAGIC_SIZE;
+            /* Nothing past the magic exists yet, so nothing is unsynced */
+            router->synced_pos = BINLOG_MAGIC_SIZE;
             pthread_mutex_unlock(&router->binlog_lock);
 
+            router->unsynced_since = 0;
             created = 1;
 
+            /* The file before the previous one can no longer change */
+            blr_compress_rotated(router);
+
             /**
              * Add an entry in GTID repo with size 4
              * and router->orig_masterid.
@@ -628,10 +640,12 @@ void blr_file_append(ROUTER_INSTANCE* router, char* file)
         return;
     }
     fsync(fd);
+    blr_file_sync(router);
     close(router->binlog_fd);
     pthread_mutex_lock(&router->binlog_lock);
     memmove(router->binlog_name, file, BINLOG_FNAMELEN);
     router->current_pos = lseek(fd, 0L, SEEK_END);
+    router->synced_pos = router->current_pos;
     if (router->current_pos < 4)
     {
         if (router->current_pos == 0)
@@ -742,6 +756,8 @@ int blr_write_binlog_record(ROUTER_INSTANCE* router,
                    router->last_written);
     }
 
+    uint64_t event_pos = router->last_written;
+
     /* Check write operation result*/
     if (n != static_cast<int>(size))
     {
@@ -763,6 +779,9 @@ int blr_write_binlog_record(ROUTER_INSTANCE* router,
         return 0;
     }
 
+    /* Keep the unencrypted event for the slaves */
+    blr_cache_add_event(router, event_pos, buf, size);
+
     /* Increment offsets */
     pthread_mutex_lock(&router->binlog_lock);
     router->current_pos = hdr->next_pos;
@@ -798,14 +817,175 @@ int blr_write_binlog_record(ROUTER_INSTANCE* router,
     return n;
 }
 
+/**
+ * Milliseconds from an arbitrary point in time, for timing the syncs.
+ */
+static int64_t blr_sync_clock()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        mxb::Clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Delayed call that syncs the binlog when the group commit delay has passed.
+ */
+static bool blr_file_sync_cb(mxb::Worker::Call::action_t action, ROUTER_INSTANCE* router)
+{
+    router->sync_dcid = 0;
+
+    if (action == mxb::Worker::Call::EXECUTE && router->synced_pos < router->last_written)
+    {
+        blr_file_sync(router);
+
+        if (router->send_durable_only)
+        {
+            blr_notify_all_slaves(router);
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Sync the events written so far into the current binlog file to disk.
+ *
+ * Must be called in the thread writing the binlog file.
+ *
+ * @param   router  The binlog router
+ */
+void blr_file_sync(ROUTER_INSTANCE* router)
+{
+    if (router->binlog_fd == -1)
+    {
+        return;
+    }
+
+    uint64_t pos = router->last_written;
+
+    if (fdatasync(router->binlog_fd) == 0)
+    {
+        pthread_mutex_lock(&router->binlog_lock);
+        router->synced_pos = pos;
+        pthread_mutex_unlock(&router->binlog_lock);
+
+        router->unsynced_since = 0;
+        router->stats.n_syncs++;
+
+        blr_gtid_index_sync(router);
+    }
+    else
+    {
+        MXS_ERROR("%s: Failed to sync binlog file %s, %s.",
+                  router->service->name,
+                  router->binlog_name,
+                  mxs_strerror(errno));
+    }
+}
+
+/**
+ * Cancel the pending delayed sync and sync the binlog file.
+ *
+ * Called before the router instance is freed, so that a pending group commit
+ * neither loses the events waiting for it nor fires on a freed instance. The
+ * delayed call can only be cancelled in the main worker, so the work is done
+ * there unless the worker has already stopped.
+ *
+ * @param   router  The binlog router
+ */
+void blr_file_stop_sync(ROUTER_INSTANCE* router)
+{
+    mxb::Worker* worker = (mxb::Worker*)mxs_rworker_get(MXS_RWORKER_MAIN);
+
+    auto stop = [router, worker]() {
+            if (router->sync_dcid)
+            {
+                worker->cancel_delayed_call(router->sync_dcid);
+                router->sync_dcid = 0;
+            }
+
+            blr_file_sync(router);
+        };
+
+    if (worker == mxb::Worker::get_current() || worker->state() == mxb::Worker::STOPPED)
+    {
+        stop();
+    }
+    else
+    {
+        worker->call(stop, mxb::Worker::EXECUTE_QUEUED);
+    }
+}
+
 /**
  * Flush the content of the binlog file to disk.
  *
+ * With group commit configured, the file is synced only when the unsynced
+ * data has waited for group_commit_delay milliseconds or when there is more
+ * than group_commit_size bytes of it. Otherwise a delayed call is scheduled
+ * that syncs the file once the delay has passed, so that the events written
+ * during the delay share a single sync.
+ *
+ * Called in the main worker, after the events of a packet from the master
+ * have been written.
+ *
  * @param   router  The binlog router
  */
 void blr_file_flush(ROUTER_INSTANCE* router)
 {
-    fsync(router->binlog_fd);
+    if (router->binlog_fd == -1 || router->synced_pos >= router->last_written)
+    {
+        return;
+    }
+
+    int64_t now = blr_sync_clock();
+
+    if (router->unsynced_since == 0)
+    {
+        router->unsynced_since = now;
+    }
+
+    int64_t waited = now - router->unsynced_since;
+    uint64_t unsynced = router->last_written - router->synced_pos;
+
+    if (router->group_commit_delay == 0
+        || waited >= router->group_commit_delay
+        || (router->group_commit_size && unsynced >= router->group_commit_size))
+    {
+        blr_file_sync(router);
+
+        if (router->send_durable_only)
+        {
+            /* The synced events can now be sent */
+            blr_notify_all_slaves(router);
+        }
+    }
+    else if (router->sync_dcid == 0)
+    {
+        mxb::Worker* worker = (mxb::Worker*)mxs_rworker_get(MXS_RWORKER_MAIN);
+        mxb_assert(worker == (mxb::Worker*)mxs_rworker_get_current());
+
+        router->sync_dcid = worker->delayed_call(router->group_commit_delay - waited,
+                                                 blr_file_sync_cb,
+                                                 router);
+    }
+}
+
+/**
+ * The position in the current binlog file up to which the slaves can be sent
+ * events. Should be called with router->binlog_lock held.
+ *
+ * @param   router  The binlog router
+ * @return  The latest committed position or, if only synced events are
+ *          sent, the synced position if that is smaller
+ */
+uint64_t blr_slave_safe_pos(const ROUTER_INSTANCE* router)
+{
+    if (router->send_durable_only && router->synced_pos < router->binlog_position)
+    {
+        return router->synced_pos;
+    }
+
+    return router->binlog_position;
 }
 
 /**
@@ -948,6 +1128,15 @@ BLFILE* blr_open_binlog(ROUTER_INSTANCE* router,
         return NULL;
     }
 
+    if (!blr_compressed_open(file->fd, &file->compressed))
+    {
+        MXS_ERROR("Failed to open compressed binlog file %s", path);
+        close(file->fd);
+        MXS_FREE(file);
+        pthread_mutex_unlock(&router->fileslock);
+        return NULL;
+    }
+
     file->next = router->files;
     router->files = file;
     pthread_mutex_unlock(&router->fileslock);
@@ -955,6 +1144,22 @@ BLFILE* blr_open_binlog(ROUTER_INSTANCE* router,
     return file;
 }
 
+/**
+ * Read from a binlog file opened with blr_open_binlog(), which may be compressed.
+ *
+ * @param file  File record
+ * @param buf   Where the data is stored
+ * @param len   Number of bytes to read
+ * @param pos   Position in the binlog file
+ * @return      Number of bytes read, -1 on error
+ */
+static ssize_t blr_file_pread(BLFILE* file, void* buf, size_t len, uint64_t pos)
+{
+    return file->compressed ?
+           blr_compressed_pread(file->compressed, buf, len, pos) :
+           pread(file->fd, buf, len, pos);
+}
+
 /**
  * Read a replication event into a GWBUF structure.
  *
@@ -995,7 +1200,11 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
     }
 
     pthread_mutex_lock(&file->lock);
-    if (fstat(file->fd, &statb) == 0)
+    if (file->compressed)
+    {
+        filelen = blr_compressed_size(file->compressed);
+    }
+    else if (fstat(file->fd, &statb) == 0)
     {
         filelen = statb.st_size;
     }
@@ -1056,12 +1265,14 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
     pthread_mutex_lock(&router->binlog_lock);
     pthread_mutex_lock(&file->lock);
 
+    uint64_t safe_pos = blr_slave_safe_pos(router);
+
     /* Check current router file and router position */
     if (blr_compare_binlogs(router,
                             &file->gtid_elms,
                             router->binlog_name,
                             file->binlog_name)
-        && pos >= router->binlog_position)
+        && pos >= safe_pos)
     {
         if (pos > router->binlog_position)
         {
@@ -1070,14 +1281,19 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
                      "Requested binlog position %lu is unsafe. "
                      "Latest safe position %lu, end of binlog file %lu",
                      pos,
-                     router->binlog_position,
+                     safe_pos,
                      router->current_pos);
 
             hdr->ok = SLAVE_POS_READ_UNSAFE;
         }
         else
         {
-            /* accessing last position is ok */
+            /**
+             * Accessing the last position is ok. With send_durable_only
+             * the events between the synced position and the binlog
+             * position are valid but not yet durable: the slave waits
+             * for the next sync to notify it.
+             */
             hdr->ok = SLAVE_POS_READ_OK;
         }
 
@@ -1091,10 +1307,10 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
     pthread_mutex_unlock(&router->binlog_lock);
 
     /* Read the header information from the file */
-    if ((n = pread(file->fd,
-                   hdbuf,
-                   BINLOG_EVENT_HDR_LEN,
-                   pos)) != BINLOG_EVENT_HDR_LEN)
+    if ((n = blr_file_pread(file,
+                            hdbuf,
+                            BINLOG_EVENT_HDR_LEN,
+                            pos)) != BINLOG_EVENT_HDR_LEN)
     {
         switch (n)
         {
@@ -1175,10 +1391,10 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
                       router->binlog_position,
                       router->binlog_name);
 
-            if ((n = pread(file->fd,
-                           hdbuf,
-                           BINLOG_EVENT_HDR_LEN,
-                           pos)) != BINLOG_EVENT_HDR_LEN)
+            if ((n = blr_file_pread(file,
+                                    hdbuf,
+                                    BINLOG_EVENT_HDR_LEN,
+                                    pos)) != BINLOG_EVENT_HDR_LEN)
             {
                 switch (n)
                 {
@@ -1279,10 +1495,10 @@ GWBUF* blr_read_binlog(ROUTER_INSTANCE* router,
 
     memcpy(data, hdbuf, BINLOG_EVENT_HDR_LEN);      // Copy the header in the buffer
 
-    if ((n = pread(file->fd,
-                   &data[BINLOG_EVENT_HDR_LEN],
-                   hdr->event_size - BINLOG_EVENT_HDR_LEN,
-                   pos + BINLOG_EVENT_HDR_LEN))
+    if ((n = blr_file_pread(file,
+                            &data[BINLOG_EVENT_HDR_LEN],
+                            hdr->event_size - BINLOG_EVENT_HDR_LEN,
+                            pos + BINLOG_EVENT_HDR_LEN))
         != static_cast<ssize_t>(hdr->event_size - BINLOG_EVENT_HDR_LEN))    // Read the balance
     {
         if (n == 0)
@@ -1442,6 +1658,7 @@ void blr_close_binlog(ROUTER_INSTANCE* router, BLFILE* file)
 
     if (file)
     {
+        blr_compressed_close(file->compressed);
         close(file->fd);
         file->fd = -1;
         MXS_FREE(file);
@@ -1479,7 +1696,11 @@ unsigned long blr_file_size(BLFILE* file)
 {
     struct stat statb;
 
-    if (fstat(file->fd, &statb) == 0)
+    if (file->compressed)
+    {
+        return blr_compressed_size(file->compressed);
+    }
+    else if (fstat(file->fd, &statb) == 0)
     {
         return statb.st_size;
     }
@@ -1761,10 +1982,26 @@ int blr_file_next_exists(ROUTER_INSTANCE* router,
     return 1;
 }
 
+/**
+ * Read from a binlog file being checked, which may be compressed.
+ *
+ * @param fd          The binlog file
+ * @param compressed  The compressed file or NULL if the file is not compressed
+ * @return            Number of bytes read, 0 at the end of the file and -1 on error
+ */
+static ssize_t blr_check_pread(int fd, BLR_COMPRESSED_FILE* compressed, void* buf, size_t len, uint64_t pos)
+{
+    return compressed ?
+           blr_compressed_pread(compressed, buf, len, pos) :
+           pread(fd, buf, len, pos);
+}
+
 /**
  * Read all replication events from a binlog file.
  *
- * Routine detects errors and pending transactions
+ * Routine detects errors and pending transactions. A compressed
+ * binlog file is read through the decompressing reader and can
+ * only be checked: fixing it would truncate the compressed data.
  *
  * @param router    The router instance
  * @param action    Whether to fix errors or blank events at pos
@@ -1821,7 +2058,30 @@ int blr_read_events_all_events(ROUTER_INSTANCE* router,
         return 1;
     }
 
-    if (fstat(router->binlog_fd, &statb) == 0)
+    BLR_COMPRESSED_FILE* compressed_file;
+
+    if (!blr_compressed_open(router->binlog_fd, &compressed_file))
+    {
+        MXS_ERROR("Failed to open compressed binlog file %s", router->binlog_name);
+        return 1;
+    }
+
+    std::unique_ptr<BLR_COMPRESSED_FILE, void (*)(BLR_COMPRESSED_FILE*)>
+    compressed(compressed_file, blr_compressed_close);
+
+    if (compressed && fix)
+    {
+        MXS_ERROR("Binlog file %s is compressed and cannot be fixed, "
+                  "it can only be checked.",
+                  router->binlog_name);
+        return 1;
+    }
+
+    if (compressed)
+    {
+        filelen = blr_compressed_size(compressed.get());
+    }
+    else if (fstat(router->binlog_fd, &statb) == 0)
     {
         filelen = statb.st_size;
     }
@@ -1834,10 +2094,11 @@ int blr_read_events_all_events(ROUTER_INSTANCE* router,
     {
 
         /* Read the header information from the file */
-        if ((n = pread(router->binlog_fd,
-                       hdbuf,
-                       BINLOG_EVENT_HDR_LEN,
-                       pos)) != BINLOG_EVENT_HDR_LEN)
+        if ((n = blr_check_pread(router->binlog_fd,
+                                 compressed.get(),
+                                 hdbuf,
+                                 BINLOG_EVENT_HDR_LEN,
+                                 pos)) != BINLOG_EVENT_HDR_LEN)
         {
             switch (n)
             {
@@ -2144,10 +2405,11 @@ int blr_read_events_all_events(ROUTER_INSTANCE* router,
         memcpy(data, hdbuf, BINLOG_EVENT_HDR_LEN);      // Copy the header in
 
         /* Read event data */
-        n = pread(router->binlog_fd,
-                  &data[BINLOG_EVENT_HDR_LEN],
-                  hdr.event_size - BINLOG_EVENT_HDR_LEN,
-                  pos + BINLOG_EVENT_HDR_LEN);
+        n = blr_check_pread(router->binlog_fd,
+                            compressed.get(),
+                            &data[BINLOG_EVENT_HDR_LEN],
+                            hdr.event_size - BINLOG_EVENT_HDR_LEN,
+                            pos + BINLOG_EVENT_HDR_LEN);
         if (n != static_cast<ssize_t>(hdr.event_size - BINLOG_EVENT_HDR_LEN))
         {
             if (n == -1)
@@ -4078,6 +4340,40 @@ static GWBUF* blr_prepare_encrypted_event(ROUTER_INSTANCE* router,
     return encrypted;
 }
 
+/**
+ * Decrypt a binlog event without modifying it
+ *
+ * @param router    The router instance with the encryption key
+ * @param event     The encrypted event
+ * @param size      The event size (CRC32 four bytes included)
+ * @param pos       The position of the event in binlog file
+ * @param nonce     The nonce of the START_ENCRYPTION event of the binlog file
+ * @return          A GWBUF buffer with the decrypted event or NULL on error
+ */
+GWBUF* blr_decrypt_event(ROUTER_INSTANCE* router,
+                         const uint8_t* event,
+                         uint32_t size,
+                         uint32_t pos,
+                         const uint8_t* nonce)
+{
+    /* The event is rearranged in place before decryption, so work on a copy */
+    GWBUF* copy = gwbuf_alloc_and_load(size, event);
+    GWBUF* decrypted = NULL;
+
+    if (copy)
+    {
+        decrypted = blr_prepare_encrypted_event(router,
+                                                GWBUF_DATA(copy),
+                                                size,
+                                                pos,
+                                                nonce,
+                                                BINLOG_FLAG_DECRYPT);
+        gwbuf_free(copy);
+    }
+
+    return decrypted;
+}
+
 /**
  * Return the encryption algorithm string
  *
@@ -4592,8 +4888,13 @@ unsigned int blr_file_get_next_seqno(const char* filename)
 uint32_t blr_slave_get_file_size(const char* filename)
 {
     struct stat statb;
+    uint64_t size;
 
-    if (stat(filename, &statb) == 0)
+    if (blr_compressed_file_size(filename, &size))
+    {
+        return size;
+    }
+    else if (stat(filename, &statb) == 0)
     {
         return statb.st_size;
     }
@@ -4652,7 +4953,7 @@ bool blr_parse_gtid(const char* gtid, MARIADB_GTID_ELEMS* info)
 }
 
 /**
- * Get MariaDB GTID from repo
+ * Get last MariaDB GTID from the GTID index or from repo
  *
  * @param    router  The current router instance
  * @param    result  The (allocated) ouput data to fill
@@ -4664,6 +4965,12 @@ bool blr_parse_gtid(const char* gtid, MARIADB_GTID_ELEMS* info)
 bool blr_load_last_mariadb_gtid(ROUTER_INSTANCE* router,
                                 MARIADB_GTID_INFO* result)
 {
+    /* Only the binlog files of older versions have their GTIDs in repo */
+    if (blr_gtid_index_last(router, result))
+    {
+        return true;
+    }
+
     char* errmsg = NULL;
     MARIADB_GTID_ELEMS gtid_elms = {};
     static const char last_gtid[] = "SELECT "
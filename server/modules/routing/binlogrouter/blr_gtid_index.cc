@@ -0,0 +1,826 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file blr_gtid_index.cc - binlog router GTID index
+ *
+ * The GTID index maps the MariaDB GTIDs of the transactions in the binlog files
+ * to their positions. A slave registering with a GTID is sent events from the
+ * position found in the index.
+ *
+ * Every binlog file has an index file of its own, stored under GTID_INDEX_DIR in
+ * the binlog directory using the same relative path as the binlog file. An index
+ * file is a header followed by fixed size records, one per transaction, appended
+ * in the order the transactions are written into the binlog file. Within a
+ * replication domain the sequence numbers grow, so the records of a domain are
+ * sorted by sequence number.
+ *
+ * The index files are memory mapped. For each file and domain, every
+ * GTID_INDEX_SAMPLE_INTERVAL'th record is kept in memory, so a GTID is found
+ * with a binary search of these samples followed by a short scan of the mapped
+ * records. Adding a transaction copies one record into the mapping of the file
+ * being written; the file is extended only when its preallocated space runs out.
+ *
+ * The GTID maps database used by older versions is only read, for the GTIDs
+ * of binlog files written before the index existed.
+ */
+
+#include "blr.hh"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <maxscale/log.h>
+#include <maxscale/service.h>
+#include <maxscale/utils.h>
+
+namespace
+{
+
+const char     GTID_INDEX_MAGIC[8] = {'M', 'X', 'S', 'G', 'T', 'I', 'D', 'X'};
+const uint32_t GTID_INDEX_VERSION = 1;
+const uint64_t GTID_INDEX_SAMPLE_INTERVAL = 64;
+const size_t   GTID_INDEX_MIN_GROWTH = 64 * 1024;
+const size_t   GTID_INDEX_MAX_GROWTH = 16 * 1024 * 1024;
+
+/**
+ * The header of an index file. As large as a record, so that no record
+ * straddles a page boundary.
+ */
+struct IndexHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint8_t  unused[16];
+};
+
+/**
+ * A transaction in a binlog file. A record with end_pos 0 is unused space at
+ * the end of the file.
+ */
+struct IndexRecord
+{
+    uint32_t domain_id;
+    uint32_t server_id;
+    uint64_t seq_no;
+    uint64_t start_pos;     /*< Position of the GTID event */
+    uint64_t end_pos;       /*< Position after the COMMIT */
+};
+
+static_assert(sizeof(IndexHeader) == sizeof(IndexRecord), "The header must be as large as a record");
+static_assert(sizeof(IndexRecord) == 32, "The records must not straddle pages");
+
+/**
+ * A record of a domain and its sequence number.
+ */
+struct Sample
+{
+    uint64_t seq_no;
+    uint64_t record;
+};
+
+/**
+ * The summary of the records of one domain in an index file.
+ */
+struct DomainSummary
+{
+    uint64_t            min_seq = UINT64_MAX;
+    uint64_t            max_seq = 0;
+    uint64_t            n_records = 0;
+    bool                ordered = true;     /*< Whether the sequence numbers grow */
+    std::vector<Sample> samples;            /*< Every GTID_INDEX_SAMPLE_INTERVAL'th record */
+};
+
+struct IndexFile
+{
+    std::string name;               /*< Relative path of the binlog file */
+    std::string binlog;             /*< The binlog file name */
+    int         fd = -1;            /*< Open only while the binlog file is written */
+    uint8_t*    map = nullptr;
+    size_t      map_size = 0;
+    uint64_t    n_records = 0;
+    uint64_t    n_synced = 0;       /*< Records synced to disk */
+    std::unordered_map<uint32_t, DomainSummary> domains;
+
+    IndexRecord* records() const
+    {
+        return reinterpret_cast<IndexRecord*>(map + sizeof(IndexHeader));
+    }
+
+    uint64_t capacity() const
+    {
+        return map_size > sizeof(IndexHeader) ?
+               (map_size - sizeof(IndexHeader)) / sizeof(IndexRecord) : 0;
+    }
+};
+}
+
+struct BLR_GTID_INDEX
+{
+    std::mutex           lock;
+    std::string          dir;               /*< The directory of the index files */
+    std::list<IndexFile> files;             /*< Least recently written first */
+    IndexFile*           current = nullptr; /*< The file being written */
+};
+
+namespace
+{
+
+void summarize(IndexFile* file, uint64_t i)
+{
+    const IndexRecord& rec = file->records()[i];
+    DomainSummary& domain = file->domains[rec.domain_id];
+
+    if (domain.n_records && rec.seq_no <= domain.max_seq)
+    {
+        domain.ordered = false;
+    }
+
+    if (domain.n_records % GTID_INDEX_SAMPLE_INTERVAL == 0)
+    {
+        domain.samples.push_back({rec.seq_no, i});
+    }
+
+    domain.min_seq = std::min(domain.min_seq, rec.seq_no);
+    domain.max_seq = std::max(domain.max_seq, rec.seq_no);
+    domain.n_records++;
+}
+
+void unmap(IndexFile* file)
+{
+    if (file->map)
+    {
+        munmap(file->map, file->map_size);
+        file->map = nullptr;
+        file->map_size = 0;
+    }
+}
+
+bool map(IndexFile* file, int fd, size_t size, int prot)
+{
+    void* ptr = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+
+    if (ptr == MAP_FAILED)
+    {
+        return false;
+    }
+
+    file->map = static_cast<uint8_t*>(ptr);
+    file->map_size = size;
+    return true;
+}
+
+std::string basename_of(const std::string& name)
+{
+    size_t slash = name.rfind('/');
+    return slash == std::string::npos ? name : name.substr(slash + 1);
+}
+
+/**
+ * Load an index file written earlier.
+ */
+bool load_file(const char* path, const std::string& name, IndexFile* file)
+{
+    int fd = open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        MXS_ERROR("Failed to open GTID index file '%s': %d, %s", path, errno, mxs_strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    bool ok = false;
+
+    if (fstat(fd, &st) == 0
+        && (size_t)st.st_size >= sizeof(IndexHeader)
+        && map(file, fd, st.st_size, PROT_READ))
+    {
+        const IndexHeader* hdr = reinterpret_cast<const IndexHeader*>(file->map);
+
+        if (memcmp(hdr->magic, GTID_INDEX_MAGIC, sizeof(GTID_INDEX_MAGIC)) == 0
+            && hdr->version == GTID_INDEX_VERSION
+            && hdr->record_size == sizeof(IndexRecord))
+        {
+            file->name = name;
+            file->binlog = basename_of(name);
+
+            // A file that was being written when MaxScale stopped may have
+            // unused space at the end.
+            uint64_t capacity = file->capacity();
+
+            while (file->n_records < capacity && file->records()[file->n_records].end_pos != 0)
+            {
+                summarize(file, file->n_records++);
+            }
+
+            file->n_synced = file->n_records;
+            ok = true;
+        }
+        else
+        {
+            MXS_ERROR("'%s' is not a GTID index file.", path);
+            unmap(file);
+        }
+    }
+    else
+    {
+        MXS_ERROR("Failed to map GTID index file '%s': %d, %s", path, errno, mxs_strerror(errno));
+    }
+
+    close(fd);
+    return ok;
+}
+
+/**
+ * Load the index files in a directory and the directories below it.
+ */
+void load_dir(BLR_GTID_INDEX* index,
+              const std::string& rdir,
+              std::vector<std::pair<std::string, IndexFile>>* loaded)
+{
+    std::string dir = index->dir + rdir;
+    DIR* dp = opendir(dir.c_str());
+
+    if (!dp)
+    {
+        return;
+    }
+
+    while (struct dirent* ent = readdir(dp))
+    {
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        std::string name = rdir + ent->d_name;
+        std::string path = index->dir + name;
+        struct stat st;
+
+        if (stat(path.c_str(), &st) != 0)
+        {
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            load_dir(index, name + "/", loaded);
+        }
+        else if (S_ISREG(st.st_mode))
+        {
+            IndexFile file;
+
+            if (load_file(path.c_str(), name, &file))
+            {
+                // Ordered by modification time and, if written at the same
+                // time, by the sequence number in the binlog file name.
+                char key[64];
+                snprintf(key,
+                         sizeof(key),
+                         "%020ld.%09ld.",
+                         (long)st.st_mtim.tv_sec,
+                         (long)st.st_mtim.tv_nsec);
+                loaded->emplace_back(key + file.binlog, std::move(file));
+            }
+        }
+    }
+
+    closedir(dp);
+}
+
+/**
+ * Stop writing an index file: the unused space is released and the file
+ * mapped read-only.
+ */
+void seal(BLR_GTID_INDEX* index, IndexFile* file)
+{
+    size_t size = sizeof(IndexHeader) + file->n_records * sizeof(IndexRecord);
+
+    unmap(file);
+
+    if (ftruncate(file->fd, size) != 0 || !map(file, file->fd, size, PROT_READ))
+    {
+        MXS_ERROR("Failed to finish GTID index file '%s%s': %d, %s",
+                  index->dir.c_str(),
+                  file->name.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+        file->n_records = 0;
+        file->domains.clear();
+    }
+
+    close(file->fd);
+    file->fd = -1;
+}
+
+/**
+ * Make room for at least one more record in the file being written.
+ */
+bool grow(BLR_GTID_INDEX* index, IndexFile* file)
+{
+    size_t growth = std::min(std::max(file->map_size, GTID_INDEX_MIN_GROWTH), GTID_INDEX_MAX_GROWTH);
+    size_t size = file->map_size + growth;
+
+    if (ftruncate(file->fd, size) != 0)
+    {
+        MXS_ERROR("Failed to extend GTID index file '%s%s': %d, %s",
+                  index->dir.c_str(),
+                  file->name.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+        return false;
+    }
+
+    void* ptr = mremap(file->map, file->map_size, size, MREMAP_MAYMOVE);
+
+    if (ptr == MAP_FAILED)
+    {
+        MXS_ERROR("Failed to map GTID index file '%s%s': %d, %s",
+                  index->dir.c_str(),
+                  file->name.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+        return false;
+    }
+
+    file->map = static_cast<uint8_t*>(ptr);
+    file->map_size = size;
+    return true;
+}
+
+/**
+ * Open the index file of a binlog file for writing, creating it if needed.
+ */
+IndexFile* open_for_append(BLR_GTID_INDEX* index, const std::string& name)
+{
+    auto it = std::find_if(index->files.begin(), index->files.end(), [&](const IndexFile& f) {
+                               return f.name == name;
+                           });
+
+    if (it == index->files.end())
+    {
+        IndexFile file;
+        file.name = name;
+        file.binlog = basename_of(name);
+        it = index->files.insert(index->files.end(), std::move(file));
+    }
+    else
+    {
+        // The most recently written file is looked at first.
+        index->files.splice(index->files.end(), index->files, it);
+    }
+
+    IndexFile* file = &*it;
+    std::string path = index->dir + name;
+    size_t slash = path.rfind('/');
+
+    if (!mxs_mkdir_all(path.substr(0, slash).c_str(), 0700))
+    {
+        return nullptr;
+    }
+
+    // A file not loaded at startup is not a valid index file.
+    file->fd = open(path.c_str(), O_RDWR | O_CREAT | (file->map ? 0 : O_TRUNC), 0660);
+
+    if (file->fd == -1)
+    {
+        MXS_ERROR("Failed to open GTID index file '%s': %d, %s",
+                  path.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+        return nullptr;
+    }
+
+    if (!file->map)
+    {
+        IndexHeader hdr = {};
+        memcpy(hdr.magic, GTID_INDEX_MAGIC, sizeof(GTID_INDEX_MAGIC));
+        hdr.version = GTID_INDEX_VERSION;
+        hdr.record_size = sizeof(IndexRecord);
+
+        if (pwrite(file->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+            || !map(file, file->fd, sizeof(hdr), PROT_READ | PROT_WRITE))
+        {
+            MXS_ERROR("Failed to initialize GTID index file '%s': %d, %s",
+                      path.c_str(),
+                      errno,
+                      mxs_strerror(errno));
+            close(file->fd);
+            file->fd = -1;
+            return nullptr;
+        }
+    }
+    else
+    {
+        size_t size = file->map_size;
+        unmap(file);
+
+        if (!map(file, file->fd, size, PROT_READ | PROT_WRITE))
+        {
+            MXS_ERROR("Failed to map GTID index file '%s': %d, %s",
+                      path.c_str(),
+                      errno,
+                      mxs_strerror(errno));
+            close(file->fd);
+            file->fd = -1;
+            return nullptr;
+        }
+    }
+
+    return file;
+}
+
+/**
+ * The relative path of the binlog file being written.
+ */
+std::string current_name(const ROUTER_INSTANCE* router)
+{
+    char name[BINLOG_FILE_EXTRA_INFO + BINLOG_FNAMELEN + 1];
+
+    if (router->storage_type == BLR_BINLOG_STORAGE_TREE)
+    {
+        snprintf(name,
+                 sizeof(name),
+                 "%" PRIu32 "/%d/%s",
+                 router->mariadb10_gtid_domain,
+                 router->orig_masterid,
+                 router->binlog_name);
+    }
+    else
+    {
+        snprintf(name, sizeof(name), "%s", router->binlog_name);
+    }
+
+    return name;
+}
+
+/**
+ * Find a GTID in one index file.
+ */
+const IndexRecord* find_in_file(const IndexFile& file, const MARIADB_GTID_ELEMS* gtid)
+{
+    auto it = file.domains.find(gtid->domain_id);
+
+    if (it == file.domains.end()
+        || gtid->seq_no < it->second.min_seq
+        || gtid->seq_no > it->second.max_seq)
+    {
+        return nullptr;
+    }
+
+    const DomainSummary& domain = it->second;
+    uint64_t i = 0;
+
+    if (domain.ordered)
+    {
+        // Start from the last sample at or before the sequence number.
+        auto s = std::upper_bound(domain.samples.begin(),
+                                  domain.samples.end(),
+                                  gtid->seq_no,
+                                  [](uint64_t seq_no, const Sample& sample) {
+                                      return seq_no < sample.seq_no;
+                                  });
+        mxb_assert(s != domain.samples.begin());
+        i = (s - 1)->record;
+    }
+
+    const IndexRecord* records = file.records();
+
+    for (; i < file.n_records; i++)
+    {
+        const IndexRecord& rec = records[i];
+
+        if (rec.domain_id == gtid->domain_id)
+        {
+            if (rec.seq_no == gtid->seq_no && rec.server_id == gtid->server_id)
+            {
+                return &rec;
+            }
+            else if (domain.ordered && rec.seq_no > gtid->seq_no)
+            {
+                break;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void fill_result(const IndexFile& file, const IndexRecord& rec, MARIADB_GTID_INFO* result)
+{
+    snprintf(result->gtid,
+             sizeof(result->gtid),
+             "%" PRIu32 "-%" PRIu32 "-%" PRIu64,
+             rec.domain_id,
+             rec.server_id,
+             rec.seq_no);
+    snprintf(result->binlog_name, sizeof(result->binlog_name), "%s", file.binlog.c_str());
+    result->start = rec.start_pos;
+    result->end = rec.end_pos;
+    result->gtid_elms.domain_id = rec.domain_id;
+    result->gtid_elms.server_id = rec.server_id;
+    result->gtid_elms.seq_no = rec.seq_no;
+}
+}
+
+/**
+ * Open the GTID index and load the index files of the existing binlog files.
+ *
+ * @param router    The router instance
+ * @return          True on success
+ */
+bool blr_gtid_index_open(ROUTER_INSTANCE* router)
+{
+    BLR_GTID_INDEX* index = new BLR_GTID_INDEX;
+    index->dir = std::string(router->binlogdir) + "/" + GTID_INDEX_DIR + "/";
+
+    if (!mxs_mkdir_all(index->dir.c_str(), 0700))
+    {
+        MXS_ERROR("%s: Failed to create GTID index directory '%s'",
+                  router->service->name,
+                  index->dir.c_str());
+        delete index;
+        return false;
+    }
+
+    std::vector<std::pair<std::string, IndexFile>> loaded;
+    load_dir(index, "", &loaded);
+
+    std::sort(loaded.begin(), loaded.end(), [](const std::pair<std::string, IndexFile>& a,
+                                               const std::pair<std::string, IndexFile>& b) {
+                  return a.first < b.first;
+              });
+
+    uint64_t n_records = 0;
+
+    for (auto& a : loaded)
+    {
+        n_records += a.second.n_records;
+        index->files.push_back(std::move(a.second));
+    }
+
+    MXS_NOTICE("%s: Loaded GTID index of %lu binlog files with %lu transactions.",
+               router->service->name,
+               index->files.size(),
+               n_records);
+
+    router->gtid_index = index;
+    return true;
+}
+
+/**
+ * Close the GTID index.
+ *
+ * @param router    The router instance
+ */
+void blr_gtid_index_close(ROUTER_INSTANCE* router)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (index)
+    {
+        if (index->current)
+        {
+            seal(index, index->current);
+        }
+
+        for (auto& file : index->files)
+        {
+            unmap(&file);
+        }
+
+        delete index;
+        router->gtid_index = NULL;
+    }
+}
+
+/**
+ * Add a transaction of the binlog file being written to the GTID index.
+ *
+ * @param router    The router instance
+ * @param gtid      The GTID of the transaction
+ * @param start     Position of the GTID event of the transaction
+ * @param end       Position after the transaction
+ * @return          True on success
+ */
+bool blr_gtid_index_add(ROUTER_INSTANCE* router,
+                        const MARIADB_GTID_ELEMS* gtid,
+                        uint64_t start,
+                        uint64_t end)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (!index)
+    {
+        return false;
+    }
+
+    std::string name = current_name(router);
+    std::lock_guard<std::mutex> guard(index->lock);
+
+    if (!index->current || index->current->name != name)
+    {
+        if (index->current)
+        {
+            seal(index, index->current);
+        }
+
+        index->current = open_for_append(index, name);
+
+        if (!index->current)
+        {
+            return false;
+        }
+    }
+
+    IndexFile* file = index->current;
+
+    if (file->n_records == file->capacity() && !grow(index, file))
+    {
+        return false;
+    }
+
+    IndexRecord& rec = file->records()[file->n_records];
+    rec.domain_id = gtid->domain_id;
+    rec.server_id = gtid->server_id;
+    rec.seq_no = gtid->seq_no;
+    rec.start_pos = start;
+    rec.end_pos = end;
+
+    summarize(file, file->n_records++);
+
+    return true;
+}
+
+/**
+ * Write the GTIDs added so far to disk. Called when the binlog file is synced,
+ * so that the index is as durable as the binlog file it describes.
+ *
+ * @param router    The router instance
+ */
+void blr_gtid_index_sync(ROUTER_INSTANCE* router)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (!index)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(index->lock);
+    IndexFile* file = index->current;
+
+    if (file && file->n_synced < file->n_records)
+    {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t begin = sizeof(IndexHeader) + file->n_synced * sizeof(IndexRecord);
+        size_t end = sizeof(IndexHeader) + file->n_records * sizeof(IndexRecord);
+        begin -= begin % page;
+
+        if (msync(file->map + begin, end - begin, MS_SYNC) == 0)
+        {
+            file->n_synced = file->n_records;
+        }
+        else
+        {
+            MXS_ERROR("%s: Failed to sync GTID index file '%s%s': %d, %s",
+                      router->service->name,
+                      index->dir.c_str(),
+                      file->name.c_str(),
+                      errno,
+                      mxs_strerror(errno));
+        }
+    }
+}
+
+/**
+ * Find a GTID in the GTID index. If the GTID is in several binlog files,
+ * the most recently written one is returned.
+ *
+ * @param router    The router instance
+ * @param gtid      The GTID to look for
+ * @param result    The file and position of the transaction
+ * @return          True if the GTID was found
+ */
+bool blr_gtid_index_find(ROUTER_INSTANCE* router,
+                         const MARIADB_GTID_ELEMS* gtid,
+                         MARIADB_GTID_INFO* result)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (!index)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(index->lock);
+
+    for (auto it = index->files.rbegin(); it != index->files.rend(); ++it)
+    {
+        if (const IndexRecord* rec = find_in_file(*it, gtid))
+        {
+            fill_result(*it, *rec, result);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Get the last GTID added to the GTID index.
+ *
+ * @param router    The router instance
+ * @param result    The GTID, its file and its position
+ * @return          True if the index has any GTIDs
+ */
+bool blr_gtid_index_last(ROUTER_INSTANCE* router, MARIADB_GTID_INFO* result)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (!index)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(index->lock);
+
+    for (auto it = index->files.rbegin(); it != index->files.rend(); ++it)
+    {
+        if (it->n_records)
+        {
+            fill_result(*it, it->records()[it->n_records - 1], result);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Remove the index file of a purged binlog file.
+ *
+ * @param router    The router instance
+ * @param file      Relative path of the binlog file
+ */
+void blr_gtid_index_remove(ROUTER_INSTANCE* router, const char* file)
+{
+    BLR_GTID_INDEX* index = router->gtid_index;
+
+    if (!index)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(index->lock);
+
+    auto it = std::find_if(index->files.begin(), index->files.end(), [&](const IndexFile& f) {
+                               return f.name == file;
+                           });
+
+    if (it != index->files.end())
+    {
+        if (&*it == index->current)
+        {
+            seal(index, index->current);
+            index->current = nullptr;
+        }
+
+        unmap(&*it);
+        index->files.erase(it);
+    }
+
+    std::string path = index->dir + file;
+
+    if (unlink(path.c_str()) == -1 && errno != ENOENT)
+    {
+        MXS_ERROR("Failed to remove GTID index file '%s': %d, %s",
+                  path.c_str(),
+                  errno,
+                  mxs_strerror(errno));
+    }
+}
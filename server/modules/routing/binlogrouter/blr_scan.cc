@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2016 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * @file blr_scan.cc - parallel binlog file scanner
+ *
+ * Verifies binlog files without modifying them or the state of the router.
+ * A file is memory mapped and its events are found by following the event
+ * sizes in the headers, starting after the binlog magic. The checksum of
+ * every event is verified, encrypted events are decrypted first, and the
+ * MariaDB 10 GTIDs of the complete transactions are collected, so that the
+ * GTID index of the file can be rebuilt from the result.
+ *
+ * The files are scanned by a pool of threads, the largest files first. The
+ * scan of a file does not depend on any other file, so apart from picking
+ * the next file the threads share nothing.
+ *
+ * Unlike blr_read_events_all_events(), the scanner never truncates or repairs
+ * a file; it only reports the position up to which the file is intact.
+ * Compressed binlog files are decompressed into memory and scanned as if
+ * they were the original files.
+ */
+
+#include "blr.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <maxscale/log.h>
+#include <maxscale/utils.h>
+
+namespace
+{
+
+/** The offset of the checksum algorithm in the body of a format description event */
+const int FDE_CHECKSUM_ALG_OFFSET = BINLOG_EVENT_CRC_ALGO_TYPE + BINLOG_EVENT_CRC_SIZE;
+
+/** The checksum algorithm value of CRC32 */
+const uint8_t CHECKSUM_ALG_CRC32 = 1;
+
+/** The state of a transaction being scanned */
+struct Transaction
+{
+    bool               open = false;
+    bool               has_gtid = false;
+    bool               standalone = false;
+    MARIADB_GTID_ELEMS gtid = {};
+    uint64_t           start = 0;
+};
+
+std::string scan_error(const char* what, uint64_t pos)
+{
+    char buf[200];
+    snprintf(buf, sizeof(buf), "%s at %lu", what, pos);
+    return buf;
+}
+
+bool valid_event_type(uint8_t type)
+{
+    return type <= MAX_EVENT_TYPE
+           || (type >= MARIADB_ANNOTATE_ROWS_EVENT && type <= MAX_EVENT_TYPE_MARIADB10);
+}
+
+/**
+ * Check whether a query event begins or ends a transaction.
+ *
+ * @param body      The event body, after the header
+ * @param len       The body length, checksum excluded
+ * @param stmt      The statement prefix to look for
+ * @return          True if the statement of the event begins with @c stmt
+ */
+bool query_is(const uint8_t* body, uint32_t len, const char* stmt)
+{
+    const uint32_t fixed = 4 + 4 + 1 + 2 + 2;
+
+    if (len < fixed)
+    {
+        return false;
+    }
+
+    uint32_t db_name_len = body[4 + 4];
+    uint32_t var_block_len = body[4 + 4 + 1 + 2];
+    uint32_t offset = fixed + var_block_len + db_name_len + 1;
+    size_t stmt_len = strlen(stmt);
+
+    return offset + stmt_len <= len && memcmp(body + offset, stmt, stmt_len) == 0;
+}
+
+/**
+ * Scan one mapped binlog file.
+ *
+ * @param router    The router instance with the encryption key, or NULL
+ * @param base      The start of the mapping
+ * @param size      The size of the file
+ * @param result    Where the result is stored
+ */
+void scan_events(ROUTER_INSTANCE* router,
+                 const uint8_t* base,
+                 uint64_t size,
+                 BLR_SCAN_RESULT* result)
+{
+    static const uint8_t magic[] = BINLOG_MAGIC;
+
+    if (size < BINLOG_MAGIC_SIZE || memcmp(base, magic, BINLOG_MAGIC_SIZE) != 0)
+    {
+        result->error = "Not a binlog file";
+        return;
+    }
+
+    uint64_t pos = BINLOG_MAGIC_SIZE;
+    bool checksum = false;
+    const uint8_t* nonce = NULL;
+    Transaction trx;
+
+    result->end_pos = pos;
+    result->safe_pos = pos;
+
+    while (pos + BINLOG_EVENT_HDR_LEN <= size)
+    {
+        // The event size is stored in clear even if the event is encrypted.
+        uint32_t event_size = gw_mysql_get_byte4(base + pos + BINLOG_EVENT_LEN_OFFSET);
+
+        if (event_size < BINLOG_EVENT_HDR_LEN)
+        {
+            result->error = scan_error("Invalid event size", pos);
+            break;
+        }
+
+        if (pos + event_size > size)
+        {
+            result->error = scan_error("Incomplete event", pos);
+            break;
+        }
+
+        const uint8_t* ev = base + pos;
+        GWBUF* decrypted = NULL;
+
+        if (nonce)
+        {
+            decrypted = blr_decrypt_event(router, ev, event_size, pos, nonce);
+
+            if (!decrypted)
+            {
+                result->error = scan_error("Failed to decrypt the event", pos);
+                break;
+            }
+
+            ev = GWBUF_DATA(decrypted);
+        }
+
+        uint8_t type = ev[4];
+        uint32_t next_pos = gw_mysql_get_byte4(ev + 13);
+        const uint8_t* body = ev + BINLOG_EVENT_HDR_LEN;
+        uint32_t body_len = event_size - BINLOG_EVENT_HDR_LEN;
+
+        if (!valid_event_type(type))
+        {
+            result->error = scan_error("Invalid event type", pos);
+        }
+        else if (next_pos != 0 && type != ROTATE_EVENT
+                 && next_pos != static_cast<uint32_t>(pos + event_size))
+        {
+            result->error = scan_error("Next position does not match the event size", pos);
+        }
+        else if (type == FORMAT_DESCRIPTION_EVENT)
+        {
+            if (body_len < BLRM_FDE_EVENT_TYPES_OFFSET + FDE_CHECKSUM_ALG_OFFSET)
+            {
+                result->error = scan_error("Invalid format description event", pos);
+            }
+            else
+            {
+                // The checksum algorithm and the checksum itself are always present.
+                checksum = body[body_len - FDE_CHECKSUM_ALG_OFFSET] == CHECKSUM_ALG_CRC32;
+                result->checksum = checksum;
+            }
+        }
+
+        if (result->error.empty() && checksum)
+        {
+            if (body_len < BINLOG_EVENT_CRC_SIZE)
+            {
+                result->error = scan_error("Event too short for a checksum", pos);
+            }
+            else
+            {
+                uint32_t len = event_size - BINLOG_EVENT_CRC_SIZE;
+                uint32_t crc = crc32(crc32(0L, NULL, 0), ev, len);
+
+                if (crc != gw_mysql_get_byte4(ev + len))
+                {
+                    result->error = scan_error("Checksum mismatch", pos);
+                }
+
+                body_len -= BINLOG_EVENT_CRC_SIZE;
+            }
+        }
+
+        if (result->error.empty())
+        {
+            bool ends_trx = false;
+
+            switch (type)
+            {
+            case MARIADB10_START_ENCRYPTION_EVENT:
+                if (!router || router->encryption.key_len == 0)
+                {
+                    result->error = scan_error("Encrypted binlog without a decryption key", pos);
+                }
+                else if (body_len < BLRM_CRYPTO_SCHEME_LENGTH + BLRM_KEY_VERSION_LENGTH
+                         + BLRM_NONCE_LENGTH)
+                {
+                    result->error = scan_error("Invalid start encryption event", pos);
+                }
+                else
+                {
+                    // The nonce is in the mapped file, so it stays valid.
+                    nonce = base + pos + BINLOG_EVENT_HDR_LEN
+                        + BLRM_CRYPTO_SCHEME_LENGTH + BLRM_KEY_VERSION_LENGTH;
+                    result->encrypted = true;
+                }
+                break;
+
+            case MARIADB10_GTID_EVENT:
+                if (trx.open)
+                {
+                    result->error = scan_error("GTID event inside a transaction", pos);
+                }
+                else if (body_len < 8 + 4 + 1)
+                {
+                    result->error = scan_error("Invalid GTID event", pos);
+                }
+                else
+                {
+                    trx.open = true;
+                    trx.has_gtid = true;
+                    trx.start = pos;
+                    trx.gtid.seq_no = gw_mysql_get_byte8(body);
+                    trx.gtid.domain_id = gw_mysql_get_byte4(body + 8);
+                    trx.gtid.server_id = gw_mysql_get_byte4(ev + 5);
+                    trx.standalone = body[8 + 4] & MARIADB_FL_STANDALONE;
+                }
+                break;
+
+            case QUERY_EVENT:
+                if (query_is(body, body_len, "BEGIN"))
+                {
+                    if (!trx.open)
+                    {
+                        trx = Transaction();
+                        trx.open = true;
+                        trx.start = pos;
+                    }
+                }
+                else if (trx.open && (trx.standalone || query_is(body, body_len, "COMMIT")))
+                {
+                    ends_trx = true;
+                }
+                break;
+
+            case XID_EVENT:
+                ends_trx = trx.open;
+                break;
+
+            default:
+                break;
+            }
+
+            if (ends_trx)
+            {
+                if (trx.has_gtid)
+                {
+                    result->trx.push_back({trx.gtid, trx.start, pos + event_size});
+                }
+
+                ++result->n_trx;
+                trx = Transaction();
+            }
+        }
+
+        gwbuf_free(decrypted);
+
+        if (!result->error.empty())
+        {
+            break;
+        }
+
+        pos += event_size;
+        ++result->n_events;
+        result->end_pos = pos;
+
+        if (!trx.open)
+        {
+            result->safe_pos = pos;
+        }
+    }
+
+    if (result->error.empty() && pos < size)
+    {
+        result->error = scan_error("Incomplete event header", pos);
+    }
+}
+
+void scan_file(ROUTER_INSTANCE* router, BLR_SCAN_RESULT* result)
+{
+    int fd = open(result->path.c_str(), O_RDONLY);
+
+    if (fd == -1)
+    {
+        result->error = std::string("Failed to open file: ") + mxs_strerror(errno);
+        return;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1)
+    {
+        result->error = std::string("Failed to stat file: ") + mxs_strerror(errno);
+        close(fd);
+        return;
+    }
+
+    result->size = st.st_size;
+
+    if (result->size == 0)
+    {
+        result->error = "Not a binlog file";
+        close(fd);
+        return;
+    }
+
+    BLR_COMPRESSED_FILE* compressed;
+
+    if (!blr_compressed_open(fd, &compressed))
+    {
+        result->error = "Invalid compressed binlog file";
+        close(fd);
+        return;
+    }
+    else if (compressed)
+    {
+        // A compressed file is scanned as if it were the original file
+        std::vector<uint8_t> data(blr_compressed_size(compressed));
+
+        if (blr_compressed_pread(compressed, data.data(), data.size(), 0) == (ssize_t)data.size())
+        {
+            result->size = data.size();
+            scan_events(router, data.data(), data.size(), result);
+        }
+        else
+        {
+            result->error = "Failed to decompress the file";
+        }
+
+        blr_compressed_close(compressed);
+        close(fd);
+        return;
+    }
+
+    void* base = mmap(NULL, result->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        result->error = std::string("Failed to map file: ") + mxs_strerror(errno);
+        return;
+    }
+
+    madvise(base, result->size, MADV_SEQUENTIAL);
+    scan_events(router, static_cast<const uint8_t*>(base), result->size, result);
+    munmap(base, result->size);
+}
+}
+
+/**
+ * Scan binlog files in parallel.
+ *
+ * @param router    The router instance with the encryption key of encrypted
+ *                  files, or NULL if no key is available
+ * @param files     The files to scan, with only the path set. On return, the
+ *                  other fields have been filled in.
+ * @param n_threads The number of threads to use
+ */
+void blr_scan_files(ROUTER_INSTANCE* router, std::vector<BLR_SCAN_RESULT>* files, int n_threads)
+{
+    std::vector<size_t> order;
+
+    for (size_t i = 0; i < files->size(); i++)
+    {
+        BLR_SCAN_RESULT& file = (*files)[i];
+        std::string path = file.path;
+        file = BLR_SCAN_RESULT();
+        file.path = path;
+
+        struct stat st;
+        file.size = stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+        order.push_back(i);
+    }
+
+    // The largest files are scanned first, so that no thread is left alone
+    // with a large file at the end.
+    std::stable_sort(order.begin(), order.end(), [files](size_t a, size_t b) {
+                         return (*files)[a].size > (*files)[b].size;
+                     });
+
+    std::atomic<size_t> next(0);
+
+    auto worker = [&]() {
+            size_t i;
+
+            while ((i = next.fetch_add(1)) < order.size())
+            {
+                scan_file(router, &(*files)[order[i]]);
+            }
+        };
+
+    n_threads = std::max(1, std::min<int>(n_threads, files->size()));
+    std::vector<std::thread> threads;
+
+    for (int i = 1; i < n_threads; i++)
+    {
+        threads.emplace_back(worker);
+    }
+
+    worker();
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
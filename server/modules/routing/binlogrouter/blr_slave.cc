@@ -68,6 +68,7 @@ typedef struct
     bool        use_tree;   /* Binlog structure type */
     size_t      n_files;    /* How many files */
     uint64_t    rowid;      /* ROWID of router current file*/
+    ROUTER_INSTANCE* router; /* The router instance */
 } BINARY_LOG_DATA_RESULT;
 
 /** Slave file read EOF handling */
@@ -311,6 +312,8 @@ static bool blr_handle_complex_select(ROUTER_INSTANCE* router,
                                       const char*   coln);
 extern bool blr_is_current_binlog(ROUTER_INSTANCE* router,
                                   ROUTER_SLAVE* slave);
+static bool blr_slave_up_to_date(ROUTER_INSTANCE* router,
+                                 ROUTER_SLAVE* slave);
 extern bool blr_compare_binlogs(const ROUTER_INSTANCE* router,
                                 const MARIADB_GTID_ELEMS* info,
                                 const char* r_file,
@@ -2288,6 +2291,22 @@ uint8_t* blr_build_header(GWBUF* pkt, REP_HEADER* hdr)
     return ptr;
 }
 
+/**
+ * Check whether the slave has been sent everything it can be sent from the
+ * current binlog file. With send_durable_only, a slave positioned between
+ * the synced position and the binlog position waits for the next sync.
+ *
+ * @param   router      The binlog router
+ * @param   slave       The slave to check
+ * @return  True if the slave must wait for new data
+ */
+static bool blr_slave_up_to_date(ROUTER_INSTANCE* router, ROUTER_SLAVE* slave)
+{
+    return slave->binlog_pos >= blr_slave_safe_pos(router)
+           && slave->binlog_pos <= router->binlog_position
+           && blr_is_current_binlog(router, slave);
+}
+
 /**
  * We have a registered slave that is behind the current leading edge of the
  * binlog. We must replay the log entries to bring this node up to speed.
@@ -2442,15 +2461,19 @@ int blr_slave_catchup(ROUTER_INSTANCE* router, ROUTER_SLAVE* slave, bool large)
 #endif
     int events_before = slave->stats.n_events;
 
-    /* Loop read binlog events from slave binlog file */
+    /**
+     * Loop read binlog events from the event cache or, if the slave
+     * is behind the cache, from the slave binlog file
+     */
     while (burst-- && burst_size > 0
            &&   /* Read one binlog event */
-           (record = blr_read_binlog(router,
-                                     file,
-                                     slave->binlog_pos,
-                                     &hdr,
-                                     read_errmsg,
-                                     slave->encryption_ctx)) != NULL)
+           ((record = blr_cache_read_event(router, slave, &hdr)) != NULL
+            || (record = blr_read_binlog(router,
+                                         file,
+                                         slave->binlog_pos,
+                                         &hdr,
+                                         read_errmsg,
+                                         slave->encryption_ctx)) != NULL))
     {
         char binlog_name[BINLOG_FNAMELEN + 1];
         uint32_t binlog_pos;
@@ -2817,8 +2840,7 @@ int blr_slave_catchup(ROUTER_INSTANCE* router, ROUTER_SLAVE* slave, bool large)
      * (2) The slave is at EOF of a file which is not the current router file
      *
      */
-    if (slave->binlog_pos == router->binlog_position
-        && blr_is_current_binlog(router, slave))
+    if (blr_slave_up_to_date(router, slave))
     {
         /**
          * (1) Same name and pos as current router file: aka Up To Date
@@ -2830,8 +2852,7 @@ int blr_slave_catchup(ROUTER_INSTANCE* router, ROUTER_SLAVE* slave, bool large)
          * Now check again since we hold the router->binlog_lock
          * and slave->catch_lock.
          */
-        if (slave->binlog_pos != router->binlog_position
-            || !blr_is_current_binlog(router, slave))
+        if (!blr_slave_up_to_date(router, slave))
         {
             slave->cstate |= CS_EXPECTCB;
             pthread_mutex_unlock(&slave->catch_lock);
@@ -7099,12 +7120,26 @@ static bool blr_slave_gtid_request(ROUTER_INSTANCE* router,
                  "/%s/%s",
                  router->binlogdir,
                  GTID_MAPS_DB);
+        MARIADB_GTID_ELEMS gtid_elms = {};
 
+        /**
+         * Look for the GTID in the GTID index and then in the
+         * GTID maps database, which has the GTIDs of the binlog
+         * files written before the GTID index existed.
+         */
+        if (blr_parse_gtid(slave->mariadb_gtid, &gtid_elms)
+            && blr_gtid_index_find(router, &gtid_elms, &f_gtid))
+        {
+            MXS_INFO("Binlog file to read from is %" PRIu32 "/%" PRIu32 "/%s",
+                     f_gtid.gtid_elms.domain_id,
+                     f_gtid.gtid_elms.server_id,
+                     f_gtid.binlog_name);
+        }
         /* Open GTID maps read-only database */
-        if (sqlite3_open_v2(dbpath,
-                            &slave->gtid_maps,
-                            SQLITE_OPEN_READONLY,
-                            NULL) != SQLITE_OK)
+        else if (sqlite3_open_v2(dbpath,
+                                 &slave->gtid_maps,
+                                 SQLITE_OPEN_READONLY,
+                                 NULL) != SQLITE_OK)
         {
             char errmsg[BINLOG_ERROR_MSG_LEN + sizeof(dbpath) + 1];
             snprintf(errmsg,
@@ -8977,6 +9012,8 @@ static int binary_logs_purge_cb(void* data,
                       errno,
                       mxs_strerror(errno));
         }
+
+        blr_gtid_index_remove(result_data->router, filename);
         result_data->n_files++;
     }
 
@@ -9116,6 +9153,7 @@ static bool blr_purge_binary_logs(ROUTER_INSTANCE* router,
     result.n_files = 0;
     result.binlogdir = router->binlogdir;
     result.use_tree = router->storage_type == BLR_BINLOG_STORAGE_TREE;
+    result.router = router;
 
     /* Use the provided name, no prefix: find the first row */
     sprintf(sql_stmt,
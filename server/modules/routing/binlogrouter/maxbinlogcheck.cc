@@ -17,16 +17,24 @@
  * This utility checks a MySQL 5.6 and MariaDB 10.0.X binlog file and reports
  * any found error or an incomplete transaction.
  * It suggests the pos the file should be trucatetd at.
+ *
+ * Several binlog files, or all the binlog files of a directory, are checked
+ * in parallel with the binlog scanner, which can also rebuild the GTID index.
  */
 
 #include "blr.hh"
 
+#include <dirent.h>
 #include <getopt.h>
+#include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <algorithm>
+#include <map>
 
+#include <maxbase/stopwatch.hh>
 #include <maxscale/alloc.h>
 #include <maxscale/log.h>
 
@@ -34,6 +42,11 @@
 static void printVersion(const char* progname);
 static void printUsage(const char* progname);
 static int  set_encryption_options(ROUTER_INSTANCE* inst, char* key_file, char* aes_algo);
+static int  scan_binlogs(ROUTER_INSTANCE* inst,
+                         char** paths,
+                         int n_paths,
+                         int n_threads,
+                         bool rebuild_index);
 
 #ifdef HAVE_GLIBC
 static struct option long_options[] =
@@ -47,11 +60,13 @@ static struct option long_options[] =
     {"aes_algo",      required_argument,      0,                      'A'                },
     {"replace-event", required_argument,      0,                      'R'                },
     {"remove-trx",    required_argument,      0,                      'T'                },
+    {"threads",       required_argument,      0,                      'j'                },
+    {"gtid-index",    no_argument,            0,                      'I'                },
     {"help",          no_argument,            0,                      '?'                },
     {0,               0,                      0,                      0                  }
 };
 #endif
-const char* binlog_check_version = "2.2.1";
+const char* binlog_check_version = "2.3.0";
 
 int maxscale_uptime()
 {
@@ -67,12 +82,14 @@ int main(int argc, char** argv)
     char* aes_algo = NULL;
     int report_header = 0;
     int c;
+    int n_threads = 0;
+    bool rebuild_index = false;
     BINLOG_FILE_FIX binlog_file = {0, false, false};
 
 #ifdef HAVE_GLIBC
-    while ((c = getopt_long(argc, argv, "dVfMHK:A:R:T:?", long_options, &option_index)) >= 0)
+    while ((c = getopt_long(argc, argv, "dVfMHK:A:R:T:j:I?", long_options, &option_index)) >= 0)
 #else
-    while ((c = getopt(argc, argv, "dVfMHK:A:R:T:?")) >= 0)
+    while ((c = getopt(argc, argv, "dVfMHK:A:R:T:j:I?")) >= 0)
 #endif
     {
         switch (c)
@@ -112,6 +129,19 @@ int main(int argc, char** argv)
             binlog_file.replace_trx = (c == 'T') ? true : false;
             break;
 
+        case 'j':
+            n_threads = atoi(optarg);
+            if (n_threads <= 0)
+            {
+                printf("ERROR: Invalid number of threads '%s'.\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+
+        case 'I':
+            rebuild_index = true;
+            break;
+
         case '?':
             printUsage(*argv);
             exit(optopt ? EXIT_FAILURE : EXIT_SUCCESS);
@@ -126,6 +156,50 @@ int main(int argc, char** argv)
         exit(EXIT_FAILURE);
     }
 
+    struct stat st;
+    bool parallel = n_threads > 0 || rebuild_index || argv[num_args + 1] != NULL
+        || (stat(argv[num_args], &st) == 0 && S_ISDIR(st.st_mode));
+
+    if (parallel)
+    {
+        if (binlog_file.fix || binlog_file.pos || report_header)
+        {
+            printf("ERROR: Fixing, replacing events and printing headers "
+                   "is only possible for a single binlog file.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        ROUTER_INSTANCE* inst = (ROUTER_INSTANCE*)MXS_CALLOC(1, sizeof(ROUTER_INSTANCE));
+        if (!inst)
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        mxs_log_init(NULL, NULL, MXS_LOG_TARGET_DEFAULT);
+        atexit(mxs_log_finish);
+        mxs_log_set_augmentation(0);
+        mxs_log_set_priority_enabled(LOG_DEBUG, debug_out);
+
+        MXS_NOTICE("maxbinlogcheck %s", binlog_check_version);
+
+        if (set_encryption_options(inst, key_file, aes_algo))
+        {
+            MXS_FREE(inst);
+            exit(EXIT_FAILURE);
+        }
+
+        if (n_threads == 0)
+        {
+            n_threads = std::max(1U, std::thread::hardware_concurrency());
+        }
+
+        int ret = scan_binlogs(inst, argv + num_args, argc - num_args, n_threads, rebuild_index);
+
+        MXS_FREE(inst);
+
+        return ret;
+    }
+
     size_t len = strlen(argv[num_args]);
     if (len > PATH_MAX)
     {
@@ -184,8 +258,14 @@ int main(int argc, char** argv)
     MXS_NOTICE("maxbinlogcheck %s", binlog_check_version);
 
     unsigned long filelen = 0;
+    uint64_t compressed_len;
     struct stat statb;
-    if (fstat(inst->binlog_fd, &statb) == 0)
+    if (blr_compressed_file_size(path, &compressed_len))
+    {
+        /* Compressed files are read through the decompressing reader */
+        filelen = compressed_len;
+    }
+    else if (fstat(inst->binlog_fd, &statb) == 0)
     {
         filelen = statb.st_size;
     }
@@ -241,7 +321,9 @@ static void printUsage(const char* progname)
     printVersion(progname);
 
     printf("The MaxScale binlog check utility.\n\n");
-    printf("Usage: %s [-f] [-M] [-d] [-V] [-H] [-K file] [-A algo] [-R pos] [-T pos] [<binlog file>]\n\n",
+    printf("Usage: %s [-f] [-M] [-d] [-V] [-H] [-K file] [-A algo] [-R pos] [-T pos] [<binlog file>]\n",
+           progname);
+    printf("       %s [-j threads] [-I] [-d] [-K file] [-A algo] <binlog file|directory>...\n\n",
            progname);
     printf("  -f|--fix              Fix binlog file, require write permissions (truncate)\n");
     printf("  -d|--debug            Print debug messages\n");
@@ -254,6 +336,9 @@ static void printUsage(const char* progname)
     printf("  -R|--replace-event    Replace the event at pos with an IGNORABLE event\n");
     printf(
         "  -T|--remove-trx       Replace all events in the transaction the specified pos belongs to, with IGNORABLE events\n");
+    printf("  -j|--threads          Check the binlog files in parallel with this many threads\n"
+           "                        (default: one per CPU if more than one file is checked)\n");
+    printf("  -I|--gtid-index       Rebuild the GTID index of the checked binlog files\n");
     printf("  -?|--help             Print this help text\n");
 }
 
@@ -318,3 +403,218 @@ static int set_encryption_options(ROUTER_INSTANCE* inst, char* key_file, char* a
         return 0;
     }
 }
+
+/**
+ * Add a binlog file, or the binlog files of a directory, to the files to scan.
+ *
+ * In a directory, the files named like binlog files, a stem followed by
+ * a dot and a sequence number, are scanned in the order of their names.
+ *
+ * @param path     A binlog file or a directory
+ * @param files    The files to scan
+ * @return         True on success
+ */
+static bool add_binlog_path(const char* path, std::vector<BLR_SCAN_RESULT>* files)
+{
+    struct stat st;
+
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        BLR_SCAN_RESULT result;
+        result.path = path;
+        files->push_back(result);
+        return true;
+    }
+
+    DIR* dir = opendir(path);
+
+    if (!dir)
+    {
+        MXS_ERROR("Failed to open directory %s: %s", path, mxs_strerror(errno));
+        return false;
+    }
+
+    std::vector<std::string> names;
+    struct dirent* ent;
+
+    while ((ent = readdir(dir)))
+    {
+        const char* seq = strrchr(ent->d_name, '.');
+
+        if (seq && seq != ent->d_name && seq[1]
+            && strspn(seq + 1, "0123456789") == strlen(seq + 1)
+            && strlen(ent->d_name) <= BINLOG_FNAMELEN)
+        {
+            names.push_back(ent->d_name);
+        }
+    }
+
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+
+    for (const auto& name : names)
+    {
+        BLR_SCAN_RESULT result;
+        result.path = std::string(path) + "/" + name;
+        files->push_back(result);
+    }
+
+    return true;
+}
+
+/**
+ * Rebuild the GTID index of scanned binlog files. The index of the binlog
+ * files of a directory is in the directory, as the binlog router expects it
+ * with the flat binlog storage.
+ *
+ * @param files    The scanned files
+ * @return         True on success
+ */
+static bool rebuild_gtid_index(const std::vector<BLR_SCAN_RESULT>& files)
+{
+    std::map<std::string, std::vector<const BLR_SCAN_RESULT*>> dirs;
+
+    for (const auto& file : files)
+    {
+        std::string path = file.path;
+        dirs[dirname(&path[0])].push_back(&file);
+    }
+
+    SERVICE* service = (SERVICE*)MXS_CALLOC(1, sizeof(SERVICE));
+    ROUTER_INSTANCE* inst = (ROUTER_INSTANCE*)MXS_CALLOC(1, sizeof(ROUTER_INSTANCE));
+    bool ok = service && inst;
+
+    if (ok)
+    {
+        service->name = "maxbinlogcheck";
+        inst->service = service;
+    }
+
+    for (auto it = dirs.begin(); ok && it != dirs.end(); ++it)
+    {
+        inst->binlogdir = (char*)it->first.c_str();
+
+        if (!blr_gtid_index_open(inst))
+        {
+            ok = false;
+            break;
+        }
+
+        uint64_t n_trx = 0;
+
+        for (const BLR_SCAN_RESULT* file : it->second)
+        {
+            std::string path = file->path;
+            snprintf(inst->binlog_name, sizeof(inst->binlog_name), "%s", basename(&path[0]));
+
+            /* The old index of the file is replaced */
+            blr_gtid_index_remove(inst, inst->binlog_name);
+
+            for (const auto& trx : file->trx)
+            {
+                if (!blr_gtid_index_add(inst, &trx.gtid, trx.start, trx.end))
+                {
+                    ok = false;
+                    break;
+                }
+            }
+
+            n_trx += file->trx.size();
+        }
+
+        blr_gtid_index_sync(inst);
+        blr_gtid_index_close(inst);
+
+        if (ok)
+        {
+            MXS_NOTICE("Rebuilt the GTID index of %lu binlog files in %s with %lu transactions.",
+                       it->second.size(),
+                       it->first.c_str(),
+                       n_trx);
+        }
+    }
+
+    MXS_FREE(inst);
+    MXS_FREE(service);
+
+    return ok;
+}
+
+/**
+ * Check binlog files in parallel and report the result of each file.
+ *
+ * @param inst           The router instance with the encryption options
+ * @param paths          The binlog files and directories
+ * @param n_paths        The number of paths
+ * @param n_threads      The number of threads to use
+ * @param rebuild_index  Whether to rebuild the GTID index
+ * @return               1 if an error was found, 0 otherwise
+ */
+static int scan_binlogs(ROUTER_INSTANCE* inst,
+                        char** paths,
+                        int n_paths,
+                        int n_threads,
+                        bool rebuild_index)
+{
+    std::vector<BLR_SCAN_RESULT> files;
+
+    for (int i = 0; i < n_paths; i++)
+    {
+        if (!add_binlog_path(paths[i], &files))
+        {
+            return 1;
+        }
+    }
+
+    mxb::StopWatch sw;
+    blr_scan_files(inst, &files, n_threads);
+    double secs = sw.split().secs();
+
+    uint64_t total = 0;
+    int n_errors = 0;
+
+    for (const auto& file : files)
+    {
+        total += file.size;
+
+        MXS_NOTICE("%s: size %lu bytes, %lu events, %lu transactions, checksum %s%s",
+                   file.path.c_str(),
+                   file.size,
+                   file.n_events,
+                   file.n_trx,
+                   file.checksum ? "CRC32" : "NONE",
+                   file.encrypted ? ", encrypted" : "");
+
+        if (!file.error.empty())
+        {
+            ++n_errors;
+            MXS_ERROR("%s: %s. The events are intact up to pos %lu.",
+                      file.path.c_str(),
+                      file.error.c_str(),
+                      file.end_pos);
+        }
+
+        if (file.safe_pos < file.end_pos || !file.error.empty())
+        {
+            MXS_WARNING("%s: The last complete transaction ends at pos %lu.",
+                        file.path.c_str(),
+                        file.safe_pos);
+        }
+    }
+
+    MXS_NOTICE("Checked %lu binlog files, %lu bytes in %.3f seconds (%.1f MB/s) with %d threads, "
+               "%d files with errors.",
+               files.size(),
+               total,
+               secs,
+               secs > 0 ? total / secs / (1024 * 1024) : 0.0,
+               n_threads,
+               n_errors);
+
+    if (rebuild_index && !rebuild_gtid_index(files))
+    {
+        return 1;
+    }
+
+    return n_errors ? 1 : 0;
+}
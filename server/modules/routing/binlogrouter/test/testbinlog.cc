@@ -46,6 +46,9 @@
 #include <ini.h>
 #include <sys/stat.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <maxbase/stopwatch.hh>
 
 #include <maxscale/version.h>
 
@@ -56,6 +59,9 @@
 static void printVersion(const char* progname);
 static void printUsage(const char* progname);
 static void master_free_parsed_options(ChangeMasterOptions* options);
+static void write_test_binlog(const char* path, uint64_t first_seq, int n_trx, int row_size,
+                              bool begin = true);
+static void benchmark_scan(const char* dir);
 extern int  blr_test_parse_change_master_command(char* input,
                                                  char* error_string,
                                                  ChangeMasterOptions* config);
@@ -905,6 +911,364 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    tests++;
+
+    /**
+     * GTID index: the positions of the GTIDs are found in the binlog file
+     * they were written into, also after the index has been reopened.
+     */
+    printf("--------- GTID index tests ---------\n");
+    char gtid_dir[] = "/tmp/testbinlog_gtid_XXXXXX";
+
+    if (!mkdtemp(gtid_dir))
+    {
+        printf("Test %d FAILED: cannot create directory for the GTID index\n", tests);
+        return 1;
+    }
+
+    inst->binlogdir = gtid_dir;
+    inst->storage_type = BLR_BINLOG_STORAGE_FLAT;
+
+    for (int reopen = 0; reopen < 2; reopen++)
+    {
+        if (!blr_gtid_index_open(inst))
+        {
+            printf("Test %d FAILED: cannot open the GTID index\n", tests);
+            return 1;
+        }
+
+        for (uint64_t seq = 1; !reopen && seq <= 1000; seq++)
+        {
+            MARIADB_GTID_ELEMS gtid = {(uint32_t)(seq % 2), 10, seq};
+            sprintf(inst->binlog_name, "%s.%06d", inst->fileroot, seq <= 500 ? 1 : 2);
+            blr_gtid_index_add(inst, &gtid, seq * 100, seq * 100 + 100);
+        }
+
+        MARIADB_GTID_ELEMS gtid = {1, 10, 333};
+        MARIADB_GTID_ELEMS missing = {0, 10, 333};
+        MARIADB_GTID_INFO info = {};
+        MARIADB_GTID_INFO last = {};
+        char expected_file[BINLOG_FNAMELEN + 1];
+        sprintf(expected_file, "%s.%06d", inst->fileroot, 1);
+
+        if (blr_gtid_index_find(inst, &gtid, &info)
+            && strcmp(info.binlog_name, expected_file) == 0
+            && info.start == 33300
+            && info.end == 33400
+            && !blr_gtid_index_find(inst, &missing, &info)
+            && blr_gtid_index_last(inst, &last)
+            && strcmp(last.gtid, "0-10-1000") == 0)
+        {
+            printf("Test %d PASSED, GTID 1-10-333 found in %s at %lu\n",
+                   tests,
+                   info.binlog_name,
+                   info.start);
+        }
+        else
+        {
+            printf("Test %d FAILED: GTID index lookup\n", tests);
+            return 1;
+        }
+
+        blr_gtid_index_close(inst);
+        tests++;
+    }
+
+    /**
+     * Binlog scanner: the events, checksums and GTIDs of intact files are
+     * verified and the first error of a damaged file is found.
+     */
+    printf("--------- Binlog scanner tests ---------\n");
+    std::vector<BLR_SCAN_RESULT> files(3);
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        char path[PATH_MAX + 1];
+        snprintf(path, sizeof(path), "%s/scan-bin.%06lu", gtid_dir, i + 1);
+        write_test_binlog(path, i * 100 + 1, 100, 200);
+        files[i].path = path;
+    }
+
+    struct stat st;
+    stat(files[0].path.c_str(), &st);
+    uint64_t scan_size = st.st_size;
+
+    std::vector<BLR_SCAN_RESULT> intact_files(files.begin(), files.begin() + 1);
+    blr_scan_files(NULL, &intact_files, 1);
+    const BLR_SCAN_RESULT& intact = intact_files[0];
+
+    if (intact.error.empty()
+        && intact.checksum
+        && intact.n_trx == 100
+        && intact.n_events == 1 + 100 * 6
+        && intact.end_pos == scan_size
+        && intact.safe_pos == scan_size
+        && intact.trx.size() == 100
+        && intact.trx[42].gtid.seq_no == 43
+        && intact.trx[42].end == intact.trx[43].start)
+    {
+        printf("Test %d PASSED, %lu events and %lu transactions scanned\n",
+               tests,
+               intact.n_events,
+               intact.n_trx);
+    }
+    else
+    {
+        printf("Test %d FAILED: scanning an intact binlog file: %s\n", tests, intact.error.c_str());
+        return 1;
+    }
+
+    tests++;
+
+    /* Damage the first row event of the 51st transaction of the second file */
+    uint64_t damaged_pos = intact.trx[50].start + 150;
+    int fd = open(files[1].path.c_str(), O_RDWR);
+    uint8_t byte = 0xff;
+    pwrite(fd, &byte, 1, damaged_pos);
+    close(fd);
+
+    /* Leave an incomplete transaction and event at the end of the third file */
+    truncate(files[2].path.c_str(), scan_size - 300);
+
+    blr_scan_files(NULL, &files, 2);
+
+    const BLR_SCAN_RESULT& damaged = files[1];
+
+    if (damaged.error.find("Checksum mismatch") == 0
+        && damaged.end_pos < damaged_pos
+        && damaged.trx.size() == 50
+        && damaged.safe_pos == intact.trx[50].start)
+    {
+        printf("Test %d PASSED, %s\n", tests, damaged.error.c_str());
+    }
+    else
+    {
+        printf("Test %d FAILED: damaged binlog file: %s\n", tests, damaged.error.c_str());
+        return 1;
+    }
+
+    tests++;
+
+    const BLR_SCAN_RESULT& truncated = files[2];
+
+    if (truncated.error.find("Incomplete event") == 0
+        && truncated.safe_pos < truncated.end_pos
+        && truncated.trx.size() == 99
+        && truncated.trx.back().end == truncated.safe_pos)
+    {
+        printf("Test %d PASSED, %s, safe pos %lu\n", tests, truncated.error.c_str(), truncated.safe_pos);
+    }
+    else
+    {
+        printf("Test %d FAILED: truncated binlog file: %s\n", tests, truncated.error.c_str());
+        return 1;
+    }
+
+    tests++;
+
+    /**
+     * Binlog compression: a compressed file reads as the original file at
+     * every position and scans as the original file.
+     */
+    printf("--------- Binlog compression tests ---------\n");
+    std::vector<uint8_t> original(scan_size);
+    fd = open(files[0].path.c_str(), O_RDONLY);
+    pread(fd, original.data(), original.size(), 0);
+    close(fd);
+
+    std::atomic<bool> stop_compression(false);
+    bool compressed_ok = blr_compress_file(files[0].path.c_str(), &stop_compression);
+    BLR_COMPRESSED_FILE* compressed = NULL;
+    uint64_t logical_size = 0;
+
+    fd = open(files[0].path.c_str(), O_RDONLY);
+    compressed_ok = compressed_ok
+        && blr_compressed_open(fd, &compressed)
+        && compressed
+        && blr_compressed_size(compressed) == scan_size
+        && blr_compressed_file_size(files[0].path.c_str(), &logical_size)
+        && logical_size == scan_size;
+
+    for (uint64_t pos = 0; compressed_ok && pos < scan_size; pos += 7919)
+    {
+        // Reads span block boundaries and may end past the end of the file
+        uint8_t buf[BINLOG_EVENT_HDR_LEN + 70000];
+        size_t expected = std::min<uint64_t>(sizeof(buf), scan_size - pos);
+
+        compressed_ok = blr_compressed_pread(compressed, buf, sizeof(buf), pos) == (ssize_t)expected
+            && memcmp(buf, original.data() + pos, expected) == 0;
+    }
+
+    if (compressed)
+    {
+        stat(files[0].path.c_str(), &st);
+        blr_compressed_close(compressed);
+    }
+
+    close(fd);
+
+    if (compressed_ok)
+    {
+        printf("Test %d PASSED, binlog file compressed from %lu to %lu bytes\n",
+               tests,
+               scan_size,
+               st.st_size);
+    }
+    else
+    {
+        printf("Test %d FAILED: reading a compressed binlog file\n", tests);
+        return 1;
+    }
+
+    tests++;
+
+    blr_scan_files(NULL, &intact_files, 1);
+
+    if (intact.error.empty()
+        && intact.n_events == 1 + 100 * 6
+        && intact.safe_pos == scan_size
+        && intact.trx.size() == 100)
+    {
+        printf("Test %d PASSED, compressed binlog file scanned\n", tests);
+    }
+    else
+    {
+        printf("Test %d FAILED: scanning a compressed binlog file: %s\n", tests, intact.error.c_str());
+        return 1;
+    }
+
+    tests++;
+
+    /**
+     * A compressed file is checked through the decompressing reader, with the
+     * same result as the original file, and it is not fixed: truncating it
+     * would destroy the compressed data.
+     */
+    char check_path[PATH_MAX + 1];
+    snprintf(check_path, sizeof(check_path), "%s/check-bin.000001", gtid_dir);
+    write_test_binlog(check_path, 1, 100, 200, false);
+    struct stat check_st;
+    stat(check_path, &check_st);
+
+    ROUTER_INSTANCE* check = (ROUTER_INSTANCE*)MXS_CALLOC(1, sizeof(ROUTER_INSTANCE));
+    check->mariadb10_compat = true;
+    strcpy(check->binlog_name, "check-bin.000001");
+    BINLOG_FILE_FIX check_fix = {};
+
+    check->binlog_fd = open(check_path, O_RDONLY);
+    int plain_rc = blr_read_events_all_events(check, &check_fix, BLR_CHECK_ONLY);
+    uint64_t plain_pos = check->binlog_position;
+    close(check->binlog_fd);
+
+    blr_compress_file(check_path, &stop_compression);
+    struct stat compressed_st;
+    stat(check_path, &compressed_st);
+
+    check->binlog_fd = open(check_path, O_RDWR);
+    int check_rc = blr_read_events_all_events(check, &check_fix, BLR_CHECK_ONLY);
+    uint64_t check_pos = check->binlog_position;
+
+    check_fix.fix = true;
+    int fix_rc = blr_read_events_all_events(check, &check_fix, BLR_CHECK_ONLY);
+
+    struct stat fixed_st;
+    fstat(check->binlog_fd, &fixed_st);
+    close(check->binlog_fd);
+    MXS_FREE(check);
+
+    if (compressed_st.st_size < check_st.st_size
+        && plain_rc == 0
+        && plain_pos == (uint64_t)check_st.st_size
+        && check_rc == plain_rc
+        && check_pos == plain_pos
+        && fix_rc != 0
+        && fixed_st.st_size == compressed_st.st_size)
+    {
+        printf("Test %d PASSED, compressed binlog file checked and not fixed\n", tests);
+    }
+    else
+    {
+        printf("Test %d FAILED: checking a compressed binlog file\n", tests);
+        return 1;
+    }
+
+    tests++;
+
+    /**
+     * Binlog rotation with send_durable_only: the magic of a new file needs
+     * no sync, and events written but not yet synced make the slaves wait
+     * instead of being reported as unsafe.
+     */
+    printf("--------- Durable binlog rotation tests ---------\n");
+    ROUTER_INSTANCE* rotate = (ROUTER_INSTANCE*)MXS_CALLOC(1, sizeof(ROUTER_INSTANCE));
+    rotate->service = inst->service;
+    rotate->binlogdir = gtid_dir;
+    rotate->storage_type = BLR_BINLOG_STORAGE_FLAT;
+    rotate->send_durable_only = true;
+    rotate->binlog_fd = -1;
+
+    const uint8_t event[BINLOG_EVENT_HDR_LEN] = {};
+    char rotate_file[] = "rotate-bin.000001";
+    char next_file[] = "rotate-bin.000002";
+    bool rotate_ok = blr_file_rotate(rotate, rotate_file, 0)
+        && write(rotate->binlog_fd, event, sizeof(event)) == sizeof(event);
+
+    rotate->last_written += sizeof(event);
+    rotate->binlog_position = rotate->current_pos = rotate->last_written;
+    rotate_ok = rotate_ok
+        && blr_file_rotate(rotate, next_file, rotate->binlog_position)
+        && blr_slave_safe_pos(rotate) == BINLOG_MAGIC_SIZE;
+
+    BLFILE* rotated = rotate_ok ? blr_open_binlog(rotate, next_file, NULL) : NULL;
+    REP_HEADER rotate_hdr;
+    char rotate_err[BINLOG_ERROR_MSG_LEN + 1] = "";
+
+    /* Up to date at the start of the new file */
+    rotate_ok = rotated
+        && !blr_read_binlog(rotate, rotated, BINLOG_MAGIC_SIZE, &rotate_hdr, rotate_err, NULL)
+        && rotate_hdr.ok == SLAVE_POS_READ_OK;
+
+    /* Written but not synced: wait for the sync */
+    rotate_ok = rotate_ok
+        && write(rotate->binlog_fd, event, sizeof(event)) == sizeof(event);
+    rotate->last_written += sizeof(event);
+    rotate->binlog_position = rotate->current_pos = rotate->last_written;
+    rotate_ok = rotate_ok
+        && blr_slave_safe_pos(rotate) == BINLOG_MAGIC_SIZE
+        && !blr_read_binlog(rotate, rotated, BINLOG_MAGIC_SIZE, &rotate_hdr, rotate_err, NULL)
+        && rotate_hdr.ok == SLAVE_POS_READ_OK
+        && !blr_read_binlog(rotate, rotated, rotate->binlog_position, &rotate_hdr, rotate_err, NULL)
+        && rotate_hdr.ok == SLAVE_POS_READ_OK;
+
+    /* Past the last committed event: unsafe */
+    rotate_ok = rotate_ok
+        && write(rotate->binlog_fd, event, sizeof(event)) == sizeof(event)
+        && !blr_read_binlog(rotate, rotated, rotate->binlog_position + sizeof(event),
+                            &rotate_hdr, rotate_err, NULL)
+        && rotate_hdr.ok == SLAVE_POS_READ_UNSAFE;
+
+    if (rotated)
+    {
+        blr_close_binlog(rotate, rotated);
+    }
+
+    close(rotate->binlog_fd);
+    MXS_FREE(rotate);
+
+    if (rotate_ok)
+    {
+        printf("Test %d PASSED, new binlog file readable before the first sync\n", tests);
+    }
+    else
+    {
+        printf("Test %d FAILED: binlog rotation with send_durable_only: %s\n", tests, rotate_err);
+        return 1;
+    }
+
+    tests++;
+
+    benchmark_scan(gtid_dir);
+
     MXS_FREE(inst->user);
     MXS_FREE(inst->password);
     MXS_FREE(inst->fileroot);
@@ -912,6 +1276,141 @@ int main(int argc, char** argv)
     return 0;
 }
 
+/**
+ * Write a binlog file with MariaDB 10 transactions. Each transaction is a GTID
+ * event, a BEGIN, three row events and an XID event, all with a checksum.
+ *
+ * @param path       The file to write
+ * @param first_seq  The sequence number of the first transaction
+ * @param n_trx      The number of transactions
+ * @param row_size   The size of the row events
+ * @param begin      Whether to write the BEGIN, which MariaDB does not write
+ *                   after a GTID event and the binlog checker does not expect
+ */
+static void write_test_binlog(const char* path, uint64_t first_seq, int n_trx, int row_size, bool begin)
+{
+    std::vector<uint8_t> buf = BINLOG_MAGIC;
+
+    auto add_event = [&buf](uint8_t type, const std::vector<uint8_t>& body) {
+            uint32_t pos = buf.size();
+            uint32_t size = BINLOG_EVENT_HDR_LEN + body.size() + BINLOG_EVENT_CRC_SIZE;
+            buf.resize(pos + size);
+            uint8_t* ev = &buf[pos];
+
+            gw_mysql_set_byte4(ev, 1500000000);
+            ev[4] = type;
+            gw_mysql_set_byte4(ev + 5, 10);
+            gw_mysql_set_byte4(ev + 9, size);
+            gw_mysql_set_byte4(ev + 13, pos + size);
+            gw_mysql_set_byte2(ev + 17, 0);
+            memcpy(ev + BINLOG_EVENT_HDR_LEN, body.data(), body.size());
+            gw_mysql_set_byte4(ev + size - BINLOG_EVENT_CRC_SIZE,
+                               crc32(crc32(0L, NULL, 0), ev, size - BINLOG_EVENT_CRC_SIZE));
+        };
+
+    auto query = [](const char* stmt) {
+            /* thread id, exec time, db name length, error code, status length, db name */
+            std::vector<uint8_t> body(4 + 4 + 1 + 2 + 2 + 1);
+            body.insert(body.end(), stmt, stmt + strlen(stmt));
+            return body;
+        };
+
+    /* Binlog version, server version, timestamp, header length, event types, checksum alg */
+    std::vector<uint8_t> fde(BLRM_FDE_EVENT_TYPES_OFFSET + MAX_EVENT_TYPE_END + 1);
+    fde[0] = 4;
+    strcpy((char*)&fde[2], "10.2.99-MariaDB");
+    fde[BLRM_FDE_EVENT_TYPES_OFFSET - 1] = BINLOG_EVENT_HDR_LEN;
+    fde.back() = 1;
+    add_event(FORMAT_DESCRIPTION_EVENT, fde);
+
+    std::vector<uint8_t> row(row_size, 'x');
+
+    for (int i = 0; i < n_trx; i++)
+    {
+        /* Sequence number, domain, flags and padding */
+        std::vector<uint8_t> gtid(8 + 4 + 1 + 6);
+        uint64_t seq = first_seq + i;
+        memcpy(&gtid[0], &seq, 8);
+        add_event(MARIADB10_GTID_EVENT, gtid);
+
+        if (begin)
+        {
+            add_event(QUERY_EVENT, query("BEGIN"));
+        }
+
+        for (int j = 0; j < 3; j++)
+        {
+            add_event(WRITE_ROWS_EVENTv2, row);
+        }
+
+        add_event(XID_EVENT, std::vector<uint8_t>(8));
+    }
+
+    FILE* file = fopen(path, "wb");
+    fwrite(buf.data(), 1, buf.size(), file);
+    fclose(file);
+}
+
+/**
+ * Compare the time it takes to check synthetic binlog files one event at a
+ * time, as maxbinlogcheck does for a single file, with the parallel scanner.
+ */
+static void benchmark_scan(const char* dir)
+{
+    const int N_FILES = 8;
+    std::vector<BLR_SCAN_RESULT> files(N_FILES);
+    uint64_t total = 0;
+
+    for (int i = 0; i < N_FILES; i++)
+    {
+        char path[PATH_MAX + 1];
+        snprintf(path, sizeof(path), "%s/bench-bin.%06d", dir, i + 1);
+        write_test_binlog(path, i * 10000 + 1, 5000, 1000);
+        files[i].path = path;
+
+        struct stat st;
+        stat(path, &st);
+        total += st.st_size;
+    }
+
+    mxb::StopWatch sw;
+
+    for (const auto& file : files)
+    {
+        ROUTER_INSTANCE* inst = (ROUTER_INSTANCE*)MXS_CALLOC(1, sizeof(ROUTER_INSTANCE));
+        BINLOG_FILE_FIX fix = {0, false, false};
+        inst->binlog_fd = open(file.path.c_str(), O_RDONLY);
+        inst->mariadb10_compat = 1;
+        strcpy(inst->binlog_name, strrchr(file.path.c_str(), '/') + 1);
+        blr_read_events_all_events(inst, &fix, BLR_CHECK_ONLY);
+        close(inst->binlog_fd);
+        MXS_FREE(inst->encryption_ctx);
+        MXS_FREE(inst);
+    }
+
+    double serial = sw.restart().secs();
+    blr_scan_files(NULL, &files, 1);
+    double one = sw.restart().secs();
+    int n_threads = std::max(2U, std::thread::hardware_concurrency());
+    blr_scan_files(NULL, &files, n_threads);
+    double parallel = sw.split().secs();
+
+    const double MB = 1024 * 1024;
+    printf("Checking %d binlog files, %.0f MB: one event at a time %.1f MB/s, "
+           "scanner with 1 thread %.1f MB/s, with %d threads %.1f MB/s\n",
+           N_FILES,
+           total / MB,
+           total / MB / serial,
+           total / MB / one,
+           n_threads,
+           total / MB / parallel);
+
+    for (const auto& file : files)
+    {
+        unlink(file.path.c_str());
+    }
+}
+
 static void master_free_parsed_options(ChangeMasterOptions* options)
 {
     options->host.clear();
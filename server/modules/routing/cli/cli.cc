@@ -87,7 +87,7 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
         MXS_ROUTER_VERSION,
         "The admin user interface",
         "V1.0.0",
-        RCAP_TYPE_NO_AUTH,
+        RCAP_TYPE_NO_AUTH | RCAP_TYPE_MAIN_WORKER,
         &MyObject,
         NULL,   /* Process init. */
         NULL,   /* Process finish. */
@@ -269,5 +269,5 @@ static json_t* diagnostics_json(const MXS_ROUTER* instance)
 
 static uint64_t getCapabilities(MXS_ROUTER* instance)
 {
-    return RCAP_TYPE_NONE;
+    return RCAP_TYPE_MAIN_WORKER;
 }
@@ -119,7 +119,7 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
         MXS_ROUTER_VERSION,
         "The MaxScale Information Schema",
         "V1.0.0",
-        RCAP_TYPE_NO_AUTH,
+        RCAP_TYPE_NO_AUTH | RCAP_TYPE_MAIN_WORKER,
         &MyObject,
         NULL,   /* Process init. */
         NULL,   /* Process finish. */
@@ -382,11 +382,11 @@ static json_t* diagnostics_json(const MXS_ROUTER* instance)
 /**
  * Capabilities interface for the rotuer
  *
- * Not used for the maxinfo router
+ * The sessions are handled by the main worker
  */
 static uint64_t getCapabilities(MXS_ROUTER* instance)
 {
-    return RCAP_TYPE_NONE;
+    return RCAP_TYPE_MAIN_WORKER;
 }
 
 
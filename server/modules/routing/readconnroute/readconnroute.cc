@@ -146,7 +146,7 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
         MXS_ROUTER_VERSION,
         "A connection based router to load balance based on connections",
         "V2.0.0",
-        RCAP_TYPE_RUNTIME_CONFIG,
+        RCAP_TYPE_RUNTIME_CONFIG | RCAP_TYPE_MOVABLE_SESSIONS,
         &MyObject,
         NULL,   /* Process init. */
         NULL,   /* Process finish. */
@@ -721,7 +721,7 @@ static void handleError(MXS_ROUTER* instance,
 
 static uint64_t getCapabilities(MXS_ROUTER* instance)
 {
-    return RCAP_TYPE_RUNTIME_CONFIG;
+    return RCAP_TYPE_RUNTIME_CONFIG | RCAP_TYPE_MOVABLE_SESSIONS;
 }
 
 /*
@@ -0,0 +1,1301 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "scatter_gather.hh"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+
+#include <maxbase/atomic.hh>
+#include <maxscale/modutil.h>
+#include <maxscale/mysql_utils.h>
+#include <maxscale/protocol/mysql.h>
+
+#include "sql_tokenizer.hh"
+
+/** Error for results that can't be merged */
+#define SCATTER_ERR     1815
+#define SCATTER_ERRSTR  "HY000"
+
+/** Error for a lost shard, the same the connector uses for a lost connection */
+#define SCATTER_ERR_LOST 2013
+
+/** The character set number of binary strings */
+#define BINARY_CHARSET 63
+
+namespace
+{
+
+using namespace schemarouter;
+
+bool is_eof(const uint8_t* payload, size_t len)
+{
+    return len < 9 && payload[0] == MYSQL_REPLY_EOF;
+}
+
+bool is_err(const uint8_t* payload, size_t len)
+{
+    return len > 0 && payload[0] == MYSQL_REPLY_ERR;
+}
+
+bool is_numeric(uint8_t type)
+{
+    switch (type)
+    {
+    case MYSQL_TYPE_DECIMAL:
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_YEAR:
+    case MYSQL_TYPE_NEWDECIMAL:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+bool is_decimal(uint8_t type)
+{
+    return type == MYSQL_TYPE_DECIMAL || type == MYSQL_TYPE_NEWDECIMAL;
+}
+
+/**
+ * Check whether the values of a column are ordered byte by byte
+ *
+ * Numbers are compared as numbers. Of the other columns only the ones with the
+ * binary character set are ordered by the server the same way memcmp() orders
+ * them. TIME values can be negative and longer than two digits in the hours
+ * which is why they can't be compared byte by byte even if they are binary.
+ */
+bool is_comparable(uint8_t type, uint16_t charset)
+{
+    return is_numeric(type) || (charset == BINARY_CHARSET && type != MYSQL_TYPE_TIME);
+}
+
+/** A decimal number with the digits before and after the decimal point */
+struct Decimal
+{
+    bool        negative;
+    std::string integer;
+    std::string fraction;
+};
+
+bool parse_decimal(const char* str, size_t len, Decimal* dec)
+{
+    const char* end = str + len;
+    dec->negative = str < end && *str == '-';
+
+    if (dec->negative)
+    {
+        ++str;
+    }
+
+    const char* dot = std::find(str, end, '.');
+    dec->integer.assign(str, dot);
+    dec->fraction.assign(dot == end ? end : dot + 1, end);
+
+    auto is_digits = [](const std::string& s) {
+            return s.find_first_not_of("0123456789") == std::string::npos;
+        };
+
+    return !dec->integer.empty() && is_digits(dec->integer) && is_digits(dec->fraction)
+           && (dot == end || !dec->fraction.empty());
+}
+
+/** Pad the numbers with zeros so that both have the same number of digits */
+void align_decimals(Decimal& a, Decimal& b)
+{
+    size_t integer = std::max(a.integer.length(), b.integer.length());
+    size_t fraction = std::max(a.fraction.length(), b.fraction.length());
+
+    for (Decimal* d : {&a, &b})
+    {
+        d->integer.insert(0, integer - d->integer.length(), '0');
+        d->fraction.append(fraction - d->fraction.length(), '0');
+    }
+}
+
+bool is_zero(const Decimal& d)
+{
+    return d.integer.find_first_not_of('0') == std::string::npos
+           && d.fraction.find_first_not_of('0') == std::string::npos;
+}
+
+/** Compare two aligned decimals */
+int compare_decimals(const Decimal& a, const Decimal& b)
+{
+    bool a_negative = a.negative && !is_zero(a);
+    bool b_negative = b.negative && !is_zero(b);
+
+    if (a_negative != b_negative)
+    {
+        return a_negative ? -1 : 1;
+    }
+
+    int rval = a.integer.compare(b.integer);
+
+    if (rval == 0)
+    {
+        rval = a.fraction.compare(b.fraction);
+    }
+
+    rval = rval < 0 ? -1 : rval > 0 ? 1 : 0;
+    return a_negative ? -rval : rval;
+}
+
+/**
+ * Add two decimal numbers exactly
+ *
+ * @param a      The first number
+ * @param b      The second number
+ * @param result The sum, has as many decimals as the number with the most decimals
+ *
+ * @return False if either one is not a decimal number
+ */
+bool add_decimals(const std::string& a, const std::string& b, std::string* result)
+{
+    Decimal x;
+    Decimal y;
+
+    if (!parse_decimal(a.data(), a.length(), &x) || !parse_decimal(b.data(), b.length(), &y))
+    {
+        return false;
+    }
+
+    align_decimals(x, y);
+    bool subtract = x.negative != y.negative;
+
+    if (subtract)
+    {
+        // Subtract the smaller magnitude from the larger one, the result has the sign of the larger
+        bool negative = x.negative;
+        x.negative = y.negative = false;
+
+        if (compare_decimals(x, y) < 0)
+        {
+            std::swap(x, y);
+            negative = !negative;
+        }
+
+        x.negative = negative;
+    }
+
+    std::string lhs = x.integer + x.fraction;
+    std::string rhs = y.integer + y.fraction;
+    std::string digits(lhs.length(), '0');
+    int carry = 0;
+
+    for (size_t i = lhs.length(); i-- > 0;)
+    {
+        int d;
+
+        if (!subtract)
+        {
+            d = (lhs[i] - '0') + (rhs[i] - '0') + carry;
+            carry = d / 10;
+            d %= 10;
+        }
+        else
+        {
+            d = (lhs[i] - '0') - (rhs[i] - '0') - carry;
+            carry = d < 0 ? 1 : 0;
+            d += carry * 10;
+        }
+
+        digits[i] = '0' + d;
+    }
+
+    if (carry)
+    {
+        digits.insert(0, 1, '1');
+    }
+
+    size_t integer = digits.length() - x.fraction.length();
+    size_t first = std::min(digits.find_first_not_of('0'), integer - 1);
+    Decimal sum {x.negative, digits.substr(first, integer - first), digits.substr(integer)};
+
+    *result = sum.negative && !is_zero(sum) ? "-" : "";
+    *result += sum.integer;
+
+    if (!sum.fraction.empty())
+    {
+        *result += "." + sum.fraction;
+    }
+
+    return true;
+}
+
+bool parse_number(const std::string& str, uint64_t* value)
+{
+    char* end;
+    errno = 0;
+    unsigned long long num = strtoull(str.c_str(), &end, 10);
+    *value = num;
+    return !str.empty() && isdigit(str[0]) && *end == '\0' && errno == 0;
+}
+
+/**
+ * Read a length-encoded string
+ *
+ * @return Pointer to the first byte after the string or NULL if the data ends before it
+ */
+const uint8_t* read_lestr(const uint8_t* ptr, const uint8_t* end, std::string* value)
+{
+    if (ptr >= end || *ptr == 0xfb || *ptr == 0xff || end - ptr < (ptrdiff_t)mxs_leint_bytes(ptr))
+    {
+        return NULL;
+    }
+
+    size_t bytes = mxs_leint_bytes(ptr);
+    uint64_t len = mxs_leint_value(ptr);
+
+    if ((uint64_t)(end - ptr - bytes) < len)
+    {
+        return NULL;
+    }
+
+    if (value)
+    {
+        value->assign((const char*)ptr + bytes, len);
+    }
+
+    return ptr + bytes + len;
+}
+
+/**
+ * Read the names, the character set and the type of a column definition
+ */
+bool parse_column(const std::string& def,
+                  std::string* name,
+                  std::string* org_name,
+                  uint16_t* charset,
+                  uint8_t* type)
+{
+    const uint8_t* ptr = (const uint8_t*)def.data();
+    const uint8_t* end = ptr + def.length();
+
+    // Catalog, schema, table and original table
+    for (int i = 0; i < 4 && ptr; i++)
+    {
+        ptr = read_lestr(ptr, end, NULL);
+    }
+
+    ptr = ptr ? read_lestr(ptr, end, name) : NULL;
+    ptr = ptr ? read_lestr(ptr, end, org_name) : NULL;
+
+    // Length of the fixed fields, the character set and the column length
+    const int charset_offset = 1;
+    const int type_offset = 1 + 2 + 4;
+
+    if (ptr && end - ptr > type_offset)
+    {
+        *charset = gw_mysql_get_byte2(ptr + charset_offset);
+        *type = ptr[type_offset];
+        return true;
+    }
+
+    return false;
+}
+
+void append_lestr(std::string& row, const std::string& value)
+{
+    uint64_t len = value.length();
+
+    if (len < 251)
+    {
+        row += (char)len;
+    }
+    else
+    {
+        int bytes = len < 0x10000 ? 2 : len < 0x1000000 ? 3 : 8;
+        row += (char)(bytes == 2 ? 0xfc : bytes == 3 ? 0xfd : 0xfe);
+
+        for (int i = 0; i < bytes; i++)
+        {
+            row += (char)(len >> (8 * i));
+        }
+    }
+
+    row += value;
+}
+}
+
+namespace schemarouter
+{
+
+// static
+std::unique_ptr<ScatterPlan> ScatterPlan::create(const char* sql, int len)
+{
+    static const char* unsupported[] =
+    {
+        "UNION", "INTO", "DISTINCT", "DISTINCTROW", "SQL_CALC_FOUND_ROWS", "GROUP", "HAVING", "OVER",
+        "WINDOW", "PROCEDURE", "FOR", "LOCK"
+    };
+
+    static const char* aggregate_functions[] =
+    {
+        "AVG", "BIT_AND", "BIT_OR", "BIT_XOR", "GROUP_CONCAT", "JSON_ARRAYAGG", "JSON_OBJECTAGG",
+        "STD", "STDDEV", "STDDEV_POP", "STDDEV_SAMP", "VARIANCE", "VAR_POP", "VAR_SAMP",
+        "COUNT", "SUM", "MIN", "MAX"
+    };
+
+    static const char* modifiers[] =
+    {
+        "ALL", "HIGH_PRIORITY", "STRAIGHT_JOIN", "SQL_SMALL_RESULT", "SQL_BIG_RESULT",
+        "SQL_BUFFER_RESULT", "SQL_CACHE", "SQL_NO_CACHE"
+    };
+
+    std::unique_ptr<ScatterPlan> plan;
+    Tokens tokens;
+
+    if (!tokenize(sql, len, &tokens) || !is_word(tokens, 0, "SELECT"))
+    {
+        return plan;
+    }
+
+    size_t n = tokens.size();
+
+    while (n > 0 && is_punct(tokens, n - 1, ";"))
+    {
+        --n;
+    }
+
+    size_t from = n;
+    size_t order = n;
+    size_t limit = n;
+    int depth = 0;
+
+    for (size_t i = 1; i < n; i++)
+    {
+        if (is_word(tokens, i, "SELECT") || is_punct(tokens, i, ";"))
+        {
+            // Subqueries and multiple statements
+            return plan;
+        }
+
+        for (auto word : unsupported)
+        {
+            if (is_word(tokens, i, word))
+            {
+                return plan;
+            }
+        }
+
+        if (is_punct(tokens, i, "("))
+        {
+            depth++;
+        }
+        else if (is_punct(tokens, i, ")"))
+        {
+            depth--;
+        }
+        else if (depth == 0)
+        {
+            if (from == n && is_word(tokens, i, "FROM"))
+            {
+                from = i;
+            }
+            else if (order == n && is_word(tokens, i, "ORDER") && is_word(tokens, i + 1, "BY"))
+            {
+                order = i;
+            }
+            else if (limit == n && is_word(tokens, i, "LIMIT"))
+            {
+                limit = i;
+            }
+        }
+    }
+
+    if (from == n || (order != n && order > limit))
+    {
+        return plan;
+    }
+
+    plan.reset(new ScatterPlan);
+    size_t start = 1;
+
+    while (std::any_of(std::begin(modifiers), std::end(modifiers), [&](const char* m) {
+                           return is_word(tokens, start, m);
+                       }))
+    {
+        ++start;
+    }
+
+    // Split the select list into its columns and find the aggregates
+    size_t n_columns = 0;
+    size_t item = start;
+
+    for (size_t i = start; i <= from; i++)
+    {
+        if (is_punct(tokens, i, "("))
+        {
+            i = find_closing(tokens, i);
+            continue;
+        }
+        else if (i < from && !is_punct(tokens, i, ","))
+        {
+            continue;
+        }
+
+        // Column from item to i
+        if (item == i)
+        {
+            return NULL;
+        }
+
+        ++n_columns;
+        bool is_aggregate = false;
+
+        if (is_punct(tokens, item + 1, "(") && !is_word(tokens, item + 2, "DISTINCT"))
+        {
+            static const std::pair<const char*, Aggregate> functions[] =
+            {
+                {"COUNT", COUNT}, {"SUM", SUM}, {"MIN", MIN}, {"MAX", MAX}
+            };
+
+            size_t rest = find_closing(tokens, item + 1) + 1;
+
+            // The function can only be followed by an alias
+            bool alias = rest == i
+                || (rest + 1 == i && is_name(tokens, rest))
+                || (rest + 2 == i && is_word(tokens, rest, "AS") && is_name(tokens, rest + 1));
+
+            for (const auto& f : functions)
+            {
+                if (alias && is_word(tokens, item, f.first))
+                {
+                    plan->m_aggregates.push_back(f.second);
+                    is_aggregate = true;
+                }
+            }
+        }
+
+        if (!is_aggregate)
+        {
+            for (size_t j = item; j < i; j++)
+            {
+                for (auto func : aggregate_functions)
+                {
+                    if (is_word(tokens, j, func) && is_punct(tokens, j + 1, "("))
+                    {
+                        // An aggregate that can't be merged or that is a part of an expression
+                        return NULL;
+                    }
+                }
+            }
+        }
+
+        item = i + 1;
+    }
+
+    if (!plan->m_aggregates.empty() && plan->m_aggregates.size() != n_columns)
+    {
+        // Aggregates mixed with normal columns
+        return NULL;
+    }
+
+    size_t order_end = limit;
+
+    if (order != n && plan->m_aggregates.empty())
+    {
+        for (size_t i = order + 2; i < order_end; )
+        {
+            OrderBy column;
+            std::vector<std::string> parts;
+            size_t next = read_name(tokens, i, &parts);
+            uint64_t position = 0;
+
+            if (next != i)
+            {
+                column.name = parts.back();
+                column.position = 0;
+            }
+            else if (tokens[i].kind == Token::NUMBER && parse_number(tokens[i].value, &position)
+                     && position > 0)
+            {
+                column.position = position;
+                next = i + 1;
+            }
+            else
+            {
+                // Ordering by an expression
+                return NULL;
+            }
+
+            column.descending = is_word(tokens, next, "DESC");
+
+            if (column.descending || is_word(tokens, next, "ASC"))
+            {
+                ++next;
+            }
+
+            plan->m_order_by.push_back(column);
+
+            if (next != order_end && !is_punct(tokens, next, ","))
+            {
+                return NULL;
+            }
+
+            i = next + 1;
+        }
+    }
+
+    std::string query(sql, len);
+
+    if (limit != n)
+    {
+        uint64_t first = 0;
+        uint64_t second = 0;
+        size_t end = limit + 2;
+
+        if (!parse_number(limit + 1 < n ? tokens[limit + 1].value : "", &first))
+        {
+            return NULL;
+        }
+
+        if (is_punct(tokens, limit + 2, ",") || is_word(tokens, limit + 2, "OFFSET"))
+        {
+            if (!parse_number(limit + 3 < n ? tokens[limit + 3].value : "", &second))
+            {
+                return NULL;
+            }
+
+            bool has_comma = is_punct(tokens, limit + 2, ",");
+            plan->m_offset = has_comma ? first : second;
+            plan->m_limit = has_comma ? second : first;
+            end = limit + 4;
+        }
+        else
+        {
+            plan->m_limit = first;
+        }
+
+        if (end != n || plan->m_offset > NO_LIMIT - plan->m_limit)
+        {
+            return NULL;
+        }
+
+        if (!plan->m_aggregates.empty() && (plan->m_offset > 0 || plan->m_limit == 0))
+        {
+            return NULL;
+        }
+
+        if (plan->m_offset > 0)
+        {
+            // Each shard must return the rows before the offset as the offset
+            // is applied to the merged result
+            query = query.substr(0, tokens[limit].start)
+                + "LIMIT " + std::to_string(plan->m_offset + plan->m_limit)
+                + query.substr(tokens[end - 1].end);
+        }
+    }
+
+    plan->m_query = query;
+    return plan;
+}
+
+ScatterGather::ScatterGather(std::unique_ptr<ScatterPlan> plan, const SSRBackendList& targets)
+    : m_plan(std::move(plan))
+    , m_seq(1)
+    , m_header_sent(false)
+    , m_finished(false)
+    , m_skipped(0)
+    , m_sent(0)
+    , m_warnings(0)
+    , m_status(0)
+{
+    for (const auto& backend : targets)
+    {
+        m_shards.emplace_back(backend);
+    }
+}
+
+ScatterGather::~ScatterGather()
+{
+    for (auto& shard : m_shards)
+    {
+        gwbuf_free(shard.partial);
+    }
+}
+
+bool ScatterGather::route()
+{
+    bool rval = false;
+
+    for (auto& shard : m_shards)
+    {
+        GWBUF* buffer = modutil_create_query(m_plan->query().c_str());
+
+        if (buffer && shard.backend->write(buffer))
+        {
+            mxb::atomic::add(&shard.backend->server()->stats.packets, 1, mxb::atomic::RELAXED);
+            rval = true;
+        }
+        else
+        {
+            MXS_ERROR("Failed to route query to '%s'", shard.backend->name());
+            gwbuf_free(buffer);
+            shard.state = DONE;
+
+            // The other shards can't complete the result without this one
+            send_error("Failed to route the query to all shards");
+        }
+    }
+
+    return rval;
+}
+
+bool ScatterGather::is_target(const SSRBackend& backend) const
+{
+    return std::any_of(m_shards.begin(), m_shards.end(), [&](const Shard& shard) {
+                           return shard.backend == backend;
+                       });
+}
+
+bool ScatterGather::is_complete() const
+{
+    return std::all_of(m_shards.begin(), m_shards.end(), [](const Shard& shard) {
+                           return shard.state == DONE;
+                       });
+}
+
+GWBUF* ScatterGather::process(const SSRBackend& backend, GWBUF* buffer)
+{
+    auto shard = std::find_if(m_shards.begin(), m_shards.end(), [&](const Shard& s) {
+                                  return s.backend == backend;
+                              });
+    mxb_assert(shard != m_shards.end());
+
+    shard->partial = gwbuf_append(shard->partial, buffer);
+
+    if (GWBUF* packets = modutil_get_complete_packets(&shard->partial))
+    {
+        packets = gwbuf_make_contiguous(packets);
+        const uint8_t* ptr = GWBUF_DATA(packets);
+        const uint8_t* end = ptr + GWBUF_LENGTH(packets);
+
+        while (ptr < end && shard->state != DONE)
+        {
+            size_t len = MYSQL_GET_PAYLOAD_LEN(ptr);
+            handle_packet(*shard, ptr + MYSQL_HEADER_LEN, len);
+            ptr += MYSQL_HEADER_LEN + len;
+        }
+
+        gwbuf_free(packets);
+    }
+
+    merge_rows();
+
+    if (is_complete())
+    {
+        finish();
+    }
+
+    return flush();
+}
+
+GWBUF* ScatterGather::fail(const SSRBackend& backend)
+{
+    for (auto& shard : m_shards)
+    {
+        if (shard.backend == backend && shard.state != DONE)
+        {
+            shard.state = DONE;
+            shard.rows.clear();
+            gwbuf_free(shard.partial);
+            shard.partial = NULL;
+
+            char msg[512];
+            snprintf(msg, sizeof(msg), "Lost connection to shard '%s'", backend->name());
+            send_error(msg);
+        }
+    }
+
+    if (is_complete())
+    {
+        finish();
+    }
+
+    return flush();
+}
+
+void ScatterGather::handle_packet(Shard& shard, const uint8_t* payload, size_t len)
+{
+    if (shard.continued)
+    {
+        // The rest of a large row
+        shard.continued = len == GW_MYSQL_MAX_PACKET_LEN;
+
+        if (shard.send_continued && !m_finished)
+        {
+            send_packet(payload, len);
+        }
+    }
+    else if (len == 0)
+    {
+        send_error("Malformed response from a shard");
+        shard.state = DONE;
+    }
+    else if (is_err(payload, len))
+    {
+        if (!m_finished)
+        {
+            // Forward the first error, it ends the result for the client
+            send_packet(payload, len);
+            m_finished = true;
+        }
+
+        shard.state = DONE;
+    }
+    else
+    {
+        switch (shard.state)
+        {
+        case COLUMN_COUNT:
+            if (payload[0] == MYSQL_REPLY_OK)
+            {
+                send_error("Unexpected response from a shard");
+                shard.state = DONE;
+            }
+            else
+            {
+                shard.n_columns = mxs_leint_value(payload);
+                shard.header.emplace_back((const char*)payload, len);
+                shard.state = COLUMNS;
+            }
+            break;
+
+        case COLUMNS:
+            shard.header.emplace_back((const char*)payload, len);
+
+            if (is_eof(payload, len))
+            {
+                handle_header(shard);
+                shard.state = ROWS;
+            }
+            break;
+
+        case ROWS:
+            if (is_eof(payload, len))
+            {
+                handle_eof(payload, len);
+                shard.state = DONE;
+            }
+            else
+            {
+                handle_row(shard, payload, len);
+            }
+            break;
+
+        case DONE:
+            mxb_assert(!true);
+            break;
+        }
+    }
+}
+
+void ScatterGather::handle_header(Shard& shard)
+{
+    // The column count, the column definitions and the EOF packet
+    if (shard.header.size() != shard.n_columns + 2)
+    {
+        send_error("Malformed column definitions from a shard");
+    }
+    else if (!m_header_sent && !m_finished)
+    {
+        std::vector<std::string> names;
+        std::vector<std::string> org_names;
+        std::vector<bool> comparable;
+
+        for (size_t i = 1; i <= shard.n_columns; i++)
+        {
+            std::string name;
+            std::string org_name;
+            uint16_t charset;
+            uint8_t type;
+
+            if (!parse_column(shard.header[i], &name, &org_name, &charset, &type))
+            {
+                send_error("Malformed column definitions from a shard");
+                return;
+            }
+
+            names.push_back(name);
+            org_names.push_back(org_name);
+            comparable.push_back(is_comparable(type, charset));
+            m_types.push_back(type);
+        }
+
+        if (!m_plan->aggregates().empty() && m_plan->aggregates().size() != shard.n_columns)
+        {
+            send_error("Unexpected number of columns from a shard");
+            return;
+        }
+
+        for (const auto& column : m_plan->order_by())
+        {
+            size_t index = shard.n_columns;
+
+            if (column.position > 0)
+            {
+                index = column.position - 1;
+            }
+            else
+            {
+                for (size_t i = 0; i < shard.n_columns && index == shard.n_columns; i++)
+                {
+                    if (strcasecmp(names[i].c_str(), column.name.c_str()) == 0)
+                    {
+                        index = i;
+                    }
+                }
+
+                for (size_t i = 0; i < shard.n_columns && index == shard.n_columns; i++)
+                {
+                    if (strcasecmp(org_names[i].c_str(), column.name.c_str()) == 0)
+                    {
+                        index = i;
+                    }
+                }
+            }
+
+            if (index >= shard.n_columns)
+            {
+                char msg[512];
+                snprintf(msg, sizeof(msg),
+                         "ORDER BY column '%s' must be in the select list of a query that is "
+                         "sent to multiple shards",
+                         column.name.empty() ? std::to_string(column.position).c_str() : column.name.c_str());
+                send_error(msg);
+                return;
+            }
+            else if (!comparable[index])
+            {
+                send_error("The results of the shards can't be merged: an ORDER BY column is ordered "
+                           "by its collation");
+                return;
+            }
+
+            m_sort.push_back({index, column.descending});
+        }
+
+        for (size_t i = 0; i < m_plan->aggregates().size(); i++)
+        {
+            ScatterPlan::Aggregate func = m_plan->aggregates()[i];
+
+            if ((func == ScatterPlan::MIN || func == ScatterPlan::MAX) && !comparable[i])
+            {
+                send_error("The results of the shards can't be merged: the values of a MIN or MAX "
+                           "are compared by their collation");
+                return;
+            }
+        }
+
+        for (const auto& packet : shard.header)
+        {
+            send_packet((const uint8_t*)packet.data(), packet.length());
+        }
+
+        m_totals.resize(shard.n_columns);
+        m_header_sent = true;
+    }
+    else if (m_header_sent && shard.n_columns != m_types.size())
+    {
+        send_error("Shards returned different numbers of columns");
+    }
+
+    shard.header.clear();
+}
+
+void ScatterGather::handle_row(Shard& shard, const uint8_t* payload, size_t len)
+{
+    bool streamed = m_plan->aggregates().empty() && m_sort.empty();
+
+    if (m_finished || !m_header_sent)
+    {
+        return;
+    }
+    else if (len == GW_MYSQL_MAX_PACKET_LEN)
+    {
+        if (streamed)
+        {
+            shard.continued = true;
+            shard.send_continued = send_row(payload, len);
+        }
+        else
+        {
+            send_error("Rows larger than 16MB can't be merged");
+        }
+    }
+    else if (streamed)
+    {
+        send_row(payload, len);
+    }
+    else
+    {
+        Row row;
+        row.data.assign((const char*)payload, len);
+
+        if (!parse_row((const uint8_t*)row.data.data(), len, m_types.size(), &row.fields))
+        {
+            send_error("Malformed row from a shard");
+        }
+        else if (!m_plan->aggregates().empty())
+        {
+            for (size_t i = 0; i < m_types.size(); i++)
+            {
+                const Field& f = row.fields[i];
+                add_total(m_totals[i],
+                          m_plan->aggregates()[i],
+                          m_types[i],
+                          f.offset ? row.data.data() + f.offset : NULL,
+                          f.length);
+            }
+        }
+        else if (m_sent < m_plan->limit())
+        {
+            shard.rows.push_back(std::move(row));
+        }
+    }
+}
+
+void ScatterGather::handle_eof(const uint8_t* payload, size_t len)
+{
+    if (len >= 5)
+    {
+        m_warnings += gw_mysql_get_byte2(payload + 1);
+        m_status = gw_mysql_get_byte2(payload + 3);
+    }
+}
+
+void ScatterGather::merge_rows()
+{
+    while (!m_finished && !m_sort.empty())
+    {
+        Shard* best = NULL;
+
+        for (auto& shard : m_shards)
+        {
+            if (shard.rows.empty())
+            {
+                if (shard.state != DONE)
+                {
+                    // The next row could come from this shard
+                    return;
+                }
+            }
+            else if (!best || less(shard.rows.front(), best->rows.front()))
+            {
+                best = &shard;
+            }
+        }
+
+        if (!best)
+        {
+            break;
+        }
+
+        const Row& row = best->rows.front();
+        send_row((const uint8_t*)row.data.data(), row.data.length());
+        best->rows.pop_front();
+
+        if (m_sent >= m_plan->limit())
+        {
+            for (auto& shard : m_shards)
+            {
+                shard.rows.clear();
+            }
+        }
+    }
+}
+
+bool ScatterGather::less(const Row& a, const Row& b) const
+{
+    for (const auto& key : m_sort)
+    {
+        const Field& fa = a.fields[key.index];
+        const Field& fb = b.fields[key.index];
+        int c;
+
+        if (!fa.offset || !fb.offset)
+        {
+            // NULL is smaller than any value
+            c = (fa.offset ? 1 : 0) - (fb.offset ? 1 : 0);
+        }
+        else
+        {
+            c = compare(m_types[key.index],
+                        a.data.data() + fa.offset, fa.length,
+                        b.data.data() + fb.offset, fb.length);
+        }
+
+        if (c != 0)
+        {
+            return key.descending ? c > 0 : c < 0;
+        }
+    }
+
+    return false;
+}
+
+int ScatterGather::compare(uint8_t type, const char* a, size_t a_len, const char* b, size_t b_len) const
+{
+    int rval;
+
+    Decimal x_dec;
+    Decimal y_dec;
+
+    if (is_decimal(type) && parse_decimal(a, a_len, &x_dec) && parse_decimal(b, b_len, &y_dec))
+    {
+        align_decimals(x_dec, y_dec);
+        rval = compare_decimals(x_dec, y_dec);
+    }
+    else if (is_numeric(type))
+    {
+        long double x = strtold(std::string(a, a_len).c_str(), NULL);
+        long double y = strtold(std::string(b, b_len).c_str(), NULL);
+        rval = x < y ? -1 : x > y ? 1 : 0;
+    }
+    else
+    {
+        rval = memcmp(a, b, std::min(a_len, b_len));
+
+        if (rval == 0)
+        {
+            rval = a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+        }
+    }
+
+    return rval;
+}
+
+void ScatterGather::add_total(Total& total,
+                              ScatterPlan::Aggregate func,
+                              uint8_t type,
+                              const char* value,
+                              size_t len)
+{
+    if (!value)
+    {
+        return;
+    }
+
+    std::string str(value, len);
+
+    if (func == ScatterPlan::COUNT)
+    {
+        total.count += strtoull(str.c_str(), NULL, 10);
+        total.null = false;
+    }
+    else if (func == ScatterPlan::SUM && is_decimal(type))
+    {
+        // The SUM of integers and decimals is a decimal, added exactly
+        if (total.null)
+        {
+            total.value = str;
+            total.null = false;
+        }
+        else if (!add_decimals(total.value, str, &total.value))
+        {
+            send_error("Malformed decimal value from a shard");
+        }
+    }
+    else if (func == ScatterPlan::SUM)
+    {
+        size_t dot = str.find('.');
+
+        if (dot != std::string::npos)
+        {
+            int decimals = str.find_first_not_of("0123456789", dot + 1) == std::string::npos ?
+                str.length() - dot - 1 : 0;
+            total.decimals = std::max(total.decimals, decimals);
+        }
+
+        total.sum += strtold(str.c_str(), NULL);
+        total.null = false;
+    }
+    else
+    {
+        int c = total.null ? 0 : compare(type, str.data(), str.length(),
+                                         total.value.data(), total.value.length());
+
+        if (total.null || (func == ScatterPlan::MIN ? c < 0 : c > 0))
+        {
+            total.value = str;
+            total.null = false;
+        }
+    }
+}
+
+bool ScatterGather::send_row(const uint8_t* payload, size_t len)
+{
+    if (m_skipped < m_plan->offset())
+    {
+        m_skipped++;
+        return false;
+    }
+    else if (m_sent >= m_plan->limit())
+    {
+        return false;
+    }
+
+    m_sent++;
+    send_packet(payload, len);
+    return true;
+}
+
+void ScatterGather::send_totals()
+{
+    std::string row;
+
+    for (size_t i = 0; i < m_totals.size(); i++)
+    {
+        const Total& total = m_totals[i];
+        ScatterPlan::Aggregate func = m_plan->aggregates()[i];
+
+        if (func == ScatterPlan::COUNT)
+        {
+            append_lestr(row, std::to_string(total.count));
+        }
+        else if (total.null)
+        {
+            row += (char)0xfb;
+        }
+        else if (func == ScatterPlan::SUM && !is_decimal(m_types[i]))
+        {
+            char buf[512];
+            snprintf(buf, sizeof(buf), "%.*Lf", std::min(total.decimals, 30), total.sum);
+            append_lestr(row, buf);
+        }
+        else
+        {
+            append_lestr(row, total.value);
+        }
+    }
+
+    send_packet((const uint8_t*)row.data(), row.length());
+}
+
+void ScatterGather::send_packet(const uint8_t* payload, size_t len)
+{
+    uint8_t header[MYSQL_HEADER_LEN];
+    gw_mysql_set_byte3(header, len);
+    header[3] = m_seq++;
+    m_out.insert(m_out.end(), header, header + MYSQL_HEADER_LEN);
+    m_out.insert(m_out.end(), payload, payload + len);
+}
+
+void ScatterGather::send_error(const char* msg)
+{
+    if (!m_finished)
+    {
+        MXS_INFO("Scatter-gather query failed: %s", msg);
+        GWBUF* err = modutil_create_mysql_err_msg(m_seq, 0, SCATTER_ERR, SCATTER_ERRSTR, msg);
+
+        if (err)
+        {
+            size_t len = gwbuf_length(err);
+            m_out.resize(m_out.size() + len);
+            gwbuf_copy_data(err, 0, len, &m_out[m_out.size() - len]);
+            gwbuf_free(err);
+        }
+
+        m_finished = true;
+    }
+}
+
+void ScatterGather::finish()
+{
+    if (m_finished)
+    {
+        return;
+    }
+    else if (!m_header_sent)
+    {
+        send_error("No result from the shards");
+        return;
+    }
+
+    if (!m_plan->aggregates().empty())
+    {
+        send_totals();
+    }
+
+    uint8_t eof[5];
+    eof[0] = MYSQL_REPLY_EOF;
+    gw_mysql_set_byte2(eof + 1, m_warnings);
+    gw_mysql_set_byte2(eof + 3, m_status & ~SERVER_MORE_RESULTS_EXIST);
+    send_packet(eof, sizeof(eof));
+    m_finished = true;
+}
+
+bool ScatterGather::parse_row(const uint8_t* payload,
+                              size_t len,
+                              size_t n_columns,
+                              std::vector<Field>* fields) const
+{
+    const uint8_t* ptr = payload;
+    const uint8_t* end = payload + len;
+
+    for (size_t i = 0; i < n_columns; i++)
+    {
+        if (ptr >= end)
+        {
+            return false;
+        }
+        else if (*ptr == 0xfb)
+        {
+            fields->push_back({0, 0});
+            ++ptr;
+        }
+        else
+        {
+            const uint8_t* next = read_lestr(ptr, end, NULL);
+
+            if (!next)
+            {
+                return false;
+            }
+
+            size_t bytes = mxs_leint_bytes(ptr);
+            fields->push_back({(size_t)(ptr + bytes - payload), (size_t)(next - ptr - bytes)});
+            ptr = next;
+        }
+    }
+
+    return ptr == end;
+}
+
+GWBUF* ScatterGather::flush()
+{
+    GWBUF* rval = NULL;
+
+    if (!m_out.empty())
+    {
+        rval = gwbuf_alloc_and_load(m_out.size(), m_out.data());
+        m_out.clear();
+    }
+
+    return rval;
+}
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+#pragma once
+
+#include "schemarouter.hh"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace schemarouter
+{
+
+/**
+ * How a SELECT that is sent to multiple shards is rewritten and how its results
+ * are merged
+ */
+class ScatterPlan
+{
+public:
+    static const uint64_t NO_LIMIT = UINT64_MAX;
+
+    enum Aggregate
+    {
+        COUNT,
+        SUM,
+        MIN,
+        MAX
+    };
+
+    /** A column of the ORDER BY clause */
+    struct OrderBy
+    {
+        std::string name;       /*< Column name, empty if ordered by position */
+        size_t      position;   /*< Position of the column in the result, starting from 1 */
+        bool        descending;
+    };
+
+    /**
+     * Create a plan for a statement
+     *
+     * @param sql The SQL statement
+     * @param len Length of the statement
+     *
+     * @return The plan or NULL if the results of the statement can't be merged
+     */
+    static std::unique_ptr<ScatterPlan> create(const char* sql, int len);
+
+    /** The statement that is sent to the shards */
+    const std::string& query() const
+    {
+        return m_query;
+    }
+
+    /** The aggregate functions of the columns, empty if the query has no aggregates */
+    const std::vector<Aggregate>& aggregates() const
+    {
+        return m_aggregates;
+    }
+
+    const std::vector<OrderBy>& order_by() const
+    {
+        return m_order_by;
+    }
+
+    /** Number of rows to skip from the merged result */
+    uint64_t offset() const
+    {
+        return m_offset;
+    }
+
+    /** Maximum number of rows in the merged result */
+    uint64_t limit() const
+    {
+        return m_limit;
+    }
+
+private:
+    ScatterPlan()
+        : m_offset(0)
+        , m_limit(NO_LIMIT)
+    {
+    }
+
+    std::string            m_query;
+    std::vector<Aggregate> m_aggregates;
+    std::vector<OrderBy>   m_order_by;
+    uint64_t               m_offset;
+    uint64_t               m_limit;
+};
+
+/**
+ * Execution of a SELECT on multiple shards
+ *
+ * The query is sent to all shards at the same time. The result of the first
+ * shard to send its column definitions is used as the header of the merged
+ * result and the rows are forwarded as they arrive. If the query is ordered,
+ * the rows are merged so that a row is only held back until every shard has
+ * sent a row it can be compared with. Aggregates are combined once all shards
+ * are done.
+ */
+class ScatterGather
+{
+    ScatterGather(const ScatterGather&) = delete;
+    ScatterGather& operator=(const ScatterGather&) = delete;
+public:
+    ScatterGather(std::unique_ptr<ScatterPlan> plan, const SSRBackendList& targets);
+    ~ScatterGather();
+
+    /**
+     * Send the query to the shards
+     *
+     * @return True if the query was sent to at least one shard
+     */
+    bool route();
+
+    /**
+     * Check whether a backend takes part in the query
+     */
+    bool is_target(const SSRBackend& backend) const;
+
+    /**
+     * Process a part of the response of a shard
+     *
+     * @param backend The backend the response came from
+     * @param buffer  The response, owned by this function
+     *
+     * @return The data that should be sent to the client or NULL if there's nothing to send
+     */
+    GWBUF* process(const SSRBackend& backend, GWBUF* buffer);
+
+    /**
+     * Handle the loss of a shard
+     *
+     * @param backend The backend that failed
+     *
+     * @return The data that should be sent to the client or NULL if there's nothing to send
+     */
+    GWBUF* fail(const SSRBackend& backend);
+
+    /**
+     * Check whether the responses of all shards have been processed
+     */
+    bool is_complete() const;
+
+private:
+    enum State
+    {
+        COLUMN_COUNT,   /*< Waiting for the column count */
+        COLUMNS,        /*< Reading the column definitions */
+        ROWS,           /*< Reading the rows */
+        DONE
+    };
+
+    /** A field of a row, NULL if offset is zero */
+    struct Field
+    {
+        size_t offset;  /*< Offset of the value in the row */
+        size_t length;
+    };
+
+    /** A row that is held back to be ordered */
+    struct Row
+    {
+        std::string        data;    /*< The payload of the row packet */
+        std::vector<Field> fields;
+    };
+
+    struct Shard
+    {
+        Shard(const SSRBackend& b)
+            : backend(b)
+            , partial(NULL)
+            , state(COLUMN_COUNT)
+            , n_columns(0)
+            , continued(false)
+            , send_continued(false)
+        {
+        }
+
+        SSRBackend               backend;
+        GWBUF*                   partial;   /*< Incomplete packet */
+        State                    state;
+        uint64_t                 n_columns;
+        std::vector<std::string> header;    /*< The column count and definitions */
+        std::deque<Row>          rows;      /*< Rows waiting to be ordered */
+        bool                     continued; /*< Whether the next packet continues a large packet */
+        bool                     send_continued;/*< Whether the continuation is sent to the client */
+    };
+
+    /** The column used to order the rows */
+    struct SortKey
+    {
+        size_t index;
+        bool   descending;
+    };
+
+    /** The merged value of an aggregate */
+    struct Total
+    {
+        Total()
+            : null(true)
+            , count(0)
+            , sum(0)
+            , decimals(0)
+        {
+        }
+
+        bool        null;
+        uint64_t    count;      /*< Value of COUNT */
+        long double sum;        /*< SUM of floating point values */
+        int         decimals;   /*< Most decimals of the summed values */
+        std::string value;      /*< Value of MIN, MAX and the SUM of decimals */
+    };
+
+    std::unique_ptr<ScatterPlan> m_plan;
+    std::vector<Shard>           m_shards;
+    std::vector<uint8_t>         m_out;             /*< Packets that are sent to the client */
+    uint8_t                      m_seq;             /*< Sequence number of the next packet */
+    bool                         m_header_sent;
+    bool                         m_finished;        /*< Whether the client has the whole response */
+    std::vector<uint8_t>         m_types;           /*< Column types */
+    std::vector<SortKey>         m_sort;
+    std::vector<Total>           m_totals;
+    uint64_t                     m_skipped;         /*< Rows skipped because of the offset */
+    uint64_t                     m_sent;            /*< Rows sent to the client */
+    uint16_t                     m_warnings;
+    uint16_t                     m_status;          /*< Server status of the last EOF packet */
+
+    void    handle_packet(Shard& shard, const uint8_t* payload, size_t len);
+    void    handle_header(Shard& shard);
+    void    handle_row(Shard& shard, const uint8_t* payload, size_t len);
+    void    handle_eof(const uint8_t* payload, size_t len);
+    void    merge_rows();
+    bool    less(const Row& a, const Row& b) const;
+    int     compare(uint8_t type, const char* a, size_t a_len, const char* b, size_t b_len) const;
+    void    add_total(Total& total, ScatterPlan::Aggregate func, uint8_t type, const char* value, size_t len);
+    bool    send_row(const uint8_t* payload, size_t len);
+    void    send_totals();
+    void    send_packet(const uint8_t* payload, size_t len);
+    void    send_error(const char* msg);
+    void    finish();
+    bool    parse_row(const uint8_t* payload, size_t len, size_t n_columns, std::vector<Field>* fields) const;
+    GWBUF*  flush();
+};
+}
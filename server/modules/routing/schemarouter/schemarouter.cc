@@ -25,6 +25,8 @@ Config::Config(MXS_CONFIG_PARAMETER* conf)
     , ignore_regex(config_get_compiled_regex(conf, "ignore_databases_regex", 0, NULL))
     , ignore_match_data(ignore_regex ? pcre2_match_data_create_from_pattern(ignore_regex, NULL) : NULL)
     , preferred_server(config_get_server(conf, "preferred_server"))
+    , background_refresh(config_get_bool(conf, "background_refresh"))
+    , scatter_gather(config_get_bool(conf, "scatter_gather"))
 {
     ignored_dbs.insert("mysql");
     ignored_dbs.insert("information_schema");
@@ -40,6 +42,44 @@ Config::Config(MXS_CONFIG_PARAMETER* conf)
     }
 }
 
+bool Config::ignore_duplicate_database(const char* name) const
+{
+    bool rval = false;
+
+    if (ignored_dbs.find(name) != ignored_dbs.end())
+    {
+        rval = true;
+    }
+    else if (sharding_rules && sharding_rules->find(name))
+    {
+        rval = true;
+    }
+    else if (ignore_regex)
+    {
+        pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(ignore_regex, NULL);
+
+        if (match_data == NULL)
+        {
+            throw std::bad_alloc();
+        }
+
+        if (pcre2_match(ignore_regex,
+                        (PCRE2_SPTR) name,
+                        PCRE2_ZERO_TERMINATED,
+                        0,
+                        0,
+                        match_data,
+                        NULL) >= 0)
+        {
+            rval = true;
+        }
+
+        pcre2_match_data_free(match_data);
+    }
+
+    return rval;
+}
+
 void SRBackend::set_mapped(bool value)
 {
     m_mapped = value;
@@ -32,6 +32,17 @@
 #include <maxscale/backend.hh>
 #include <maxscale/protocol/rwbackend.hh>
 
+#include "shard_rules.hh"
+
+/** The query that lists the databases without tables and the tables of a server */
+#define MAPPING_QUERY \
+    "SELECT schema_name FROM information_schema.schemata AS s " \
+    "LEFT JOIN information_schema.tables AS t ON s.schema_name = t.table_schema " \
+    "WHERE t.table_name IS NULL " \
+    "UNION " \
+    "SELECT CONCAT (table_schema, '.', table_name) FROM information_schema.tables " \
+    "WHERE table_schema NOT IN ('information_schema', 'performance_schema', 'mysql');"
+
 namespace schemarouter
 {
 /**
@@ -48,9 +59,23 @@ struct Config
     pcre2_match_data*     ignore_match_data;/**< Match data for @c ignore_regex */
     std::set<std::string> ignored_dbs;      /**< Set of ignored databases */
     SERVER*               preferred_server; /**< Server to prefer in conflict situations */
+    bool                  background_refresh;/**< Map the databases in the background */
+    SShardRules           sharding_rules;   /**< The sharding rules of the tables */
+    bool                  scatter_gather;   /**< Send SELECTs of sharded tables to all shards */
 
     Config(MXS_CONFIG_PARAMETER* conf);
 
+    /**
+     * Check if a database or table is ignored when checking for duplicates
+     *
+     * Tables with sharding rules are expected to be found on multiple servers.
+     *
+     * @param name Database or table name
+     *
+     * @return True if duplicates of @c name are ignored
+     */
+    bool ignore_duplicate_database(const char* name) const;
+
     ~Config()
     {
         pcre2_match_data_free(ignore_match_data);
@@ -44,14 +44,42 @@ namespace schemarouter
 SchemaRouter::SchemaRouter(SERVICE* service, SConfig config)
     : mxs::Router<SchemaRouter, SchemaRouterSession>(service)
     , m_config(config)
+    , m_discovery(service, m_shard_manager)
     , m_service(service)
 {
+    m_discovery.configure(config);
 }
 
 SchemaRouter::~SchemaRouter()
 {
 }
 
+/**
+ * Create the router configuration
+ *
+ * @param service The service of the router
+ * @param params  The router parameters
+ *
+ * @return The configuration or an empty pointer if the sharding rules could not be loaded
+ */
+static SConfig create_config(SERVICE* service, MXS_CONFIG_PARAMETER* params)
+{
+    SConfig config(new Config(params));
+    const char* rules = config_get_string(params, "sharding_rules");
+
+    if (*rules)
+    {
+        config->sharding_rules = ShardRules::load(rules, service);
+
+        if (!config->sharding_rules)
+        {
+            config.reset();
+        }
+    }
+
+    return config;
+}
+
 SchemaRouter* SchemaRouter::create(SERVICE* pService, MXS_CONFIG_PARAMETER* params)
 {
     if ((config_get_param(params, "auth_all_servers")) == NULL)
@@ -61,14 +89,21 @@ SchemaRouter* SchemaRouter::create(SERVICE* pService, MXS_CONFIG_PARAMETER* para
         pService->users_from_all = true;
     }
 
-    SConfig config(new Config(params));
-    return new SchemaRouter(pService, config);
+    SConfig config = create_config(pService, params);
+    return config ? new SchemaRouter(pService, config) : NULL;
 }
 
 bool SchemaRouter::configure(MXS_CONFIG_PARAMETER* params)
 {
-    SConfig config(new Config(params));
+    SConfig config = create_config(m_service, params);
+
+    if (!config)
+    {
+        return false;
+    }
+
     m_config = config;
+    m_discovery.configure(config);
     return true;
 }
 
@@ -303,6 +338,9 @@ extern "C" MXS_MODULE* MXS_CREATE_MODULE()
             {"refresh_interval",                              MXS_MODULE_PARAM_COUNT, DEFAULT_REFRESH_INTERVAL},
             {"debug",                                         MXS_MODULE_PARAM_BOOL, "false"},
             {"preferred_server",                              MXS_MODULE_PARAM_SERVER  },
+            {"background_refresh",                            MXS_MODULE_PARAM_BOOL, "false"},
+            {"sharding_rules",                                MXS_MODULE_PARAM_PATH, NULL, MXS_MODULE_OPT_PATH_R_OK},
+            {"scatter_gather",                                MXS_MODULE_PARAM_BOOL, "false"},
             {MXS_END_MODULE_PARAMS}
         }
     };
@@ -22,6 +22,7 @@
 #include <maxscale/pcre2.h>
 
 #include "schemaroutersession.hh"
+#include "shard_discovery.hh"
 
 namespace schemarouter
 {
@@ -49,10 +50,11 @@ private:
     SchemaRouter(SERVICE* service, SConfig config);
 
     /** Member variables */
-    SConfig      m_config;          /*< expanded config info from SERVICE */
-    ShardManager m_shard_manager;   /*< Shard maps hashed by user name */
-    SERVICE*     m_service;         /*< Pointer to service */
-    std::mutex   m_lock;            /*< Lock for the instance data */
-    Stats        m_stats;           /*< Statistics for this router */
+    SConfig        m_config;        /*< expanded config info from SERVICE */
+    ShardManager   m_shard_manager; /*< Shard maps hashed by user name */
+    ShardDiscovery m_discovery;     /*< Background discovery of the databases */
+    SERVICE*       m_service;       /*< Pointer to service */
+    std::mutex     m_lock;          /*< Lock for the instance data */
+    Stats          m_stats;         /*< Statistics for this router */
 };
 }
@@ -259,6 +259,155 @@ SERVER* SchemaRouterSession::resolve_query_target(GWBUF* pPacket,
     return target;
 }
 
+/**
+ * Send a SELECT of a sharded table to all of its shards
+ *
+ * Only read-only SELECTs that use exactly one table with a HASH or RANGE rule and
+ * whose shard keys don't resolve to a single server are sent to multiple shards.
+ * If such a query can't be sent to all of its shards, the client gets an error
+ * instead of the rows of only one shard.
+ *
+ * @param pPacket The query, freed if the query was handled
+ * @param type    The type of the query
+ *
+ * @return True if the query was routed to the shards or an error was sent
+ */
+bool SchemaRouterSession::scatter_query(GWBUF* pPacket, uint32_t type)
+{
+    if (!qc_query_is_type(type, QUERY_TYPE_READ)
+        || qc_query_is_type(type, QUERY_TYPE_WRITE)
+        || qc_get_operation(pPacket) != QUERY_OP_SELECT)
+    {
+        return false;
+    }
+
+    int n_tables = 0;
+    char** tables = qc_get_table_names(pPacket, &n_tables, true);
+    const ShardRule* rule = n_tables == 1 ? find_rule(tables[0]) : NULL;
+
+    for (int i = 0; i < n_tables; i++)
+    {
+        MXS_FREE(tables[i]);
+    }
+    MXS_FREE(tables);
+
+    if (!rule || rule->type() == ShardRule::TABLE)
+    {
+        return false;
+    }
+
+    std::set<SERVER*> servers;
+    std::vector<std::string> keys;
+
+    if (get_shard_keys(pPacket, *rule, n_tables, &keys))
+    {
+        for (const auto& key : keys)
+        {
+            SERVER* server = rule->locate(key);
+
+            if (server == NULL)
+            {
+                servers.clear();
+                break;
+            }
+
+            servers.insert(server);
+        }
+    }
+
+    if (servers.empty())
+    {
+        servers.insert(rule->servers().begin(), rule->servers().end());
+    }
+
+    if (servers.size() < 2)
+    {
+        // Routed normally
+        return false;
+    }
+
+    char* sql;
+    int len;
+    std::unique_ptr<ScatterPlan> plan;
+    std::string error;
+
+    if (modutil_extract_SQL(pPacket, &sql, &len))
+    {
+        plan = ScatterPlan::create(sql, len);
+    }
+
+    if (!plan)
+    {
+        error = "The results of the query can't be merged from multiple shards";
+    }
+
+    SSRBackendList targets;
+
+    for (auto it = m_backends.begin(); it != m_backends.end() && error.empty(); it++)
+    {
+        const SSRBackend& bref = *it;
+
+        if (servers.count(bref->backend()->server))
+        {
+            if (!bref->in_use() || bref->is_closed() || !server_is_usable(bref->backend()->server)
+                || bref->has_session_commands())
+            {
+                error = "Shard '" + std::string(bref->name()) + "' is not available for a query "
+                    "that is sent to multiple shards";
+            }
+            else
+            {
+                targets.push_back(bref);
+            }
+        }
+    }
+
+    if (error.empty() && targets.size() != servers.size())
+    {
+        error = "Not all shards of the query are servers of the service";
+    }
+
+    if (error.empty())
+    {
+        MXS_INFO("Sending query to %lu shards", targets.size());
+        m_scatter.reset(new ScatterGather(std::move(plan), targets));
+
+        if (m_scatter->route())
+        {
+            mxb::atomic::add(&m_router->m_stats.n_queries, 1, mxb::atomic::RELAXED);
+        }
+        else
+        {
+            m_scatter.reset();
+            error = "Failed to route the query to the shards";
+        }
+    }
+
+    gwbuf_free(pPacket);
+
+    if (!error.empty())
+    {
+        MXS_INFO("%s", error.c_str());
+        write_error_to_client(m_client, SCHEMA_ERR_SCATTER, SCHEMA_ERRSTR_SCATTER, error.c_str());
+    }
+
+    return true;
+}
+
+/**
+ * End the scatter-gather query once all shards are done and route the next
+ * queued query, if any
+ */
+void SchemaRouterSession::finish_scatter()
+{
+    m_scatter.reset();
+
+    if (m_queue.size())
+    {
+        route_queued_query();
+    }
+}
+
 static bool is_empty_packet(GWBUF* pPacket)
 {
     bool rval = false;
@@ -314,6 +463,13 @@ int32_t SchemaRouterSession::routeQuery(GWBUF* pPacket)
         return ret;
     }
 
+    if (m_scatter)
+    {
+        /** The rest of the results of a scatter-gather query are still coming */
+        m_queue.push_back(pPacket);
+        return 1;
+    }
+
     uint8_t command = 0;
     SERVER* target = NULL;
     uint32_t type = QUERY_TYPE_UNKNOWN;
@@ -375,6 +531,12 @@ int32_t SchemaRouterSession::routeQuery(GWBUF* pPacket)
                                       SCHEMA_ERR_DBNOTFOUND,
                                       SCHEMA_ERRSTR_DBNOTFOUND,
                                       errbuf);
+
+                if (m_config->background_refresh && m_config->refresh_databases)
+                {
+                    // The database may have been created after the last refresh
+                    m_router->m_discovery.refresh();
+                }
                 return 1;
             }
 
@@ -396,6 +558,24 @@ int32_t SchemaRouterSession::routeQuery(GWBUF* pPacket)
         else
         {
             route_target = get_shard_route_target(type);
+
+            if (TARGET_IS_UNDEFINED(route_target) && m_config->scatter_gather
+                && command == MXS_COM_QUERY && pPacket->hint == NULL
+                && scatter_query(pPacket, type))
+            {
+                return 1;
+            }
+
+            if ((pPacket->hint == NULL || pPacket->hint->type != HINT_ROUTE_TO_NAMED_SERVER)
+                && !is_routable(pPacket, command, type))
+            {
+                gwbuf_free(pPacket);
+                write_error_to_client(m_client,
+                                      SCHEMA_ERR_SHARDKEY,
+                                      SCHEMA_ERRSTR_SHARDKEY,
+                                      "The shard keys of a query of a sharded table must all be on one server");
+                return 1;
+            }
         }
 
         /**
@@ -551,6 +731,20 @@ void SchemaRouterSession::clientReply(GWBUF* pPacket, DCB* pDcb)
 
     bref->process_reply(pPacket);
 
+    if (m_scatter && m_scatter->is_target(bref))
+    {
+        if (GWBUF* pReply = m_scatter->process(bref, pPacket))
+        {
+            MXS_SESSION_ROUTE_REPLY(pDcb->session, pReply);
+        }
+
+        if (m_scatter->is_complete())
+        {
+            finish_scatter();
+        }
+        return;
+    }
+
     if (m_state & INIT_MAPPING)
     {
         handle_mapping_reply(bref, &pPacket);
@@ -573,7 +767,7 @@ void SchemaRouterSession::clientReply(GWBUF* pPacket, DCB* pDcb)
         }
     }
 
-    else if (m_queue.size())
+    else if (m_queue.size() && !m_scatter)
     {
         mxb_assert(m_state == INIT_READY);
         route_queued_query();
@@ -619,7 +813,20 @@ void SchemaRouterSession::handleError(GWBUF* pMessage,
     switch (action)
     {
     case ERRACT_NEW_CONNECTION:
-        if (bref->is_waiting_result())
+        if (m_scatter && m_scatter->is_target(bref))
+        {
+            /** The merged result can't be completed without this shard */
+            if (GWBUF* pReply = m_scatter->fail(bref))
+            {
+                MXS_SESSION_ROUTE_REPLY(m_client->session, pReply);
+            }
+
+            if (m_scatter->is_complete())
+            {
+                finish_scatter();
+            }
+        }
+        else if (bref->is_waiting_result())
         {
             /** If the client is waiting for a reply, send an error. */
             m_client->func.write(m_client, gwbuf_clone(pMessage));
@@ -1192,40 +1399,6 @@ char* get_lenenc_str(void* data)
     return rval;
 }
 
-bool SchemaRouterSession::ignore_duplicate_database(const char* data)
-{
-    bool rval = false;
-
-    if (m_config->ignored_dbs.find(data) != m_config->ignored_dbs.end())
-    {
-        rval = true;
-    }
-    else if (m_config->ignore_regex)
-    {
-        pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(m_config->ignore_regex, NULL);
-
-        if (match_data == NULL)
-        {
-            throw std::bad_alloc();
-        }
-
-        if (pcre2_match(m_config->ignore_regex,
-                        (PCRE2_SPTR) data,
-                        PCRE2_ZERO_TERMINATED,
-                        0,
-                        0,
-                        match_data,
-                        NULL) >= 0)
-        {
-            rval = true;
-        }
-
-        pcre2_match_data_free(match_data);
-    }
-
-    return rval;
-}
-
 /**
  * Parses a response set to a SHOW DATABASES query and inserts them into the
  * router client session's database hashtable. The name of the database is used
@@ -1302,7 +1475,7 @@ enum showdb_response SchemaRouterSession::parse_mapping_response(SSRBackend& bre
             }
             else
             {
-                if (!ignore_duplicate_database(data) && strchr(data, '.') != NULL)
+                if (!m_config->ignore_duplicate_database(data) && strchr(data, '.') != NULL)
                 {
                     duplicate_found = true;
                     SERVER* duplicate = m_shard.get_location(data);
@@ -1375,12 +1548,7 @@ void SchemaRouterSession::query_databases()
     m_state |= INIT_MAPPING;
     m_state &= ~INIT_UNINT;
 
-    GWBUF* buffer = modutil_create_query("SELECT schema_name FROM information_schema.schemata AS s "
-                                         "LEFT JOIN information_schema.tables AS t ON s.schema_name = t.table_schema "
-                                         "WHERE t.table_name IS NULL "
-                                         "UNION "
-                                         "SELECT CONCAT (table_schema, '.', table_name) FROM information_schema.tables "
-                                         "WHERE table_schema NOT IN ('information_schema', 'performance_schema', 'mysql');");
+    GWBUF* buffer = modutil_create_query(MAPPING_QUERY);
     gwbuf_set_type(buffer, GWBUF_TYPE_COLLECT_RESULT);
 
     for (SSRBackendList::iterator it = m_backends.begin(); it != m_backends.end(); it++)
@@ -1616,9 +1784,12 @@ SERVER* SchemaRouterSession::get_query_target(GWBUF* buffer)
 {
     int n_tables = 0;
     char** tables = qc_get_table_names(buffer, &n_tables, true);
-    SERVER* rval = NULL;
 
-    for (int i = 0; i < n_tables; i++)
+    // The sharded tables decide the target if their shard keys are known
+    bool resolved;
+    SERVER* rval = get_rule_target(buffer, tables, n_tables, &resolved);
+
+    for (int i = 0; i < n_tables && rval == NULL; i++)
     {
         if (strchr(tables[i], '.') == NULL)
         {
@@ -1637,6 +1808,12 @@ SERVER* SchemaRouterSession::get_query_target(GWBUF* buffer)
         {
             for (int i = 0; i < n_tables; i++)
             {
+                if (find_rule(tables[i]))
+                {
+                    // The rows of a sharded table can be on any of its servers
+                    continue;
+                }
+
                 SERVER* target = m_shard.get_location(tables[i]);
                 if (target)
                 {
@@ -1686,6 +1863,161 @@ SERVER* SchemaRouterSession::get_query_target(GWBUF* buffer)
     return rval;
 }
 
+/**
+ * Find the sharding rule of a table
+ *
+ * @param table Table name, qualified with the current database if it has no database
+ *
+ * @return The rule of the table or NULL if the table has no rule
+ */
+const ShardRule* SchemaRouterSession::find_rule(const char* table) const
+{
+    const ShardRule* rval = NULL;
+
+    if (m_config->sharding_rules)
+    {
+        rval = strchr(table, '.') ?
+            m_config->sharding_rules->find(table) :
+            m_config->sharding_rules->find(m_current_db + '.' + table);
+    }
+
+    return rval;
+}
+
+/**
+ * Find the target of a query from the sharding rules of its tables
+ *
+ * @param buffer   The query
+ * @param tables   The tables of the query
+ * @param n_tables Number of tables
+ * @param resolved Set to false if the rows of a sharded table are not on one
+ *                 server or if the sharded tables are on different servers
+ *
+ * @return The server that has the rows of the sharded tables or NULL if the
+ *         query uses no sharded tables or the server can't be resolved
+ */
+SERVER* SchemaRouterSession::get_rule_target(GWBUF* buffer, char** tables, int n_tables, bool* resolved)
+{
+    SERVER* rval = NULL;
+    *resolved = true;
+
+    for (int i = 0; i < n_tables; i++)
+    {
+        const ShardRule* rule = find_rule(tables[i]);
+
+        if (!rule)
+        {
+            continue;
+        }
+
+        SERVER* target = locate_rows(buffer, *rule, n_tables);
+
+        if (!target)
+        {
+            MXS_INFO("The shard keys of table '%s' in the query are not on one server", tables[i]);
+            *resolved = false;
+        }
+        else
+        {
+            if (rval && target != rval)
+            {
+                MXS_ERROR("Query targets shards on servers '%s' and '%s'. "
+                          "Cross server queries are not supported.",
+                          rval->name, target->name);
+                *resolved = false;
+            }
+            else if (rval == NULL)
+            {
+                rval = target;
+                MXS_INFO("Query targets shard of table '%s' on server '%s'", tables[i], rval->name);
+            }
+        }
+    }
+
+    return rval;
+}
+
+/**
+ * Check whether a query of the sharded tables can be routed to one server
+ *
+ * A query must be sent to the server that has the rows of its shard keys. If
+ * it was routed by the database, a write would only modify the rows of one
+ * server and a read would only return them. As prepared statements are not
+ * routed by their shard keys, they can't use tables that are sharded by a key.
+ * The SELECTs that are sent to multiple shards are handled before this.
+ *
+ * @param buffer  The query
+ * @param command The command of the query
+ * @param type    The type of the query
+ *
+ * @return True if the query doesn't use a sharded table or if the rows that
+ *         it uses are on one server
+ */
+bool SchemaRouterSession::is_routable(GWBUF* buffer, uint8_t command, uint32_t type)
+{
+    if (!m_config->sharding_rules || (command != MXS_COM_QUERY && command != MXS_COM_STMT_PREPARE))
+    {
+        return true;
+    }
+
+    bool prepared = command == MXS_COM_STMT_PREPARE;
+    GWBUF* stmt = buffer;
+
+    if (qc_query_is_type(type, QUERY_TYPE_PREPARE_NAMED_STMT))
+    {
+        stmt = qc_get_preparable_stmt(buffer);
+        prepared = true;
+    }
+
+    if (stmt == NULL)
+    {
+        return true;
+    }
+
+    switch (qc_get_operation(stmt))
+    {
+    case QUERY_OP_SELECT:
+    case QUERY_OP_INSERT:
+    case QUERY_OP_UPDATE:
+    case QUERY_OP_DELETE:
+    case QUERY_OP_LOAD:
+    case QUERY_OP_LOAD_LOCAL:
+        break;
+
+    default:
+        return true;
+    }
+
+    int n_tables = 0;
+    char** tables = qc_get_table_names(stmt, &n_tables, true);
+    bool resolved = true;
+
+    if (prepared)
+    {
+        for (int i = 0; i < n_tables; i++)
+        {
+            const ShardRule* rule = find_rule(tables[i]);
+
+            if (rule && rule->type() != ShardRule::TABLE)
+            {
+                resolved = false;
+            }
+        }
+    }
+    else
+    {
+        get_rule_target(stmt, tables, n_tables, &resolved);
+    }
+
+    for (int i = 0; i < n_tables; i++)
+    {
+        MXS_FREE(tables[i]);
+    }
+    MXS_FREE(tables);
+
+    return resolved;
+}
+
 SERVER* SchemaRouterSession::get_ps_target(GWBUF* buffer, uint32_t qtype, qc_query_op_t op)
 {
     SERVER* rval = NULL;
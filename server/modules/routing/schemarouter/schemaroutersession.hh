@@ -14,14 +14,16 @@
 
 #include "schemarouter.hh"
 
-#include <string>
 #include <list>
+#include <memory>
+#include <string>
 
 #include <maxscale/protocol/mysql.h>
 #include <maxscale/router.hh>
 #include <maxscale/session_command.hh>
 
 #include "shard_map.hh"
+#include "scatter_gather.hh"
 
 namespace schemarouter
 {
@@ -50,6 +52,10 @@ enum showdb_response
 #define SCHEMA_ERRSTR_DUPLICATEDB "DUPDB"
 #define SCHEMA_ERR_DBNOTFOUND     1049
 #define SCHEMA_ERRSTR_DBNOTFOUND  "42000"
+#define SCHEMA_ERR_SHARDKEY       5001
+#define SCHEMA_ERRSTR_SHARDKEY    "HY000"
+#define SCHEMA_ERR_SCATTER        5002
+#define SCHEMA_ERRSTR_SCATTER     "HY000"
 
 /**
  * Route target types
@@ -129,9 +135,11 @@ private:
     bool       get_shard_dcb(DCB** dcb, char* name);
     bool       have_servers();
     bool       handle_default_db();
-    bool       ignore_duplicate_database(const char* data);
     SERVER*    get_query_target(GWBUF* buffer);
     SERVER*    get_ps_target(GWBUF* buffer, uint32_t qtype, qc_query_op_t op);
+    SERVER*    get_rule_target(GWBUF* buffer, char** tables, int n_tables, bool* resolved);
+    bool       is_routable(GWBUF* buffer, uint8_t command, uint32_t type);
+    const ShardRule* find_rule(const char* table) const;
 
     /** Routing functions */
     bool    route_session_write(GWBUF* querybuf, uint8_t command);
@@ -140,6 +148,8 @@ private:
                                  uint32_t type,
                                  uint8_t  command,
                                  enum route_target& route_target);
+    bool    scatter_query(GWBUF* pPacket, uint32_t type);
+    void    finish_scatter();
 
     /** Shard mapping functions */
     void                 send_databases();
@@ -168,5 +178,6 @@ private:
     uint64_t               m_sent_sescmd;   /**< The latest session command being executed */
     uint64_t               m_replied_sescmd;/**< The last session command reply that was sent to the client */
     SERVER*                m_load_target;   /**< Target for LOAD DATA LOCAL INFILE */
+    std::unique_ptr<ScatterGather> m_scatter;/**< The active scatter-gather query */
 };
 }
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "shard_discovery.hh"
+
+#include <algorithm>
+#include <chrono>
+
+#include <maxscale/alloc.h>
+#include <maxscale/config.h>
+#include <maxscale/log.h>
+#include <maxscale/maxscale.h>
+#include <maxscale/mysql_utils.h>
+#include <maxscale/paths.h>
+#include <maxscale/secrets.h>
+
+/**
+ * A checksum of the databases and tables that the mapping query returns. It is
+ * a lot cheaper to send than the whole list when there are many tables.
+ */
+#define CHECKSUM_QUERY \
+    "SELECT CONCAT(COUNT(*), '-', COALESCE(SUM(CRC32(name)), 0)) FROM (" \
+    "SELECT schema_name AS name FROM information_schema.schemata " \
+    "UNION ALL " \
+    "SELECT CONCAT(table_schema, '.', table_name) FROM information_schema.tables " \
+    "WHERE table_schema NOT IN ('information_schema', 'performance_schema', 'mysql')) AS names"
+
+/**
+ * The shortest interval between the periodic refreshes in seconds. A
+ * refresh_interval of zero would otherwise query the servers in a busy loop.
+ */
+#define MIN_REFRESH_INTERVAL 1.0
+
+namespace schemarouter
+{
+
+ShardDiscovery::ShardDiscovery(SERVICE* service, ShardManager& manager)
+    : m_service(service)
+    , m_manager(manager)
+    , m_running(false)
+    , m_refresh(false)
+    , m_reconfigured(false)
+{
+}
+
+ShardDiscovery::~ShardDiscovery()
+{
+    stop();
+}
+
+void ShardDiscovery::configure(const SConfig& config)
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_config = config;
+    m_reconfigured = true;
+    bool running = m_running;
+    guard.unlock();
+
+    if (config->background_refresh && !running)
+    {
+        start();
+    }
+    else if (!config->background_refresh && running)
+    {
+        stop();
+
+        // The sessions map the databases themselves again
+        m_manager.set_global_locations(SShardLocations());
+    }
+    else
+    {
+        // The interval or the duplicate database handling may have changed
+        refresh();
+    }
+}
+
+void ShardDiscovery::refresh()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_refresh = true;
+    m_cond.notify_one();
+}
+
+void ShardDiscovery::start()
+{
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_running = true;
+    m_refresh = true;
+    m_thread = std::thread(&ShardDiscovery::run, this);
+}
+
+void ShardDiscovery::stop()
+{
+    std::unique_lock<std::mutex> guard(m_lock);
+    m_running = false;
+    m_cond.notify_one();
+    guard.unlock();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    m_results.clear();
+}
+
+void ShardDiscovery::run()
+{
+    if (mysql_thread_init() != 0)
+    {
+        MXS_ERROR("[%s] mysql_thread_init() failed, the databases are not mapped in the background.",
+                  m_service->name);
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(m_lock);
+    bool mapped = false;
+
+    while (m_running)
+    {
+        // Until the first successful refresh, retry more often as the servers
+        // usually aren't available when the router is created
+        double seconds = std::max(m_config->refresh_min_interval, MIN_REFRESH_INTERVAL);
+        auto interval = std::chrono::duration<double>(mapped ? seconds : std::min(seconds, 10.0));
+
+        if (!m_refresh && !m_cond.wait_for(guard, interval, [this]() {
+                                               return m_refresh || !m_running;
+                                           }))
+        {
+            // Periodic refresh
+            m_refresh = true;
+        }
+
+        if (m_running && m_refresh && !maxscale_is_shutting_down())
+        {
+            bool reconfigured = m_reconfigured;
+            m_refresh = false;
+            m_reconfigured = false;
+            SConfig config = m_config;
+            guard.unlock();
+
+            if (update_locations(config, reconfigured))
+            {
+                mapped = true;
+            }
+
+            guard.lock();
+        }
+    }
+
+    guard.unlock();
+    mysql_thread_end();
+}
+
+/**
+ * Query the databases and tables of one server
+ *
+ * If the checksum of the databases and tables matches the one of the previous
+ * result, the previous list is kept.
+ *
+ * @param server   Server to query
+ * @param user     Service user
+ * @param password Decrypted password of the service user
+ * @param result   The previous result of the server, updated with the new result
+ */
+// static
+void ShardDiscovery::query_server(SERVER* server,
+                                  const char* user,
+                                  const char* password,
+                                  ServerResult* result)
+{
+    if (mysql_thread_init() != 0)
+    {
+        result->ok = false;
+        return;
+    }
+
+    MYSQL* mysql = mysql_init(NULL);
+    MXS_CONFIG* cnf = config_get_global_options();
+    bool ok = false;
+
+    if (mysql)
+    {
+        mysql_optionsv(mysql, MYSQL_OPT_READ_TIMEOUT, &cnf->auth_read_timeout);
+        mysql_optionsv(mysql, MYSQL_OPT_CONNECT_TIMEOUT, &cnf->auth_conn_timeout);
+        mysql_optionsv(mysql, MYSQL_OPT_WRITE_TIMEOUT, &cnf->auth_write_timeout);
+        mysql_optionsv(mysql, MYSQL_PLUGIN_DIR, get_connector_plugindir());
+    }
+
+    if (mysql && mxs_mysql_real_connect(mysql, server, user, password))
+    {
+        MYSQL_RES* res;
+        std::string checksum;
+
+        if (mxs_mysql_query(mysql, CHECKSUM_QUERY) == 0 && (res = mysql_store_result(mysql)))
+        {
+            MYSQL_ROW row = mysql_fetch_row(res);
+
+            if (row && row[0])
+            {
+                checksum = row[0];
+            }
+
+            mysql_free_result(res);
+        }
+
+        if (result->ok && !checksum.empty() && checksum == result->checksum)
+        {
+            // Nothing has changed since the previous refresh
+            ok = true;
+        }
+        else if (mxs_mysql_query(mysql, MAPPING_QUERY) == 0 && (res = mysql_store_result(mysql)))
+        {
+            result->names.clear();
+            result->names.reserve(mysql_num_rows(res));
+
+            while (MYSQL_ROW row = mysql_fetch_row(res))
+            {
+                if (row[0])
+                {
+                    result->names.push_back(row[0]);
+                }
+            }
+
+            mysql_free_result(res);
+            result->checksum = checksum;
+            ok = true;
+        }
+    }
+
+    if (!ok)
+    {
+        MXS_ERROR("Failed to map the databases of server '%s': %d, %s",
+                  server->name,
+                  mysql ? mysql_errno(mysql) : 0,
+                  mysql ? mysql_error(mysql) : "Out of memory");
+    }
+
+    result->ok = ok;
+    mysql_close(mysql);
+    mysql_thread_end();
+}
+
+/**
+ * Query all servers and publish the new locations if they changed
+ *
+ * @param config       The configuration to use
+ * @param reconfigured Whether the configuration changed since the previous refresh
+ *
+ * @return True if the locations of at least one server are known
+ */
+bool ShardDiscovery::update_locations(const SConfig& config, bool reconfigured)
+{
+    const char* username;
+    const char* password;
+    serviceGetUser(m_service, &username, &password);
+
+    // The credentials of the service can be altered while the servers are queried
+    std::string user = username;
+    char* dpasswd = decrypt_password(password);
+
+    if (!dpasswd)
+    {
+        return false;
+    }
+
+    std::vector<SERVER*> servers;
+
+    for (SERVER_REF* ref = m_service->dbref; ref; ref = ref->next)
+    {
+        if (SERVER_REF_IS_ACTIVE(ref) && server_is_usable(ref->server))
+        {
+            servers.push_back(ref->server);
+        }
+    }
+
+    // Each server is queried in its own thread, starting from its previous result
+    std::vector<ServerResult> results;
+    std::vector<std::thread> threads;
+    results.reserve(servers.size());
+
+    for (SERVER* server : servers)
+    {
+        auto it = m_results.find(server);
+        results.push_back(it != m_results.end() ? it->second : ServerResult());
+    }
+
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        threads.emplace_back(query_server, servers[i], user.c_str(), dpasswd, &results[i]);
+    }
+
+    for (auto& thr : threads)
+    {
+        thr.join();
+    }
+
+    MXS_FREE(dpasswd);
+
+    ResultMap new_results;
+
+    for (size_t i = 0; i < servers.size(); i++)
+    {
+        if (results[i].ok)
+        {
+            new_results[servers[i]] = std::move(results[i]);
+        }
+    }
+
+    if (new_results.empty())
+    {
+        // Keep using the previous locations until a server can be queried
+        return false;
+    }
+
+    if (reconfigured || results_changed(m_results, new_results, servers.size()))
+    {
+        SShardLocations locations = create_locations(config, servers, new_results);
+
+        MXS_INFO("[%s] Mapped %lu databases and tables from %lu servers.",
+                 m_service->name,
+                 locations->content().size(),
+                 new_results.size());
+
+        m_manager.set_global_locations(locations);
+    }
+
+    m_results.swap(new_results);
+    return true;
+}
+
+/**
+ * Check whether the databases or tables of the servers have changed
+ *
+ * A server without a checksum is always considered changed.
+ *
+ * @param previous  The results of the previous refresh
+ * @param current   The results of the servers that were queried successfully
+ * @param n_servers How many servers were queried
+ *
+ * @return True if the locations must be created again
+ */
+// static
+bool ShardDiscovery::results_changed(const ResultMap& previous, const ResultMap& current, size_t n_servers)
+{
+    if (n_servers != previous.size() || current.size() != n_servers)
+    {
+        // A server was added, removed or could not be queried
+        return true;
+    }
+
+    return std::any_of(current.begin(), current.end(), [&](const ResultMap::value_type& result) {
+                           auto it = previous.find(result.first);
+                           return it == previous.end() || result.second.checksum.empty()
+                                  || it->second.checksum != result.second.checksum;
+                       });
+}
+
+/**
+ * Create the locations from the results of the servers
+ *
+ * @param config  The configuration
+ * @param servers The servers in the order they are listed in the service
+ * @param results The results of the servers that were queried successfully
+ *
+ * @return The new locations
+ */
+// static
+SShardLocations ShardDiscovery::create_locations(const SConfig& config,
+                                                 const std::vector<SERVER*>& servers,
+                                                 const ResultMap& results)
+{
+    SShardLocations locations = std::make_shared<ShardLocations>();
+
+    // The servers are merged in the order they are listed in the service
+    for (SERVER* server : servers)
+    {
+        auto it = results.find(server);
+
+        if (it == results.end())
+        {
+            continue;
+        }
+
+        for (const auto& name : it->second.names)
+        {
+            if (!locations->add(name, server))
+            {
+                SERVER* duplicate = locations->get(name);
+
+                if (!config->ignore_duplicate_database(name.c_str())
+                    && name.find('.') != std::string::npos)
+                {
+                    MXS_ERROR("Table '%s' found on servers '%s' and '%s', using '%s'.",
+                              name.c_str(),
+                              duplicate->name,
+                              server->name,
+                              duplicate->name);
+                }
+                else if (config->preferred_server == server)
+                {
+                    /** In conflict situations, use the preferred server */
+                    locations->replace(name, server);
+                }
+            }
+        }
+    }
+
+    return locations;
+}
+}
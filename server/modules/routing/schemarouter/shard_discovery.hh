@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+#pragma once
+
+#include "schemarouter.hh"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "shard_map.hh"
+
+namespace schemarouter
+{
+
+/**
+ * Background discovery of the database and table locations
+ *
+ * The servers of the service are queried in parallel with the service user's
+ * credentials. Each refresh first asks the servers for a checksum of their
+ * databases and tables and only the servers whose checksum changed send the
+ * full list. The result is published to the shard manager, where new sessions
+ * pick it up without having to map the databases themselves.
+ */
+class ShardDiscovery
+{
+    ShardDiscovery(const ShardDiscovery&) = delete;
+    ShardDiscovery& operator=(const ShardDiscovery&) = delete;
+public:
+    // Helper class used for testing.
+    class Test;
+    friend class Test;
+
+    ShardDiscovery(SERVICE* service, ShardManager& manager);
+    ~ShardDiscovery();
+
+    /**
+     * Start or stop the discovery based on the configuration
+     *
+     * @param config The new configuration
+     */
+    void configure(const SConfig& config);
+
+    /**
+     * Refresh the locations right away
+     */
+    void refresh();
+
+private:
+    /** The latest result of one server */
+    struct ServerResult
+    {
+        ServerResult()
+            : ok(false)
+        {
+        }
+
+        bool                     ok;            /*< Whether the server was queried successfully */
+        std::string              checksum;      /*< Checksum of the databases and tables */
+        std::vector<std::string> names;         /*< The databases and tables of the server */
+    };
+
+    typedef std::unordered_map<SERVER*, ServerResult> ResultMap;
+
+    SERVICE*                m_service;
+    ShardManager&           m_manager;
+    std::mutex              m_lock;
+    std::condition_variable m_cond;
+    SConfig                 m_config;
+    bool                    m_running;          /*< Whether the thread should keep running */
+    bool                    m_refresh;          /*< Whether a refresh was requested */
+    bool                    m_reconfigured;     /*< Whether the configuration has changed */
+    std::thread             m_thread;
+    ResultMap               m_results;          /*< Only accessed by the discovery thread */
+
+    void start();
+    void stop();
+    void run();
+    bool update_locations(const SConfig& config, bool reconfigured);
+
+    static bool results_changed(const ResultMap& previous, const ResultMap& current, size_t n_servers);
+    static SShardLocations create_locations(const SConfig& config,
+                                            const std::vector<SERVER*>& servers,
+                                            const ResultMap& results);
+
+    static void query_server(SERVER* server,
+                             const char* user,
+                             const char* password,
+                             ServerResult* result);
+};
+}
@@ -17,18 +17,78 @@
 
 #include <maxscale/alloc.h>
 
-Shard::Shard()
+static std::string to_lower(const std::string& str)
+{
+    std::string rval(str);
+    std::transform(rval.begin(), rval.end(), rval.begin(), ::tolower);
+    return rval;
+}
+
+ShardLocations::ShardLocations()
     : m_last_updated(time(NULL))
 {
 }
 
+bool ShardLocations::add(const std::string& name, SERVER* target)
+{
+    bool added = m_map.insert(std::make_pair(name, target)).second;
+
+    if (added)
+    {
+        std::string key = to_lower(name);
+        m_names.insert(std::make_pair(key, target));
+
+        // If the same database is on multiple servers, the first one is used
+        m_databases.insert(std::make_pair(key.substr(0, key.find('.')), target));
+    }
+
+    return added;
+}
+
+void ShardLocations::replace(const std::string& name, SERVER* target)
+{
+    std::string key = to_lower(name);
+    m_map[name] = target;
+    m_names[key] = target;
+    m_databases[key.substr(0, key.find('.'))] = target;
+}
+
+SERVER* ShardLocations::get(const std::string& name) const
+{
+    std::string key = to_lower(name);
+    const ServerMap& index = key.find('.') == std::string::npos ? m_databases : m_names;
+    auto it = index.find(key);
+    return it != index.end() ? it->second : NULL;
+}
+
+Shard::Shard()
+    : m_locations(std::make_shared<ShardLocations>())
+{
+}
+
+Shard::Shard(const SShardLocations& locations)
+    : m_locations(locations)
+{
+}
+
 Shard::~Shard()
 {
 }
 
-bool Shard::add_location(std::string db, SERVER* target)
+ShardLocations& Shard::writable_locations()
+{
+    if (!m_locations.unique())
+    {
+        // The locations are shared with other sessions, modify a copy of them
+        m_locations = std::make_shared<ShardLocations>(*m_locations);
+    }
+
+    return *m_locations;
+}
+
+bool Shard::add_location(const std::string& db, SERVER* target)
 {
-    return m_map.insert(std::make_pair(db, target)).second;
+    return writable_locations().add(db, target);
 }
 
 void Shard::add_statement(std::string stmt, SERVER* target)
@@ -63,54 +123,14 @@ uint32_t Shard::get_ps_handle(uint32_t id)
     return 0;
 }
 
-void Shard::replace_location(std::string db, SERVER* target)
+void Shard::replace_location(const std::string& db, SERVER* target)
 {
-    m_map[db] = target;
+    writable_locations().replace(db, target);
 }
 
-SERVER* Shard::get_location(std::string table)
+SERVER* Shard::get_location(const std::string& db) const
 {
-    SERVER* rval = NULL;
-    if (table.find(".") == std::string::npos)
-    {
-        for (ServerMap::iterator it = m_map.begin(); it != m_map.end(); it++)
-        {
-            std::transform(table.begin(), table.end(), table.begin(), ::tolower);
-            std::string db = it->first.substr(0, it->first.find("."));
-            std::transform(db.begin(), db.end(), db.begin(), ::tolower);
-            if (db.compare(table) == 0)
-            {
-                if ((rval && rval != it->second))
-                {
-                    MXS_DEBUG("There are 2 databases with same name on a different servers: '%s' and '%s'. Connecting to '%s'"
-                              ,
-                              rval->name,
-                              it->second->name,
-                              rval->name);
-                    break;
-                }
-                else
-                {
-                    rval = it->second;
-                }
-            }
-        }
-    }
-    else
-    {
-        for (ServerMap::iterator it = m_map.begin(); it != m_map.end(); it++)
-        {
-            std::transform(table.begin(), table.end(), table.begin(), ::tolower);
-            std::string db = it->first;
-            std::transform(db.begin(), db.end(), db.begin(), ::tolower);
-            if (db.compare(table) == 0)
-            {
-                rval = it->second;
-                break;
-            }
-        }
-    }
-    return rval;
+    return m_locations->get(db);
 }
 
 SERVER* Shard::get_statement(std::string stmt)
@@ -149,28 +169,27 @@ bool Shard::stale(double max_interval) const
 {
     time_t now = time(NULL);
 
-    return difftime(now, m_last_updated) > max_interval;
+    return difftime(now, m_locations->last_updated()) > max_interval;
 }
 
 bool Shard::empty() const
 {
-    return m_map.size() == 0;
+    return m_locations->content().empty();
 }
 
 void Shard::get_content(ServerMap& dest)
 {
-    for (ServerMap::iterator it = m_map.begin(); it != m_map.end(); it++)
-    {
-        dest.insert(*it);
-    }
+    const ServerMap& content = m_locations->content();
+    dest.insert(content.begin(), content.end());
 }
 
 bool Shard::newer_than(const Shard& shard) const
 {
-    return m_last_updated > shard.m_last_updated;
+    return m_locations->last_updated() > shard.m_locations->last_updated();
 }
 
 ShardManager::ShardManager()
+    : m_maps(std::make_shared<ShardMap>())
 {
 }
 
@@ -178,35 +197,45 @@ ShardManager::~ShardManager()
 {
 }
 
-Shard ShardManager::get_shard(std::string user, double max_interval)
+Shard ShardManager::get_shard(const std::string& user, double max_interval) const
 {
-    std::lock_guard<std::mutex> guard(m_lock);
-
-    ShardMap::iterator iter = m_maps.find(user);
+    SShardLocations global = std::atomic_load(&m_global);
 
-    if (iter == m_maps.end() || iter->second.stale(max_interval))
+    if (global)
     {
-        // No previous shard or a stale shard, construct a new one
+        return Shard(global);
+    }
 
-        if (iter != m_maps.end())
-        {
-            m_maps.erase(iter);
-        }
+    std::shared_ptr<const ShardMap> maps = std::atomic_load(&m_maps);
+    ShardMap::const_iterator iter = maps->find(user);
 
+    if (iter == maps->end() || difftime(time(NULL), iter->second->last_updated()) > max_interval)
+    {
+        // No previous shard or a stale shard, construct a new one
         return Shard();
     }
 
     // Found valid shard
-    return iter->second;
+    return Shard(iter->second);
 }
 
-void ShardManager::update_shard(Shard& shard, std::string user)
+void ShardManager::update_shard(const Shard& shard, const std::string& user)
 {
     std::lock_guard<std::mutex> guard(m_lock);
-    ShardMap::iterator iter = m_maps.find(user);
+    std::shared_ptr<const ShardMap> maps = std::atomic_load(&m_maps);
+    ShardMap::const_iterator iter = maps->find(user);
 
-    if (iter == m_maps.end() || shard.newer_than(iter->second))
+    if (iter == maps->end() || shard.locations()->last_updated() > iter->second->last_updated())
     {
-        m_maps[user] = shard;
+        // Only the pointers to the locations are copied, the sessions that use
+        // the old map keep using it until they are closed
+        std::shared_ptr<ShardMap> updated = std::make_shared<ShardMap>(*maps);
+        (*updated)[user] = shard.locations();
+        std::atomic_store(&m_maps, std::shared_ptr<const ShardMap>(updated));
     }
 }
+
+void ShardManager::set_global_locations(const SShardLocations& locations)
+{
+    std::atomic_store(&m_global, locations);
+}
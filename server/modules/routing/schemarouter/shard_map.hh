@@ -15,6 +15,7 @@
 #include <maxscale/ccdefs.hh>
 
 #include <list>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
@@ -28,10 +29,74 @@ typedef std::unordered_map<std::string, SERVER*> ServerMap;
 typedef std::unordered_map<uint64_t, SERVER*>    BinaryPSMap;
 typedef std::unordered_map<uint32_t, uint32_t>   PSHandleMap;
 
+/**
+ * The locations of the databases and tables of a shard
+ *
+ * The names are indexed in lowercase when they are added which makes a lookup
+ * a single hash table search. A published ShardLocations is never modified,
+ * which allows sessions to share it without copying or locking.
+ */
+class ShardLocations
+{
+public:
+    ShardLocations();
+
+    /**
+     * @brief Add a database or table location
+     *
+     * @param name   Database or table, in `database.table` format, to add
+     * @param target Target where the database or table is located
+     *
+     * @return True if location was added
+     */
+    bool add(const std::string& name, SERVER* target);
+
+    /**
+     * @brief Change the location of a database or table
+     *
+     * @param name   Database or table to relocate
+     * @param target Target where the database or table is relocated to
+     */
+    void replace(const std::string& name, SERVER* target);
+
+    /**
+     * @brief Retrieve the location of a database or table
+     *
+     * The lookup is case-insensitive.
+     *
+     * @param name Database or table to locate
+     *
+     * @return The server or NULL if no server contains the database or table
+     */
+    SERVER* get(const std::string& name) const;
+
+    /**
+     * @brief All database and table to server mappings
+     */
+    const ServerMap& content() const
+    {
+        return m_map;
+    }
+
+    time_t last_updated() const
+    {
+        return m_last_updated;
+    }
+
+private:
+    ServerMap m_map;        /*< Locations with the names as they were discovered */
+    ServerMap m_names;      /*< Lowercase database and table names */
+    ServerMap m_databases;  /*< Lowercase database names, including those of the tables */
+    time_t    m_last_updated;
+};
+
+typedef std::shared_ptr<ShardLocations> SShardLocations;
+
 class Shard
 {
 public:
     Shard();
+    Shard(const SShardLocations& locations);
     ~Shard();
 
     /**
@@ -42,7 +107,7 @@ public:
      *
      * @return True if location was added
      */
-    bool add_location(std::string db, SERVER* target);
+    bool add_location(const std::string& db, SERVER* target);
 
     /**
      * @brief Retrieve the location of a database
@@ -51,7 +116,7 @@ public:
      *
      * @return The database or NULL if no server contains the database
      */
-    SERVER* get_location(std::string db);
+    SERVER* get_location(const std::string& db) const;
 
     void     add_statement(std::string stmt, SERVER* target);
     void     add_statement(uint32_t id, SERVER* target);
@@ -69,7 +134,7 @@ public:
      * @param db     Database to relocate
      * @param target Target where database is relocated to
      */
-    void replace_location(std::string db, SERVER* target);
+    void replace_location(const std::string& db, SERVER* target);
 
     /**
      * @brief Check if shard contains stale information
@@ -103,15 +168,25 @@ public:
      */
     bool newer_than(const Shard& shard) const;
 
+    /**
+     * @brief The database locations of this shard
+     */
+    const SShardLocations& locations() const
+    {
+        return m_locations;
+    }
+
 private:
-    ServerMap   m_map;
-    ServerMap   stmt_map;
-    BinaryPSMap m_binary_map;
-    PSHandleMap m_ps_handles;
-    time_t      m_last_updated;
+    SShardLocations m_locations;
+    ServerMap       stmt_map;
+    BinaryPSMap     m_binary_map;
+    PSHandleMap     m_ps_handles;
+
+    ShardLocations& writable_locations();
 };
 
-typedef std::unordered_map<std::string, Shard> ShardMap;
+/** The latest shard locations of each user */
+typedef std::unordered_map<std::string, SShardLocations> ShardMap;
 
 class ShardManager
 {
@@ -122,13 +197,16 @@ public:
     /**
      * @brief Retrieve or create a shard
      *
+     * The shard shares the locations stored in the shard manager, no locks
+     * are taken and nothing is copied.
+     *
      * @param user         User whose shard to retrieve
      * @param max_lifetime The maximum lifetime of a shard
      *
      * @return The latest version of the shard or a newly created shard if no
      * old version is available
      */
-    Shard get_shard(std::string user, double max_lifetime);
+    Shard get_shard(const std::string& user, double max_lifetime) const;
 
     /**
      * @brief Update the shard information
@@ -139,9 +217,23 @@ public:
      * @param shard New version of the shard
      * @param user  The user whose shard this is
      */
-    void update_shard(Shard& shard, std::string user);
+    void update_shard(const Shard& shard, const std::string& user);
+
+    /**
+     * @brief Set the locations that all users share
+     *
+     * When set, the shared locations are used instead of the locations of each
+     * user and they don't expire.
+     *
+     * @param locations The locations found by the background discovery or an
+     *                  empty pointer if each user's locations are to be used
+     */
+    void set_global_locations(const SShardLocations& locations);
 
 private:
-    mutable std::mutex m_lock;
-    ShardMap           m_maps;
+    std::mutex                      m_lock;     /*< Serializes the updates */
+    std::shared_ptr<const ShardMap> m_maps;     /*< Replaced as a whole on each update, always
+                                                 * accessed with std::atomic_load and std::atomic_store */
+    SShardLocations                 m_global;   /*< Locations shared by all users, accessed
+                                                 * with std::atomic_load and std::atomic_store */
 };
@@ -0,0 +1,906 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "schemarouter.hh"
+#include "shard_rules.hh"
+#include "sql_tokenizer.hh"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <set>
+
+#include <maxscale/log.h>
+#include <maxscale/modutil.h>
+#include <maxscale/query_classifier.h>
+
+using namespace schemarouter;
+
+namespace
+{
+
+std::string to_lower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+SERVER* find_server(SERVICE* service, const char* name)
+{
+    for (SERVER_REF* ref = service->dbref; ref; ref = ref->next)
+    {
+        if (SERVER_REF_IS_ACTIVE(ref) && strcmp(ref->server->name, name) == 0)
+        {
+            return ref->server;
+        }
+    }
+
+    MXS_ERROR("Server '%s' in the sharding rules is not a server of service '%s'.",
+              name,
+              service->name);
+    return NULL;
+}
+
+const char* get_string(json_t* json, const char* key)
+{
+    json_t* value = json_object_get(json, key);
+    return json_is_string(value) ? json_string_value(value) : NULL;
+}
+
+class KeyFinder
+{
+public:
+    KeyFinder(const Tokens& tokens, const ShardRule& rule, int n_tables)
+        : m_tokens(tokens)
+        , m_column(rule.column())
+        , m_single_table(n_tables <= 1)
+    {
+        size_t dot = rule.table().find('.');
+        m_db = rule.table().substr(0, dot);
+        m_table = rule.table().substr(dot + 1);
+    }
+
+    bool find_keys(std::vector<std::string>* keys)
+    {
+        if (is_word(m_tokens, 0, "INSERT") || is_word(m_tokens, 0, "REPLACE"))
+        {
+            return find_insert_keys(keys);
+        }
+
+        for (size_t i = 0; i < m_tokens.size(); i++)
+        {
+            if (is_word(m_tokens, i, "UNION"))
+            {
+                // Each part of the UNION has its own conditions
+                return false;
+            }
+        }
+
+        size_t where = find_top_level(0, "WHERE");
+        return where < m_tokens.size() && find_where_keys(where + 1, keys);
+    }
+
+private:
+    const Tokens& m_tokens;
+    std::string   m_db;
+    std::string   m_table;
+    std::string   m_column;
+    bool          m_single_table;
+    std::set<size_t> m_between_and;     /*< The ANDs that belong to a BETWEEN */
+
+    size_t find_top_level(size_t start, const char* word) const
+    {
+        int depth = 0;
+
+        for (size_t i = start; i < m_tokens.size(); i++)
+        {
+            if (is_punct(m_tokens, i, "("))
+            {
+                depth++;
+            }
+            else if (is_punct(m_tokens, i, ")"))
+            {
+                depth--;
+            }
+            else if (depth == 0 && is_word(m_tokens, i, word))
+            {
+                return i;
+            }
+        }
+
+        return m_tokens.size();
+    }
+
+    bool is_key_column(const std::vector<std::string>& parts) const
+    {
+        bool rval = false;
+
+        if (!parts.empty() && strcasecmp(parts.back().c_str(), m_column.c_str()) == 0)
+        {
+            switch (parts.size())
+            {
+            case 1:
+                rval = true;
+                break;
+
+            case 2:
+                // A qualifier that isn't the table name is an alias
+                rval = strcasecmp(parts[0].c_str(), m_table.c_str()) == 0 || m_single_table;
+                break;
+
+            case 3:
+                rval = strcasecmp(parts[0].c_str(), m_db.c_str()) == 0
+                    && strcasecmp(parts[1].c_str(), m_table.c_str()) == 0;
+                break;
+            }
+        }
+
+        return rval;
+    }
+
+    bool is_conjunction(size_t i) const
+    {
+        return (is_word(m_tokens, i, "AND") && m_between_and.count(i) == 0) || is_punct(m_tokens, i, "&&");
+    }
+
+    /** Whether a predicate can start after token @c i */
+    bool is_predicate_start(size_t i) const
+    {
+        return is_word(m_tokens, i, "WHERE") || is_conjunction(i) || is_punct(m_tokens, i, "(");
+    }
+
+    /** Whether a predicate ends at token @c i */
+    bool is_predicate_end(size_t i, size_t end) const
+    {
+        return i >= end || is_conjunction(i) || is_punct(m_tokens, i, ")");
+    }
+
+    bool is_equals(size_t i) const
+    {
+        return is_punct(m_tokens, i, "=") || is_punct(m_tokens, i, "<=>");
+    }
+
+    size_t find_where_end(size_t start) const
+    {
+        static const char* clause_ends[] =
+        {
+            "GROUP", "HAVING", "WINDOW", "ORDER", "LIMIT", "PROCEDURE", "INTO", "FOR", "LOCK"
+        };
+        int depth = 0;
+
+        for (size_t i = start; i < m_tokens.size(); i++)
+        {
+            if (is_punct(m_tokens, i, "("))
+            {
+                depth++;
+            }
+            else if (is_punct(m_tokens, i, ")"))
+            {
+                depth--;
+            }
+            else if (depth == 0)
+            {
+                if (is_punct(m_tokens, i, ";"))
+                {
+                    return i;
+                }
+
+                for (auto word : clause_ends)
+                {
+                    if (is_word(m_tokens, i, word))
+                    {
+                        return i;
+                    }
+                }
+            }
+        }
+
+        return m_tokens.size();
+    }
+
+    /**
+     * Check that every predicate of the condition must be true, so that any
+     * equality with the key column limits the rows to its key.
+     */
+    bool is_conjunctive(size_t start, size_t end)
+    {
+        for (size_t i = start; i < end; i++)
+        {
+            if (is_word(m_tokens, i, "OR") || is_word(m_tokens, i, "XOR") || is_punct(m_tokens, i, "||")
+                || is_word(m_tokens, i, "SELECT") || is_word(m_tokens, i, "CASE")
+                || is_punct(m_tokens, i, "!"))
+            {
+                return false;
+            }
+            else if (is_word(m_tokens, i, "NOT") && is_predicate_start(i - 1))
+            {
+                // NOT in e.g. IS NOT NULL or NOT IN doesn't negate other predicates
+                return false;
+            }
+            else if (is_word(m_tokens, i, "BETWEEN"))
+            {
+                int depth = 0;
+
+                for (size_t j = i + 1; j < end; j++)
+                {
+                    if (is_punct(m_tokens, j, "("))
+                    {
+                        depth++;
+                    }
+                    else if (is_punct(m_tokens, j, ")"))
+                    {
+                        depth--;
+                    }
+                    else if (depth == 0 && is_word(m_tokens, j, "AND"))
+                    {
+                        m_between_and.insert(j);
+                        break;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Read the values of `column IN (...)`
+     *
+     * @return The index after the closing parenthesis or @c i if there's no list of literals
+     */
+    size_t read_in_list(size_t i, std::vector<std::string>* values) const
+    {
+        if (!is_word(m_tokens, i, "IN") || !is_punct(m_tokens, i + 1, "("))
+        {
+            return i;
+        }
+
+        size_t pos = i + 2;
+
+        while (true)
+        {
+            std::string value;
+            size_t next = read_literal(m_tokens, pos, &value);
+
+            if (next == pos)
+            {
+                return i;
+            }
+
+            values->push_back(value);
+            pos = next;
+
+            if (is_punct(m_tokens, pos, ")"))
+            {
+                return pos + 1;
+            }
+            else if (!is_punct(m_tokens, pos, ","))
+            {
+                return i;
+            }
+
+            ++pos;
+        }
+    }
+
+    bool find_where_keys(size_t start, std::vector<std::string>* keys)
+    {
+        size_t end = find_where_end(start);
+
+        if (!is_conjunctive(start, end))
+        {
+            return false;
+        }
+
+        std::vector<std::string> parts;
+        bool found = false;
+
+        for (size_t i = start; i < end; i++)
+        {
+            if (!is_predicate_start(i - 1))
+            {
+                continue;
+            }
+
+            std::vector<std::string> values(1);
+            size_t name_end = read_name(m_tokens, i, &parts);
+            size_t pred_end = i;
+
+            if (name_end != i && is_key_column(parts))
+            {
+                // column = literal or column IN (literal, ...)
+                if (is_equals(name_end))
+                {
+                    pred_end = read_literal(m_tokens, name_end + 1, &values[0]);
+                    pred_end = pred_end == name_end + 1 ? i : pred_end;
+                }
+                else
+                {
+                    values.clear();
+                    pred_end = read_in_list(name_end, &values);
+                    pred_end = pred_end == name_end ? i : pred_end;
+                }
+            }
+            else
+            {
+                // literal = column
+                size_t lit_end = read_literal(m_tokens, i, &values[0]);
+
+                if (lit_end != i && is_equals(lit_end))
+                {
+                    name_end = read_name(m_tokens, lit_end + 1, &parts);
+
+                    if (name_end != lit_end + 1 && is_key_column(parts))
+                    {
+                        pred_end = name_end;
+                    }
+                }
+            }
+
+            if (pred_end != i && is_predicate_end(pred_end, end))
+            {
+                if (found)
+                {
+                    // All conditions must hold: the keys are the ones common to both
+                    std::vector<std::string> common;
+
+                    for (const auto& v : values)
+                    {
+                        if (std::find(keys->begin(), keys->end(), v) != keys->end())
+                        {
+                            common.push_back(v);
+                        }
+                    }
+
+                    keys->swap(common);
+                }
+                else
+                {
+                    keys->insert(keys->end(), values.begin(), values.end());
+                    found = true;
+                }
+            }
+        }
+
+        return found && !keys->empty();
+    }
+
+    bool find_insert_keys(std::vector<std::string>* keys) const
+    {
+        static const char* modifiers[] = {"LOW_PRIORITY", "DELAYED", "HIGH_PRIORITY", "IGNORE", "INTO"};
+        size_t i = 1;
+
+        while (std::any_of(std::begin(modifiers), std::end(modifiers), [&](const char* m) {
+                               return is_word(m_tokens, i, m);
+                           }))
+        {
+            ++i;
+        }
+
+        std::vector<std::string> parts;
+        size_t pos = read_name(m_tokens, i, &parts);
+
+        if (pos == i || parts.size() > 2 || strcasecmp(parts.back().c_str(), m_table.c_str()) != 0
+            || !is_punct(m_tokens, pos, "("))
+        {
+            // Not the sharded table or no column list
+            return false;
+        }
+
+        // The position of the key column in the column list
+        size_t index = 0;
+        bool found = false;
+
+        for (++pos; !is_punct(m_tokens, pos, ")"); ++pos)
+        {
+            size_t next = read_name(m_tokens, pos, &parts);
+
+            if (next == pos || parts.size() != 1)
+            {
+                return false;
+            }
+
+            if (strcasecmp(parts[0].c_str(), m_column.c_str()) == 0)
+            {
+                found = true;
+            }
+            else if (!found)
+            {
+                ++index;
+            }
+
+            pos = next;
+
+            if (!is_punct(m_tokens, pos, ",") && !is_punct(m_tokens, pos, ")"))
+            {
+                return false;
+            }
+            else if (is_punct(m_tokens, pos, ")"))
+            {
+                break;
+            }
+        }
+
+        ++pos;
+
+        if (!found || !(is_word(m_tokens, pos, "VALUES") || is_word(m_tokens, pos, "VALUE")))
+        {
+            return false;
+        }
+
+        // Read the key of each row
+        for (++pos; is_punct(m_tokens, pos, "("); )
+        {
+            size_t field = 0;
+            int depth = 0;
+            bool has_key = false;
+
+            for (++pos; pos < m_tokens.size(); ++pos)
+            {
+                if (depth == 0 && field == index && !has_key)
+                {
+                    std::string value;
+                    size_t next = read_literal(m_tokens, pos, &value);
+
+                    if (next == pos || !(is_punct(m_tokens, next, ",") || is_punct(m_tokens, next, ")")))
+                    {
+                        // The key is an expression
+                        return false;
+                    }
+
+                    keys->push_back(value);
+                    has_key = true;
+                    pos = next - 1;
+                }
+                else if (is_punct(m_tokens, pos, "("))
+                {
+                    depth++;
+                }
+                else if (is_punct(m_tokens, pos, ")"))
+                {
+                    if (depth-- == 0)
+                    {
+                        break;
+                    }
+                }
+                else if (depth == 0 && is_punct(m_tokens, pos, ","))
+                {
+                    field++;
+                }
+            }
+
+            if (!has_key)
+            {
+                return false;
+            }
+
+            // Skip the closing parenthesis and the comma between the rows
+            ++pos;
+
+            if (is_punct(m_tokens, pos, ","))
+            {
+                ++pos;
+            }
+        }
+
+        return !keys->empty();
+    }
+};
+}
+
+namespace schemarouter
+{
+
+// static
+uint64_t HashRing::hash(const char* data, size_t len)
+{
+    // 64-bit FNV-1a followed by the MurmurHash3 finalizer to spread the bits
+    uint64_t h = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t)data[i];
+        h *= 1099511628211ULL;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+void HashRing::add(SERVER* server)
+{
+    for (int i = 0; i < POINTS_PER_SERVER; i++)
+    {
+        std::string point = std::string(server->name) + "-" + std::to_string(i);
+        m_points.emplace_back(hash(point.c_str(), point.length()), server);
+    }
+
+    std::sort(m_points.begin(), m_points.end());
+}
+
+SERVER* HashRing::get(const std::string& key) const
+{
+    if (m_points.empty())
+    {
+        return NULL;
+    }
+
+    uint64_t h = hash(key.c_str(), key.length());
+    auto it = std::lower_bound(m_points.begin(), m_points.end(), Point(h, NULL));
+
+    // The ring wraps around
+    return it != m_points.end() ? it->second : m_points.front().second;
+}
+
+ShardRule::ShardRule(Type type, const std::string& table, const std::string& column)
+    : m_type(type)
+    , m_table(table)
+    , m_column(column)
+    , m_last(NULL)
+{
+}
+
+// static
+std::unique_ptr<ShardRule> ShardRule::create(json_t* json, SERVICE* service)
+{
+    const char* table = get_string(json, "table");
+    const char* type = get_string(json, "type");
+    const char* column = get_string(json, "column");
+
+    if (!table || !strchr(table, '.'))
+    {
+        MXS_ERROR("Sharding rule must have a 'table' of the form 'database.table'.");
+        return NULL;
+    }
+
+    Type rule_type;
+
+    if (!type || strcmp(type, "table") == 0)
+    {
+        rule_type = TABLE;
+    }
+    else if (strcmp(type, "hash") == 0)
+    {
+        rule_type = HASH;
+    }
+    else if (strcmp(type, "range") == 0)
+    {
+        rule_type = RANGE;
+    }
+    else
+    {
+        MXS_ERROR("Unknown type '%s' in the sharding rule of table '%s'.", type, table);
+        return NULL;
+    }
+
+    if (rule_type != TABLE && !column)
+    {
+        MXS_ERROR("The sharding rule of table '%s' has no 'column'.", table);
+        return NULL;
+    }
+
+    std::unique_ptr<ShardRule> rule(new ShardRule(rule_type, to_lower(table), column ? column : ""));
+
+    if (rule_type == TABLE)
+    {
+        const char* name = get_string(json, "server");
+        SERVER* server = name ? find_server(service, name) : NULL;
+
+        if (!server)
+        {
+            MXS_ERROR("The sharding rule of table '%s' has no valid 'server'.", table);
+            return NULL;
+        }
+
+        rule->m_servers.push_back(server);
+    }
+    else if (rule_type == HASH)
+    {
+        json_t* servers = json_object_get(json, "servers");
+
+        if (servers && !json_is_array(servers))
+        {
+            MXS_ERROR("The 'servers' of the sharding rule of table '%s' is not an array.", table);
+            return NULL;
+        }
+        else if (servers)
+        {
+            size_t i;
+            json_t* value;
+
+            json_array_foreach(servers, i, value)
+            {
+                SERVER* server = json_is_string(value) ? find_server(service, json_string_value(value)) : NULL;
+
+                if (!server)
+                {
+                    return NULL;
+                }
+
+                rule->m_servers.push_back(server);
+            }
+        }
+        else
+        {
+            // By default, the rows are spread over all servers of the service
+            for (SERVER_REF* ref = service->dbref; ref; ref = ref->next)
+            {
+                if (SERVER_REF_IS_ACTIVE(ref))
+                {
+                    rule->m_servers.push_back(ref->server);
+                }
+            }
+        }
+
+        if (rule->m_servers.empty())
+        {
+            MXS_ERROR("The sharding rule of table '%s' has no servers.", table);
+            return NULL;
+        }
+
+        for (SERVER* server : rule->m_servers)
+        {
+            rule->m_ring.add(server);
+        }
+    }
+    else
+    {
+        json_t* ranges = json_object_get(json, "ranges");
+
+        if (!json_is_array(ranges) || json_array_size(ranges) == 0)
+        {
+            MXS_ERROR("The sharding rule of table '%s' has no 'ranges'.", table);
+            return NULL;
+        }
+
+        size_t i;
+        json_t* range;
+
+        json_array_foreach(ranges, i, range)
+        {
+            const char* name = get_string(range, "server");
+            json_t* end = json_object_get(range, "end");
+            SERVER* server = name ? find_server(service, name) : NULL;
+
+            if (!server)
+            {
+                MXS_ERROR("Range %lu of the sharding rule of table '%s' has no valid 'server'.", i, table);
+                return NULL;
+            }
+
+            if (std::find(rule->m_servers.begin(), rule->m_servers.end(), server) == rule->m_servers.end())
+            {
+                rule->m_servers.push_back(server);
+            }
+
+            if (json_is_integer(end))
+            {
+                int64_t value = json_integer_value(end);
+
+                if (rule->m_last || (!rule->m_ranges.empty() && rule->m_ranges.back().first >= value))
+                {
+                    MXS_ERROR("The ranges of the sharding rule of table '%s' are not in ascending order.",
+                              table);
+                    return NULL;
+                }
+
+                rule->m_ranges.emplace_back(value, server);
+            }
+            else if (!end && i == json_array_size(ranges) - 1)
+            {
+                rule->m_last = server;
+            }
+            else
+            {
+                MXS_ERROR("Only the last range of the sharding rule of table '%s' can be without "
+                          "an integer 'end'.", table);
+                return NULL;
+            }
+        }
+    }
+
+    return rule;
+}
+
+SERVER* ShardRule::locate(const std::string& key) const
+{
+    SERVER* rval = NULL;
+
+    switch (m_type)
+    {
+    case TABLE:
+        rval = m_servers.front();
+        break;
+
+    case HASH:
+        rval = m_ring.get(canonical_key(key));
+        break;
+
+    case RANGE:
+        {
+            char* end;
+            errno = 0;
+            long long value = strtoll(key.c_str(), &end, 10);
+
+            if (!key.empty() && *end == '\0' && errno == 0)
+            {
+                auto it = std::upper_bound(m_ranges.begin(), m_ranges.end(), Range(value, NULL),
+                                           [](const Range& a, const Range& b) {
+                                               return a.first < b.first;
+                                           });
+                rval = it != m_ranges.end() ? it->second : m_last;
+            }
+        }
+        break;
+    }
+
+    return rval;
+}
+
+// static
+std::unique_ptr<ShardRules> ShardRules::load(const char* path, SERVICE* service)
+{
+    std::unique_ptr<ShardRules> rules;
+    json_error_t error;
+    std::unique_ptr<json_t> root(json_load_file(path, 0, &error));
+
+    if (!root)
+    {
+        MXS_ERROR("Loading sharding rules file failed: (%s:%d:%d): %s",
+                  path,
+                  error.line,
+                  error.column,
+                  error.text);
+        return rules;
+    }
+
+    json_t* tables = json_object_get(root.get(), "tables");
+
+    if (!json_is_array(tables))
+    {
+        MXS_ERROR("The sharding rules file '%s' has no 'tables' array.", path);
+        return rules;
+    }
+
+    rules.reset(new ShardRules);
+    size_t i;
+    json_t* value;
+
+    json_array_foreach(tables, i, value)
+    {
+        std::unique_ptr<ShardRule> rule = ShardRule::create(value, service);
+
+        if (!rule)
+        {
+            MXS_ERROR("Invalid sharding rule %lu in '%s'.", i, path);
+            rules.reset();
+            break;
+        }
+
+        std::string table = rule->table();
+
+        if (!rules->m_rules.emplace(table, std::move(rule)).second)
+        {
+            MXS_ERROR("Table '%s' has multiple sharding rules in '%s'.", table.c_str(), path);
+            rules.reset();
+            break;
+        }
+    }
+
+    return rules;
+}
+
+const ShardRule* ShardRules::find(const std::string& table) const
+{
+    auto it = m_rules.find(to_lower(table));
+    return it != m_rules.end() ? it->second.get() : NULL;
+}
+
+bool get_shard_keys(GWBUF* buffer, const ShardRule& rule, int n_tables, std::vector<std::string>* keys)
+{
+    if (rule.type() == ShardRule::TABLE || !modutil_is_SQL(buffer))
+    {
+        return false;
+    }
+
+    qc_query_op_t op = qc_get_operation(buffer);
+
+    if (op != QUERY_OP_INSERT)
+    {
+        // Use the classifier to check that the key column is used outside of
+        // subqueries and unions before looking for its values
+        const QC_FIELD_INFO* infos;
+        size_t n_infos;
+        bool used = false;
+        qc_get_field_info(buffer, &infos, &n_infos);
+
+        for (size_t i = 0; i < n_infos; i++)
+        {
+            if (strcasecmp(infos[i].column, rule.column().c_str()) == 0)
+            {
+                if (infos[i].context != 0)
+                {
+                    return false;
+                }
+
+                used = true;
+            }
+        }
+
+        if (!used)
+        {
+            return false;
+        }
+    }
+
+    char* sql;
+    int len;
+    Tokens tokens;
+
+    if (!modutil_extract_SQL(buffer, &sql, &len) || !tokenize(sql, len, &tokens))
+    {
+        return false;
+    }
+
+    KeyFinder finder(tokens, rule, n_tables);
+    std::vector<std::string> found;
+
+    if (finder.find_keys(&found))
+    {
+        keys->insert(keys->end(), found.begin(), found.end());
+        return true;
+    }
+
+    return false;
+}
+
+SERVER* locate_rows(GWBUF* buffer, const ShardRule& rule, int n_tables)
+{
+    if (rule.servers().size() == 1)
+    {
+        // All rows of the table are on the same server
+        return rule.servers().front();
+    }
+
+    SERVER* rval = NULL;
+    std::vector<std::string> keys;
+
+    if (get_shard_keys(buffer, rule, n_tables, &keys))
+    {
+        for (const auto& key : keys)
+        {
+            SERVER* server = rule.locate(key);
+
+            if (server == NULL || (rval && server != rval))
+            {
+                return NULL;
+            }
+
+            rval = server;
+        }
+    }
+
+    return rval;
+}
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+#pragma once
+
+#include <maxscale/cdefs.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <maxscale/buffer.h>
+#include <maxscale/jansson.hh>
+#include <maxscale/server.h>
+#include <maxscale/service.h>
+
+namespace schemarouter
+{
+
+/**
+ * A consistent-hash ring of servers
+ *
+ * Each server is placed on the ring at several points derived from its name.
+ * A key belongs to the first server found clockwise from the hash of the key,
+ * which means that adding a server only moves the keys that now belong to it.
+ */
+class HashRing
+{
+public:
+    /** How many points each server has on the ring */
+    static const int POINTS_PER_SERVER = 160;
+
+    /**
+     * Add a server to the ring
+     *
+     * @param server Server to add
+     */
+    void add(SERVER* server);
+
+    /**
+     * Find the server of a key
+     *
+     * @param key The shard key
+     *
+     * @return The server the key belongs to or NULL if the ring is empty
+     */
+    SERVER* get(const std::string& key) const;
+
+    /**
+     * Calculate the hash of a key
+     *
+     * The hash must not change between versions as it decides where the data is stored.
+     *
+     * @param data Data to hash
+     * @param len  Length of the data
+     *
+     * @return The 64-bit hash of the data
+     */
+    static uint64_t hash(const char* data, size_t len);
+
+private:
+    typedef std::pair<uint64_t, SERVER*> Point;
+    std::vector<Point> m_points;        /*< The points of the servers, sorted by hash */
+};
+
+/**
+ * The sharding rule of one table
+ */
+class ShardRule
+{
+public:
+    enum Type
+    {
+        TABLE,  /*< The whole table is on one server */
+        HASH,   /*< The rows are distributed with a consistent-hash ring */
+        RANGE   /*< The rows are distributed by ranges of the shard key */
+    };
+
+    /**
+     * Create a rule from JSON
+     *
+     * @param json    The JSON object of the rule
+     * @param service The service the rule is used in
+     *
+     * @return The rule or NULL if the JSON is invalid
+     */
+    static std::unique_ptr<ShardRule> create(json_t* json, SERVICE* service);
+
+    /** The fully qualified, lowercase name of the table */
+    const std::string& table() const
+    {
+        return m_table;
+    }
+
+    /** The column that contains the shard key, empty for TABLE rules */
+    const std::string& column() const
+    {
+        return m_column;
+    }
+
+    Type type() const
+    {
+        return m_type;
+    }
+
+    /** All servers that can store rows of the table */
+    const std::vector<SERVER*>& servers() const
+    {
+        return m_servers;
+    }
+
+    /**
+     * Find the server of a shard key
+     *
+     * @param key The shard key as text, unquoted if it was a string literal
+     *
+     * @return The server or NULL if the key is not on any of the servers
+     */
+    SERVER* locate(const std::string& key) const;
+
+private:
+    /** The exclusive upper bound of a key range and its server */
+    typedef std::pair<int64_t, SERVER*> Range;
+
+    ShardRule(Type type, const std::string& table, const std::string& column);
+
+    Type                 m_type;
+    std::string          m_table;
+    std::string          m_column;
+    std::vector<SERVER*> m_servers;
+    HashRing             m_ring;        /*< Used by HASH rules */
+    std::vector<Range>   m_ranges;      /*< Used by RANGE rules, in ascending order */
+    SERVER*              m_last;        /*< RANGE rule server of the keys above the last range */
+};
+
+/**
+ * The sharding rules of the tables
+ */
+class ShardRules
+{
+public:
+    /**
+     * Load the rules from a file
+     *
+     * @param path    Path to the rules file
+     * @param service The service the rules are used in
+     *
+     * @return The rules or NULL if the file could not be read or is invalid
+     */
+    static std::unique_ptr<ShardRules> load(const char* path, SERVICE* service);
+
+    /**
+     * Find the rule of a table
+     *
+     * @param table Fully qualified table name
+     *
+     * @return The rule of the table or NULL if the table has no rule
+     */
+    const ShardRule* find(const std::string& table) const;
+
+private:
+    std::unordered_map<std::string, std::unique_ptr<ShardRule>> m_rules;
+};
+
+typedef std::shared_ptr<const ShardRules> SShardRules;
+
+/**
+ * Find the shard keys of a table from a statement
+ *
+ * The keys are the literal values that the key column is compared to with `=`
+ * in the `WHERE` clause, or the values given to it in an `INSERT` with a column
+ * list. Conditions that can't be resolved to a fixed set of keys, such as those
+ * that contain `OR` or subqueries, yield no keys.
+ *
+ * @param buffer   A COM_QUERY packet
+ * @param rule     The rule of the table
+ * @param n_tables How many tables the statement uses
+ * @param keys     The keys of the statement are appended here
+ *
+ * @return True if at least one key was found
+ */
+bool get_shard_keys(GWBUF* buffer, const ShardRule& rule, int n_tables, std::vector<std::string>* keys);
+
+/**
+ * Find the server that has the rows of a table that a statement uses
+ *
+ * @param buffer   A COM_QUERY packet
+ * @param rule     The rule of the table
+ * @param n_tables How many tables the statement uses
+ *
+ * @return The server or NULL if the rows are not known to be on one server
+ */
+SERVER* locate_rows(GWBUF* buffer, const ShardRule& rule, int n_tables);
+}
@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+#include "sql_tokenizer.hh"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+namespace schemarouter
+{
+
+std::string canonical_key(const std::string& value)
+{
+    const char* str = value.c_str();
+    char* end;
+    errno = 0;
+    long long num = strtoll(str, &end, 10);
+
+    if (*str && !isspace(*str) && *end == '\0' && errno == 0)
+    {
+        return std::to_string(num);
+    }
+
+    return value;
+}
+
+static bool is_word_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_' || c == '$' || (c & 0x80);
+}
+
+bool tokenize(const char* sql, int len, Tokens* tokens)
+{
+    const char* it = sql;
+    const char* end = sql + len;
+
+    while (it < end)
+    {
+        char c = *it;
+
+        if (isspace((unsigned char)c))
+        {
+            ++it;
+        }
+        else if (c == '#' || (c == '-' && end - it > 2 && it[1] == '-' && isspace((unsigned char)it[2])))
+        {
+            while (it < end && *it != '\n')
+            {
+                ++it;
+            }
+        }
+        else if (c == '/' && end - it > 1 && it[1] == '*')
+        {
+            if (end - it > 2 && it[2] == '!')
+            {
+                // Executable comments could contain anything
+                return false;
+            }
+
+            for (it += 2; it < end - 1 && !(it[0] == '*' && it[1] == '/'); ++it)
+            {
+            }
+
+            if (it >= end - 1)
+            {
+                return false;
+            }
+
+            it += 2;
+        }
+        else if (c == '"')
+        {
+            // A string or a name depending on ANSI_QUOTES, the SQL mode of the session isn't known
+            return false;
+        }
+        else if (c == '\'' || c == '`')
+        {
+            const char* start = it;
+            std::string value;
+            bool closed = false;
+
+            for (++it; it < end; ++it)
+            {
+                if (*it == '\\' && c == '\'')
+                {
+                    // Whether the string ends at the next quote depends on NO_BACKSLASH_ESCAPES
+                    return false;
+                }
+                else if (*it == c)
+                {
+                    if (it + 1 < end && it[1] == c)
+                    {
+                        // A doubled quote is an escaped quote
+                        value += c;
+                        ++it;
+                    }
+                    else
+                    {
+                        closed = true;
+                        ++it;
+                        break;
+                    }
+                }
+                else
+                {
+                    value += *it;
+                }
+            }
+
+            if (!closed)
+            {
+                return false;
+            }
+
+            tokens->emplace_back(c == '`' ? Token::NAME : Token::STRING, value, start - sql, it - sql);
+        }
+        else if (isdigit((unsigned char)c) || (c == '.' && end - it > 1 && isdigit((unsigned char)it[1])))
+        {
+            const char* start = it;
+
+            for (++it; it < end; ++it)
+            {
+                bool exponent_sign = (*it == '-' || *it == '+') && (it[-1] == 'e' || it[-1] == 'E');
+
+                if (!is_word_char(*it) && *it != '.' && !exponent_sign)
+                {
+                    break;
+                }
+            }
+
+            tokens->emplace_back(Token::NUMBER, std::string(start, it), start - sql, it - sql);
+        }
+        else if (is_word_char(c))
+        {
+            const char* start = it;
+
+            while (it < end && is_word_char(*it))
+            {
+                ++it;
+            }
+
+            tokens->emplace_back(Token::WORD, std::string(start, it), start - sql, it - sql);
+        }
+        else
+        {
+            static const char* operators[] = {"<=>", "<=", ">=", "!=", "<>", "||", "&&", ":="};
+            size_t n = 1;
+
+            for (auto op : operators)
+            {
+                size_t op_len = strlen(op);
+
+                if ((size_t)(end - it) >= op_len && strncmp(it, op, op_len) == 0)
+                {
+                    n = op_len;
+                    break;
+                }
+            }
+
+            tokens->emplace_back(Token::PUNCT, std::string(it, it + n), it - sql, it + n - sql);
+            it += n;
+        }
+    }
+
+    return true;
+}
+
+bool is_word(const Tokens& tokens, size_t i, const char* word)
+{
+    return i < tokens.size() && tokens[i].kind == Token::WORD
+           && strcasecmp(tokens[i].value.c_str(), word) == 0;
+}
+
+bool is_punct(const Tokens& tokens, size_t i, const char* punct)
+{
+    return i < tokens.size() && tokens[i].kind == Token::PUNCT && tokens[i].value == punct;
+}
+
+bool is_name(const Tokens& tokens, size_t i)
+{
+    return i < tokens.size() && (tokens[i].kind == Token::WORD || tokens[i].kind == Token::NAME);
+}
+
+size_t read_name(const Tokens& tokens, size_t i, std::vector<std::string>* parts)
+{
+    parts->clear();
+
+    while (is_name(tokens, i) && parts->size() < 3)
+    {
+        parts->push_back(tokens[i++].value);
+
+        if (!is_punct(tokens, i, ".") || !is_name(tokens, i + 1))
+        {
+            break;
+        }
+
+        ++i;
+    }
+
+    return i;
+}
+
+size_t read_literal(const Tokens& tokens, size_t i, std::string* value)
+{
+    if (i < tokens.size() && tokens[i].kind == Token::STRING)
+    {
+        *value = tokens[i].value;
+        return i + 1;
+    }
+    else if (i < tokens.size() && tokens[i].kind == Token::NUMBER)
+    {
+        *value = canonical_key(tokens[i].value);
+        return i + 1;
+    }
+    else if ((is_punct(tokens, i, "-") || is_punct(tokens, i, "+"))
+             && i + 1 < tokens.size() && tokens[i + 1].kind == Token::NUMBER)
+    {
+        *value = canonical_key(tokens[i].value + tokens[i + 1].value);
+        return i + 2;
+    }
+
+    return i;
+}
+
+size_t find_closing(const Tokens& tokens, size_t i)
+{
+    int depth = 0;
+
+    for (; i < tokens.size(); i++)
+    {
+        if (is_punct(tokens, i, "("))
+        {
+            depth++;
+        }
+        else if (is_punct(tokens, i, ")") && --depth == 0)
+        {
+            return i;
+        }
+    }
+
+    return tokens.size();
+}
+
+}
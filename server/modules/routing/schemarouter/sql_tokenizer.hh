@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+#pragma once
+
+#include <maxscale/cdefs.h>
+
+#include <string>
+#include <vector>
+
+namespace schemarouter
+{
+
+/**
+ * A minimal SQL tokenizer
+ *
+ * It only recognizes enough of the syntax to find the literals, names and
+ * clauses of simple statements. Anything it doesn't understand makes the
+ * callers give up and use the normal routing.
+ */
+struct Token
+{
+    enum Kind
+    {
+        WORD,   /*< Keyword or unquoted identifier */
+        NAME,   /*< Quoted identifier */
+        STRING, /*< String literal, without the quotes */
+        NUMBER, /*< Numeric literal */
+        PUNCT   /*< Operator or punctuation */
+    };
+
+    Token(Kind k, const std::string& v, size_t s, size_t e)
+        : kind(k)
+        , value(v)
+        , start(s)
+        , end(e)
+    {
+    }
+
+    Kind        kind;
+    std::string value;
+    size_t      start;  /*< Offset of the token in the statement */
+    size_t      end;    /*< Offset of the first character after the token */
+};
+
+typedef std::vector<Token> Tokens;
+
+/**
+ * Split a statement into tokens
+ *
+ * Double-quoted text and backslashes in strings are not understood as their
+ * meaning depends on the ANSI_QUOTES and NO_BACKSLASH_ESCAPES SQL modes.
+ *
+ * @param sql    The SQL statement
+ * @param len    Length of the statement
+ * @param tokens The tokens are stored here
+ *
+ * @return False if the statement has syntax the tokenizer doesn't understand
+ */
+bool tokenize(const char* sql, int len, Tokens* tokens);
+
+/** Whether token @c i is the keyword @c word */
+bool is_word(const Tokens& tokens, size_t i, const char* word);
+
+/** Whether token @c i is the operator or punctuation @c punct */
+bool is_punct(const Tokens& tokens, size_t i, const char* punct);
+
+/** Whether token @c i is a quoted or unquoted name */
+bool is_name(const Tokens& tokens, size_t i);
+
+/**
+ * Read a possibly qualified name
+ *
+ * @return The index of the first token after the name or @c i if there is no name
+ */
+size_t read_name(const Tokens& tokens, size_t i, std::vector<std::string>* parts);
+
+/**
+ * Read a string or a number literal
+ *
+ * @return The index of the first token after the literal or @c i if there is no literal
+ */
+size_t read_literal(const Tokens& tokens, size_t i, std::string* value);
+
+/**
+ * Find the closing parenthesis that matches an opening one
+ *
+ * @param tokens The tokens
+ * @param i      Index of the opening parenthesis
+ *
+ * @return Index of the closing parenthesis or the number of tokens if it is missing
+ */
+size_t find_closing(const Tokens& tokens, size_t i);
+
+/**
+ * Convert an integer literal into its canonical form so that e.g. `05` and `'5'`
+ * are the same key. Other values are returned as they are.
+ */
+std::string canonical_key(const std::string& value);
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the queries that are sent to multiple shards
+ *
+ * The LIMIT and OFFSET of a query must be rewritten so that each shard returns
+ * enough rows, the ordered results must be merged in order and the aggregates
+ * must be combined exactly. Results that can only be compared by a collation
+ * must not be merged.
+ */
+
+#include "../scatter_gather.hh"
+
+#include <string.h>
+#include <maxscale/log.h>
+#include <maxscale/mysql_utils.h>
+
+using namespace schemarouter;
+
+namespace
+{
+
+const int N_SHARDS = 3;
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+SERVER servers[N_SHARDS];
+SERVER_REF refs[N_SHARDS];
+
+struct Column
+{
+    Column(const std::string& name, uint8_t type, uint16_t charset = 63)
+        : name(name)
+        , type(type)
+        , charset(charset)
+    {
+    }
+
+    std::string name;
+    uint8_t     type;
+    uint16_t    charset;
+};
+
+typedef std::vector<std::vector<const char*>> Rows;
+
+/** The response that is sent to the client */
+struct Response
+{
+    Response()
+        : columns(0)
+    {
+    }
+
+    size_t                   columns;
+    std::vector<std::string> rows;  /*< The values of each row separated by commas */
+    std::string              error;
+};
+
+std::string packet(const std::string& payload, uint8_t seq)
+{
+    std::string rval;
+    rval += (char)payload.size();
+    rval += (char)(payload.size() >> 8);
+    rval += (char)(payload.size() >> 16);
+    rval += (char)seq;
+    return rval + payload;
+}
+
+std::string lestr(const std::string& str)
+{
+    return std::string(1, (char)str.size()) + str;
+}
+
+std::string column_definition(const Column& col)
+{
+    std::string rval = lestr("def") + lestr("db") + lestr("t") + lestr("t") + lestr(col.name) + lestr(col.name);
+    rval += '\x0c';
+    rval += (char)col.charset;
+    rval += (char)(col.charset >> 8);
+    rval += std::string("\x0b\x00\x00\x00", 4);
+    rval += (char)col.type;
+    rval += std::string(5, '\0');
+    return rval;
+}
+
+/** The packets of a resultset */
+std::vector<std::string> resultset(const std::vector<Column>& cols, const Rows& rows)
+{
+    const std::string eof("\xfe\x00\x00\x02\x00", 5);
+    std::vector<std::string> rval;
+    uint8_t seq = 1;
+
+    rval.push_back(packet(std::string(1, (char)cols.size()), seq++));
+
+    for (const auto& col : cols)
+    {
+        rval.push_back(packet(column_definition(col), seq++));
+    }
+
+    rval.push_back(packet(eof, seq++));
+
+    for (const auto& row : rows)
+    {
+        std::string payload;
+
+        for (const char* value : row)
+        {
+            payload += value ? lestr(value) : std::string("\xfb");
+        }
+
+        rval.push_back(packet(payload, seq++));
+    }
+
+    rval.push_back(packet(eof, seq++));
+    return rval;
+}
+
+std::vector<std::string> error(const std::string& msg)
+{
+    return {packet(std::string("\xff\x7a\x04#42S02", 9) + msg, 1)};
+}
+
+void parse_response(GWBUF* buffer, Response* response, uint8_t* seq)
+{
+    buffer = gwbuf_make_contiguous(buffer);
+    const uint8_t* ptr = GWBUF_DATA(buffer);
+    const uint8_t* end = ptr + gwbuf_length(buffer);
+
+    while (ptr < end)
+    {
+        size_t len = gw_mysql_get_byte3(ptr);
+        EXPECT(ptr[3] == (*seq)++);
+        const uint8_t* data = ptr + MYSQL_HEADER_LEN;
+        ptr = data + len;
+
+        if (*data == MYSQL_REPLY_ERR)
+        {
+            response->error.assign((const char*)data + 9, len - 9);
+        }
+        else if (response->columns == 0)
+        {
+            response->columns = mxs_leint_value(data);
+        }
+        else if (*data == MYSQL_REPLY_EOF && len < 9)
+        {
+            // The end of the column definitions or of the rows
+        }
+        else if (*seq <= response->columns + 2)
+        {
+            // A column definition
+        }
+        else
+        {
+            std::string row;
+
+            for (const uint8_t* field = data; field < ptr;)
+            {
+                row += row.empty() ? "" : ",";
+
+                if (*field == 0xfb)
+                {
+                    row += "NULL";
+                    field++;
+                }
+                else
+                {
+                    size_t bytes = mxs_leint_bytes(field);
+                    size_t size = mxs_leint_value(field);
+                    row.append((const char*)field + bytes, size);
+                    field += bytes + size;
+                }
+            }
+
+            response->rows.push_back(row);
+        }
+    }
+
+    gwbuf_free(buffer);
+}
+
+/**
+ * Send a query to the shards
+ *
+ * The packets of the shards are processed one packet at a time from each shard in turn.
+ */
+Response query(const std::string& sql, const std::vector<std::vector<std::string>>& results)
+{
+    Response response;
+    std::unique_ptr<ScatterPlan> plan = ScatterPlan::create(sql.c_str(), sql.length());
+    EXPECT(plan);
+
+    if (plan)
+    {
+        SSRBackendList backends;
+
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            backends.emplace_back(new SRBackend(&refs[i]));
+        }
+
+        ScatterGather sg(std::move(plan), backends);
+        std::vector<SSRBackend> targets(backends.begin(), backends.end());
+        uint8_t seq = 1;
+        bool more = true;
+
+        for (size_t n = 0; more; n++)
+        {
+            more = false;
+
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                if (n < results[i].size())
+                {
+                    more = true;
+                    const std::string& pkt = results[i][n];
+
+                    if (GWBUF* reply = sg.process(targets[i], gwbuf_alloc_and_load(pkt.size(), pkt.data())))
+                    {
+                        parse_response(reply, &response, &seq);
+                    }
+                }
+            }
+        }
+
+        EXPECT(sg.is_complete());
+    }
+
+    return response;
+}
+
+bool rows_are(const Response& response, const std::vector<std::string>& rows)
+{
+    return response.error.empty() && response.rows == rows;
+}
+
+void test_plan()
+{
+    auto plan = ScatterPlan::create("SELECT id FROM t", strlen("SELECT id FROM t"));
+    EXPECT(plan && plan->query() == "SELECT id FROM t");
+    EXPECT(plan && plan->offset() == 0 && plan->limit() == ScatterPlan::NO_LIMIT);
+
+    // Each shard must return the rows that are skipped
+    std::string sql = "SELECT id, name FROM t ORDER BY name DESC, 1 LIMIT 2, 3";
+    plan = ScatterPlan::create(sql.c_str(), sql.length());
+    EXPECT(plan && plan->query() == "SELECT id, name FROM t ORDER BY name DESC, 1 LIMIT 5");
+    EXPECT(plan && plan->offset() == 2 && plan->limit() == 3);
+    EXPECT(plan && plan->order_by().size() == 2);
+    EXPECT(plan && plan->order_by()[0].name == "name" && plan->order_by()[0].descending);
+    EXPECT(plan && plan->order_by()[1].position == 1 && !plan->order_by()[1].descending);
+
+    sql = "SELECT id FROM t LIMIT 10 OFFSET 5";
+    plan = ScatterPlan::create(sql.c_str(), sql.length());
+    EXPECT(plan && plan->query() == "SELECT id FROM t LIMIT 15");
+    EXPECT(plan && plan->offset() == 5 && plan->limit() == 10);
+
+    sql = "SELECT COUNT(*), SUM(a) AS s, MIN(b), MAX(c) m FROM t WHERE x > 1";
+    plan = ScatterPlan::create(sql.c_str(), sql.length());
+    EXPECT(plan && plan->aggregates().size() == 4);
+    EXPECT(plan && plan->aggregates()[0] == ScatterPlan::COUNT && plan->aggregates()[1] == ScatterPlan::SUM);
+    EXPECT(plan && plan->aggregates()[2] == ScatterPlan::MIN && plan->aggregates()[3] == ScatterPlan::MAX);
+
+    // Results that can't be merged
+    for (const char* sql : {"SELECT AVG(x) FROM t",
+                            "SELECT COUNT(*), id FROM t",
+                            "SELECT COUNT(*) + 1 FROM t",
+                            "SELECT id FROM t GROUP BY id",
+                            "SELECT DISTINCT id FROM t",
+                            "SELECT COUNT(DISTINCT id) FROM t",
+                            "SELECT id FROM t ORDER BY id + 1",
+                            "SELECT id FROM t UNION ALL SELECT id FROM u",
+                            "SELECT * FROM t WHERE id IN (SELECT 1)",
+                            "SELECT id FROM t LIMIT 5; DELETE FROM t",
+                            "SELECT id FROM t FOR UPDATE",
+                            "SELECT id FROM t LIMIT 18446744073709551610, 10"})
+    {
+        EXPECT(!ScatterPlan::create(sql, strlen(sql)));
+    }
+}
+
+void test_merge()
+{
+    std::vector<Column> cols = {{"id", MYSQL_TYPE_LONG}, {"name", MYSQL_TYPE_VAR_STRING}};
+
+    // The rows of an unordered query are forwarded as they arrive
+    Response res = query("SELECT id, name FROM t",
+                         {resultset(cols, {{"1", "a"}, {"4", "d"}}),
+                          resultset(cols, {{"2", "b"}}),
+                          resultset(cols, {})});
+    EXPECT(res.columns == 2);
+    EXPECT(rows_are(res, {"1,a", "2,b", "4,d"}));
+
+    res = query("SELECT id, name FROM t ORDER BY id DESC LIMIT 3",
+                {resultset(cols, {{"9", "a"}, {"4", "d"}, {"1", "x"}}),
+                 resultset(cols, {{"10", "b"}, {"2", "q"}}),
+                 resultset(cols, {{"5", NULL}})});
+    EXPECT(rows_are(res, {"10,b", "9,a", "5,NULL"}));
+
+    // NULLs come first, ties are ordered by the next column and the skipped rows are not sent
+    res = query("SELECT id, name FROM t ORDER BY name, 1 LIMIT 2, 3",
+                {resultset(cols, {{"1", NULL}, {"4", "d"}}),
+                 resultset(cols, {{"2", "b"}, {"3", "b"}}),
+                 resultset(cols, {{"5", "c"}})});
+    EXPECT(rows_are(res, {"3,b", "5,c", "4,d"}));
+
+    res = query("SELECT id, name FROM t LIMIT 1 OFFSET 2",
+                {resultset(cols, {{"1", "a"}, {"4", "d"}}),
+                 resultset(cols, {{"2", "b"}}),
+                 resultset(cols, {{"7", "z"}})});
+    EXPECT(rows_are(res, {"7,z"}));
+
+    // Decimals are compared exactly
+    std::vector<Column> dec = {{"v", MYSQL_TYPE_NEWDECIMAL}};
+    res = query("SELECT v FROM t ORDER BY v DESC",
+                {resultset(dec, {{"123456789012345678901234567890.2"}, {"-3"}}),
+                 resultset(dec, {{"123456789012345678901234567890.11"}, {"0.5"}}),
+                 resultset(dec, {{"-2.999"}})});
+    EXPECT(rows_are(res, {"123456789012345678901234567890.2", "123456789012345678901234567890.11",
+                          "0.5", "-2.999", "-3"}));
+
+    // The error of a shard is sent instead of the result
+    res = query("SELECT id, name FROM t",
+                {resultset(cols, {{"1", "a"}}), error("Table doesn't exist"), resultset(cols, {})});
+    EXPECT(res.error == "Table doesn't exist");
+
+    res = query("SELECT id FROM t ORDER BY other",
+                {resultset(cols, {{"1", "a"}}), resultset(cols, {}), resultset(cols, {})});
+    EXPECT(!res.error.empty() && res.rows.empty());
+}
+
+void test_aggregates()
+{
+    std::vector<Column> cols = {{"COUNT(*)", MYSQL_TYPE_LONGLONG},
+                                {"s", MYSQL_TYPE_NEWDECIMAL},
+                                {"mn", MYSQL_TYPE_LONG},
+                                {"mx", MYSQL_TYPE_VAR_STRING}};
+
+    Response res = query("SELECT COUNT(*), SUM(v) AS s, MIN(id) mn, MAX(name) AS mx FROM t",
+                         {resultset(cols, {{"3", "1.50", "10", "abc"}}),
+                          resultset(cols, {{"2", "2.25", "-4", "b"}}),
+                          resultset(cols, {{"0", NULL, NULL, NULL}})});
+    EXPECT(res.columns == 4);
+    EXPECT(rows_are(res, {"5,3.75,-4,b"}));
+
+    // The SUM of integers doesn't lose precision
+    std::vector<Column> sum = {{"s", MYSQL_TYPE_LONGLONG}};
+    res = query("SELECT SUM(v) s FROM t",
+                {resultset(sum, {{"9223372036854775807"}}),
+                 resultset(sum, {{"1"}}),
+                 resultset(sum, {{NULL}})});
+    EXPECT(rows_are(res, {"9223372036854775808"}));
+
+    // Decimals are added exactly
+    std::vector<Column> dec = {{"s", MYSQL_TYPE_NEWDECIMAL}, {"m", MYSQL_TYPE_NEWDECIMAL}};
+    res = query("SELECT SUM(v), MAX(v) FROM t",
+                {resultset(dec, {{"99999999999999999999999.000000001", "12345678901234567890.1"}}),
+                 resultset(dec, {{"-0.5", "12345678901234567890.09"}}),
+                 resultset(dec, {{"0.4999999990", "-9.9"}})});
+    EXPECT(rows_are(res, {"99999999999999999999999.0000000000,12345678901234567890.1"}));
+
+    res = query("SELECT SUM(v), MIN(v) FROM t",
+                {resultset(dec, {{"-10.25", "-1"}}),
+                 resultset(dec, {{"3", "-1.5"}}),
+                 resultset(dec, {{"7.25", "-0.25"}})});
+    EXPECT(rows_are(res, {"0.00,-1.5"}));
+
+    res = query("SELECT SUM(v), MIN(v) FROM t",
+                {resultset(dec, {{"-10.25", "1"}}),
+                 resultset(dec, {{"3.5", "2"}})});
+    EXPECT(rows_are(res, {"-6.75,1"}));
+
+    res = query("SELECT SUM(v), MIN(v) FROM t",
+                {resultset(dec, {{"99999999999999999999999.5", "1"}}),
+                 resultset(dec, {{"0.5", "1"}})});
+    EXPECT(rows_are(res, {"100000000000000000000000.0,1"}));
+
+    res = query("SELECT SUM(v), MAX(v) FROM t",
+                {resultset(dec, {{"abc", "1"}}),
+                 resultset(dec, {{"3", "1"}}),
+                 resultset(dec, {})});
+    EXPECT(!res.error.empty() && res.rows.empty());
+}
+
+void test_collation()
+{
+    // A column ordered by a collation is not merged, the client gets an error
+    std::vector<Column> cols = {{"id", MYSQL_TYPE_LONG}, {"name", MYSQL_TYPE_VAR_STRING, 33}};
+    Response res = query("SELECT id, name FROM t ORDER BY name",
+                         {resultset(cols, {{"1", "a"}}),
+                          resultset(cols, {{"2", "B"}}),
+                          resultset(cols, {})});
+    EXPECT(res.columns == 0 && res.rows.empty() && res.error.find("collation") != std::string::npos);
+
+    // Other columns can have a collation
+    res = query("SELECT id, name FROM t ORDER BY id",
+                {resultset(cols, {{"1", "a"}}),
+                 resultset(cols, {{"2", "B"}}),
+                 resultset(cols, {})});
+    EXPECT(rows_are(res, {"1,a", "2,B"}));
+
+    std::vector<Column> str = {{"m", MYSQL_TYPE_VAR_STRING, 8}};
+    res = query("SELECT MAX(name) FROM t", {resultset(str, {{"a"}}), resultset(str, {{"B"}})});
+    EXPECT(res.columns == 0 && res.rows.empty() && !res.error.empty());
+
+    // TIME values can't be compared as bytes
+    std::vector<Column> time = {{"t", MYSQL_TYPE_TIME}};
+    res = query("SELECT MIN(t) FROM t", {resultset(time, {{"-02:00:00"}}), resultset(time, {{"100:00:00"}})});
+    EXPECT(res.columns == 0 && res.rows.empty() && !res.error.empty());
+}
+}
+
+int main()
+{
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT))
+    {
+        return 1;
+    }
+
+    const char* names[N_SHARDS] = {"server1", "server2", "server3"};
+
+    for (int i = 0; i < N_SHARDS; i++)
+    {
+        servers[i].name = (char*)names[i];
+        refs[i].server = &servers[i];
+    }
+
+    test_plan();
+    test_merge();
+    test_aggregates();
+    test_collation();
+
+    mxs_log_finish();
+    return errors ? 1 : 0;
+}
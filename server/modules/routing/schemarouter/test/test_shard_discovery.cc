@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the background discovery of the shard locations
+ *
+ * The locations must only be created again when the checksum of a server
+ * changes or when the set of servers changes and the results of the servers
+ * must be merged in the order the servers are listed in.
+ */
+
+#include "../shard_discovery.hh"
+
+#include <maxscale/log.h>
+
+using namespace schemarouter;
+
+namespace
+{
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+SERVER server1;
+SERVER server2;
+SERVER server3;
+}
+
+class schemarouter::ShardDiscovery::Test
+{
+public:
+    static void test_checksum()
+    {
+        ResultMap previous;
+        previous[&server1] = result("2-100", {"db1", "db1.t1"});
+        previous[&server2] = result("1-200", {"db2"});
+
+        // Nothing has changed
+        ResultMap current = previous;
+        EXPECT(!results_changed(previous, current, 2));
+
+        // The first refresh
+        EXPECT(results_changed(ResultMap(), current, 2));
+
+        // The checksum of a server changed
+        current[&server2] = result("2-300", {"db2", "db2.t1"});
+        EXPECT(results_changed(previous, current, 2));
+
+        // A server whose checksum couldn't be read
+        current = previous;
+        current[&server2].checksum.clear();
+        EXPECT(results_changed(previous, current, 2));
+
+        // A server failed or was removed
+        current = previous;
+        current.erase(&server2);
+        EXPECT(results_changed(previous, current, 2));
+        EXPECT(results_changed(previous, current, 1));
+
+        // A server was added
+        current = previous;
+        current[&server3] = result("1-1", {"db3"});
+        EXPECT(results_changed(previous, current, 3));
+    }
+
+    static void test_locations()
+    {
+        SConfig config(new Config(NULL));
+        ResultMap results;
+        results[&server1] = result("", {"db1", "shop", "shop.orders", "mysql"});
+        results[&server2] = result("", {"db2", "shop", "shop.orders", "mysql"});
+
+        SShardLocations locations = create_locations(config, {&server1, &server2, &server3}, results);
+        EXPECT(locations->get("db1") == &server1);
+        EXPECT(locations->get("db2") == &server2);
+        EXPECT(locations->content().size() == 5);
+
+        // The first server in the list is used for duplicates
+        EXPECT(locations->get("shop") == &server1);
+        EXPECT(locations->get("shop.orders") == &server1);
+        EXPECT(locations->get("mysql") == &server1);
+
+        locations = create_locations(config, {&server2, &server1}, results);
+        EXPECT(locations->get("shop") == &server2);
+        EXPECT(locations->get("shop.orders") == &server2);
+
+        // The preferred server is used for duplicate databases but not for tables
+        config->preferred_server = &server2;
+        locations = create_locations(config, {&server1, &server2}, results);
+        EXPECT(locations->get("shop") == &server2);
+        EXPECT(locations->get("mysql") == &server2);
+        EXPECT(locations->get("shop.orders") == &server1);
+        EXPECT(locations->get("db1") == &server1);
+    }
+
+private:
+    static ServerResult result(const std::string& checksum, const std::vector<std::string>& names)
+    {
+        ServerResult rval;
+        rval.ok = true;
+        rval.checksum = checksum;
+        rval.names = names;
+        return rval;
+    }
+};
+
+int main()
+{
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT))
+    {
+        return 1;
+    }
+
+    server1.name = (char*)"server1";
+    server2.name = (char*)"server2";
+    server3.name = (char*)"server3";
+
+    ShardDiscovery::Test::test_checksum();
+    ShardDiscovery::Test::test_locations();
+
+    mxs_log_finish();
+    return errors ? 1 : 0;
+}
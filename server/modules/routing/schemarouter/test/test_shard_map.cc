@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the shard locations
+ *
+ * The lookups must be case-insensitive, the shards must share the locations of
+ * the shard manager and a shard that is modified must not change the locations
+ * that the other shards and the shard manager see.
+ */
+
+#include "../shard_map.hh"
+
+#include <maxscale/log.h>
+
+namespace
+{
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+SERVER server1;
+SERVER server2;
+
+void test_locations()
+{
+    ShardLocations locations;
+
+    EXPECT(locations.add("Shop", &server1));
+    EXPECT(locations.add("Shop.Orders", &server2));
+    EXPECT(locations.add("logs.events", &server2));
+
+    // The same name is only added once
+    EXPECT(!locations.add("Shop", &server2));
+    EXPECT(locations.get("shop") == &server1);
+
+    // Lookups ignore the case
+    EXPECT(locations.get("SHOP") == &server1);
+    EXPECT(locations.get("shop.orders") == &server2);
+    EXPECT(locations.get("SHOP.ORDERS") == &server2);
+    EXPECT(locations.get("shop.customers") == NULL);
+    EXPECT(locations.get("other") == NULL);
+
+    // A database is found from its tables
+    EXPECT(locations.get("LOGS") == &server2);
+
+    // The names are listed as they were added
+    EXPECT(locations.content().size() == 3);
+    EXPECT(locations.content().count("Shop.Orders") == 1);
+
+    locations.replace("shop", &server2);
+    EXPECT(locations.get("Shop") == &server2);
+    EXPECT(locations.get("shop.orders") == &server2);
+}
+
+void test_copy_on_write()
+{
+    ShardManager manager;
+    Shard first;
+
+    EXPECT(first.empty());
+    EXPECT(first.add_location("db1", &server1));
+    EXPECT(first.add_location("db2", &server1));
+
+    // A location is added to the same locations if they are not shared
+    SShardLocations before = first.locations();
+    ShardLocations* ptr = before.get();
+    before.reset();
+    EXPECT(first.add_location("db3", &server1));
+    EXPECT(first.locations().get() == ptr);
+
+    manager.update_shard(first, "user");
+
+    // The shards of the same user share the locations of the shard manager
+    Shard second = manager.get_shard("user", 60);
+    Shard third = manager.get_shard("user", 60);
+    EXPECT(second.locations() == first.locations());
+    EXPECT(third.locations() == first.locations());
+    EXPECT(second.get_location("DB1") == &server1);
+
+    // A modified shard gets a copy of its own
+    second.replace_location("db1", &server2);
+    EXPECT(second.add_location("db4", &server2));
+    EXPECT(second.locations() != first.locations());
+    EXPECT(second.get_location("db1") == &server2);
+    EXPECT(second.get_location("db4") == &server2);
+    EXPECT(second.get_location("db2") == &server1);
+
+    // The others are not affected
+    EXPECT(first.get_location("db1") == &server1);
+    EXPECT(first.get_location("db4") == NULL);
+    EXPECT(third.get_location("db1") == &server1);
+    EXPECT(manager.get_shard("user", 60).get_location("db4") == NULL);
+
+    // Other users don't see the locations and stale locations are not used
+    EXPECT(manager.get_shard("other", 60).empty());
+    EXPECT(manager.get_shard("user", -1).empty());
+
+    // The global locations are used by all users
+    SShardLocations global = std::make_shared<ShardLocations>();
+    global->add("global", &server2);
+    manager.set_global_locations(global);
+    EXPECT(manager.get_shard("user", 60).locations() == global);
+    EXPECT(manager.get_shard("other", 60).get_location("global") == &server2);
+
+    // Modifying a shard does not modify the global locations
+    Shard fourth = manager.get_shard("other", 60);
+    EXPECT(fourth.add_location("db5", &server1));
+    EXPECT(global->get("db5") == NULL);
+
+    // Without the global locations the locations of each user are used again
+    manager.set_global_locations(SShardLocations());
+    EXPECT(manager.get_shard("user", 60).locations() == first.locations());
+}
+}
+
+int main()
+{
+    if (!mxs_log_init(NULL, ".", MXS_LOG_TARGET_STDOUT))
+    {
+        return 1;
+    }
+
+    server1.name = (char*)"server1";
+    server2.name = (char*)"server2";
+
+    test_locations();
+    test_copy_on_write();
+
+    mxs_log_finish();
+    return errors ? 1 : 0;
+}
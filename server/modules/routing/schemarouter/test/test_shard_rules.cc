@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2018 MariaDB Corporation Ab
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file and at www.mariadb.com/bsl11.
+ *
+ * Change Date: 2022-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2 or later of the General
+ * Public License.
+ */
+
+/**
+ * Test for the sharding rules
+ *
+ * The hash of a key must never change, the consistent-hash ring must only move
+ * keys to a server that is added, the rules must locate the keys and the shard
+ * keys must be found from the statements that limit the rows to fixed keys.
+ * Statements without keys or with keys on multiple servers have no single server.
+ */
+
+#include "../shard_rules.hh"
+#include "../sql_tokenizer.hh"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <maxscale/alloc.h>
+#include <maxscale/config.h>
+#include <maxscale/log.h>
+#include <maxscale/modutil.h>
+#include <maxscale/paths.h>
+#include <maxscale/query_classifier.h>
+
+using namespace schemarouter;
+
+namespace
+{
+
+const int N_SERVERS = 4;
+const int N_KEYS = 100000;
+
+int errors = 0;
+
+#define EXPECT(a) do {if (!(a)) {printf("%s:%d: %s\n", __FILE__, __LINE__, #a); errors++;}} while (false)
+
+SERVER servers[N_SERVERS];
+SERVER_REF refs[N_SERVERS];
+SERVICE test_service;
+
+std::string key(int i)
+{
+    return "customer-" + std::to_string(i);
+}
+
+void test_hash_ring()
+{
+    // The hashes decide where the rows are stored, they must never change
+    EXPECT(HashRing::hash("", 0) == 0xefd01f60ba992926ULL);
+    EXPECT(HashRing::hash("1", 1) == 0x7c3832dde020d3d6ULL);
+    EXPECT(HashRing::hash("customer-42", 11) == 0xe5c7993df9de03b9ULL);
+
+    HashRing ring;
+    EXPECT(ring.get("1") == NULL);
+
+    for (int i = 0; i < N_SERVERS - 1; i++)
+    {
+        ring.add(&servers[i]);
+    }
+
+    // The order in which the servers are added doesn't matter
+    HashRing reversed;
+
+    for (int i = N_SERVERS - 2; i >= 0; i--)
+    {
+        reversed.add(&servers[i]);
+    }
+
+    std::map<SERVER*, int> counts;
+    std::vector<SERVER*> before;
+
+    for (int i = 0; i < N_KEYS; i++)
+    {
+        SERVER* server = ring.get(key(i));
+        EXPECT(server == reversed.get(key(i)));
+        counts[server]++;
+        before.push_back(server);
+    }
+
+    // The keys are spread evenly
+    EXPECT(counts.size() == N_SERVERS - 1);
+
+    for (const auto& c : counts)
+    {
+        EXPECT(c.second > N_KEYS / (N_SERVERS - 1) * 8 / 10);
+        EXPECT(c.second < N_KEYS / (N_SERVERS - 1) * 12 / 10);
+    }
+
+    // Adding a server only moves keys to the new server
+    ring.add(&servers[N_SERVERS - 1]);
+    int moved = 0;
+
+    for (int i = 0; i < N_KEYS; i++)
+    {
+        SERVER* server = ring.get(key(i));
+
+        if (server != before[i])
+        {
+            EXPECT(server == &servers[N_SERVERS - 1]);
+            moved++;
+        }
+    }
+
+    EXPECT(moved > N_KEYS / N_SERVERS * 8 / 10);
+    EXPECT(moved < N_KEYS / N_SERVERS * 12 / 10);
+}
+
+std::unique_ptr<ShardRules> load_rules(const char* json)
+{
+    char path[] = "/tmp/test_shard_rules.XXXXXX";
+    int fd = mkstemp(path);
+    std::unique_ptr<ShardRules> rules;
+
+    if (fd != -1)
+    {
+        bool ok = write(fd, json, strlen(json)) == (ssize_t)strlen(json);
+        close(fd);
+
+        if (ok)
+        {
+            rules = ShardRules::load(path, &test_service);
+        }
+
+        unlink(path);
+    }
+
+    return rules;
+}
+
+const char* rules_json =
+    "{\"tables\": ["
+    "{\"table\": \"shop.orders\", \"type\": \"hash\", \"column\": \"cust\","
+    " \"servers\": [\"server1\", \"server2\", \"server3\"]},"
+    "{\"table\": \"shop.events\", \"type\": \"range\", \"column\": \"cust\", \"ranges\": ["
+    " {\"server\": \"server1\", \"end\": 100}, {\"server\": \"server2\", \"end\": 200},"
+    " {\"server\": \"server3\"}]},"
+    "{\"table\": \"shop.products\", \"server\": \"server4\"}"
+    "]}";
+
+void test_rules()
+{
+    std::unique_ptr<ShardRules> rules = load_rules(rules_json);
+    EXPECT(rules);
+
+    if (!rules)
+    {
+        return;
+    }
+
+    const ShardRule* hash = rules->find("SHOP.Orders");
+    const ShardRule* range = rules->find("shop.events");
+    const ShardRule* table = rules->find("shop.products");
+    EXPECT(hash && hash->type() == ShardRule::HASH && hash->servers().size() == 3);
+    EXPECT(range && range->type() == ShardRule::RANGE && range->servers().size() == 3);
+    EXPECT(table && table->type() == ShardRule::TABLE);
+    EXPECT(rules->find("shop.customers") == NULL);
+
+    if (!hash || !range || !table)
+    {
+        return;
+    }
+
+    // Integers are located by their value
+    EXPECT(hash->locate("5") == hash->locate("05"));
+    EXPECT(hash->locate("5") == hash->locate("+5"));
+    EXPECT(hash->locate("-0") == hash->locate("0"));
+
+    // The ends of the ranges are exclusive
+    EXPECT(range->locate("-3") == &servers[0]);
+    EXPECT(range->locate("99") == &servers[0]);
+    EXPECT(range->locate("100") == &servers[1]);
+    EXPECT(range->locate("199") == &servers[1]);
+    EXPECT(range->locate("200") == &servers[2]);
+    EXPECT(range->locate("5000") == &servers[2]);
+    EXPECT(range->locate("abc") == NULL);
+
+    EXPECT(table->locate("1") == &servers[3]);
+
+    // Invalid rules
+    EXPECT(!load_rules("{\"tables\": [{\"table\": \"orders\", \"server\": \"server1\"}]}"));
+    EXPECT(!load_rules("{\"tables\": [{\"table\": \"a.b\", \"type\": \"hash\"}]}"));
+    EXPECT(!load_rules("{\"tables\": [{\"table\": \"a.b\", \"server\": \"server5\"}]}"));
+    EXPECT(!load_rules("{\"tables\": [{\"table\": \"a.b\", \"type\": \"range\", \"column\": \"c\", "
+                       "\"ranges\": [{\"server\": \"server1\", \"end\": 10}, "
+                       "{\"server\": \"server2\", \"end\": 5}]}]}"));
+    EXPECT(!load_rules("{\"tables\": [{\"table\": \"a.b\", \"server\": \"server1\"}, "
+                       "{\"table\": \"A.B\", \"server\": \"server2\"}]}"));
+}
+
+std::string describe(const Tokens& tokens)
+{
+    static const char kinds[] = "WNSDP";
+    std::string rval;
+
+    for (const auto& t : tokens)
+    {
+        rval += rval.empty() ? "" : " ";
+        rval += kinds[t.kind];
+        rval += ":" + t.value;
+    }
+
+    return rval;
+}
+
+std::string tokens_of(const char* sql)
+{
+    Tokens tokens;
+    return tokenize(sql, strlen(sql), &tokens) ? describe(tokens) : "ERROR";
+}
+
+void test_tokenizer()
+{
+    EXPECT(tokens_of("SELECT a.b, `c``d` FROM t") == "W:SELECT W:a P:. W:b P:, N:c`d W:FROM W:t");
+    EXPECT(tokens_of("'it''s' ''''") == "S:it's S:'");
+    EXPECT(tokens_of("1 -5 1.5e-3 .5 0x1F") == "D:1 P:- D:5 D:1.5e-3 D:.5 D:0x1F");
+    EXPECT(tokens_of("a<=>b AND c<=d OR e<>f || g") == "W:a P:<=> W:b W:AND W:c P:<= W:d W:OR W:e P:<> W:f P:|| W:g");
+
+    // Comments
+    EXPECT(tokens_of("/* a */ SELECT 1 # b") == "W:SELECT D:1");
+    EXPECT(tokens_of("SELECT 1 -- c\n, 2") == "W:SELECT D:1 P:, D:2");
+    EXPECT(tokens_of("SELECT 1--1") == "W:SELECT D:1 P:- P:- D:1");
+
+    // Syntax that isn't understood
+    EXPECT(tokens_of("SELECT 'abc") == "ERROR");
+    EXPECT(tokens_of("SELECT /* abc") == "ERROR");
+    EXPECT(tokens_of("SELECT /*! STRAIGHT_JOIN */ 1") == "ERROR");
+
+    // The meaning depends on the SQL mode
+    EXPECT(tokens_of("SELECT \"a\" FROM t") == "ERROR");
+    EXPECT(tokens_of("SELECT 'a\\' OR 1 -- '") == "ERROR");
+
+    // The offsets of the tokens
+    Tokens tokens;
+    const char sql[] = "SELECT  'ab' LIMIT 10";
+    EXPECT(tokenize(sql, sizeof(sql) - 1, &tokens) && tokens.size() == 4);
+    EXPECT(tokens.size() == 4 && tokens[1].start == 8 && tokens[1].end == 12);
+    EXPECT(tokens.size() == 4 && tokens[3].start == 19 && tokens[3].end == 21);
+
+    EXPECT(canonical_key("007") == "7");
+    EXPECT(canonical_key("-0") == "0");
+    EXPECT(canonical_key(" 5") == " 5");
+    EXPECT(canonical_key("5a") == "5a");
+    EXPECT(canonical_key("99999999999999999999") == "99999999999999999999");
+}
+
+std::string keys_of(const ShardRule& rule, const char* sql, int n_tables = 1)
+{
+    GWBUF* buffer = modutil_create_query(sql);
+    std::vector<std::string> keys;
+    std::string rval = "NONE";
+
+    if (get_shard_keys(buffer, rule, n_tables, &keys))
+    {
+        rval.clear();
+
+        for (const auto& k : keys)
+        {
+            rval += rval.empty() ? k : "," + k;
+        }
+    }
+
+    gwbuf_free(buffer);
+    return rval;
+}
+
+void test_keys()
+{
+    std::unique_ptr<ShardRules> rules = load_rules(rules_json);
+
+    if (!rules)
+    {
+        return;
+    }
+
+    const ShardRule& rule = *rules->find("shop.orders");
+
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = 5") == "5");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE 007 = cust AND y IS NOT NULL ORDER BY cust") == "7");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE (cust = -5) /* c */ -- x\n") == "-5");
+    EXPECT(keys_of(rule, "UPDATE shop.orders SET v = 1 WHERE cust = 'abc' AND `cust` = 'abc'") == "abc");
+    EXPECT(keys_of(rule, "DELETE FROM shop.orders WHERE shop.orders.cust = 3 LIMIT 1") == "3");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = \"5\"") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = 5 AND 'a\\' OR cust = 6 -- '") == "NONE");
+
+    // Aliases and qualified names
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders o WHERE o.cust = '05' AND x = 1") == "05");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders o, shop.c c WHERE c.cust = 5", 2) == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders o, shop.c c WHERE orders.cust = 5", 2) == "5");
+
+    // IN lists, all conditions must hold
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust IN (1, 2, 3)") == "1,2,3");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust IN (1, 2, 3) AND cust IN (2, 3, 4)") == "2,3");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust IN (1, 2) AND cust = 3") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust IN (1, f(2))") == "NONE");
+
+    // The AND of a BETWEEN is not a conjunction
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE a BETWEEN 1 AND 10 AND cust = 5") == "5");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE a BETWEEN 1 AND cust = 5") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust BETWEEN 1 AND 5") == "NONE");
+
+    // Conditions that don't limit the rows to fixed keys
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = 5 OR x = 1") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE NOT cust = 5") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE x + cust = 5") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = 5 + x") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust > 5") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders") == "NONE");
+    EXPECT(keys_of(rule, "SELECT * FROM shop.orders WHERE cust = 1 "
+                         "UNION SELECT * FROM shop.orders WHERE cust = 2") == "NONE");
+
+    // Multi-row INSERTs with a column list
+    EXPECT(keys_of(rule, "INSERT INTO shop.orders (id, cust, v) VALUES (1, 42, 'a,b'), (2, 43, f(1, 2))")
+           == "42,43");
+    EXPECT(keys_of(rule, "INSERT IGNORE orders (cust) VALUE ('x')") == "x");
+    EXPECT(keys_of(rule, "INSERT INTO shop.orders (id, cust) VALUES (1, 2), (3, now())") == "NONE");
+    EXPECT(keys_of(rule, "INSERT INTO shop.orders VALUES (1, 2)") == "NONE");
+    EXPECT(keys_of(rule, "INSERT INTO shop.other (id, cust) VALUES (1, 2)") == "NONE");
+}
+
+SERVER* rows_of(const ShardRule& rule, const char* sql, int n_tables = 1)
+{
+    GWBUF* buffer = modutil_create_query(sql);
+    SERVER* rval = locate_rows(buffer, rule, n_tables);
+    gwbuf_free(buffer);
+    return rval;
+}
+
+void test_locate()
+{
+    std::unique_ptr<ShardRules> rules = load_rules(rules_json);
+
+    if (!rules)
+    {
+        return;
+    }
+
+    const ShardRule& hash = *rules->find("shop.orders");
+    const ShardRule& range = *rules->find("shop.events");
+    const ShardRule& table = *rules->find("shop.products");
+
+    // The rows of the keys
+    EXPECT(rows_of(hash, "SELECT * FROM shop.orders WHERE cust = 5") == hash.locate("5"));
+    EXPECT(rows_of(range, "SELECT * FROM shop.events WHERE cust IN (1, 99)") == &servers[0]);
+    EXPECT(rows_of(range, "DELETE FROM shop.events WHERE cust = 150") == &servers[1]);
+
+    // A SELECT without keys reads the rows of all servers
+    EXPECT(rows_of(hash, "SELECT * FROM shop.orders") == NULL);
+    EXPECT(rows_of(hash, "SELECT COUNT(*) FROM shop.orders WHERE v > 10") == NULL);
+    EXPECT(rows_of(range, "SELECT * FROM shop.events WHERE cust > 5") == NULL);
+
+    // Keys on multiple servers
+    EXPECT(rows_of(range, "SELECT * FROM shop.events WHERE cust IN (1, 150)") == NULL);
+    EXPECT(rows_of(range, "UPDATE shop.events SET v = 1 WHERE cust IN (1, 250)") == NULL);
+
+    // A table on one server needs no keys
+    EXPECT(rows_of(table, "SELECT * FROM shop.products") == &servers[3]);
+}
+}
+
+int main()
+{
+    int rc = EXIT_FAILURE;
+
+    if (mxs_log_init(NULL, ".", MXS_LOG_TARGET_DEFAULT))
+    {
+        const char* names[N_SERVERS] = {"server1", "server2", "server3", "server4"};
+
+        for (int i = 0; i < N_SERVERS; i++)
+        {
+            servers[i].name = (char*)names[i];
+            servers[i].is_active = true;
+            refs[i].server = &servers[i];
+            refs[i].active = true;
+            refs[i].next = i < N_SERVERS - 1 ? &refs[i + 1] : NULL;
+        }
+
+        test_service.name = (char*)"test-service";
+        test_service.dbref = &refs[0];
+
+        set_libdir(MXS_STRDUP_A("../../../../../query_classifier/qc_sqlite/"));
+
+        if (qc_init(NULL, QC_SQL_MODE_DEFAULT, "qc_sqlite", ""))
+        {
+            test_hash_ring();
+            test_rules();
+            test_tokenizer();
+            test_keys();
+            test_locate();
+            rc = errors ? EXIT_FAILURE : EXIT_SUCCESS;
+
+            qc_end();
+        }
+        else
+        {
+            MXS_ERROR("Could not initialize query classifier.");
+        }
+
+        mxs_log_finish();
+    }
+
+    return rc;
+}